@@ -0,0 +1,204 @@
+#pragma once
+
+#include "preamble.h"
+
+#include "str.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <time.h>
+#include <sys/resource.h>
+#endif
+
+
+// Wall clock time in seconds. `clock()` measures CPU time, which is
+// meaningless once work is spread over several threads.
+static inline f64 bench_now(void) {
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (f64) counter.QuadPart / (f64) frequency.QuadPart;
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (f64) time.tv_sec + (f64) time.tv_nsec * 1e-9;
+#endif
+}
+
+// Peak resident set size of the process in KiB, or 0 if it's unknown.
+static inline size_t bench_peak_rss_kib(void) {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (size_t) usage.ru_maxrss / 1024;  // Bytes on macOS.
+#else
+    return (size_t) usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Lets the next bench_peak_rss_kib only see what happens from now on, where the
+// platform allows it. Returns 0 if the peak keeps covering the whole process.
+static inline int bench_reset_peak_rss(void) {
+#if defined(__linux__)
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file == NULL)
+        return 0;
+    int ok = fputs("5", file) >= 0;
+    return fclose(file) == 0 && ok;
+#else
+    return 0;
+#endif
+}
+
+// Deterministic xorshift generator so every run lexes the exact same input.
+static inline u64 bench_random(u64* state) {
+    u64 x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+
+static const char* BENCH_IDENTIFIERS[] = { "count", "index", "total", "value", "result", "left", "right", "a", "b", "helper" };
+static const char* BENCH_NUMBERS[]     = { "0", "1", "2", "10", "42", "100", "255", "1024", "3.14", "0.5" };
+static const char* BENCH_OPERATORS[]   = { "+", "-", "*", "/", "%", "<", "<=", "==", "!=", ">=", ">" };
+
+#define BENCH_PICK(state, array) (array)[bench_random(state) % (sizeof(array) / sizeof(*(array)))]
+
+
+// What kind of code the generator writes.
+#define ALL_BENCH_MODES(X) \
+    X(Mixed,       mixed)         \
+    X(Identifiers, identifiers)   \
+    X(Numbers,     numbers)       \
+    X(Comments,    comments)      \
+    X(Strings,     strings)
+
+typedef enum {
+#define X(upper, lower) BenchMode_##upper,
+    ALL_BENCH_MODES(X)
+#undef X
+    BENCH_MODE_COUNT,
+} BenchMode;
+
+static const char* BENCH_MODE_NAMES[] = {
+#define X(upper, lower) #lower,
+    ALL_BENCH_MODES(X)
+#undef X
+};
+
+// Returns BENCH_MODE_COUNT if there's no mode with that name.
+static inline BenchMode bench_mode_from_name(const char* name) {
+    for (int mode = 0; mode < BENCH_MODE_COUNT; ++mode) {
+        if (strcmp(BENCH_MODE_NAMES[mode], name) == 0)
+            return (BenchMode) mode;
+    }
+    return BENCH_MODE_COUNT;
+}
+
+
+static const char* BENCH_WORDS[] = { "the", "counter", "is", "updated", "below", "when", "every", "value", "was", "read", "before", "loop" };
+
+// A mix of everything, roughly like handwritten code.
+static size_t bench_generate_mixed(char* out, u64* state) {
+    switch (bench_random(state) % 6) {
+        case 0:
+            return (size_t) sprintf(out, "%s := %s %s %s\n", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_OPERATORS), BENCH_PICK(state, BENCH_NUMBERS));
+        case 1:
+            return (size_t) sprintf(out, "%s = (%s %s %s) * %s\n", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_NUMBERS), BENCH_PICK(state, BENCH_OPERATORS), BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_NUMBERS));
+        case 2:
+            return (size_t) sprintf(out, "if %s < %s {\n    %s(%s, %s)\n}\n", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_NUMBERS), BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_NUMBERS));
+        case 3:
+            return (size_t) sprintf(out, "fun %s(a: int, b: int) int {\n    return a %s b\n}\n", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_OPERATORS));
+        case 4:
+            return (size_t) sprintf(out, "// %s is updated below\n", BENCH_PICK(state, BENCH_IDENTIFIERS));
+        default:
+            return (size_t) sprintf(out, "while %s != %s { %s = \"hello world\" }\n", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_NUMBERS), BENCH_PICK(state, BENCH_IDENTIFIERS));
+    }
+}
+
+// Long and mostly distinct identifiers, which stress the intern pool.
+static size_t bench_generate_identifiers(char* out, u64* state) {
+    return (size_t) sprintf(out, "%s_%u = %s_%u + %s_count_%u(%s_%u, %s)\n",
+                            BENCH_PICK(state, BENCH_IDENTIFIERS), (u32) (bench_random(state) % 100000),
+                            BENCH_PICK(state, BENCH_IDENTIFIERS), (u32) (bench_random(state) % 100000),
+                            BENCH_PICK(state, BENCH_IDENTIFIERS), (u32) (bench_random(state) % 1000),
+                            BENCH_PICK(state, BENCH_WORDS),       (u32) (bench_random(state) % 100),
+                            BENCH_PICK(state, BENCH_IDENTIFIERS));
+}
+
+// Integers and reals of every length, which stress literal decoding.
+static size_t bench_generate_numbers(char* out, u64* state) {
+    u64 a = bench_random(state) % 1000000000000ull;
+    u64 b = bench_random(state) % 100000;
+    u64 c = bench_random(state) % 1000;
+    return (size_t) sprintf(out, "x = %llu + %llu.%llu * %llu - 0.%llu + %llu\n",
+                            (unsigned long long) a, (unsigned long long) b, (unsigned long long) c,
+                            (unsigned long long) c, (unsigned long long) a, (unsigned long long) (b % 10));
+}
+
+// Long line and block comments with a little code between them.
+static size_t bench_generate_comments(char* out, u64* state) {
+    size_t size = (size_t) sprintf(out, (bench_random(state) % 2) ? "// " : "/* ");
+    int words = 4 + (int) (bench_random(state) % 16);
+    for (int i = 0; i < words; ++i)
+        size += (size_t) sprintf(out + size, "%s ", BENCH_PICK(state, BENCH_WORDS));
+    if (out[0] == '/' && out[1] == '*')
+        size += (size_t) sprintf(out + size, "\n   %s */", BENCH_PICK(state, BENCH_WORDS));
+    size += (size_t) sprintf(out + size, "\n%s = 1\n", BENCH_PICK(state, BENCH_IDENTIFIERS));
+    return size;
+}
+
+// String literals of every length, some with escape sequences.
+static size_t bench_generate_strings(char* out, u64* state) {
+    size_t size = (size_t) sprintf(out, "%s = \"", BENCH_PICK(state, BENCH_IDENTIFIERS));
+    int words = 1 + (int) (bench_random(state) % 12);
+    for (int i = 0; i < words; ++i)
+        size += (size_t) sprintf(out + size, (bench_random(state) % 8) ? "%s " : "\\\"%s\\\" ", BENCH_PICK(state, BENCH_WORDS));
+    size += (size_t) sprintf(out + size, "%u\"\n", (u32) (bench_random(state) % 1000));
+    return size;
+}
+
+// Appends one pseudo-random statement. Returns the number of bytes written, at most 256.
+static size_t bench_generate_statement(BenchMode mode, char* out, u64* state) {
+    switch (mode) {
+        case BenchMode_Identifiers: return bench_generate_identifiers(out, state);
+        case BenchMode_Numbers:     return bench_generate_numbers(out, state);
+        case BenchMode_Comments:    return bench_generate_comments(out, state);
+        case BenchMode_Strings:     return bench_generate_strings(out, state);
+        default:                    return bench_generate_mixed(out, state);
+    }
+}
+
+// A NUL-terminated pseudo-random program of at least `size` bytes. Free the data with free().
+static Str bench_generate_source_of(BenchMode mode, size_t size) {
+    char* data = malloc(size + 256);
+    u64 state = 0x9E3779B97F4A7C15ull;
+
+    size_t used = 0;
+    while (used < size) {
+        used += bench_generate_statement(mode, data + used, &state);
+    }
+    data[used] = '\0';
+    return (Str) { used, data };
+}
+
+static inline Str bench_generate_source(size_t size) {
+    return bench_generate_source_of(BenchMode_Mixed, size);
+}
@@ -0,0 +1,151 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "type_checker/checker.h"
+#include "cache.h"
+#include "file.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// `count` top-level functions, each called by the statement after it.
+static Str bench_generate_program(size_t count) {
+    char* data = malloc(count * 128 + 1);
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i) {
+        used += (size_t) sprintf(data + used, "fun f%zu(a: int) int {\n    return a + %zu\n}\nx%zu := f%zu(%zu)\n", i, i % 100, i, i, i % 10);
+    }
+    data[used] = '\0';
+    return (Str) { used, data };
+}
+
+static int bench_write_file(const char* path, Str source) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+        return 0;
+    int written = fwrite(source.data, 1, source.size, file) == source.size;
+    return fclose(file) == 0 && written;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: nox-bench-cache [max_declarations] [--path <file>] [--csv]\n");
+}
+
+// A cold start reads, lexes, parses and type checks the source. A warm start
+// reads it and loads the tree that the cold start left in the cache.
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t      max_count = 100000;
+    int         csv       = 0;
+    const char* path      = "nox-bench-cache.nox";
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = 1;
+        } else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if ('0' <= argv[i][0] && argv[i][0] <= '9') {
+            max_count = (size_t) strtoull(argv[i], NULL, 10);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (csv)
+        printf("declarations,source_bytes,cache_bytes,cold_ms,write_ms,warm_ms,speedup\n");
+    else
+        printf("%12s %12s %12s %10s %10s %10s %8s\n", "declarations", "source", "cache", "cold ms", "write ms", "warm ms", "speedup");
+
+    for (size_t count = 1000; count <= max_count; count *= 10) {
+        Str source = bench_generate_program(count);
+        if (!bench_write_file(path, source)) {
+            fprintf(stderr, "Failed to write %s\n", path);
+            return 1;
+        }
+
+        size_t iterations = 0;
+        size_t nodes = 0;
+        f64 cold = 0;
+        f64 writing = 0;
+        f64 start = bench_now();
+        do {
+            f64 before = bench_now();
+            File file = read_file(path);
+            TokenArray array = lexer_lex(str_from_c_str(path), file.contents, &logger);
+            if (array.tokens == NULL) {
+                fprintf(stderr, "Failed to lex %zu declarations\n", count);
+                return 1;
+            }
+            GrammarTree tree = parse(array);
+            if (tree.arena.kinds == NULL || tree.error_count != 0) {
+                fprintf(stderr, "Failed to parse %zu declarations\n", count);
+                return 1;
+            }
+            TypedAst ast = type_check(tree);
+            if (ast.arena.kinds == NULL) {
+                fprintf(stderr, "Failed to type check %zu declarations\n", count);
+                return 1;
+            }
+            cold += bench_now() - before;
+
+            before = bench_now();
+            if (!cache_write(path, file.contents, array, ast)) {
+                fprintf(stderr, "Failed to write the cache of %s\n", path);
+                return 1;
+            }
+            writing += bench_now() - before;
+
+            nodes = ast.arena.count;
+            typed_ast_free(ast);
+            token_array_free(array);
+            file_close(file);
+
+            iterations += 1;
+        } while (bench_now() - start < 0.25);
+        cold    /= (f64) iterations;
+        writing /= (f64) iterations;
+
+        size_t cache_size = 0;
+        f64 warm = 0;
+        iterations = 0;
+        start = bench_now();
+        do {
+            f64 before = bench_now();
+            File file = read_file(path);
+            CachedAst cached = cache_read(path, file.contents);
+            warm += bench_now() - before;
+            if (cached.mapping == NULL || cached.ast.arena.count != nodes) {
+                fprintf(stderr, "Failed to load %zu declarations from the cache\n", count);
+                return 1;
+            }
+
+            cache_size = cached.size;
+            cache_close(cached);
+            file_close(file);
+
+            iterations += 1;
+        } while (bench_now() - start < 0.25);
+        warm /= (f64) iterations;
+
+        if (csv)
+            printf("%zu,%zu,%zu,%.3f,%.3f,%.3f,%.1f\n", count, source.size, cache_size, cold * 1e3, writing * 1e3, warm * 1e3, cold / warm);
+        else
+            printf("%12zu %12zu %12zu %10.3f %10.3f %10.3f %7.1fx\n", count, source.size, cache_size, cold * 1e3, writing * 1e3, warm * 1e3, cold / warm);
+        fflush(stdout);
+
+        free((char*) source.data);
+    }
+
+    remove(path);
+    char cache_path[4096];
+    snprintf(cache_path, sizeof(cache_path), "%s%s", path, CACHE_EXTENSION);
+    remove(cache_path);
+    return 0;
+}
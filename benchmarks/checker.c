@@ -0,0 +1,95 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "type_checker/checker.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// `count` functions of a few locals each, with most of them in blocks of their own.
+static Str bench_generate_blocks(size_t count) {
+    char* data = malloc(count * 512 + 1);
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i) {
+        used += (size_t) sprintf(data + used,
+            "fun f%zu(a: int) int {\n"
+            "    b := a + %zu\n"
+            "    if b < 10 {\n        c := b * 2\n    }\n"
+            "    while b > 100 {\n        d := b - 1\n        b = d\n    }\n"
+            "    if a == b {\n        e := a\n        if e < 1 {\n            g := e + 1\n        }\n    }\n"
+            "    return b\n"
+            "}\n",
+            i, i % 100);
+    }
+    data[used] = '\0';
+    return (Str) { used, data };
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: nox-bench-checker [functions] [--csv]\n");
+}
+
+// Checks one program of many small blocks, and reports how much memory the
+// checker held on top of the parsed tree.
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t count = 20000;
+    int    csv   = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = 1;
+        } else if ('0' <= argv[i][0] && argv[i][0] <= '9') {
+            count = (size_t) strtoull(argv[i], NULL, 10);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    Str source = bench_generate_blocks(count);
+    TokenArray array = lexer_lex(STR("<bench>"), source, &logger);
+    if (array.tokens == NULL) {
+        fprintf(stderr, "Failed to lex %zu functions\n", count);
+        return 1;
+    }
+    GrammarTree tree = parse(array);
+    if (tree.arena.kinds == NULL || tree.error_count != 0) {
+        fprintf(stderr, "Failed to parse %zu functions\n", count);
+        return 1;
+    }
+
+    // Without a way to reset the peak, it also covers lexing and parsing.
+    size_t before_kib = bench_reset_peak_rss() ? 0 : bench_peak_rss_kib();
+    f64 start = bench_now();
+    TypedAst ast = type_check(tree);
+    f64 seconds = bench_now() - start;
+    size_t peak_kib = bench_peak_rss_kib();
+    if (ast.arena.kinds == NULL) {
+        fprintf(stderr, "Failed to type check %zu functions\n", count);
+        return 1;
+    }
+
+    size_t locals = 0;
+    for (size_t i = 0; i < ast.block_count; ++i)
+        locals += (size_t) ast.block[i].count;
+
+    if (csv) {
+        printf("functions,blocks,locals,seconds,peak_rss_kib,peak_rss_before_kib\n");
+        printf("%zu,%zu,%zu,%.6f,%zu,%zu\n", count, ast.block_count, locals, seconds, peak_kib, before_kib);
+    } else {
+        printf("%10s %10s %10s %10s %14s %14s\n", "functions", "blocks", "locals", "seconds", "peak RSS KiB", "before KiB");
+        printf("%10zu %10zu %10zu %10.6f %14zu %14zu\n", count, ast.block_count, locals, seconds, peak_kib, before_kib);
+    }
+
+    typed_ast_free(ast);
+    token_array_free(array);
+    free((char*) source.data);
+    return 0;
+}
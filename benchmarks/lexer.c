@@ -0,0 +1,107 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "allocator.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Memory of the per-token arrays, without the data pool and line index.
+static size_t token_array_bytes(TokenArray array) {
+    size_t words = array.size / 64 + 1;
+    return array.size * (sizeof(*array.tokens) + sizeof(*array.source_offsets))
+         + array.payload_count * sizeof(*array.payloads)
+         + words * (sizeof(*array.payload_bits) + sizeof(*array.payload_ranks));
+}
+
+
+static void usage(void) {
+    fprintf(stderr, "Usage: nox-bench-lexer [max_size] [all");
+    for (int mode = 0; mode < BENCH_MODE_COUNT; ++mode)
+        fprintf(stderr, "|%s", BENCH_MODE_NAMES[mode]);
+    fprintf(stderr, "] [--csv]\n");
+}
+
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t    max_size = 100u * 1024 * 1024;
+    BenchMode only     = BENCH_MODE_COUNT;  // Every mode.
+    int       csv      = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = 1;
+        } else if ('0' <= argv[i][0] && argv[i][0] <= '9') {
+            max_size = (size_t) strtoull(argv[i], NULL, 10);
+        } else if (strcmp(argv[i], "all") != 0) {
+            only = bench_mode_from_name(argv[i]);
+            if (only == BENCH_MODE_COUNT) {
+                usage();
+                return 1;
+            }
+        }
+    }
+
+    // The peak RSS covers the whole process unless it can be reset before each size.
+    int rss_resets = bench_reset_peak_rss();
+    if (csv)
+        printf("mode,bytes,tokens,seconds,tokens_per_sec,mb_per_sec,bytes_per_token,allocations,allocated_bytes,peak_rss_kib\n");
+    else
+        printf("%-12s %12s %12s %10s %14s %10s %12s %12s %14s %14s\n", "mode", "bytes", "tokens", "seconds", "tokens/sec", "MB/sec", "bytes/token", "allocations", "allocated", rss_resets ? "peak_rss_kib" : "max_rss_kib");
+
+    for (int mode = 0; mode < BENCH_MODE_COUNT; ++mode) {
+        if (only != BENCH_MODE_COUNT && mode != (int) only)
+            continue;
+
+        for (size_t size = 1024; size <= max_size; size *= 10) {
+            Str source = bench_generate_source_of((BenchMode) mode, size);
+            bench_reset_peak_rss();
+
+            // Repeat small inputs so the timer has something to measure.
+            size_t iterations = 0;
+            size_t tokens = 0;
+            size_t token_bytes = 0;
+            size_t allocations = 0;
+            size_t allocated = 0;
+            f64 start = bench_now();
+            f64 elapsed = 0;
+            do {
+                size_t count_before = mallocated_count;
+                size_t bytes_before = mallocated_user_size;
+                TokenArray array = lexer_lex(STR("<bench>"), source, &logger);
+                allocations = mallocated_count - count_before;
+                allocated   = mallocated_user_size - bytes_before;
+                if (array.tokens == NULL) {
+                    fprintf(stderr, "Failed to lex %zu bytes\n", source.size);
+                    return 1;
+                }
+                tokens = array.size;
+                token_bytes = token_array_bytes(array);
+                token_array_free(array);
+
+                iterations += 1;
+                elapsed = bench_now() - start;
+            } while (elapsed < 0.25);
+
+            f64 seconds = elapsed / (f64) iterations;
+            f64 tokens_per_second = (f64) tokens / seconds;
+            f64 mb_per_second = (f64) source.size / seconds / (1024.0 * 1024.0);
+            f64 bytes_per_token = (f64) token_bytes / (f64) tokens;
+            size_t peak_rss = bench_peak_rss_kib();
+            if (csv)
+                printf("%s,%zu,%zu,%.9f,%.0f,%.3f,%.3f,%zu,%zu,%zu\n", BENCH_MODE_NAMES[mode], source.size, tokens, seconds, tokens_per_second, mb_per_second, bytes_per_token, allocations, allocated, peak_rss);
+            else
+                printf("%-12s %12zu %12zu %10.6f %14.0f %10.1f %12.2f %12zu %14zu %14zu\n", BENCH_MODE_NAMES[mode], source.size, tokens, seconds, tokens_per_second, mb_per_second, bytes_per_token, allocations, allocated, peak_rss);
+            fflush(stdout);
+
+            free((char*) source.data);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "os/thread.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// 1, 2, 4, ... and finally max_threads itself, even if it isn't a power of two.
+static int next_thread_count(int threads, int max_threads) {
+    if (threads == max_threads)
+        return max_threads + 1;
+    return (2 * threads < max_threads) ? 2 * threads : max_threads;
+}
+
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t size        = (argc > 1) ? (size_t) strtoull(argv[1], NULL, 10) : 100u * 1024 * 1024;
+    int    max_threads = (argc > 2) ? atoi(argv[2]) : thread_hardware_count();
+
+    Str source = bench_generate_source(size);
+
+    printf("%8s %12s %12s %10s %10s %8s\n", "threads", "bytes", "tokens", "seconds", "MB/sec", "speedup");
+    f64 single = 0;
+    for (int threads = 1; threads <= max_threads; threads = next_thread_count(threads, max_threads)) {
+        // Best of a few runs, since the first touches all the pages.
+        f64 best = 0;
+        size_t tokens = 0;
+        for (int run = 0; run < 3; ++run) {
+            f64 start = bench_now();
+            TokenArray array = lexer_lex_parallel(STR("<bench>"), source, &logger, threads);
+            f64 elapsed = bench_now() - start;
+            if (array.tokens == NULL) {
+                fprintf(stderr, "Failed to lex %zu bytes\n", source.size);
+                return 1;
+            }
+            tokens = array.size;
+            token_array_free(array);
+
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        if (threads == 1)
+            single = best;
+        printf("%8d %12zu %12zu %10.6f %10.1f %7.2fx\n", threads, source.size, tokens, best, (f64) source.size / best / (1024.0 * 1024.0), single / best);
+    }
+
+    free((char*) source.data);
+    return 0;
+}
@@ -0,0 +1,231 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// `count` top-level functions, each followed by a statement, so that hoisting
+// the declarations has to move every one of them past the statements before it.
+static Str bench_generate_declarations(size_t count) {
+    char* data = malloc(count * 96 + 1);
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i) {
+        used += (size_t) sprintf(data + used, "fun f%zu(a: int) int {\n    return a + %zu\n}\nx%zu := %zu\n", i, i % 100, i, i % 10);
+    }
+    data[used] = '\0';
+    return (Str) { used, data };
+}
+
+// One statement of `count` operands joined by random operators, where some
+// operands are calls and some are parenthesised pairs: `x := a + f(b, 1) * (c - 2)`.
+static size_t bench_generate_flat(char* out, u64* state, int count) {
+    size_t size = (size_t) sprintf(out, "%s :=", BENCH_PICK(state, BENCH_IDENTIFIERS));
+    for (int i = 0; i < count; ++i) {
+        if (i != 0)
+            size += (size_t) sprintf(out + size, " %s", BENCH_PICK(state, BENCH_OPERATORS));
+        switch (bench_random(state) % 4) {
+            case 0:  size += (size_t) sprintf(out + size, " %s(%s, %s)", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_NUMBERS)); break;
+            case 1:  size += (size_t) sprintf(out + size, " (%s %s %s)", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_OPERATORS), BENCH_PICK(state, BENCH_NUMBERS)); break;
+            case 2:  size += (size_t) sprintf(out + size, " %s", BENCH_PICK(state, BENCH_IDENTIFIERS)); break;
+            default: size += (size_t) sprintf(out + size, " %s", BENCH_PICK(state, BENCH_NUMBERS)); break;
+        }
+    }
+    out[size++] = '\n';
+    return size;
+}
+
+// One statement with `depth` groups inside each other: `x := (a + (b * (... 1)))`.
+static size_t bench_generate_nested(char* out, u64* state, int depth) {
+    size_t size = (size_t) sprintf(out, "%s :=", BENCH_PICK(state, BENCH_IDENTIFIERS));
+    for (int i = 0; i < depth; ++i)
+        size += (size_t) sprintf(out + size, " (%s %s", BENCH_PICK(state, BENCH_IDENTIFIERS), BENCH_PICK(state, BENCH_OPERATORS));
+    size += (size_t) sprintf(out + size, " %s", BENCH_PICK(state, BENCH_NUMBERS));
+    memset(out + size, ')', (size_t) depth);
+    size += (size_t) depth;
+    out[size++] = '\n';
+    return size;
+}
+
+// How the expressions are shaped, and how many operands or levels each one has.
+typedef struct {
+    const char* name;
+    int nested;
+    int size;
+} BenchExpressions;
+
+static const BenchExpressions BENCH_EXPRESSIONS[] = {
+    { "flat/8",      0, 8    },
+    { "flat/64",     0, 64   },
+    { "nested/16",   1, 16   },
+    { "nested/256",  1, 256  },
+    { "nested/1000", 1, 1000 },
+};
+
+// At least `size` bytes of statements shaped as `shape`. Free the data with free().
+static Str bench_generate_expressions(BenchExpressions shape, size_t size, size_t* statements) {
+    char* data = malloc(size + 16 * (size_t) shape.size + 64);
+    u64 state = 0x9E3779B97F4A7C15ull;
+
+    size_t used = 0;
+    *statements = 0;
+    while (used < size) {
+        if (shape.nested)
+            used += bench_generate_nested(data + used, &state, shape.size);
+        else
+            used += bench_generate_flat(data + used, &state, shape.size);
+        *statements += 1;
+    }
+    data[used] = '\0';
+    return (Str) { used, data };
+}
+
+
+static void usage(void) {
+    fprintf(stderr, "Usage: nox-bench-parser [max_declarations] [--expressions] [--csv]\n");
+}
+
+// Parses each shape of expression statements and reports the throughput.
+static int bench_expressions(Logger* logger, int csv) {
+    const size_t size = 4 * 1024 * 1024;
+
+    if (csv)
+        printf("shape,bytes,nodes,seconds,ns_per_node,mb_per_second\n");
+    else
+        printf("%12s %12s %12s %10s %12s %10s\n", "shape", "bytes", "nodes", "seconds", "ns/node", "MB/s");
+
+    for (size_t i = 0; i < sizeof(BENCH_EXPRESSIONS) / sizeof(*BENCH_EXPRESSIONS); ++i) {
+        BenchExpressions shape = BENCH_EXPRESSIONS[i];
+        size_t statements = 0;
+        Str source = bench_generate_expressions(shape, size, &statements);
+
+        size_t iterations = 0;
+        size_t nodes = 0;
+        f64 parsing = 0;
+        f64 start = bench_now();
+        do {
+            TokenArray array = lexer_lex(STR("<bench>"), source, logger);
+            if (array.tokens == NULL) {
+                fprintf(stderr, "Failed to lex %s expressions\n", shape.name);
+                return 1;
+            }
+
+            f64 before = bench_now();
+            GrammarTree tree = parse(array);
+            parsing += bench_now() - before;
+            if (tree.arena.kinds == NULL) {
+                fprintf(stderr, "Failed to parse %s expressions\n", shape.name);
+                return 1;
+            }
+
+            NodeModule* module = node_module_at(&tree.arena, tree.start);
+            if (module->stmts.count != statements) {
+                fprintf(stderr, "Expected %zu statements, got %u\n", statements, module->stmts.count);
+                return 1;
+            }
+            nodes = tree.arena.count;
+            grammar_tree_free(tree);
+
+            iterations += 1;
+        } while (bench_now() - start < 0.5);
+
+        f64 seconds = parsing / (f64) iterations;
+        f64 mb_per_second = (f64) source.size / seconds / 1e6;
+        if (csv)
+            printf("%s,%zu,%zu,%.9f,%.2f,%.1f\n", shape.name, source.size, nodes, seconds, seconds * 1e9 / (f64) nodes, mb_per_second);
+        else
+            printf("%12s %12zu %12zu %10.6f %12.2f %10.1f\n", shape.name, source.size, nodes, seconds, seconds * 1e9 / (f64) nodes, mb_per_second);
+        fflush(stdout);
+
+        free((char*) source.data);
+    }
+
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t max_count   = 100000;
+    int    csv         = 0;
+    int    expressions = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = 1;
+        } else if (strcmp(argv[i], "--expressions") == 0) {
+            expressions = 1;
+        } else if ('0' <= argv[i][0] && argv[i][0] <= '9') {
+            max_count = (size_t) strtoull(argv[i], NULL, 10);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (expressions)
+        return bench_expressions(&logger, csv);
+
+    if (csv)
+        printf("declarations,nodes,seconds,ns_per_declaration\n");
+    else
+        printf("%12s %12s %10s %18s\n", "declarations", "nodes", "seconds", "ns/declaration");
+
+    // With a quadratic hoist, ns/declaration grows tenfold with every row.
+    for (size_t count = 100; count <= max_count; count *= 10) {
+        Str source = bench_generate_declarations(count);
+
+        size_t iterations = 0;
+        size_t nodes = 0;
+        f64 parsing = 0;
+        f64 start = bench_now();
+        do {
+            TokenArray array = lexer_lex(STR("<bench>"), source, &logger);
+            if (array.tokens == NULL) {
+                fprintf(stderr, "Failed to lex %zu declarations\n", count);
+                return 1;
+            }
+
+            // Only the parse is timed, not the lexing before it.
+            f64 before = bench_now();
+            GrammarTree tree = parse(array);
+            parsing += bench_now() - before;
+            if (tree.arena.kinds == NULL) {
+                fprintf(stderr, "Failed to parse %zu declarations\n", count);
+                return 1;
+            }
+
+            NodeModule* module = node_module_at(&tree.arena, tree.start);
+            if (module->decls.count != count || module->stmts.count != count) {
+                fprintf(stderr, "Expected %zu declarations and statements, got %u and %u\n", count, module->decls.count, module->stmts.count);
+                return 1;
+            }
+            for (u32 i = 0; i < module->decls.count; ++i) {
+                if (node_kind_at(&tree.arena, node_view_at(&tree.arena, module->decls, i)) != NodeKind_FunDecl) {
+                    fprintf(stderr, "Expected only functions among the declarations\n");
+                    return 1;
+                }
+            }
+            nodes = tree.arena.count;
+            grammar_tree_free(tree);
+
+            iterations += 1;
+        } while (bench_now() - start < 0.25);
+
+        f64 seconds = parsing / (f64) iterations;
+        if (csv)
+            printf("%zu,%zu,%.9f,%.1f\n", count, nodes, seconds, seconds * 1e9 / (f64) count);
+        else
+            printf("%12zu %12zu %10.6f %18.1f\n", count, nodes, seconds, seconds * 1e9 / (f64) count);
+        fflush(stdout);
+
+        free((char*) source.data);
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "os/thread.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// `count` top-level functions with a few statements each, and a call to each.
+static Str bench_generate_functions(size_t count) {
+    char* data = malloc(count * 256 + 1);
+    size_t used = 0;
+    for (size_t i = 0; i < count; ++i) {
+        used += (size_t) sprintf(data + used,
+            "fun f%zu(a: int, b: int) int {\n"
+            "    c := a * %zu + (b - 1)\n"
+            "    while c > 100 { c = c / 2 }\n"
+            "    if c < b { return c } else { return b + f%zu(c, a) }\n"
+            "}\n"
+            "x%zu := f%zu(%zu, 2)\n", i, i % 100, i, i, i, i % 10);
+    }
+    data[used] = '\0';
+    return (Str) { used, data };
+}
+
+// 1, 2, 4, ... and finally max_threads itself, even if it isn't a power of two.
+static int next_thread_count(int threads, int max_threads) {
+    if (threads == max_threads)
+        return max_threads + 1;
+    return (2 * threads < max_threads) ? 2 * threads : max_threads;
+}
+
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t count       = (argc > 1) ? (size_t) strtoull(argv[1], NULL, 10) : 200000;
+    int    max_threads = (argc > 2) ? atoi(argv[2]) : thread_hardware_count();
+
+    Str source = bench_generate_functions(count);
+    TokenArray array = lexer_lex(STR("<bench>"), source, &logger);
+    if (array.tokens == NULL) {
+        fprintf(stderr, "Failed to lex %zu functions\n", count);
+        return 1;
+    }
+
+    printf("%8s %12s %12s %10s %12s %8s\n", "threads", "tokens", "nodes", "seconds", "ns/token", "speedup");
+    f64 single = 0;
+    for (int threads = 1; threads <= max_threads; threads = next_thread_count(threads, max_threads)) {
+        // Best of a few runs, since the first touches all the pages.
+        f64 best = 0;
+        size_t nodes = 0;
+        for (int run = 0; run < 3; ++run) {
+            f64 start = bench_now();
+            GrammarTree tree = parse_parallel(array, PARSER_DEFAULT_MAX_ERRORS, threads);
+            f64 elapsed = bench_now() - start;
+            if (tree.arena.kinds == NULL || tree.error_count != 0) {
+                fprintf(stderr, "Failed to parse %zu functions\n", count);
+                return 1;
+            }
+            nodes = tree.arena.count;
+            // The tokens are used again, so only the tree is freed.
+            node_arena_free(&tree.arena);
+            free(tree.errors);
+
+            if (run == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        if (threads == 1)
+            single = best;
+        printf("%8d %12u %12zu %10.6f %12.2f %7.2fx\n", threads, array.size, nodes, best, best * 1e9 / (f64) array.size, single / best);
+    }
+
+    token_array_free(array);
+    free((char*) source.data);
+    return 0;
+}
@@ -0,0 +1,165 @@
+#define LOGGER_IMPLEMENTATION
+#include "logger.h"
+
+#include "lexer/lexer.h"
+#include "parser/parser.h"
+#include "parser/visitor.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Both walks count the nodes they reach, which is as close to doing nothing as
+// they can get without the compiler dropping the walk altogether.
+
+/* ---- Through visit() and the Visitor's table ---- */
+typedef struct {
+    Visitor visitor;
+    size_t  count;
+} DynamicCounter;
+
+// visitor.c has no walk for the module, since visit() never gets one as a child.
+static void* walk_module(Visitor* visitor, NodeModule* node) {
+    walk_view(visitor, node->decls);
+    walk_view(visitor, node->stmts);
+    return NULL;
+}
+
+#define X(upper, lower, flags, body)                                        \
+    static void* dynamic_##lower(Visitor* visitor, Node##upper* node) {     \
+        ((DynamicCounter*) visitor)->count += 1;                            \
+        return walk_##lower(visitor, node);                                 \
+    }
+ALL_NODES(X)
+#undef X
+
+static size_t dynamic_count(const GrammarTree* tree) {
+    DynamicCounter counter = {
+        .visitor = {
+#define X(upper, lower, flags, body) .visit_##lower = dynamic_##lower,
+            ALL_NODES(X)
+#undef X
+            .arena = &tree->arena,
+        },
+        .count = 0,
+    };
+    visit(&counter, tree->start);
+    return counter.count;
+}
+
+
+/* ---- Through a static visitor ---- */
+typedef struct {
+    const NodeArena* arena;
+    size_t           count;
+} StaticCounter;
+
+#define STATIC_VISITOR_CONTEXT StaticCounter
+#define STATIC_VISITOR_PREFIX  counter
+DECLARE_STATIC_VISITOR()
+
+#define X(upper, lower, flags, body)                                        \
+    static void* counter_##lower(StaticCounter* counter, Node##upper* node) { \
+        counter->count += 1;                                                \
+        return counter_walk(counter, NodeKind_##upper, (Node*) node);       \
+    }
+ALL_NODES(X)
+#undef X
+
+DEFINE_STATIC_VISITOR()
+#undef STATIC_VISITOR_PREFIX
+#undef STATIC_VISITOR_CONTEXT
+
+static size_t static_count(const GrammarTree* tree) {
+    StaticCounter counter = { &tree->arena, 0 };
+    counter_visit(&counter, tree->start);
+    return counter.count;
+}
+
+
+// Mean seconds per walk over at least a quarter of a second.
+static f64 bench_walk(size_t (*count)(const GrammarTree*), const GrammarTree* tree, size_t* visited) {
+    size_t iterations = 0;
+    f64 start = bench_now();
+    f64 elapsed = 0;
+    do {
+        *visited = count(tree);
+        iterations += 1;
+        elapsed = bench_now() - start;
+    } while (elapsed < 0.25);
+    return elapsed / (f64) iterations;
+}
+
+// Grows the program until its tree has at least `min_nodes` nodes. The arena is
+// empty if it couldn't be parsed.
+static GrammarTree bench_parse_at_least(size_t min_nodes, Str* source, Logger* logger) {
+    for (size_t size = min_nodes; ; size *= 2) {
+        *source = bench_generate_source(size);
+        TokenArray array = lexer_lex(STR("<bench>"), *source, logger);
+        if (array.tokens == NULL) {
+            fprintf(stderr, "Failed to lex %zu bytes\n", source->size);
+            return (GrammarTree) { .arena = { 0 } };
+        }
+        GrammarTree tree = parse_with_max_errors(array, 0);
+        if (tree.arena.kinds == NULL || tree.error_count != 0) {
+            fprintf(stderr, "Failed to parse %zu bytes\n", source->size);
+            return (GrammarTree) { .arena = { 0 } };
+        }
+        if (tree.arena.count >= min_nodes)
+            return tree;
+        grammar_tree_free(tree);
+        free((char*) source->data);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: nox-bench-visitor [min_nodes] [--csv]\n");
+}
+
+int main(int argc, const char* argv[]) {
+    logger_init(LOG_LEVEL_ERROR);
+    Logger logger = logger_make_with_file("bench", LOG_LEVEL_ERROR, stderr);
+
+    size_t min_nodes = 1000000;
+    int    csv       = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--csv") == 0) {
+            csv = 1;
+        } else if ('0' <= argv[i][0] && argv[i][0] <= '9') {
+            min_nodes = (size_t) strtoull(argv[i], NULL, 10);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    Str source = { 0, NULL };
+    GrammarTree tree = bench_parse_at_least(min_nodes, &source, &logger);
+    if (tree.arena.kinds == NULL)
+        return 1;
+
+    size_t dynamic_visited = 0;
+    size_t static_visited  = 0;
+    f64 dynamic_seconds = bench_walk(dynamic_count, &tree, &dynamic_visited);
+    f64 static_seconds  = bench_walk(static_count,  &tree, &static_visited);
+    if (dynamic_visited != static_visited) {
+        fprintf(stderr, "visit() reached %zu nodes, the static visitor %zu\n", dynamic_visited, static_visited);
+        return 1;
+    }
+
+    if (csv) {
+        printf("walk,nodes,visited,seconds,ns_per_node,speedup\n");
+        printf("visit,%zu,%zu,%.9f,%.3f,%.2f\n",  (size_t) tree.arena.count, dynamic_visited, dynamic_seconds, dynamic_seconds * 1e9 / (f64) dynamic_visited, 1.0);
+        printf("static,%zu,%zu,%.9f,%.3f,%.2f\n", (size_t) tree.arena.count, static_visited, static_seconds, static_seconds * 1e9 / (f64) static_visited, dynamic_seconds / static_seconds);
+    } else {
+        printf("%8s %12s %12s %10s %10s %8s\n", "walk", "nodes", "visited", "seconds", "ns/node", "speedup");
+        printf("%8s %12zu %12zu %10.6f %10.3f %7.2fx\n", "visit",  (size_t) tree.arena.count, dynamic_visited, dynamic_seconds, dynamic_seconds * 1e9 / (f64) dynamic_visited, 1.0);
+        printf("%8s %12zu %12zu %10.6f %10.3f %7.2fx\n", "static", (size_t) tree.arena.count, static_visited, static_seconds, static_seconds * 1e9 / (f64) static_visited, dynamic_seconds / static_seconds);
+    }
+
+    grammar_tree_free(tree);
+    free((char*) source.data);
+    return 0;
+}
@@ -61,12 +61,25 @@ const destroy_fn destroy_functions[COUNT] = {
 
 /// Does not support take padding and alignment into account.
 size_t mallocated_user_size = 0;
+size_t mallocated_count = 0;
+
+// The lexer, the parser and the checker allocate on several threads at once.
+// The counters are only statistics, so they don't order anything else.
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MALLOC_COUNTER_ADD(counter, value) _InterlockedExchangeAdd64((volatile __int64*) &(counter), (__int64) (value))
+#define MALLOC_COUNTER_SUB(counter, value) _InterlockedExchangeAdd64((volatile __int64*) &(counter), -(__int64) (value))
+#else
+#define MALLOC_COUNTER_ADD(counter, value) __atomic_fetch_add(&(counter), (value), __ATOMIC_RELAXED)
+#define MALLOC_COUNTER_SUB(counter, value) __atomic_fetch_sub(&(counter), (value), __ATOMIC_RELAXED)
+#endif
 
 void* malloc_allocate(Allocator allocator, size_t size) {
     (void) allocator;
     void* ptr = malloc(size);
 
-    mallocated_user_size += size;
+    MALLOC_COUNTER_ADD(mallocated_user_size, size);
+    MALLOC_COUNTER_ADD(mallocated_count, 1);
 
     return ptr;
 }
@@ -75,18 +88,31 @@ void* malloc_reallocate(Allocator allocator, size_t size, void* old_ptr, size_t
     (void) allocator;
     void* new_ptr = realloc(old_ptr, size);
 
-    mallocated_user_size += size;
-    mallocated_user_size -= old_size;
+    MALLOC_COUNTER_ADD(mallocated_user_size, size);
+    MALLOC_COUNTER_ADD(mallocated_count, 1);
+    MALLOC_COUNTER_SUB(mallocated_user_size, old_size);
 
     return new_ptr;
 }
 
 void malloc_deallocate(Allocator allocator, void* old_ptr, size_t old_size) {
     (void) allocator;
-    mallocated_user_size -= old_size;
+    MALLOC_COUNTER_SUB(mallocated_user_size, old_size);
     free(old_ptr);
 }
 
+void* grow_array(void* data, size_t count, size_t new_count, size_t element_size) {
+    void* result = alloc(0, new_count * element_size);
+    if (result == NULL)
+        return NULL;
+
+    // memcpy may not be passed NULL, even to copy nothing.
+    if (count != 0)
+        memcpy(result, data, count * element_size);
+    free(data);
+    return result;
+}
+
 #define realloc(allocator, new_size, old_ptr, old_size) realloc_(allocator, new_size, old_ptr, old_size, (Alloc_Location) { __FILE_NAME__, __FUNCTION_NAME__, __LINE__ } )
 
 
@@ -152,6 +152,14 @@ static inline void destroy_(Allocator allocator, Alloc_Location location) {
  ****************************************************************************************/
 /// Does not support take padding and alignment into account.
 extern size_t mallocated_user_size;
+/// Number of calls to malloc_allocate and malloc_reallocate.
+extern size_t mallocated_count;
+
+/// Moves the first `count` elements of `data` to a new array with room for
+/// `new_count`, and frees `data`. Both are allocated with alloc(0, ...), so
+/// free them with free. `data` may be NULL if `count` is 0.
+/// Returns NULL, and leaves `data` as it is, if out of memory.
+void* grow_array(void* data, size_t count, size_t new_count, size_t element_size);
 
 
 /****************************************************************************************
@@ -10,6 +10,8 @@ const char* USAGE = ""
 "  OPTIONS:\n"
 "    -q, --quiet       Don't output anything from the compiler\n"
 "    -t, --time        Output time to finish command\n"
+"    --max-errors <n>  Stop after n syntax errors, 0 for no limit (default 20)\n"
+"    --no-cache        Don't read or write the .noxc cache next to the file\n"
 "    -h, --help        Display options for a command\n"
 "  SUBCOMMAND:\n"
 "    com  [file]       Compile the project or a given file\n"
@@ -119,10 +121,21 @@ int parse_sim(int argc, const char* const argv[], ArgCommands* commands) {
     return 0;
 }
 
+int parse_max_errors(int argc, const char* const argv[], ArgCommands* commands) {
+    char* end = NULL;
+    if (argc > 0)
+        commands->max_errors = (unsigned) strtoul(argv[0], &end, 10);
+    if (argc == 0 || end == argv[0] || *end != '\0') {
+        fprintf(stderr, "'--max-errors' requires a number.\n");
+        exit(EXIT_FAILURE);
+    }
+    return 1;
+}
+
 
 
 ArgCommands parse_args(int argc, const char* const argv[]) {
-    ArgCommands commands = { .working_file=argv[0], .input_file=0, .mode=NO_RUN_MODE, .verbose=0, .take_time=0 };
+    ArgCommands commands = { .working_file=argv[0], .input_file=0, .mode=NO_RUN_MODE, .verbose=0, .take_time=0, .max_errors=20 };
     argv++; argc--;
     for (int i = 0; i < argc; ++i) {
         const char* const arg = argv[i];
@@ -137,6 +150,8 @@ ArgCommands parse_args(int argc, const char* const argv[]) {
         else if (is_argument(arg, "-t") || is_argument(arg, "--time"))    {  commands.take_time = 1; }
         else if (is_argument(arg, "-h") || is_argument(arg, "--help"))    {  commands.show_help = 1; }
         else if (is_argument(arg, "-s") || is_argument(arg, "--source"))  {  commands.as_source = 1; }
+        else if (is_argument(arg, "--max-errors"))  {  i += parse_max_errors(argc-i-1, argv+i+1, &commands); }
+        else if (is_argument(arg, "--no-cache"))    {  commands.no_cache = 1; }
         else {
             // @TODO: Check that there are no more commands.
             fprintf(stderr, "Unknown command '%s'\n", argv[i]);
@@ -23,6 +23,8 @@ typedef struct {
     int take_time;
     int show_help;
     int as_source;
+    unsigned max_errors;
+    int no_cache;
 } ArgCommands;
 
 
@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "cache.h"
+#include "os/memory.h"
+
+
+// "NOXC" when read back in the byte order it was written in.
+#define CACHE_MAGIC 0x43584F4Eu
+#define CACHE_ALIGN 8
+
+// The cache file is one image that starts with this header. Every pointer in
+// it, and in the nodes and locals it leads to, holds an offset from the start
+// of the image instead, so the image can be mapped anywhere and loading only
+// adds the address it was mapped at.
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 pointer_size;
+    u32 node_size;
+    u64 source_hash;
+    u64 source_size;
+    u64 size;
+
+    TokenArray tokens;          // Without name and source, which the reader has.
+    NodeArena  arena;
+    NodeId     start;
+    u64        block_count;
+    Block*     blocks;
+    TypeTable  types;
+} CacheImage;
+
+static const u32 NODE_SIZES[NODE_KIND_COUNT] = {
+#define X(upper, lower, flags, body) [NodeKind_##upper] = NODE_POOL_STRIDE(Node##upper),
+    ALL_NODES(X)
+#undef X
+};
+
+// Where the nodes that name something keep the name, which points into the
+// data pool. Offset 0 is the node's kind, so it means the node has no name.
+static const size_t NAME_OFFSETS[NODE_KIND_COUNT] = {
+    [NodeKind_Literal]     = offsetof(NodeLiteral, value.string),
+    [NodeKind_Identifier]  = offsetof(NodeIdentifier, name),
+    [NodeKind_Call]        = offsetof(NodeCall, name),
+    [NodeKind_Type]        = offsetof(NodeType, name),
+    [NodeKind_Assign]      = offsetof(NodeAssign, name),
+    [NodeKind_VarDecl]     = offsetof(NodeVarDecl, name),
+    [NodeKind_FunParam]    = offsetof(NodeFunParam, name),
+    [NodeKind_FunDecl]     = offsetof(NodeFunDecl, name),
+    [NodeKind_InitArg]     = offsetof(NodeInitArg, name),
+    [NodeKind_Init]        = offsetof(NodeInit, name),
+    [NodeKind_StructField] = offsetof(NodeStructField, name),
+    [NodeKind_Struct]      = offsetof(NodeStruct, name),
+};
+
+
+/* ---------------------------- CACHE HELPERS -------------------------------- */
+// Four independent lanes of eight bytes each, so that the multiply of one word
+// doesn't wait for the one before it. Hashing is on the path of every warm run.
+u64 cache_hash(Str source) {
+    const u64 prime = 0x9E3779B97F4A7C15ull;
+    const u8* data  = (const u8*) source.data;
+
+    u64 lanes[4] = { prime, prime + 1, prime + 2, prime + 3 };
+    size_t i = 0;
+    for (; i + 32 <= source.size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            u64 word;
+            memcpy(&word, data + i + 8 * lane, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * prime;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    u64 hash = (u64) source.size * prime;
+    for (int lane = 0; lane < 4; ++lane) {
+        hash = (hash ^ lanes[lane]) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < source.size; ++i)
+        hash = (hash ^ data[i]) * prime;
+    return hash ^ (hash >> 32);
+}
+
+static char* cache_path_of(const char* path) {
+    size_t size = strlen(path);
+    char* result = alloc(size + sizeof(CACHE_EXTENSION));
+    if (result == NULL)
+        return NULL;
+
+    memcpy(result, path, size);
+    memcpy(result + size, CACHE_EXTENSION, sizeof(CACHE_EXTENSION));
+    return result;
+}
+
+// Adds `delta` to a pointer that isn't NULL. Unsigned arithmetic, as it goes
+// both from an address to an offset and back.
+#define CACHE_RELOCATE(pointer, delta) \
+    do { if ((pointer) != NULL) (pointer) = (void*) ((uintptr_t) (pointer) + (delta)); } while (0)
+
+// A literal only has a pointer if it's a string, and a type only if it isn't
+// one of the literal types, which are stored in its name.
+static int node_has_name(NodeKind kind, const Node* node) {
+    if (kind == NodeKind_Literal)
+        return node->literal.type == LiteralType_String;
+    if (kind == NodeKind_Type)
+        return (uintptr_t) node->type.name > LITERAL_TYPE_LAST;
+    return 1;
+}
+
+static void relocate_names(u8* items, NodeKind kind, u32 stride, u32 count, uintptr_t delta) {
+    size_t at = NAME_OFFSETS[kind];
+    if (at == 0)
+        return;
+
+    for (u32 i = 0; i < count; ++i) {
+        u8* item = items + (size_t) i * stride;
+        if (node_has_name(kind, (const Node*) item)) {
+            const char** name = (const char**) (item + at);
+            CACHE_RELOCATE(*name, delta);
+        }
+    }
+}
+
+
+/* ---------------------------- CACHE WRITER -------------------------------- */
+// The image is laid out twice: once without data to measure it, and once
+// into a buffer of that size.
+typedef struct {
+    u8*    data;
+    size_t size;
+} CacheWriter;
+
+// Places `size` bytes at the next aligned offset, and returns the offset, or
+// 0 if `from` is NULL so that it stays NULL when loaded.
+static size_t cache_append(CacheWriter* writer, const void* from, size_t size) {
+    if (from == NULL)
+        return 0;
+
+    size_t offset = (writer->size + CACHE_ALIGN - 1) & ~(size_t) (CACHE_ALIGN - 1);
+    if (writer->data != NULL)
+        memcpy(writer->data + offset, from, size);
+    writer->size = offset + size;
+    return offset;
+}
+
+#define CACHE_OFFSET(type, offset) ((type) (uintptr_t) (offset))
+
+static void cache_lay_out(CacheWriter* writer, CacheImage* image, TokenArray tokens, const TypedAst* ast) {
+    writer->size = sizeof(CacheImage);
+
+    // Sections are appended one statement at a time, as the order of the side
+    // effects in an initializer list is unspecified.
+    size_t words = tokens.size / 64 + 1;
+    image->tokens = tokens;
+    image->tokens.name   = STR_EMPTY;
+    image->tokens.source = STR_EMPTY;
+
+    size_t data_pool_at = cache_append(writer, tokens.data_pool, tokens.data_pool_size);
+    image->tokens.data_pool      = CACHE_OFFSET(u8*,            data_pool_at);
+    image->tokens.tokens         = CACHE_OFFSET(u8*,            cache_append(writer, tokens.tokens, tokens.size));
+    image->tokens.source_offsets = CACHE_OFFSET(SourceIndex*,   cache_append(writer, tokens.source_offsets, tokens.size * sizeof(SourceIndex)));
+    image->tokens.payloads       = CACHE_OFFSET(DataPoolIndex*, cache_append(writer, tokens.payloads, tokens.payload_count * sizeof(DataPoolIndex)));
+    image->tokens.payload_bits   = CACHE_OFFSET(u64*,           cache_append(writer, tokens.payload_bits, words * sizeof(u64)));
+    image->tokens.payload_ranks  = CACHE_OFFSET(TokenIndex*,    cache_append(writer, tokens.payload_ranks, words * sizeof(TokenIndex)));
+    image->tokens.constants      = CACHE_OFFSET(Constant*,      cache_append(writer, tokens.constants, tokens.constant_count * sizeof(Constant)));
+    image->tokens.lines.starts   = CACHE_OFFSET(u32*,           cache_append(writer, tokens.lines.starts, tokens.lines.count * sizeof(u32)));
+
+    // The arena is stored full, as there is nothing to grow into.
+    const NodeArena* arena = &ast->arena;
+    image->arena = *arena;
+    image->arena.capacity      = arena->count;
+    image->arena.view_capacity = arena->view_count;
+    image->arena.kinds = CACHE_OFFSET(u8*,     cache_append(writer, arena->kinds, arena->count));
+    image->arena.slots = CACHE_OFFSET(u32*,    cache_append(writer, arena->slots, arena->count * sizeof(u32)));
+    image->arena.views = CACHE_OFFSET(NodeId*, cache_append(writer, arena->views, arena->view_count * sizeof(NodeId)));
+
+    // Names point from the items into the data pool, and locals to their
+    // declarations in the items, so both move along with what they point to.
+    uintptr_t pool_deltas[NODE_KIND_COUNT];
+    uintptr_t name_delta = (uintptr_t) data_pool_at - (uintptr_t) tokens.data_pool;
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        const NodePool* pool = &arena->pools[kind];
+        NodePool* stored = &image->arena.pools[kind];
+        size_t items_at = cache_append(writer, pool->items, (size_t) pool->count * pool->stride);
+        stored->items    = CACHE_OFFSET(u8*,     items_at);
+        stored->ids      = CACHE_OFFSET(NodeId*, cache_append(writer, pool->ids, pool->count * sizeof(NodeId)));
+        stored->capacity = pool->count;
+        pool_deltas[kind] = (uintptr_t) items_at - (uintptr_t) pool->items;
+
+        if (writer->data != NULL && items_at != 0)
+            relocate_names(writer->data + items_at, (NodeKind) kind, pool->stride, pool->count, name_delta);
+    }
+    image->start = ast->start;
+
+    // The locals and the table of every block follow each other, in the order of the blocks.
+    size_t blocks_at = cache_append(writer, ast->block, ast->block_count * sizeof(Block));
+    image->block_count = ast->block_count;
+    image->blocks      = CACHE_OFFSET(Block*, blocks_at);
+    for (size_t i = 0; i < ast->block_count; ++i) {
+        const Block* block = ast->block + i;
+        size_t locals_at = cache_append(writer, block->locals, (size_t) block->count * sizeof(Local));
+        size_t table_at  = cache_append(writer, block->table, block->table_capacity * sizeof(u32));
+        if (writer->data == NULL)
+            continue;
+
+        Block* stored = (Block*) (writer->data + blocks_at) + i;
+        stored->locals   = CACHE_OFFSET(Local*, locals_at);
+        stored->capacity = block->count;
+        stored->table    = CACHE_OFFSET(u32*, table_at);
+        stored->names    = CACHE_OFFSET(const char*, data_pool_at);
+        for (i64 j = 0; j < block->count; ++j) {
+            Local* local = (Local*) (writer->data + locals_at) + j;
+            CACHE_RELOCATE(local->decl, pool_deltas[local->decl->kind]);
+        }
+    }
+
+    // The type table is stored full too. The names of structs point into the
+    // data pool, like the names in the nodes.
+    const TypeTable* types = &ast->types;
+    image->types = *types;
+    image->types.capacity        = types->count;
+    image->types.member_capacity = types->member_count;
+    size_t names_at = cache_append(writer, types->names, types->count * sizeof(const char*));
+    image->types.kinds         = CACHE_OFFSET(u8*,          cache_append(writer, types->kinds, types->count));
+    image->types.names         = CACHE_OFFSET(const char**, names_at);
+    image->types.firsts        = CACHE_OFFSET(u32*,         cache_append(writer, types->firsts, types->count * sizeof(u32)));
+    image->types.member_counts = CACHE_OFFSET(u32*,         cache_append(writer, types->member_counts, types->count * sizeof(u32)));
+    image->types.members       = CACHE_OFFSET(TypeId*,      cache_append(writer, types->members, types->member_count * sizeof(TypeId)));
+    image->types.table         = CACHE_OFFSET(u32*,         cache_append(writer, types->table, types->table_capacity * sizeof(u32)));
+    image->types.data_pool     = CACHE_OFFSET(const char*,  data_pool_at);
+    if (writer->data != NULL && names_at != 0) {
+        const char** names = (const char**) (writer->data + names_at);
+        for (u32 i = 0; i < types->count; ++i)
+            CACHE_RELOCATE(names[i], name_delta);
+    }
+}
+
+int cache_write(const char* path, Str source, TokenArray tokens, TypedAst ast) {
+    CacheImage image = { 0 };
+    CacheWriter writer = { NULL, 0 };
+    cache_lay_out(&writer, &image, tokens, &ast);
+
+    size_t size = writer.size;
+    writer.data = alloc(size);
+    if (writer.data == NULL)
+        return 0;
+
+    // Zeroed, so that the padding between sections isn't written out uninitialized.
+    memset(writer.data, 0, size);
+    cache_lay_out(&writer, &image, tokens, &ast);
+
+    image.magic        = CACHE_MAGIC;
+    image.version      = CACHE_VERSION;
+    image.pointer_size = sizeof(void*);
+    image.node_size    = sizeof(Node);
+    image.source_hash  = cache_hash(source);
+    image.source_size  = source.size;
+    image.size         = size;
+    memcpy(writer.data, &image, sizeof(image));
+
+    // Written aside and renamed over the old cache, so a reader never sees half of it.
+    char* cache_path = cache_path_of(path);
+    char* temporary  = cache_path != NULL ? alloc(strlen(cache_path) + sizeof(".tmp")) : NULL;
+    if (temporary == NULL) {
+        dealloc(cache_path);
+        dealloc(writer.data);
+        return 0;
+    }
+    sprintf(temporary, "%s.tmp", cache_path);
+
+    FILE* file = fopen(temporary, "wb");
+    int written = file != NULL && fwrite(writer.data, 1, size, file) == size;
+    if (file != NULL && fclose(file) != 0)
+        written = 0;
+#if defined(_WIN32)
+    if (written)
+        remove(cache_path);
+#endif
+    if (written && rename(temporary, cache_path) != 0)
+        written = 0;
+    if (!written)
+        remove(temporary);
+
+    dealloc(temporary);
+    dealloc(cache_path);
+    dealloc(writer.data);
+    return written;
+}
+
+
+/* ---------------------------- CACHE READER -------------------------------- */
+static int cache_image_matches(const CacheImage* image, size_t size, Str source) {
+    if (size < sizeof(CacheImage))
+        return 0;
+    if (image->magic != CACHE_MAGIC || image->version != CACHE_VERSION || image->size != size)
+        return 0;
+    if (image->pointer_size != sizeof(void*) || image->node_size != sizeof(Node))
+        return 0;
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        if (image->arena.pools[kind].stride != NODE_SIZES[kind])
+            return 0;
+    }
+    return image->source_size == source.size && image->source_hash == cache_hash(source);
+}
+
+CachedAst cache_read(const char* path, Str source) {
+    CachedAst cached = { 0 };
+
+    char* cache_path = cache_path_of(path);
+    if (cache_path == NULL)
+        return cached;
+
+    size_t size = 0;
+    u8* base = memory_map_file_copy(cache_path, &size);
+    dealloc(cache_path);
+    if (base == NULL)
+        return cached;
+
+    CacheImage* image = (CacheImage*) base;
+    if (!cache_image_matches(image, size, source)) {
+        memory_unmap_file(base, size);
+        return cached;
+    }
+
+    uintptr_t delta = (uintptr_t) base;
+
+    TokenArray tokens = image->tokens;
+    tokens.name   = str_from_c_str(path);
+    tokens.source = source;
+    CACHE_RELOCATE(tokens.tokens,         delta);
+    CACHE_RELOCATE(tokens.source_offsets, delta);
+    CACHE_RELOCATE(tokens.payloads,       delta);
+    CACHE_RELOCATE(tokens.payload_bits,   delta);
+    CACHE_RELOCATE(tokens.payload_ranks,  delta);
+    CACHE_RELOCATE(tokens.data_pool,      delta);
+    CACHE_RELOCATE(tokens.constants,      delta);
+    CACHE_RELOCATE(tokens.lines.starts,   delta);
+
+    NodeArena arena = image->arena;
+    CACHE_RELOCATE(arena.kinds, delta);
+    CACHE_RELOCATE(arena.slots, delta);
+    CACHE_RELOCATE(arena.views, delta);
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        NodePool* pool = &arena.pools[kind];
+        CACHE_RELOCATE(pool->items, delta);
+        CACHE_RELOCATE(pool->ids,   delta);
+        if (pool->items != NULL)
+            relocate_names(pool->items, (NodeKind) kind, pool->stride, pool->count, delta);
+    }
+
+    Block* blocks = image->blocks;
+    CACHE_RELOCATE(blocks, delta);
+    // The tables are keyed by where the names are in the data pool, which
+    // moves along with them.
+    for (u64 i = 0; i < image->block_count; ++i) {
+        CACHE_RELOCATE(blocks[i].locals, delta);
+        CACHE_RELOCATE(blocks[i].table,  delta);
+        CACHE_RELOCATE(blocks[i].names,  delta);
+        for (i64 j = 0; j < blocks[i].count; ++j)
+            CACHE_RELOCATE(blocks[i].locals[j].decl, delta);
+    }
+
+    TypeTable types = image->types;
+    CACHE_RELOCATE(types.kinds,         delta);
+    CACHE_RELOCATE(types.names,         delta);
+    CACHE_RELOCATE(types.firsts,        delta);
+    CACHE_RELOCATE(types.member_counts, delta);
+    CACHE_RELOCATE(types.members,       delta);
+    CACHE_RELOCATE(types.table,         delta);
+    CACHE_RELOCATE(types.data_pool,     delta);
+    for (u32 i = 0; i < types.count; ++i)
+        CACHE_RELOCATE(types.names[i], delta);
+
+    cached.tokens  = tokens;
+    // The locals, tables and types live in the mapping, with nothing of their own to free.
+    cached.ast     = (TypedAst) { arena, image->start, blocks, (size_t) image->block_count, NULL, NULL, types };
+    cached.mapping = base;
+    cached.size    = size;
+    return cached;
+}
+
+void cache_close(CachedAst cached) {
+    if (cached.mapping != NULL)
+        memory_unmap_file(cached.mapping, cached.size);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "preamble.h"
+#include "str.h"
+#include "lexer/lexer.h"
+#include "type_checker/checker.h"
+
+
+/// Bump whenever the layout of the tokens, the nodes, the blocks or the types changes.
+#define CACHE_VERSION 9
+
+/// The cache of a source file is stored next to it, with this appended to its path.
+#define CACHE_EXTENSION ".noxc"
+
+/// A type checked program loaded from the cache. It all lives in one copy-on-write
+/// mapping of the cache file, so nothing in it may be grown or freed on its own:
+/// close it with cache_close once the tokens and the tree are no longer used.
+typedef struct {
+    TokenArray tokens;
+    TypedAst   ast;
+
+    void*  mapping;
+    size_t size;
+} CachedAst;
+
+/// The program cached next to `path`. Returns one with mapping == NULL if there
+/// is no cache, or if it was made from another source or by another build.
+CachedAst cache_read(const char* path, Str source);
+
+/// Store the tokens and the type checked tree of the source at `path` next to it.
+/// Returns 0 if the cache couldn't be written, which only makes the next run slower.
+int cache_write(const char* path, Str source, TokenArray tokens, TypedAst ast);
+
+void cache_close(CachedAst cached);
+
+/// The hash of the source that its cache is keyed by.
+u64 cache_hash(Str source);
@@ -37,6 +37,10 @@ typedef struct {
     size_t         deferred_blocks_count;
 } Generator;
 
+static inline Node* get_node(const Generator* generator, NodeId id) {
+    return node_at(&generator->ast.arena, id);
+}
+
 Register register_alloc(Generator* generator) {
     return generator->current_register++;
 }
@@ -139,22 +143,10 @@ void pop(Generator* generator, Register dst) {
     };
 }
 
-static Local* find_local(const Generator* generator, const char* name) {
-    Block* current = generator->current;
-    while (current != NULL) {
-        for (i32 i = 0; i < (i32) current->count; ++i) {
-            Local* local = current->locals + i;
-            assert((local->decl->kind == NodeKind_VarDecl || local->decl->kind == NodeKind_FunDecl || local->decl->kind == NodeKind_FunParam) && "Invalid node kind");
-
-            if (local->decl->var_decl.name == name) {
-                return local;
-            }
-        }
-        current = (current->parent == -1) ? NULL : generator->ast.block + current->parent;
-    }
-
-    assert(0 && "Unknown identifier");
-    exit(1);
+// The type checker has made sure that every name is declared.
+static Local* resolved_local(const Generator* generator, NodeSlot slot) {
+    assert(slot.block != -1 && "Unknown identifier");
+    return generator->ast.block[slot.block].locals + slot.slot;
 }
 
 
@@ -188,7 +180,7 @@ Register generate_literal(Generator* generator, const NodeLiteral* literal) {
 
 // Adds 1 scratch register.
 Register generate_identifier(Generator* generator, const NodeIdentifier* identifier) {
-    Local* local = find_local(generator, identifier->name);
+    Local* local = resolved_local(generator, identifier->resolved);
     if (local != NULL) {
         Register dst = register_alloc(generator);
         return load(generator, dst, local->decl->var_decl.decl_offset);
@@ -231,7 +223,7 @@ Register generate_binary(Generator* generator, const NodeBinary* binary) {
 Register generate_assign(Generator* generator, const NodeAssign* assign) {
     Register src = (Register) visit(generator, assign->expression);
 
-    Local* local = find_local(generator, assign->name);
+    Local* local = resolved_local(generator, assign->resolved);
     if (local != NULL) {
         if (local->decl->kind == NodeKind_FunParam) {
             assert(0 && "not implemented");
@@ -248,13 +240,12 @@ Register generate_assign(Generator* generator, const NodeAssign* assign) {
 }
 
 Register generate_var_decl(Generator* generator, const NodeVarDecl* var_decl) {
-    Local*   dst = find_local(generator, var_decl->name);
     Register src = (Register) visit(generator, var_decl->expression);
 
     // Free the scratch register.
     register_free(generator);
 
-    return store(generator, dst->decl->var_decl.decl_offset, src);
+    return store(generator, var_decl->decl_offset, src);
 }
 
 Register generate_if_stmt(Generator* generator, const NodeIf* if_stmt) {
@@ -270,13 +261,13 @@ Register generate_if_stmt(Generator* generator, const NodeIf* if_stmt) {
     register_free(generator);  // Consume the expression register
 
     Instruction* jump_to_else = jmp_zero(generator, condition);
-    visit(generator, (Node*) if_stmt->then_block);
+    visit(generator, if_stmt->then_block);
 
-    if (if_stmt->else_block != NULL) {
+    if (if_stmt->else_block != 0) {
         Instruction* jump_to_end = jmp(generator);
         jump_to_else->jmp.label = (i32) generator->count;
 
-        visit(generator, (Node*) if_stmt->else_block);
+        visit(generator, if_stmt->else_block);
         jump_to_end->jmp.label = (i32) generator->count;
     } else {
         jump_to_else->jmp.label = (i32) generator->count;
@@ -299,18 +290,18 @@ Register generate_while_stmt(Generator* generator, const NodeWhile* while_stmt)
     register_free(generator);  // Consume the expression register
 
     Instruction* jump_to_else = jmp_zero(generator, condition);
-    visit(generator, (Node*) while_stmt->then_block);
+    visit(generator, while_stmt->then_block);
 
     Instruction* jump_to_start = jmp(generator);
     jump_to_start->jmp.label = (Register) start;
 
-    if (while_stmt->else_block != NULL) {
+    if (while_stmt->else_block != 0) {
         assert(0 && "not implemented");
 
 //        Instruction* jump_to_end = jmp(generator);
 //        jump_to_else->jmp.label = generator->count;
 //
-//        visit(generator, (Node*) while_stmt->else_block);
+//        visit(generator, while_stmt->else_block);
 //        jump_to_end->jmp.label = generator->count;
     } else {
         jump_to_else->jmp.label = (i32) generator->count;
@@ -321,19 +312,19 @@ Register generate_while_stmt(Generator* generator, const NodeWhile* while_stmt)
 Register generate_call(Generator* generator, const NodeCall* fn_call) {
     Local* result;
     if (strcmp(fn_call->name, "print") != 0) {
-        result = find_local(generator, fn_call->name);
+        result = resolved_local(generator, fn_call->resolved);
         assert(result->decl->kind == NodeKind_FunDecl && "Not a function");
     }
 
-    for (i32 i = 0; i < fn_call->count; ++i) {
-        Node* arg = fn_call->args[i];
+    for (i32 i = 0; i < (i32) fn_call->args.count; ++i) {
+        NodeId arg = node_view_at(&generator->ast.arena, fn_call->args, (u32) i);
         Register reg = (Register)(size_t)visit(generator, arg);
 
         push(generator, REG_BASE + i);
         mov_reg(generator, REG_BASE + i, reg);
     }
 
-    for (i32 i = 0; i < fn_call->count; ++i) {
+    for (i32 i = 0; i < (i32) fn_call->args.count; ++i) {
         // NOTE(ted): The argument registers are free to use after the call.
         register_free(generator);
     }
@@ -344,7 +335,7 @@ Register generate_call(Generator* generator, const NodeCall* fn_call) {
             .type = Instruction_Print,
         };
         // NOTE(ted): Restore the registers used for arguments.
-        for (i32 i = fn_call->count-1; i >= 0; --i) {
+        for (i32 i = (i32) fn_call->args.count-1; i >= 0; --i) {
             pop(generator, REG_BASE + i);
         }
         // NOTE(ted): 'print' does not return a value.
@@ -355,7 +346,7 @@ Register generate_call(Generator* generator, const NodeCall* fn_call) {
     }
 
     // NOTE(ted): Restore the registers used for arguments, except the return register.
-    for (i32 i = fn_call->count-1; i >= 1; --i) {
+    for (i32 i = (i32) fn_call->args.count-1; i >= 1; --i) {
         pop(generator, REG_BASE + i);
     }
 
@@ -366,7 +357,7 @@ Register generate_call(Generator* generator, const NodeCall* fn_call) {
     }
 
     // NOTE(ted): Restore the return register.
-    if (fn_call->count > 0)
+    if (fn_call->args.count > 0)
         pop(generator, REG_BASE);
 
     for (size_t i = 0; i < generator->deferred_blocks_count; ++i) {
@@ -390,8 +381,8 @@ Register generate_fun_param(Generator* generator, const NodeFunParam* node) {
 Register generate_block(Generator* generator, const NodeBlock* node) {
     Block* current = generator->current;
     generator->current = generator->ast.block + node->id;
-    for (i32 i = 0; i < node->count; ++i) {
-        visit(generator, node->nodes[i]);
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        visit(generator, node_view_at(&generator->ast.arena, node->nodes, i));
     }
     generator->current = current;
     return -1;
@@ -400,8 +391,8 @@ Register generate_block(Generator* generator, const NodeBlock* node) {
 Register generate_fun_body(Generator* generator, const NodeFunBody* node) {
     Block* current = generator->current;
     generator->current = generator->ast.block + node->id;
-    for (i32 i = 0; i < node->count; ++i) {
-        visit(generator, node->nodes[i]);
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        visit(generator, node_view_at(&generator->ast.arena, node->nodes, i));
     }
     generator->current = current;
     return -1;
@@ -415,22 +406,21 @@ Register generate_deferred(Generator* generator, const NodeFunDecl* node) {
     mov_reg(generator, BP, SP);
 
     // Allocate space for parameters
-    bin_op(generator, Instruction_Add_Imm, SP, node->param_count);
+    bin_op(generator, Instruction_Add_Imm, SP, (i32) node->params.count);
     // Allocate space for locals
-    bin_op(generator, Instruction_Add_Imm, SP, node->body->decls);
+    NodeFunBody* body = node_fun_body_at(&generator->ast.arena, node->body);
+    bin_op(generator, Instruction_Add_Imm, SP, body->local_count);
 
     Block* current = generator->current;
-    generator->current = generator->ast.block + node->body->id;
+    generator->current = generator->ast.block + body->id;
 
-    for (i32 i = 0; i < node->param_count; ++i) {
-        NodeFunParam* param = node->params[i];
-        Local* local = find_local(generator, param->name);
-        assert(local->decl->kind == NodeKind_FunParam && "Invalid node kind");
-        store(generator, local->decl->fun_param.offset, REG_BASE + i);
+    for (i32 i = 0; i < (i32) node->params.count; ++i) {
+        NodeFunParam* param = node_fun_param_at(&generator->ast.arena, node_view_at(&generator->ast.arena, node->params, (u32) i));
+        store(generator, param->offset, REG_BASE + i);
     }
 
-    for (i32 i = 0; i < node->body->count; ++i) {
-        visit(generator, node->body->nodes[i]);
+    for (u32 i = 0; i < body->nodes.count; ++i) {
+        visit(generator, node_view_at(&generator->ast.arena, body->nodes, i));
     }
     generator->current = current;
 
@@ -477,11 +467,11 @@ Register generate_type(Generator* generator, const NodeType* node) {
 Register generate_module(Generator* generator, const NodeModule* node) {
     Block* current = generator->current;
     generator->current = generator->ast.block;
-    for (i32 i = 0; i < node->decl_count; ++i) {
-        visit(generator, node->decls[i]);
+    for (u32 i = 0; i < node->decls.count; ++i) {
+        visit(generator, node_view_at(&generator->ast.arena, node->decls, i));
     }
-    for (i32 i = 0; i < node->stmt_count; ++i) {
-        visit(generator, node->stmts[i]);
+    for (u32 i = 0; i < node->stmts.count; ++i) {
+        visit(generator, node_view_at(&generator->ast.arena, node->stmts, i));
     }
     generator->current = current;
     return -1;
@@ -508,13 +498,15 @@ Bytecode generate_code(TypedAst ast) {
         .deferred_blocks_count = 0,
     };
 
-    Node* node = ast.start;
+    generator.visitors.arena = &generator.ast.arena;
+
+    Node* node = get_node(&generator, ast.start);
 
     if (node->kind == NodeKind_Module) {
         // Allocate space for locals
         bin_op(&generator, Instruction_Add_Imm, SP, node->module.global_count);
     }
-    visit(&generator, node);
+    visit(&generator, ast.start);
     if (node->kind == NodeKind_Module) {
         bin_op(&generator, Instruction_Add_Imm, SP, -node->module.global_count);
     }
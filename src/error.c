@@ -7,8 +7,12 @@
 
 
 void point_to_error(Logger* logger, Str source, int start, int end) {
-    Location loc_start = location_of(source.data, start);
-    Location loc_end   = location_of(source.data, end);
+    point_to_error_indexed(logger, source, (LineIndex) { NULL, 0 }, start, end);
+}
+
+void point_to_error_indexed(Logger* logger, Str source, LineIndex lines, int start, int end) {
+    Location loc_start = location_of_indexed(lines, source.data, start);
+    Location loc_end   = location_of_indexed(lines, source.data, end);
         
     int line_number_width = 0;
     int row = loc_end.row;
@@ -18,7 +22,7 @@ void point_to_error(Logger* logger, Str source, int start, int end) {
     }
 
     if (loc_start.row == loc_end.row) {
-        Str line_start = str_line_at(source, loc_start.index);
+        Str line_start = str_line_at(source, start);
         
         logger_extend(logger, LOG_LEVEL_ERROR, " %d |     ", loc_start.row);
         logger_extend(logger, LOG_LEVEL_ERROR, STR_FMT "\n", STR_ARG(line_start));
@@ -26,8 +30,8 @@ void point_to_error(Logger* logger, Str source, int start, int end) {
         logger_extend(logger, LOG_LEVEL_ERROR, " " STR_FMT " | " , line_number_width, SPACES);
         logger_extend(logger, LOG_LEVEL_ERROR, STR_FMT STR_FMT "\n", 4+loc_start.column-1, DASHES, (loc_end.column-loc_start.column), ARROWS);
     } else {
-        Str line_start = str_line_at(source, loc_start.index);
-        Str line_end   = str_line_at(source, loc_end.index);
+        Str line_start = str_line_at(source, start);
+        Str line_end   = str_line_at(source, end);
         
         logger_extend(logger, LOG_LEVEL_ERROR, " %.*d |     ", line_number_width, loc_start.row);
         logger_extend(logger, LOG_LEVEL_ERROR, STR_FMT "\n", STR_ARG(line_start));
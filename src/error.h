@@ -8,3 +8,6 @@
 
 
 void point_to_error(Logger* logger, Str source, int index, int size);
+
+/// Same as point_to_error, but looks up rows in the line index of the source.
+void point_to_error_indexed(Logger* logger, Str source, LineIndex lines, int index, int size);
@@ -1,31 +1,62 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include "allocator.h"
 #include "file.h"
+#include "os/memory.h"
 
 
-Str read_file(const char* path) {
+// Mapping costs a few system calls and page faults, which is more than reading
+// a small file takes.
+#define FILE_MAP_MIN_SIZE (64 * 1024)
+
+
+static void release_mapped(Str contents) {
+    memory_unmap_file((void*) contents.data, contents.size);
+}
+
+static void release_read(Str contents) {
+    dealloc((char*) contents.data);
+}
+
+static File read_file_into_memory(FILE* file, size_t size) {
+    char* buffer = alloc(size + 1);
+    if (!buffer)
+        return (File) { STR_EMPTY, NULL };
+
+    size_t read = fread(buffer, 1, size, file);
+    if (read != size) {
+        dealloc(buffer);
+        return (File) { STR_EMPTY, NULL };
+    }
+
+    buffer[size] = '\0';
+    return (File) { (Str) { size, buffer }, release_read };
+}
+
+File read_file(const char* path) {
     FILE* file = fopen(path, "rb");
     if (!file)
-        return STR_EMPTY;
+        return (File) { STR_EMPTY, NULL };
 
     fseek(file, 0, SEEK_END);
     size_t size = ftell(file);
     fseek(file, 0, SEEK_SET);
 
-    char* buffer = alloc(0, size + 1);
-    if (!buffer)
-        return STR_EMPTY;
+    if (size >= FILE_MAP_MIN_SIZE) {
+        size_t mapped_size = 0;
+        void*  mapped      = memory_map_file(path, &mapped_size);
+        if (mapped != NULL) {
+            fclose(file);
+            return (File) { (Str) { mapped_size, mapped }, release_mapped };
+        }
+    }
 
-    size_t read = fread(buffer, 1, size, file);
+    File result = read_file_into_memory(file, size);
     fclose(file);
+    return result;
+}
 
-    if (read != size) {
-        free(buffer);
-        return STR_EMPTY;
-    }
-
-    buffer[size] = '\0';
-    return (Str) { size, buffer };
+void file_close(File file) {
+    if (file.release != NULL)
+        file.release(file.contents);
 }
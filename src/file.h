@@ -2,4 +2,15 @@
 
 #include "str.h"
 
-Str read_file(const char* path);
+typedef void (*FileRelease)(Str contents);
+
+/// The contents of a file, always followed by a '\0' that isn't part of its size.
+/// Large files are memory mapped and small ones are read into memory, so release
+/// them with file_close.
+typedef struct {
+    Str         contents;
+    FileRelease release;
+} File;
+
+File read_file(const char* path);
+void file_close(File file);
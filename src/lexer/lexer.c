@@ -8,64 +8,417 @@
 #include "error.h"
 #include "utf8.h"
 #include "allocator.h"
+#include "scan.h"
+#include "os/thread.h"
 
 
 
 /* ---------------------------- TOKEN ARRAY -------------------------------- */
 void token_array_free(TokenArray tokens) {
     free(tokens.tokens);
-    free(tokens.identifiers);
     free(tokens.source_offsets);
+    free(tokens.payloads);
+    free(tokens.payload_bits);
+    free(tokens.payload_ranks);
     free(tokens.data_pool);
+    free(tokens.constants);
+    free(tokens.lines.starts);
+}
+
+// Returns NULL if out of memory, and for empty arrays.
+static void* copy_array(const void* data, size_t count, size_t element_size) {
+    if (count == 0)
+        return NULL;
+    void* result = alloc(0, count * element_size);
+    if (result != NULL)
+        memcpy(result, data, count * element_size);
+    return result;
+}
+
+TokenArray token_array_copy(TokenArray tokens) {
+    size_t words = tokens.size / 64 + 1;
+    TokenArray copy = tokens;
+    copy.tokens         = copy_array(tokens.tokens,         tokens.size,           sizeof(u8));
+    copy.source_offsets = copy_array(tokens.source_offsets, tokens.size,           sizeof(SourceIndex));
+    copy.payloads       = copy_array(tokens.payloads,       tokens.payload_count,  sizeof(DataPoolIndex));
+    copy.payload_bits   = copy_array(tokens.payload_bits,   words,                 sizeof(u64));
+    copy.payload_ranks  = copy_array(tokens.payload_ranks,  words,                 sizeof(TokenIndex));
+    copy.data_pool      = copy_array(tokens.data_pool,      tokens.data_pool_size, sizeof(u8));
+    copy.constants      = copy_array(tokens.constants,      tokens.constant_count, sizeof(Constant));
+    copy.lines.starts   = copy_array(tokens.lines.starts,   tokens.lines.count,    sizeof(u32));
+
+    if ((copy.tokens == NULL && tokens.size != 0) || (copy.source_offsets == NULL && tokens.size != 0) ||
+        (copy.payloads == NULL && tokens.payload_count != 0) || copy.payload_bits == NULL || copy.payload_ranks == NULL ||
+        (copy.data_pool == NULL && tokens.data_pool_size != 0) || (copy.constants == NULL && tokens.constant_count != 0) ||
+        (copy.lines.starts == NULL && tokens.lines.count != 0)) {
+        token_array_free(copy);
+        return (TokenArray) { .name = tokens.name, .source = tokens.source };
+    }
+    return copy;
+}
+
+// Builds the rank index over the token kinds, so a payload can be found
+// from its token index with one popcount. The words before `first_word` must
+// already be ranked, and the arrays must have room for size / 64 + 1 words.
+static void token_array_rank_payloads(TokenArray* tokens, size_t first_word) {
+    size_t words = tokens->size / 64 + 1;
+
+    TokenIndex rank = 0;
+    if (first_word > 0)
+        rank = tokens->payload_ranks[first_word-1] + token_popcount64(tokens->payload_bits[first_word-1]);
+
+    for (size_t word = first_word; word < words; ++word) {
+        size_t first = word * 64;
+        size_t last  = first + 64 < tokens->size ? first + 64 : tokens->size;
+
+        u64 bits = 0;
+        for (size_t i = first; i < last; ++i)
+            bits |= (u64) token_has_payload((Token) tokens->tokens[i]) << (i - first);
+
+        tokens->payload_bits[word]  = bits;
+        tokens->payload_ranks[word] = rank;
+        rank += token_popcount64(bits);
+    }
+    assert(rank == tokens->payload_count && "Every payload token must have a payload");
+}
+
+static int token_array_index_payloads(TokenArray* tokens) {
+    size_t words = tokens->size / 64 + 1;
+    tokens->payload_bits  = alloc(0, words * sizeof(u64));
+    tokens->payload_ranks = alloc(0, words * sizeof(TokenIndex));
+    if (tokens->payload_bits == NULL || tokens->payload_ranks == NULL)
+        return 0;
+
+    token_array_rank_payloads(tokens, 0);
+    return 1;
 }
 
 
 /* ---------------------------- LEXER HELPERS -------------------------------- */
+// Open-addressing table from string to its offset in the data pool.
+// Each slot caches the hash and size of its string, so probes only touch
+// the data pool when both match.
+typedef struct {
+    DataPoolIndex offset;  // 0 means the slot is empty.
+    u32           hash;
+    u32           size;
+} InternSlot;
+
 typedef struct {
-    u32*   lookup;
-    u8*    data;
-    size_t used;
+    InternSlot* slots;
+    u32         slot_count;  // Always a power of two.
+    u32         count;
+    u8*         data;
+    size_t      used;
+    size_t      capacity;
 } InternPool;
 
+#define INTERN_POOL_INITIAL_SLOTS 1024
+#define INTERN_POOL_INITIAL_BYTES 4096
+
 static InternPool intern_pool_make(void) {
+    InternSlot* slots = alloc(0, INTERN_POOL_INITIAL_SLOTS * sizeof(InternSlot));
+    if (slots != NULL)
+        memset(slots, 0, INTERN_POOL_INITIAL_SLOTS * sizeof(InternSlot));
+
     return (InternPool) {
-        .lookup = memset(alloc(0, 1024 * sizeof(u32)), 0, 1024 * sizeof(u32)),
-        .data   = (u8*) alloc(0, 1024),
-        .used   = sizeof(DataPoolIndex),  // Skip the first few bytes so that 0 from the lookup table means "not found".
+        .slots      = slots,
+        .slot_count = slots != NULL ? INTERN_POOL_INITIAL_SLOTS : 0,
+        .count      = 0,
+        .data       = (u8*) alloc(0, INTERN_POOL_INITIAL_BYTES),
+        .used       = sizeof(DataPoolIndex),  // Skip the first few bytes so that offset 0 means "empty slot".
+        .capacity   = INTERN_POOL_INITIAL_BYTES,
     };
 }
 
+// str_hash gives nearby values for strings like "a1", "a2", "a3", which would form
+// long clusters under linear probing, so the bits are mixed before use.
+static u32 intern_hash(Str string) {
+    u64 hash = str_hash(string);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return (u32) hash;
+}
+
+// Doubles the slot table and reinserts every entry using its cached hash.
+static int intern_pool_grow_slots(InternPool* intern_pool) {
+    u32 slot_count = intern_pool->slot_count * 2;
+    InternSlot* slots = alloc(0, slot_count * sizeof(InternSlot));
+    if (slots == NULL)
+        return 0;
+    memset(slots, 0, slot_count * sizeof(InternSlot));
+
+    for (u32 i = 0; i < intern_pool->slot_count; ++i) {
+        InternSlot slot = intern_pool->slots[i];
+        if (slot.offset == 0)
+            continue;
+
+        u32 index = slot.hash & (slot_count-1);
+        while (slots[index].offset != 0)
+            index = (index + 1) & (slot_count-1);
+        slots[index] = slot;
+    }
+
+    free(intern_pool->slots);
+    intern_pool->slots = slots;
+    intern_pool->slot_count = slot_count;
+    return 1;
+}
+
+static int intern_pool_reserve_bytes(InternPool* intern_pool, size_t size) {
+    size_t needed = intern_pool->used + size;
+    if (needed <= intern_pool->capacity)
+        return 1;
+    if (needed > (DataPoolIndex) -1)
+        return 0;  // Offsets would no longer fit in a DataPoolIndex.
+
+    size_t capacity = intern_pool->capacity;
+    while (capacity < needed)
+        capacity *= 2;
+
+    u8* data = alloc(0, capacity);
+    if (data == NULL)
+        return 0;
+    memcpy(data, intern_pool->data, intern_pool->used);
+    free(intern_pool->data);
+    intern_pool->data = data;
+    intern_pool->capacity = capacity;
+    return 1;
+}
+
+// Returns the offset of the interned string, or 0 if we ran out of memory.
 static DataPoolIndex intern_string(InternPool* intern_pool, Str string) {
-    u64 index  = str_hash(string) & (1024-1);
-    u32 offset = intern_pool->lookup[index];
+    u32 hash  = intern_hash(string);
+    u32 index = hash & (intern_pool->slot_count-1);
 
-    do {
-        // If the offset is 0, we have not found a match,
-        // which means that the string is not interned yet.
-        if (offset == 0) {
-            offset = intern_pool->used;
-
-            // Copy over the data and a null pointer at the end.
-            memcpy(intern_pool->data + intern_pool->used, string.data, string.size);
-            memset(intern_pool->data + intern_pool->used + string.size, '\0', 1);
-
-            intern_pool->used += string.size + 1;
-            intern_pool->lookup[index] = offset;
-            return offset;
+    while (1) {
+        InternSlot* slot = &intern_pool->slots[index];
+
+        // An empty slot means that the string is not interned yet.
+        if (slot->offset == 0)
+            break;
+
+        if (slot->hash == hash && slot->size == string.size && memcmp(intern_pool->data + slot->offset, string.data, string.size) == 0)
+            return slot->offset;
+
+        index = (index + 1) & (intern_pool->slot_count-1);
+    }
+
+    // Keep the load factor at or below 3/4 so that probe sequences stay short.
+    if (4 * ((u64) intern_pool->count + 1) > 3 * (u64) intern_pool->slot_count) {
+        if (!intern_pool_grow_slots(intern_pool))
+            return 0;
+        index = hash & (intern_pool->slot_count-1);
+        while (intern_pool->slots[index].offset != 0)
+            index = (index + 1) & (intern_pool->slot_count-1);
+    }
+
+    if (!intern_pool_reserve_bytes(intern_pool, string.size + 1))
+        return 0;
+
+    // Copy over the data and a null terminator at the end.
+    DataPoolIndex offset = (DataPoolIndex) intern_pool->used;
+    memcpy(intern_pool->data + offset, string.data, string.size);
+    intern_pool->data[offset + string.size] = '\0';
+    intern_pool->used += string.size + 1;
+
+    intern_pool->slots[index] = (InternSlot) { offset, hash, (u32) string.size };
+    intern_pool->count += 1;
+    return offset;
+}
+
+
+/* ---------------------------- CONSTANTS -------------------------------- */
+// Open-addressing table that deduplicates decoded literals by kind, value and
+// repr, so that every token's repr is its own text even though 7 and 007 have
+// the same value. Constant 0 is a placeholder, so index 0 means "empty slot"
+// like in the intern pool.
+typedef struct {
+    ConstantIndex* slots;
+    u32            slot_count;  // Always a power of two.
+    Constant*      constants;
+    u32            count;
+    u32            capacity;
+} ConstantPool;
+
+#define CONSTANT_POOL_INITIAL_SLOTS 256
+
+static ConstantPool constant_pool_make(void) {
+    ConstantIndex* slots     = alloc(0, CONSTANT_POOL_INITIAL_SLOTS * sizeof(ConstantIndex));
+    Constant*      constants = alloc(0, CONSTANT_POOL_INITIAL_SLOTS * sizeof(Constant));
+    if (slots != NULL)
+        memset(slots, 0, CONSTANT_POOL_INITIAL_SLOTS * sizeof(ConstantIndex));
+    if (constants != NULL)
+        memset(constants, 0, sizeof(Constant));
+
+    return (ConstantPool) {
+        .slots      = slots,
+        .slot_count = slots != NULL ? CONSTANT_POOL_INITIAL_SLOTS : 0,
+        .constants  = constants,
+        .count      = 1,
+        .capacity   = constants != NULL ? CONSTANT_POOL_INITIAL_SLOTS : 0,
+    };
+}
+
+// The value of a constant as raw bits. Reals compare by their bits, so 0.0
+// and -0.0 stay apart, and strings by their interned offset.
+static u64 constant_bits(Constant constant) {
+    switch (constant.kind) {
+        case ConstantKind_Real: {
+            u64 bits;
+            memcpy(&bits, &constant.as.real, sizeof(bits));
+            return bits;
         }
+        case ConstantKind_String:
+            return constant.as.string;
+        default:
+            return constant.as.integer;
+    }
+}
 
-        const char* candidate = (const char*) (intern_pool->data + offset);
-        if (strncmp(string.data, candidate, string.size) == 0) {
-            // We found a match! Returned the cached offset.
-            return offset;
-        } else {
-            // Go to the next entry in the lookup table.
-            index = (index + 1) & (1024-1);
-            offset = intern_pool->lookup[index];
+static u32 constant_hash(Constant constant) {
+    u64 hash = constant_bits(constant) ^ ((u64) constant.kind << 59) ^ ((u64) constant.repr << 27);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return (u32) hash;
+}
+
+static inline int constant_equal(Constant a, Constant b) {
+    return a.kind == b.kind && a.repr == b.repr && constant_bits(a) == constant_bits(b);
+}
+
+static int constant_pool_grow_slots(ConstantPool* pool) {
+    u32 slot_count = pool->slot_count * 2;
+    ConstantIndex* slots = alloc(0, slot_count * sizeof(ConstantIndex));
+    if (slots == NULL)
+        return 0;
+    memset(slots, 0, slot_count * sizeof(ConstantIndex));
+
+    for (ConstantIndex i = 1; i < pool->count; ++i) {
+        u32 index = constant_hash(pool->constants[i]) & (slot_count-1);
+        while (slots[index] != 0)
+            index = (index + 1) & (slot_count-1);
+        slots[index] = i;
+    }
+
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_count = slot_count;
+    return 1;
+}
+
+// Returns the index of the constant equal to the given one, adding it if there
+// is none, or 0 if we ran out of memory.
+static ConstantIndex constant_pool_add(ConstantPool* pool, Constant constant) {
+    u32 hash  = constant_hash(constant);
+    u32 index = hash & (pool->slot_count-1);
+
+    while (pool->slots[index] != 0) {
+        if (constant_equal(pool->constants[pool->slots[index]], constant))
+            return pool->slots[index];
+        index = (index + 1) & (pool->slot_count-1);
+    }
+
+    if (4 * ((u64) pool->count + 1) > 3 * (u64) pool->slot_count) {
+        if (!constant_pool_grow_slots(pool))
+            return 0;
+        index = hash & (pool->slot_count-1);
+        while (pool->slots[index] != 0)
+            index = (index + 1) & (pool->slot_count-1);
+    }
+
+    if (pool->count == pool->capacity) {
+        Constant* constants = grow_array(pool->constants, pool->count, 2 * (size_t) pool->capacity, sizeof(Constant));
+        if (constants == NULL)
+            return 0;
+        pool->constants = constants;
+        pool->capacity *= 2;
+    }
+
+    ConstantIndex result = pool->count++;
+    pool->constants[result] = constant;
+    pool->slots[index] = result;
+    return result;
+}
+
+// Exact powers of ten, for decoding reals without strtod.
+static const f64 POWERS_OF_TEN[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Returns 0 if the integer doesn't fit in an i64.
+static int decode_integer(Str digits, u64* value) {
+    u64 result = 0;
+    for (size_t i = 0; i < digits.size; ++i) {
+        u64 digit = (u64) (digits.data[i] - '0');
+        if (result > ((u64) INT64_MAX - digit) / 10)
+            return 0;
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return 1;
+}
+
+// When all digits fit in the 53 bits of a double's mantissa and the power of
+// ten is exact, one division rounds correctly, the same as strtod. Anything
+// else goes through strtod. `repr` must be null-terminated.
+static f64 decode_real(Str repr) {
+    u64 mantissa = 0;
+    int digits   = 0;
+    int decimals = -1;
+    for (size_t i = 0; i < repr.size; ++i) {
+        if (repr.data[i] == '.') {
+            decimals = 0;
+            continue;
+        }
+        if (mantissa == 0 && repr.data[i] == '0') {
+            decimals += (decimals >= 0);
+            continue;
+        }
+        mantissa = mantissa * 10 + (u64) (repr.data[i] - '0');
+        digits   += 1;
+        decimals += (decimals >= 0);
+        if (digits > 15)
+            return strtod(repr.data, NULL);
+    }
+
+    if (decimals < 0)
+        decimals = 0;
+    if (decimals >= (int) (sizeof(POWERS_OF_TEN) / sizeof(*POWERS_OF_TEN)))
+        return strtod(repr.data, NULL);
+    return (f64) mantissa / POWERS_OF_TEN[decimals];
+}
+
+// Replaces the escape sequences of a string literal. Returns the size of the
+// unescaped string, or -1 and the offset of the bad sequence in `error`.
+static long unescape_string(Str string, char* out, size_t* error) {
+    size_t size = 0;
+    for (size_t i = 0; i < string.size; ++i) {
+        char c = string.data[i];
+        if (c != '\\') {
+            out[size++] = c;
+            continue;
+        }
+
+        switch (i + 1 < string.size ? string.data[i+1] : '\0') {
+            case 'n':  out[size++] = '\n'; break;
+            case 't':  out[size++] = '\t'; break;
+            case 'r':  out[size++] = '\r'; break;
+            case '"':  out[size++] = '"';  break;
+            case '\\': out[size++] = '\\'; break;
+            default:
+                *error = i;
+                return -1;
         }
-    } while (1);
+        i += 1;
+    }
+    return (long) size;
 }
 
+
 static inline int is_identifier_start(char c) {
     return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
 }
@@ -74,65 +427,166 @@ static inline int is_identifier_continue(char c) {
     return is_identifier_start(c) || is_digit(c);
 }
 
+static inline int is_whitespace_byte(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
 
 /* ---------------------------- LEXER IMPL -------------------------------- */
 typedef struct {
     Str source;
+    const char*    end;   // source.data + source.size, always points at '\0'.
+    const Scanner* scan;
 
     size_t          count;
-    Token*          tokens;
-    DataPoolIndex*  identifiers;
+    size_t          capacity;
+    u8*             tokens;
     SourceIndex*    indices;
 
-    InternPool intern_pool;
+    size_t          payload_count;
+    size_t          payload_capacity;
+    DataPoolIndex*  payloads;
+
+    InternPool   intern_pool;
+    ConstantPool constant_pool;
+    LineIndex    lines;
+    size_t       line_capacity;
+
+    // Where strings with escape sequences are unescaped before they're interned.
+    char*  scratch;
+    size_t scratch_capacity;
+
+    // Chunks of a parallel lex don't report errors. Any error in a chunk makes
+    // the whole source get lexed serially, which reports them.
+    int is_chunk;
+    int failed;
+    Logger* logger;  // NULL for chunks.
 } Lexer;
 
 static void lexer_free(Lexer* lexer) {
     free(lexer->tokens);
-    free(lexer->identifiers);
     free(lexer->indices);
-    free(lexer->intern_pool.lookup);
+    free(lexer->payloads);
+    free(lexer->intern_pool.slots);
     free(lexer->intern_pool.data);
+    free(lexer->constant_pool.slots);
+    free(lexer->constant_pool.constants);
+    free(lexer->lines.starts);
+    free(lexer->scratch);
+}
+
+// Most sources average well above 4 bytes per token (identifiers, whitespace
+// and comments), so this covers the common case with a single allocation.
+// Every token except Eof consumes at least one byte, so size + 1 is a hard upper bound.
+static size_t lexer_estimate_capacity(size_t source_size) {
+    size_t estimate = source_size / 4 + 64;
+    return estimate < source_size + 1 ? estimate : source_size + 1;
+}
+
+static int lexer_reserve(Lexer* lexer, size_t capacity) {
+    u8* tokens = grow_array(lexer->tokens, lexer->count, capacity, sizeof(u8));
+    if (tokens == NULL)
+        return 0;
+    lexer->tokens = tokens;
+
+    SourceIndex* indices = grow_array(lexer->indices, lexer->count, capacity, sizeof(SourceIndex));
+    if (indices == NULL)
+        return 0;
+    lexer->indices = indices;
+
+    lexer->capacity = capacity;
+    return 1;
+}
+
+// Grows geometrically, but never past the upper bound of one token per source byte.
+static int lexer_grow(Lexer* lexer) {
+    size_t capacity = lexer->capacity == 0 ? 64 : 2 * lexer->capacity;
+    if (capacity > lexer->source.size + 1)
+        capacity = lexer->source.size + 1;
+    if (capacity <= lexer->count)
+        capacity = lexer->count + 1;
+    return lexer_reserve(lexer, capacity);
+}
+
+// Roughly a third of the tokens in typical code are identifiers or literals.
+static int lexer_grow_payloads(Lexer* lexer) {
+    size_t capacity = lexer->payload_capacity == 0 ? lexer->capacity / 2 + 16 : 2 * lexer->payload_capacity;
+    DataPoolIndex* payloads = grow_array(lexer->payloads, lexer->payload_count, capacity, sizeof(DataPoolIndex));
+    if (payloads == NULL)
+        return 0;
+    lexer->payloads = payloads;
+    lexer->payload_capacity = capacity;
+    return 1;
 }
 
 static TokenArray lexer_to_token_array(Lexer* lexer, Str name) {
-    free(lexer->intern_pool.lookup);
+    free(lexer->intern_pool.slots);
+    free(lexer->constant_pool.slots);
+    free(lexer->scratch);
     return (TokenArray) {
             .name        = name,
             .source      = lexer->source,
             .tokens      = lexer->tokens,
-            .identifiers = lexer->identifiers,
             .source_offsets = lexer->indices,
             .size        = lexer->count,
+            .payloads    = lexer->payloads,
+            .payload_count = (TokenIndex) lexer->payload_count,
             .data_pool   = lexer->intern_pool.data,
-            .data_pool_size = lexer->intern_pool.used
+            .data_pool_size = lexer->intern_pool.used,
+            .constants   = lexer->constant_pool.constants,
+            .constant_count = lexer->constant_pool.count,
+            .lines       = lexer->lines,
     };
 }
 
-static Str parse_identifier(const char* source) {
+// Records where every line starts, up to the '\0' that ends the source.
+// Lines that start after `from` are indexed again, the ones before are kept.
+static int lexer_index_lines(Lexer* lexer, size_t from) {
+    if (lexer->lines.starts == NULL) {
+        lexer->line_capacity = lexer->source.size / 32 + 16;
+        lexer->lines.starts  = alloc(0, lexer->line_capacity * sizeof(u32));
+        if (lexer->lines.starts == NULL)
+            return 0;
+        lexer->lines.starts[0] = 0;
+        lexer->lines.count = 1;
+    }
+    while (lexer->lines.count > 1 && lexer->lines.starts[lexer->lines.count-1] > from)
+        lexer->lines.count -= 1;
+
+    const char* current = lexer->source.data + from;
+    while (1) {
+        current = lexer->scan->find_line_end(current, lexer->end);
+        if (current == lexer->end || *current == '\0')
+            break;
+        current += 1;
+
+        if (lexer->lines.count == lexer->line_capacity) {
+            u32* grown = grow_array(lexer->lines.starts, lexer->lines.count, 2 * lexer->line_capacity, sizeof(u32));
+            if (grown == NULL)
+                return 0;
+            lexer->lines.starts = grown;
+            lexer->line_capacity *= 2;
+        }
+        lexer->lines.starts[lexer->lines.count++] = (u32) (current - lexer->source.data);
+    }
+    return 1;
+}
+
+static Str parse_identifier(Lexer* lexer, const char* source) {
     assert(is_identifier_start(*source) && "Expected a start of identifier");
     const char* start = source;
-    do {
-        ++source;
-    } while (is_identifier_continue(*source));
-    const char* end = source;
+    const char* end   = lexer->scan->skip_identifier(source + 1, lexer->end);
 
     return (Str) { (size_t)(end-start), start };
 }
 
-static Str parse_number(const char* source, Token* token) {
+static Str parse_number(Lexer* lexer, const char* source, Token* token) {
     assert(is_digit(*source) && "Expected a digit");
     const char* start = source;
-    do {
-        ++source;
-    } while (is_digit(*source));
-    const char* end = source;
+    const char* end   = lexer->scan->skip_digits(source + 1, lexer->end);
 
-    if (*source == '.') {
-        do {
-            ++source;
-        } while (is_digit(*source));
-        end = source;
+    if (*end == '.') {
+        end = lexer->scan->skip_digits(end + 1, lexer->end);
         *token = Token_Real;
         return (Str) { (size_t)(end-start), start };
     }
@@ -141,55 +595,102 @@ static Str parse_number(const char* source, Token* token) {
     return (Str) { (size_t)(end-start), start };
 }
 
-static Str parse_string(const char* source, int* is_valid) {
+// Interns the unescaped string. Returns 0 on a bad escape sequence, which is
+// reported, and -1 if we ran out of memory.
+static int decode_string(Lexer* lexer, Str name, Str string, DataPoolIndex* result) {
+    // Most strings have nothing to unescape.
+    if (memchr(string.data, '\\', string.size) == NULL) {
+        *result = intern_string(&lexer->intern_pool, string);
+        return *result != 0 ? 1 : -1;
+    }
+
+    if (string.size > lexer->scratch_capacity) {
+        size_t capacity = lexer->scratch_capacity == 0 ? 256 : 2 * lexer->scratch_capacity;
+        while (capacity < string.size)
+            capacity *= 2;
+
+        char* scratch = alloc(0, capacity);
+        if (scratch == NULL)
+            return -1;
+        free(lexer->scratch);
+        lexer->scratch = scratch;
+        lexer->scratch_capacity = capacity;
+    }
+
+    size_t error = 0;
+    long   size  = unescape_string(string, lexer->scratch, &error);
+    if (size < 0) {
+        if (!lexer->is_chunk) {
+            fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Unknown escape sequence in string literal.\n", STR_ARG(name));
+            int start = (int)(string.data + error - lexer->source.data);
+            point_to_error(lexer->logger, lexer->source, start, start+2);
+        }
+        return 0;
+    }
+
+    *result = intern_string(&lexer->intern_pool, (Str) { (size_t) size, lexer->scratch });
+    return *result != 0 ? 1 : -1;
+}
+
+// Escapes pair up from the left, each backslash taking the byte after it, so
+// the quote is escaped only if an odd run of backslashes comes right before it.
+static int is_escaped_quote(const char* first, const char* quote) {
+    const char* current = quote;
+    while (current > first && *(current-1) == '\\')
+        --current;
+    return (quote - current) % 2 == 1;
+}
+
+static Str parse_string(Lexer* lexer, const char* source, int* is_valid) {
     assert(*source == '"' && "Expected a quote");
-    // Skip the first quote.
-    const char* start = source + 1;
-    continue_parsing:;
+    const char* start = source;
     do {
-        ++source;
-    } while (*source != '"' && *source != '\0');
+        source = lexer->scan->find_quote(source + 1, lexer->end);
+    } while (*source == '"' && is_escaped_quote(start + 1, source));
     const char* end = source;
 
     if (*source == '"') {
-        if (*(source-1) == '\\')  // Quote is escaped.
-            goto continue_parsing;
-
-        ++source;
         *is_valid = 1;
-        return (Str) { (size_t)(end-start), start };
+        return (Str) { (size_t)(end-start-1), start+1 };
     } else {
-        fprintf(stderr, "[Error] (Lexer) Unterminated string literal.\n");
-        size_t length = (size_t)(end-start);
-        point_to_error((Str) { length, start }, 0, length);
+        if (!lexer->is_chunk) {
+            fprintf(stderr, "[Error] (Lexer) Unterminated string literal.\n");
+            size_t length = (size_t)(end-start-1);
+            point_to_error(lexer->logger, (Str) { length, start+1 }, 0, length);
+        }
         *is_valid = 0;
         return STR_EMPTY;
     }
 }
 
-static const char* parse_line_comment(const char* source) {
+static const char* parse_line_comment(Lexer* lexer, const char* source) {
     assert(*source == '/' && *(source+1) == '/' && "Expected a line comment");
-    while (*source != '\n' && *source != '\0')
-        ++source;
-    return source;
+    return lexer->scan->find_line_end(source + 2, lexer->end);
 }
 
-static const char* parse_block_comment(const char* source) {
+static const char* parse_block_comment(Lexer* lexer, const char* source) {
     assert(*source == '/' && *(source+1) == '*' && "Expected a block comment");
     source += 2;
 
-    while (*source != '\0' && !(*source == '*' && *(source+1) == '/')) {
-        if (*source == '/' && *(source+1) == '*') {
-            source = parse_block_comment(source);
+    while (1) {
+        // Jump straight to the next character that could open or close a comment.
+        source = lexer->scan->find_comment_delimiter(source, lexer->end);
+        if (source == lexer->end || *source == '\0')
+            break;
+
+        if (*source == '*' && *(source+1) == '/') {
+            return source + 2;
+        } else if (*source == '/' && *(source+1) == '*') {
+            source = parse_block_comment(lexer, source);
         } else {
             ++source;
         }
     }
-    if (*source == '\0') {
+
+    lexer->failed = 1;
+    if (!lexer->is_chunk) {
         fprintf(stderr, "[Error] (Lexer) Unterminated block comment.\n");
-        point_to_error((Str) { 2, source-2 }, 0, 2);
-    } else {
-        source += 2;
+        point_to_error(lexer->logger, (Str) { 2, source-2 }, 0, 2);
     }
     return source;
 }
@@ -197,42 +698,113 @@ static const char* parse_block_comment(const char* source) {
 
 static inline int add_single_token(Lexer* lexer, const char* current, Token token) {
     lexer->indices[lexer->count] = current - lexer->source.data;
-    lexer->tokens[lexer->count++] = (Token) { token };
+    lexer->tokens[lexer->count++] = (u8) token;
     return 1;
 }
 
 static inline int add_double_token(Lexer* lexer, const char* current, Token token) {
     lexer->indices[lexer->count] = current - lexer->source.data;
-    lexer->tokens[lexer->count++] = (Token) { token };
+    lexer->tokens[lexer->count++] = (u8) token;
     return 2;
 }
 
+// Returns the width of the identifier, or -1 if it couldn't be interned.
 static inline int add_token_with_identifier(Lexer* lexer, const char* current, Token token, Str identifier) {
     DataPoolIndex ident = intern_string(&lexer->intern_pool, identifier);
+    if (ident == 0)
+        return -1;
+    if (lexer->payload_count == lexer->payload_capacity && !lexer_grow_payloads(lexer))
+        return -1;
     lexer->indices[lexer->count] = current - lexer->source.data;
-    lexer->identifiers[lexer->count] = ident;
-    lexer->tokens[lexer->count++] = (Token) { token };
+    lexer->payloads[lexer->payload_count++] = ident;
+    lexer->tokens[lexer->count++] = (u8) token;
     return (int) identifier.size;
 }
 
-static Token token_from_string(Str string) {
-    if (str_equals(string, STR("if")))     return Token_If;
-    if (str_equals(string, STR("else")))   return Token_Else;
-    if (str_equals(string, STR("fun")))    return Token_Fun;
-    if (str_equals(string, STR("while")))  return Token_While;
-    if (str_equals(string, STR("return"))) return Token_Return;
+// Returns the width of the literal, or -1 if it couldn't be added. Integers and
+// strings come decoded, reals are decoded from their interned repr.
+static inline int add_constant_token(Lexer* lexer, const char* current, Token token, Str repr, Constant constant) {
+    constant.repr = intern_string(&lexer->intern_pool, repr);
+    if (constant.repr == 0)
+        return -1;
+    if (constant.kind == ConstantKind_Real)
+        constant.as.real = decode_real((Str) { repr.size, (const char*) lexer->intern_pool.data + constant.repr });
+
+    ConstantIndex index = constant_pool_add(&lexer->constant_pool, constant);
+    if (index == 0)
+        return -1;
+    if (lexer->payload_count == lexer->payload_capacity && !lexer_grow_payloads(lexer))
+        return -1;
+    lexer->indices[lexer->count] = current - lexer->source.data;
+    lexer->payloads[lexer->payload_count++] = index;
+    lexer->tokens[lexer->count++] = (u8) token;
+    return (int) repr.size;
+}
+
+static inline int add_keyword_token(Lexer* lexer, const char* current, Token token, Str keyword) {
+    lexer->indices[lexer->count] = current - lexer->source.data;
+    lexer->tokens[lexer->count++] = (u8) token;  // Keywords get their repr from the token itself.
+    return (int) keyword.size;
+}
+
+
+/* ---------------------------- KEYWORDS -------------------------------- */
+// Every keyword in ALL_TOKENS has a unique slot given by its length and its first and
+// last character, so classifying an identifier is one table load and one memcmp.
+// If a new keyword collides, keyword_table_build fails on the first lex, in every
+// build, and the constants need changing.
+#define KEYWORD_TABLE_SIZE 32
+#define KEYWORD_HASH(size, first, last) ((8 * (u32) (size) + (u8) (first) + (u8) (last)) & (KEYWORD_TABLE_SIZE-1))
+
+typedef struct {
+    const char* repr;
+    u32         size;  // 0 for an empty slot.
+    Token       token;
+} KeywordSlot;
+
+static KeywordSlot KEYWORD_TABLE[KEYWORD_TABLE_SIZE];
+static ThreadOnce  keyword_table_once;
+
+// The slot of a keyword depends on the characters of its repr, which C can't index
+// in a constant expression, so the table is filled from ALL_TOKENS on first use.
+static void keyword_table_build(void) {
+    for (int token = 0; token <= TOKEN_LAST; ++token) {
+        if (!(token_group((Token) token) & TokenGroup_Keyword))
+            continue;
+
+        Str keyword = str_from_c_str(token_repr((Token) token));
+        u32 hash = KEYWORD_HASH(keyword.size, keyword.data[0], keyword.data[keyword.size-1]);
+        if (KEYWORD_TABLE[hash].size != 0) {
+            fprintf(stderr, "[Error] (Lexer) Keywords '%s' and '%s' share a slot, change KEYWORD_HASH\n", KEYWORD_TABLE[hash].repr, keyword.data);
+            abort();
+        }
+        KEYWORD_TABLE[hash] = (KeywordSlot) { keyword.data, (u32) keyword.size, (Token) token };
+    }
+}
+
+// Lexers may start on several threads at once.
+static void keyword_table_init(void) {
+    thread_once(&keyword_table_once, keyword_table_build);
+}
 
+static inline Token token_from_string(Str string) {
+    KeywordSlot slot = KEYWORD_TABLE[KEYWORD_HASH(string.size, string.data[0], string.data[string.size-1])];
+    if (slot.size == string.size && memcmp(slot.repr, string.data, string.size) == 0)
+        return slot.token;
     return Token_Identifier;
 }
 
 const char* lexer_repr_of(TokenArray tokens, TokenIndex id) {
-    Token token = tokens.tokens[id];
+    Token token = (Token) tokens.tokens[id];
     switch (token) {
         case Token_Number:
         case Token_Real:
-        case Token_String:
+        case Token_String: {
+            size_t offset = token_array_constant(tokens, id).repr;
+            return (const char*) &tokens.data_pool[offset];
+        }
         case Token_Identifier: {
-            size_t offset = tokens.identifiers[id];
+            size_t offset = token_array_payload(tokens, id);
             return (const char*) &tokens.data_pool[offset];
         }
         default: {
@@ -242,127 +814,645 @@ const char* lexer_repr_of(TokenArray tokens, TokenIndex id) {
 }
 
 
-TokenArray lexer_lex(Str name, Str source) {
-    Lexer lexer =  {
+static Lexer lexer_make(Str source, int is_chunk, Logger* logger) {
+    return (Lexer) {
         .source = source,
+        .end    = source.data + source.size,
+        .scan   = scanner_get(),
         .count  = 0,
-        .tokens = (Token*) alloc(0, 1024 * sizeof(Token)),
-        .identifiers = (DataPoolIndex*) alloc(0, 1024 * sizeof(DataPoolIndex)),
-        .indices = (SourceIndex*) alloc(0, 1024 * sizeof(SourceIndex)),
-        .intern_pool = intern_pool_make()
+        .capacity = 0,
+        .tokens = NULL,
+        .indices = NULL,
+        .payload_count = 0,
+        .payload_capacity = 0,
+        .payloads = NULL,
+        .intern_pool = intern_pool_make(),
+        .constant_pool = constant_pool_make(),
+        .is_chunk = is_chunk,
+        .failed = 0,
+        .logger = logger,
     };
+}
 
-    const char* current = source.data;
+// Lexes the whole source into the lexer. Returns 0 on errors, which are
+// printed unless the lexer is a chunk.
+static int lexer_run(Lexer* lexer, Str name, size_t from) {
+    size_t estimate = lexer_estimate_capacity(lexer->source.size);
+    if (lexer->intern_pool.slots == NULL || lexer->intern_pool.data == NULL || lexer->constant_pool.slots == NULL || lexer->constant_pool.constants == NULL || (lexer->capacity == 0 && !lexer_reserve(lexer, estimate))) {
+        if (!lexer->is_chunk)
+            fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while allocating tokens.\n", STR_ARG(name));
+        return 0;
+    }
+
+    const char* current = lexer->source.data + from;
     while (1) {
+        // Each iteration adds at most one token.
+        if (lexer->count == lexer->capacity && !lexer_grow(lexer)) {
+            if (!lexer->is_chunk)
+                fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while growing tokens to %zu.\n", STR_ARG(name), 2 * lexer->capacity);
+            return 0;
+        }
+
         switch (*current) {
             case '\0': {
-                add_single_token(&lexer, current, Token_Eof);
-                return lexer_to_token_array(&lexer, name);
+                add_single_token(lexer, current, Token_Eof);
+                return !(lexer->is_chunk && lexer->failed);
             } break;
             case '\n':
             case '\t':
             case '\r':
             case ' ':
-                current += 1;  // Skip whitespace.
+                // Most whitespace is a single space between tokens, so only call the kernel for runs.
+                current += 1;
+                if (is_whitespace_byte(*current))
+                    current = lexer->scan->skip_whitespace(current, lexer->end);
             break;
             case '+': {
-                current += add_single_token(&lexer, current, Token_Plus);
+                current += add_single_token(lexer, current, Token_Plus);
             } break;
             case '-': {
-                current += add_single_token(&lexer, current, Token_Minus);
+                current += add_single_token(lexer, current, Token_Minus);
             } break;
             case '*': {
-                current += add_single_token(&lexer, current, Token_Asterisk);
+                current += add_single_token(lexer, current, Token_Asterisk);
             } break;
             case '/': {
                 if (*(current+1) == '/') {
-                    current = parse_line_comment(current);
+                    current = parse_line_comment(lexer, current);
                 } else if (*(current+1) == '*') {
-                    current = parse_block_comment(current);
+                    current = parse_block_comment(lexer, current);
                 } else {
-                    current += add_single_token(&lexer, current, Token_Slash);
+                    current += add_single_token(lexer, current, Token_Slash);
                 }
             } break;
             case '%': {
-                current += add_single_token(&lexer, current, Token_Percent);
+                current += add_single_token(lexer, current, Token_Percent);
             } break;
             case '>': {
                 if (*(current+1) == '=')
-                    current += add_double_token(&lexer, current, Token_Greater_Equal);
+                    current += add_double_token(lexer, current, Token_Greater_Equal);
                 else
-                    current += add_single_token(&lexer, current, Token_Greater);
+                    current += add_single_token(lexer, current, Token_Greater);
             } break;
             case ':': {
                 if (*(current+1) == '=')
-                    current += add_double_token(&lexer, current, Token_Colon_Equal);
+                    current += add_double_token(lexer, current, Token_Colon_Equal);
                 else
-                    current += add_single_token(&lexer, current, Token_Colon);
+                    current += add_single_token(lexer, current, Token_Colon);
             } break;
             case '=': {
                 if (*(current+1) == '=')
-                    current += add_double_token(&lexer, current, Token_Equal_Equal);
+                    current += add_double_token(lexer, current, Token_Equal_Equal);
                 else
-                    current += add_single_token(&lexer, current, Token_Equal);
+                    current += add_single_token(lexer, current, Token_Equal);
             } break;
             case '!': {
                 if (*(current+1) == '=')
-                    current += add_double_token(&lexer, current, Token_Bang_Equal);
+                    current += add_double_token(lexer, current, Token_Bang_Equal);
                 else
-                    current += add_single_token(&lexer, current, Token_Bang);
+                    current += add_single_token(lexer, current, Token_Bang);
             } break;
             case '<': {
                 if (*(current+1) == '=')
-                    current += add_double_token(&lexer, current, Token_Less_Equal);
+                    current += add_double_token(lexer, current, Token_Less_Equal);
                 else
-                    current += add_single_token(&lexer, current, Token_Less);
+                    current += add_single_token(lexer, current, Token_Less);
             } break;
             case '(': {
-                current += add_single_token(&lexer, current, Token_Open_Paren);
+                current += add_single_token(lexer, current, Token_Open_Paren);
             } break;
             case ')': {
-                current += add_single_token(&lexer, current, Token_Close_Paren);
+                current += add_single_token(lexer, current, Token_Close_Paren);
             } break;
             case '{': {
-                current += add_single_token(&lexer, current, Token_Open_Brace);
+                current += add_single_token(lexer, current, Token_Open_Brace);
             } break;
             case '}': {
-                current += add_single_token(&lexer, current, Token_Close_Brace);
+                current += add_single_token(lexer, current, Token_Close_Brace);
             } break;
             case ',': {
-                current += add_single_token(&lexer, current, Token_Comma);
+                current += add_single_token(lexer, current, Token_Comma);
             } break;
             case '"': {
                 int is_valid = 0;
-                Str string = parse_string(current, &is_valid);
-                if (!is_valid) {
-                    lexer_free(&lexer);
-                    return (TokenArray) { name, source, NULL, NULL, NULL, 0, NULL, 0 };
-                }
+                Str string = parse_string(lexer, current, &is_valid);
+                if (!is_valid)
+                    return 0;
+
+                Constant constant = { .kind = ConstantKind_String };
+                int decoded = decode_string(lexer, name, string, &constant.as.string);
+                if (decoded == 0)
+                    return 0;
+                if (decoded < 0)
+                    goto out_of_memory;
+
                 // current + 1 to skip the first quote.
-                current += add_token_with_identifier(&lexer, current+1, Token_String, string) + 2;
+                int width = add_constant_token(lexer, current+1, Token_String, string, constant);
+                if (width < 0)
+                    goto out_of_memory;
+                current += width + 2;
             } break;
             default: {
                 if (is_digit(*current)) {
                     Token token;
-                    Str string = parse_number(current, &token);
-                    current += add_token_with_identifier(&lexer, current, token, string);
+                    Str string = parse_number(lexer, current, &token);
+
+                    Constant constant = { .kind = (token == Token_Real) ? ConstantKind_Real : ConstantKind_Integer };
+                    if (token == Token_Number && !decode_integer(string, &constant.as.integer)) {
+                        if (!lexer->is_chunk) {
+                            fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Integer literal is too large: '" STR_FMT "'\n", STR_ARG(name), STR_ARG(string));
+                            int start = (int)(current - lexer->source.data);
+                            point_to_error(lexer->logger, lexer->source, start, start+(int)string.size);
+                        }
+                        return 0;
+                    }
+
+                    int width = add_constant_token(lexer, current, token, string, constant);
+                    if (width < 0)
+                        goto out_of_memory;
+                    current += width;
                 } else if (is_identifier_start(*current)) {
-                    Str string = parse_identifier(current);
+                    Str string = parse_identifier(lexer, current);
                     Token keyword_or_ident = token_from_string(string);
-                    current += add_token_with_identifier(&lexer, current, keyword_or_ident, string);
+                    if (keyword_or_ident != Token_Identifier) {
+                        current += add_keyword_token(lexer, current, keyword_or_ident, string);
+                    } else {
+                        int width = add_token_with_identifier(lexer, current, Token_Identifier, string);
+                        if (width < 0)
+                            goto out_of_memory;
+                        current += width;
+                    }
                 } else {
                     int width = multi_byte_count(*current);
                     if (width == 0) width = 1;
-                    fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Unknown character: '" STR_FMT "'\n", STR_ARG(name), width, current);
+                    if (!lexer->is_chunk) {
+                        fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Unknown character: '" STR_FMT "'\n", STR_ARG(name), width, current);
 
-                    // Assume all characters only take up one column in the terminal for now.
-                    int start = (int)(current - source.data);
-                    point_to_error(source, start, start+width);
-                    lexer_free(&lexer);
-                    return (TokenArray) { name, source, NULL, NULL, NULL, 0, NULL, 0 };
+                        // Assume all characters only take up one column in the terminal for now.
+                        int start = (int)(current - lexer->source.data);
+                        point_to_error(lexer->logger, lexer->source, start, start+width);
+                    }
+                    return 0;
                 }
             } break;
         }
     }
+
+    out_of_memory:
+    if (!lexer->is_chunk)
+        fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while interning strings (%zu bytes used).\n", STR_ARG(name), lexer->intern_pool.used);
+    return 0;
+}
+
+
+static TokenArray lexer_lex_whole(Str name, Str source, Logger* logger) {
+    Lexer lexer = lexer_make(source, 0, logger);
+    if (!lexer_run(&lexer, name, 0)) {
+        lexer_free(&lexer);
+        return (TokenArray) { .name = name, .source = source };
+    }
+    if (!lexer_index_lines(&lexer, 0)) {
+        fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while indexing lines.\n", STR_ARG(name));
+        lexer_free(&lexer);
+        return (TokenArray) { .name = name, .source = source };
+    }
+
+    TokenArray result = lexer_to_token_array(&lexer, name);
+    if (!token_array_index_payloads(&result)) {
+        fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while indexing payloads.\n", STR_ARG(name));
+        token_array_free(result);
+        return (TokenArray) { .name = name, .source = source };
+    }
+    return result;
+}
+
+TokenArray lexer_lex(Str name, Str source, Logger* logger) {
+    keyword_table_init();
+    return lexer_lex_whole(name, source, logger);
+}
+
+
+/* ---------------------------- INCREMENTAL LEXER -------------------------------- */
+// Appended text may continue the last token, or a comment after it, so an append
+// drops the last token and the Eof after it and lexes again from where the last
+// token starts. Everything before it stays as it is.
+typedef struct {
+    size_t source_size;
+    size_t count;          // Tokens before the last one.
+    size_t payload_count;  // Payloads of those tokens.
+    size_t from;           // Where the last token starts.
+} IncrementalCheckpoint;
+
+struct IncrementalLexer {
+    Str    name;
+    char*  buffer;  // The source, always followed by '\0'.
+    size_t size;
+    size_t capacity;
+    Lexer  lexer;
+
+    u64*        payload_bits;
+    TokenIndex* payload_ranks;
+    size_t      word_capacity;
+
+    // The intern and constant pools only grow. Strings and constants of a rolled
+    // back append stay in them unused, which doesn't change how anything is lexed.
+    IncrementalCheckpoint current;
+    IncrementalCheckpoint committed;
+};
+
+IncrementalLexer* lexer_incremental_make(Str name) {
+    keyword_table_init();
+
+    IncrementalLexer* incremental = alloc(0, sizeof(IncrementalLexer));
+    char* buffer = alloc(0, 256);
+    if (incremental == NULL || buffer == NULL) {
+        free(incremental);
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[0] = '\0';
+    *incremental = (IncrementalLexer) {
+        .name     = name,
+        .buffer   = buffer,
+        .size     = 0,
+        .capacity = 256,
+        .lexer    = lexer_make((Str) { 0, buffer }, 0, NULL),
+    };
+    return incremental;
+}
+
+void lexer_incremental_free(IncrementalLexer* incremental) {
+    lexer_free(&incremental->lexer);
+    free(incremental->buffer);
+    free(incremental->payload_bits);
+    free(incremental->payload_ranks);
+    free(incremental);
+}
+
+static int lexer_incremental_reserve_words(IncrementalLexer* incremental, size_t words) {
+    if (words <= incremental->word_capacity)
+        return 1;
+
+    size_t capacity = incremental->word_capacity == 0 ? 64 : 2 * incremental->word_capacity;
+    if (capacity < words)
+        capacity = words;
+
+    u64* bits = grow_array(incremental->payload_bits, incremental->word_capacity, capacity, sizeof(u64));
+    if (bits == NULL)
+        return 0;
+    incremental->payload_bits = bits;
+
+    TokenIndex* ranks = grow_array(incremental->payload_ranks, incremental->word_capacity, capacity, sizeof(TokenIndex));
+    if (ranks == NULL)
+        return 0;
+    incremental->payload_ranks = ranks;
+
+    incremental->word_capacity = capacity;
+    return 1;
+}
+
+// Lexes the source again from the current checkpoint on.
+static TokenArray lexer_incremental_relex(IncrementalLexer* incremental) {
+    Lexer* lexer = &incremental->lexer;
+    lexer->source = (Str) { incremental->size, incremental->buffer };
+    lexer->end    = incremental->buffer + incremental->size;
+
+    IncrementalCheckpoint resume = incremental->current;
+    lexer->count         = resume.count;
+    lexer->payload_count = resume.payload_count;
+
+    TokenArray failed = { .name = incremental->name, .source = lexer->source };
+    if (!lexer_run(lexer, incremental->name, resume.from))
+        return failed;
+    if (!lexer_index_lines(lexer, resume.from) || !lexer_incremental_reserve_words(incremental, lexer->count / 64 + 1)) {
+        fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while indexing lines.\n", STR_ARG(incremental->name));
+        return failed;
+    }
+
+    TokenArray result = {
+        .name           = incremental->name,
+        .source         = lexer->source,
+        .tokens         = lexer->tokens,
+        .source_offsets = lexer->indices,
+        .size           = (TokenIndex) lexer->count,
+        .payloads       = lexer->payloads,
+        .payload_count  = (TokenIndex) lexer->payload_count,
+        .payload_bits   = incremental->payload_bits,
+        .payload_ranks  = incremental->payload_ranks,
+        .data_pool      = lexer->intern_pool.data,
+        .data_pool_size = lexer->intern_pool.used,
+        .constants      = lexer->constant_pool.constants,
+        .constant_count = lexer->constant_pool.count,
+        .lines          = lexer->lines,
+    };
+    token_array_rank_payloads(&result, resume.count / 64);
+
+    // The next append starts at the last token. A string token starts after its quote.
+    IncrementalCheckpoint next = { incremental->size, 0, 0, 0 };
+    if (lexer->count >= 2) {
+        Token last = (Token) lexer->tokens[lexer->count-2];
+        next.count         = lexer->count - 2;
+        next.payload_count = lexer->payload_count - (size_t) token_has_payload(last);
+        next.from          = lexer->indices[lexer->count-2] - (last == Token_String);
+    }
+    incremental->current = next;
+    return result;
+}
+
+TokenArray lexer_incremental_append(IncrementalLexer* incremental, Str text, Logger* logger) {
+    incremental->lexer.logger = logger;
+
+    size_t needed = incremental->size + text.size + 1;
+    if (needed > incremental->capacity) {
+        size_t capacity = incremental->capacity;
+        while (capacity < needed)
+            capacity *= 2;
+
+        char* buffer = grow_array(incremental->buffer, incremental->size + 1, capacity, sizeof(char));
+        if (buffer == NULL) {
+            fprintf(stderr, "[Error] (Lexer) " STR_FMT "\n  Out of memory while appending to the source.\n", STR_ARG(incremental->name));
+            return (TokenArray) { .name = incremental->name, .source = incremental->lexer.source };
+        }
+        incremental->buffer   = buffer;
+        incremental->capacity = capacity;
+    }
+
+    memcpy(incremental->buffer + incremental->size, text.data, text.size);
+    incremental->size += text.size;
+    incremental->buffer[incremental->size] = '\0';
+
+    // Text that doesn't lex is dropped right away. The tokens are restored by
+    // the next append or rollback, which both lex again from the checkpoint.
+    TokenArray result = lexer_incremental_relex(incremental);
+    if (result.tokens == NULL) {
+        incremental->size = incremental->current.source_size;
+        incremental->buffer[incremental->size] = '\0';
+    }
+    return result;
+}
+
+void lexer_incremental_commit(IncrementalLexer* incremental) {
+    incremental->committed = incremental->current;
+}
+
+// The committed source lexes exactly like it did before, so this only costs
+// lexing its last token again.
+void lexer_incremental_rollback(IncrementalLexer* incremental) {
+    incremental->size = incremental->committed.source_size;
+    incremental->buffer[incremental->size] = '\0';
+    incremental->current = incremental->committed;
+    lexer_incremental_relex(incremental);
+}
+
+
+/* ---------------------------- PARALLEL LEXER -------------------------------- */
+// The source is split right after newlines and every chunk is lexed as if it
+// started outside of any token. That only holds if the previous chunk ended
+// outside of a string or block comment, and if it didn't, lexing the previous
+// chunk fails with an unterminated string or comment. So when every chunk lexes
+// without errors, every split was safe and the stitched result is exactly what
+// lexer_lex produces. Otherwise we lex the whole source again serially, which
+// also reports the errors.
+#define LEXER_MAX_THREADS    64
+#define LEXER_MIN_CHUNK_SIZE (256 * 1024)
+
+typedef struct {
+    Str    name;
+    Str    source;      // The original bytes of the chunk.
+    size_t offset;      // Where the chunk starts in the whole source.
+    int    is_last;
+    char*  copy;        // The chunk followed by '\0', for every chunk but the last.
+    Lexer  lexer;
+
+    // Filled in when stitching.
+    DataPoolIndex* remap;           // Offset in the chunk's data pool -> offset in the merged data pool.
+    ConstantIndex* constant_remap;  // Index in the chunk's constants -> index in the merged constants.
+    size_t         first;       // Index of the chunk's first token in the merged arrays.
+    size_t         first_payload;
+    size_t         first_line;  // Where the chunk's line starts, minus its first, go in the merged line index.
+    TokenArray*    merged;
+} LexerChunk;
+
+static int lexer_chunk_lex(void* arg) {
+    LexerChunk* chunk = (LexerChunk*) arg;
+
+    Str source = chunk->source;
+    if (!chunk->is_last) {
+        chunk->copy = alloc(0, source.size + 1);
+        if (chunk->copy == NULL)
+            return 0;
+        memcpy(chunk->copy, source.data, source.size);
+        chunk->copy[source.size] = '\0';
+        source.data = chunk->copy;
+    }
+
+    chunk->lexer = lexer_make(source, 1, NULL);
+    if (!lexer_run(&chunk->lexer, chunk->name, 0) || !lexer_index_lines(&chunk->lexer, 0))
+        return 0;
+
+    // A '\0' inside the chunk ends the whole source, which only the last chunk may do.
+    SourceIndex eof = chunk->lexer.indices[chunk->lexer.count-1];
+    return chunk->is_last || eof == source.size;
 }
 
+// Interns the strings of the chunk's data pool, in the order they were first
+// seen, into the merged pool. That is the order lexer_lex would have seen them,
+// so the merged pool ends up byte for byte the same.
+static int lexer_chunk_merge_pool(LexerChunk* chunk, InternPool* merged) {
+    InternPool* pool = &chunk->lexer.intern_pool;
+    chunk->remap = alloc(0, pool->used * sizeof(DataPoolIndex));
+    if (chunk->remap == NULL)
+        return 0;
+
+    size_t offset = sizeof(DataPoolIndex);
+    while (offset < pool->used) {
+        Str string = str_from_c_str((const char*) pool->data + offset);
+        DataPoolIndex merged_offset = intern_string(merged, string);
+        if (merged_offset == 0)
+            return 0;
+
+        chunk->remap[offset] = merged_offset;
+        offset += string.size + 1;
+    }
+    return 1;
+}
+
+// Same as the data pool: the chunk's constants are added in the order they were
+// first seen, after the strings they refer to were merged.
+static int lexer_chunk_merge_constants(LexerChunk* chunk, ConstantPool* merged) {
+    ConstantPool* pool = &chunk->lexer.constant_pool;
+    chunk->constant_remap = alloc(0, pool->count * sizeof(ConstantIndex));
+    if (chunk->constant_remap == NULL)
+        return 0;
+
+    chunk->constant_remap[0] = 0;
+    for (ConstantIndex i = 1; i < pool->count; ++i) {
+        Constant constant = pool->constants[i];
+        constant.repr = chunk->remap[constant.repr];
+        if (constant.kind == ConstantKind_String)
+            constant.as.string = chunk->remap[constant.as.string];
+
+        chunk->constant_remap[i] = constant_pool_add(merged, constant);
+        if (chunk->constant_remap[i] == 0)
+            return 0;
+    }
+    return 1;
+}
+
+static int lexer_chunk_stitch(void* arg) {
+    LexerChunk* chunk = (LexerChunk*) arg;
+    TokenArray* merged = chunk->merged;
+    Lexer*      lexer  = &chunk->lexer;
+
+    // Every chunk but the last drops its Eof token.
+    size_t count = chunk->is_last ? lexer->count : lexer->count - 1;
+    memcpy(merged->tokens + chunk->first, lexer->tokens, count * sizeof(u8));
+
+    // Eof has no payload, so every payload of the chunk is kept. The first
+    // chunk's pools are the merged ones, so its payloads stay as they are.
+    size_t payload = 0;
+    for (size_t i = 0; i < count; ++i) {
+        merged->source_offsets[chunk->first + i] = (SourceIndex) (lexer->indices[i] + chunk->offset);
+
+        Token token = (Token) lexer->tokens[i];
+        if (!token_has_payload(token))
+            continue;
+
+        u32 value = lexer->payloads[payload];
+        if (chunk->remap != NULL)
+            value = (token == Token_Identifier) ? chunk->remap[value] : chunk->constant_remap[value];
+        merged->payloads[chunk->first_payload + payload] = value;
+        payload += 1;
+    }
+
+    // The first line of a chunk starts right after the last newline of the previous one,
+    // which already recorded it, so only the lines after it are copied.
+    LineIndex lines = lexer->lines;
+    for (u32 i = 1; i < lines.count; ++i)
+        merged->lines.starts[chunk->first_line + i - 1] = (u32) (lines.starts[i] + chunk->offset);
+    return 1;
+}
+
+static void lexer_chunk_free(LexerChunk* chunk) {
+    lexer_free(&chunk->lexer);
+    free(chunk->copy);
+    free(chunk->remap);
+    free(chunk->constant_remap);
+}
+
+// Runs proc on every chunk, the first one on the calling thread.
+// If a thread can't be started, its chunk also runs on the calling thread.
+static int lexer_chunks_run(LexerChunk* chunks, int count, ThreadProc proc) {
+    Thread threads[LEXER_MAX_THREADS];
+    int    started[LEXER_MAX_THREADS];
+    for (int i = 1; i < count; ++i)
+        started[i] = thread_start(&threads[i], proc, &chunks[i]);
+
+    int ok = proc(&chunks[0]);
+    for (int i = 1; i < count; ++i) {
+        int result = started[i] ? thread_join(threads[i]) : proc(&chunks[i]);
+        ok = ok && result;
+    }
+    return ok;
+}
+
+TokenArray lexer_lex_parallel(Str name, Str source, Logger* logger, int thread_count) {
+    keyword_table_init();
+
+    const Scanner* scan = scanner_get();
+    if (thread_count <= 0)
+        thread_count = thread_hardware_count();
+    if (thread_count > LEXER_MAX_THREADS)
+        thread_count = LEXER_MAX_THREADS;
+    if ((size_t) thread_count > source.size / LEXER_MIN_CHUNK_SIZE)
+        thread_count = (int) (source.size / LEXER_MIN_CHUNK_SIZE);
+    if (thread_count <= 1)
+        return lexer_lex_whole(name, source, logger);
+
+    LexerChunk chunks[LEXER_MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+
+    int    count = 0;
+    size_t start = 0;
+    for (int i = 0; i < thread_count && start < source.size; ++i) {
+        size_t end = source.size;
+        if (i != thread_count-1) {
+            end = source.size / thread_count * (i+1);
+            if (end < start)
+                end = start;
+            // Split right after the next newline.
+            end = (size_t) (scan->find_line_end(source.data + end, source.data + source.size) - source.data);
+            if (end < source.size)
+                end += 1;
+        }
+
+        chunks[count] = (LexerChunk) {
+            .name    = name,
+            .source  = (Str) { end - start, source.data + start },
+            .offset  = start,
+            .is_last = (end == source.size),
+        };
+        count += 1;
+        start = end;
+    }
+
+    TokenArray result = { .name = name, .source = source };
+    if (!lexer_chunks_run(chunks, count, lexer_chunk_lex))
+        goto serial;
+
+    // The first chunk's pools become the merged pools, and its offsets stay as they are.
+    InternPool*   merged_pool      = &chunks[0].lexer.intern_pool;
+    ConstantPool* merged_constants = &chunks[0].lexer.constant_pool;
+    size_t size = 0;
+    size_t payload_count = 0;
+    size_t line_count = 1;
+    for (int i = 0; i < count; ++i) {
+        chunks[i].first = size;
+        chunks[i].first_payload = payload_count;
+        chunks[i].first_line = line_count;
+        size += chunks[i].is_last ? chunks[i].lexer.count : chunks[i].lexer.count - 1;
+        payload_count += chunks[i].lexer.payload_count;
+        line_count += chunks[i].lexer.lines.count - 1;
+        if (i > 0 && !lexer_chunk_merge_pool(&chunks[i], merged_pool))
+            goto serial;
+        if (i > 0 && !lexer_chunk_merge_constants(&chunks[i], merged_constants))
+            goto serial;
+    }
+    if (size > (TokenIndex) -1)
+        goto serial;
+
+    result.tokens         = alloc(0, size * sizeof(u8));
+    result.source_offsets = alloc(0, size * sizeof(SourceIndex));
+    result.payloads       = alloc(0, (payload_count + 1) * sizeof(DataPoolIndex));
+    result.lines.starts   = alloc(0, line_count * sizeof(u32));
+    if (result.tokens == NULL || result.source_offsets == NULL || result.payloads == NULL || result.lines.starts == NULL)
+        goto serial;
+    result.lines.starts[0] = 0;
+    result.lines.count = (u32) line_count;
+
+    for (int i = 0; i < count; ++i)
+        chunks[i].merged = &result;
+    lexer_chunks_run(chunks, count, lexer_chunk_stitch);
+
+    result.size           = (TokenIndex) size;
+    result.payload_count  = (TokenIndex) payload_count;
+    if (!token_array_index_payloads(&result))
+        goto serial;
+
+    result.data_pool      = merged_pool->data;
+    result.data_pool_size = merged_pool->used;
+    merged_pool->data     = NULL;  // Owned by the result now.
+    result.constants      = merged_constants->constants;
+    result.constant_count = merged_constants->count;
+    merged_constants->constants = NULL;
+    for (int i = 0; i < count; ++i)
+        lexer_chunk_free(&chunks[i]);
+    return result;
+
+    serial:
+    token_array_free(result);
+    for (int i = 0; i < count; ++i)
+        lexer_chunk_free(&chunks[i]);
+    return lexer_lex_whole(name, source, logger);
+}
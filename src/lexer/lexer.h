@@ -4,35 +4,136 @@
 #include "str.h"
 #include "token.h"
 #include "logger.h"
+#include "location.h"
 
 typedef u32 TokenIndex;
 typedef u32 DataPoolIndex;
 typedef u32 SourceIndex;
+typedef u32 ConstantIndex;
+
+typedef enum {
+    ConstantKind_None,
+    ConstantKind_Integer,
+    ConstantKind_Real,
+    ConstantKind_String,
+} ConstantKind;
+
+/// A literal decoded by the lexer. Literals that are written the same way share
+/// one constant, so equal values written differently, like 7 and 007, don't.
+/// - repr: The literal as written, in the data_pool.
+/// - as.string: The unescaped string, in the data_pool.
+typedef struct {
+    ConstantKind  kind;
+    DataPoolIndex repr;
+    union {
+        u64           integer;
+        f64           real;
+        DataPoolIndex string;
+    } as;
+} Constant;
+
+// Token kinds are stored in a single byte each.
+typedef char token_kind_fits_in_a_byte[TOKEN_LAST < 256 ? 1 : -1];
 
 typedef struct {
     Str name;
     Str source;
 
-    /// Parallel arrays.
-    /// - tokens: The token kinds.
-    /// - identifiers: Id's to the data_pool.
+    /// Parallel arrays, one entry per token.
+    /// - tokens: The token kinds, one byte each.
     /// - source_offsets: The offset in the source where the token starts.
-    Token*          tokens;
-    DataPoolIndex*  identifiers;
+    u8*             tokens;
     SourceIndex*    source_offsets;
     TokenIndex      size;
 
+    /// Only for the tokens that have one, in token order: an offset into the
+    /// data_pool for identifiers and an index into constants for literals.
+    /// Look them up with token_array_payload.
+    /// - payload_bits: Bit i is set if token i has a payload.
+    /// - payload_ranks: The number of payloads before each 64-bit word of payload_bits.
+    DataPoolIndex*  payloads;
+    TokenIndex      payload_count;
+    u64*            payload_bits;
+    TokenIndex*     payload_ranks;
+
     u8*    data_pool;
     size_t data_pool_size;
+
+    /// The decoded literals. Index 0 is a ConstantKind_None placeholder.
+    Constant*     constants;
+    ConstantIndex constant_count;
+
+    /// Where every line of the source starts, for finding the location of a token.
+    LineIndex lines;
 } TokenArray;
 
 
+/// Whether tokens of this kind have their text in the data pool.
+static inline int token_has_payload(Token token) {
+    return token == Token_Number || token == Token_Real || token == Token_String || token == Token_Identifier;
+}
+
+static inline u32 token_popcount64(u64 bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32) __builtin_popcountll(bits);
+#else
+    bits = bits - ((bits >> 1) & 0x5555555555555555ull);
+    bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+    bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (u32) ((bits * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+/// The payload of the token, or 0 if it has none.
+static inline DataPoolIndex token_array_payload(TokenArray tokens, TokenIndex id) {
+    u64 bits = tokens.payload_bits[id / 64];
+    u64 bit  = (u64) 1 << (id % 64);
+    if ((bits & bit) == 0)
+        return 0;
+    return tokens.payloads[tokens.payload_ranks[id / 64] + token_popcount64(bits & (bit - 1))];
+}
+
+/// The decoded value of a Number, Real or String token.
+static inline Constant token_array_constant(TokenArray tokens, TokenIndex id) {
+    return tokens.constants[token_array_payload(tokens, id)];
+}
+
+
 /// Lex the source to a token array.
 TokenArray lexer_lex(Str name, Str source, Logger* logger);
 
+/// Lex the source on up to `thread_count` threads, or one per hardware thread if it's 0.
+/// The result is identical to `lexer_lex`. Small sources are lexed on the calling thread.
+TokenArray lexer_lex_parallel(Str name, Str source, Logger* logger, int thread_count);
+
+/// Lexes a source that only grows at the end, like the lines typed into the REPL.
+/// Each append only lexes the new text, starting from the last token before it,
+/// and can be undone with a rollback to the last commit.
+typedef struct IncrementalLexer IncrementalLexer;
+
+IncrementalLexer* lexer_incremental_make(Str name);
+
+/// Append text to the source and lex it. The returned tokens cover the whole source
+/// and are owned by the lexer: they stay valid until the next append or rollback.
+/// Returns an array without tokens on errors, and the append should be rolled back.
+TokenArray lexer_incremental_append(IncrementalLexer* lexer, Str text, Logger* logger);
+
+/// Keep everything appended so far.
+void lexer_incremental_commit(IncrementalLexer* lexer);
+
+/// Drop everything appended since the last commit.
+void lexer_incremental_rollback(IncrementalLexer* lexer);
+
+void lexer_incremental_free(IncrementalLexer* lexer);
+
 /// Get the textual representation of a token.
 const char* lexer_repr_of(TokenArray tokens, TokenIndex id);
 
 /// Free the memory allocated by the token array.
 void token_array_free(TokenArray tokens);
 
+/// A copy of the arrays of the token array, which refers to the same source.
+/// For handing tokens over to the parser while keeping them, as the incremental
+/// lexer does. Returns one with tokens == NULL if out of memory.
+TokenArray token_array_copy(TokenArray tokens);
+
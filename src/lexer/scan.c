@@ -0,0 +1,263 @@
+#include "scan.h"
+#include "os/thread.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+/* ---------------------------- SCALAR -------------------------------- */
+static inline int scan_is_whitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline int scan_is_digit(char c) {
+    return '0' <= c && c <= '9';
+}
+
+static inline int scan_is_identifier(char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || scan_is_digit(c) || c == '_';
+}
+
+// Returns true for the byte that ends the scan of each kernel.
+static inline int stop_skip_whitespace(char c)        { return !scan_is_whitespace(c); }
+static inline int stop_skip_identifier(char c)        { return !scan_is_identifier(c); }
+static inline int stop_skip_digits(char c)            { return !scan_is_digit(c); }
+static inline int stop_find_line_end(char c)          { return c == '\n' || c == '\0'; }
+static inline int stop_find_quote(char c)             { return c == '"' || c == '\0'; }
+static inline int stop_find_comment_delimiter(char c) { return c == '*' || c == '/' || c == '\0'; }
+
+#define SCALAR_KERNEL(name)                                                         \
+    static const char* scalar_##name(const char* current, const char* end) {        \
+        while (current < end && !stop_##name(*current))                             \
+            ++current;                                                              \
+        return current;                                                             \
+    }
+
+SCALAR_KERNEL(skip_whitespace)
+SCALAR_KERNEL(skip_identifier)
+SCALAR_KERNEL(skip_digits)
+SCALAR_KERNEL(find_line_end)
+SCALAR_KERNEL(find_quote)
+SCALAR_KERNEL(find_comment_delimiter)
+#undef SCALAR_KERNEL
+
+// Most identifiers, numbers and whitespace runs are only a few bytes long.
+// The vector kernels check this many bytes one at a time before loading a
+// whole block, since a block costs more than a short run does.
+#define SCAN_PROBE_BYTES 8
+
+#define SCAN_PROBE(name, current, end)                                              \
+    for (int probe = 0; probe < SCAN_PROBE_BYTES; ++probe, ++(current)) {           \
+        if ((current) == (end) || stop_##name(*(current)))                          \
+            return (current);                                                       \
+    }
+
+static const Scanner SCALAR_SCANNER = {
+    .name                   = "scalar",
+    .skip_whitespace        = scalar_skip_whitespace,
+    .skip_identifier        = scalar_skip_identifier,
+    .skip_digits            = scalar_skip_digits,
+    .find_line_end          = scalar_find_line_end,
+    .find_quote             = scalar_find_quote,
+    .find_comment_delimiter = scalar_find_comment_delimiter,
+};
+
+
+#ifdef SCAN_X86
+/* ---------------------------- SSE2 -------------------------------- */
+// The masks have one bit per byte in the block, set if the byte is in the class.
+// Bytes >= 0x80 compare as negative, so the signed range checks reject them.
+#define SSE2_IN_RANGE(block, lo, hi) \
+    _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8((char)((lo)-1))), _mm_cmplt_epi8(block, _mm_set1_epi8((char)((hi)+1))))
+
+static inline u32 sse2_whitespace_mask(__m128i block) {
+    __m128i result = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')),  _mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\r')))
+    );
+    return (u32) _mm_movemask_epi8(result);
+}
+
+static inline u32 sse2_identifier_mask(__m128i block) {
+    __m128i lower  = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    __m128i result = _mm_or_si128(
+        _mm_or_si128(SSE2_IN_RANGE(lower, 'a', 'z'), SSE2_IN_RANGE(block, '0', '9')),
+        _mm_cmpeq_epi8(block, _mm_set1_epi8('_'))
+    );
+    return (u32) _mm_movemask_epi8(result);
+}
+
+static inline u32 sse2_digit_mask(__m128i block) {
+    return (u32) _mm_movemask_epi8(SSE2_IN_RANGE(block, '0', '9'));
+}
+
+static inline u32 sse2_line_end_mask(__m128i block) {
+    __m128i result = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(block, _mm_setzero_si128()));
+    return (u32) _mm_movemask_epi8(result);
+}
+
+static inline u32 sse2_quote_mask(__m128i block) {
+    __m128i result = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')), _mm_cmpeq_epi8(block, _mm_setzero_si128()));
+    return (u32) _mm_movemask_epi8(result);
+}
+
+static inline u32 sse2_comment_delimiter_mask(__m128i block) {
+    __m128i result = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('*')), _mm_cmpeq_epi8(block, _mm_set1_epi8('/'))),
+        _mm_cmpeq_epi8(block, _mm_setzero_si128())
+    );
+    return (u32) _mm_movemask_epi8(result);
+}
+
+// Skip kernels stop at the first byte outside the class, find kernels at the first byte inside it.
+// The tail that doesn't fill a whole block is handled by the scalar kernel.
+#define SSE2_KERNEL(name, class_mask, invert)                                       \
+    static const char* sse2_##name(const char* current, const char* end) {          \
+        SCAN_PROBE(name, current, end)                                              \
+        while (end - current >= 16) {                                               \
+            __m128i block = _mm_loadu_si128((const __m128i*) current);              \
+            u32 mask = (class_mask(block) ^ (invert)) & 0xFFFFu;                    \
+            if (mask != 0)                                                          \
+                return current + __builtin_ctz(mask);                               \
+            current += 16;                                                          \
+        }                                                                           \
+        return scalar_##name(current, end);                                         \
+    }
+
+SSE2_KERNEL(skip_whitespace,        sse2_whitespace_mask,        0xFFFFu)
+SSE2_KERNEL(skip_identifier,        sse2_identifier_mask,        0xFFFFu)
+SSE2_KERNEL(skip_digits,            sse2_digit_mask,             0xFFFFu)
+SSE2_KERNEL(find_line_end,          sse2_line_end_mask,          0)
+SSE2_KERNEL(find_quote,             sse2_quote_mask,             0)
+SSE2_KERNEL(find_comment_delimiter, sse2_comment_delimiter_mask, 0)
+#undef SSE2_KERNEL
+
+static const Scanner SSE2_SCANNER = {
+    .name                   = "sse2",
+    .skip_whitespace        = sse2_skip_whitespace,
+    .skip_identifier        = sse2_skip_identifier,
+    .skip_digits            = sse2_skip_digits,
+    .find_line_end          = sse2_find_line_end,
+    .find_quote             = sse2_find_quote,
+    .find_comment_delimiter = sse2_find_comment_delimiter,
+};
+
+
+/* ---------------------------- AVX2 -------------------------------- */
+#define AVX2 __attribute__((target("avx2")))
+
+#define AVX2_IN_RANGE(block, lo, hi) \
+    _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8((char)(lo)), block), _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((hi)+1)), block))
+
+static inline AVX2 u32 avx2_whitespace_mask(__m256i block) {
+    __m256i result = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')),  _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')))
+    );
+    return (u32) _mm256_movemask_epi8(result);
+}
+
+static inline AVX2 u32 avx2_identifier_mask(__m256i block) {
+    __m256i lower  = _mm256_or_si256(block, _mm256_set1_epi8(0x20));
+    __m256i result = _mm256_or_si256(
+        _mm256_or_si256(AVX2_IN_RANGE(lower, 'a', 'z'), AVX2_IN_RANGE(block, '0', '9')),
+        _mm256_cmpeq_epi8(block, _mm256_set1_epi8('_'))
+    );
+    return (u32) _mm256_movemask_epi8(result);
+}
+
+static inline AVX2 u32 avx2_digit_mask(__m256i block) {
+    return (u32) _mm256_movemask_epi8(AVX2_IN_RANGE(block, '0', '9'));
+}
+
+static inline AVX2 u32 avx2_line_end_mask(__m256i block) {
+    __m256i result = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(block, _mm256_setzero_si256()));
+    return (u32) _mm256_movemask_epi8(result);
+}
+
+static inline AVX2 u32 avx2_quote_mask(__m256i block) {
+    __m256i result = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(block, _mm256_setzero_si256()));
+    return (u32) _mm256_movemask_epi8(result);
+}
+
+static inline AVX2 u32 avx2_comment_delimiter_mask(__m256i block) {
+    __m256i result = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('*')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('/'))),
+        _mm256_cmpeq_epi8(block, _mm256_setzero_si256())
+    );
+    return (u32) _mm256_movemask_epi8(result);
+}
+
+// Same as the SSE2 kernels, with 32-byte blocks.
+#define AVX2_KERNEL(name, class_mask, invert)                                       \
+    static AVX2 const char* avx2_##name(const char* current, const char* end) {     \
+        SCAN_PROBE(name, current, end)                                              \
+        while (end - current >= 32) {                                               \
+            __m256i block = _mm256_loadu_si256((const __m256i*) current);           \
+            u32 mask = class_mask(block) ^ (invert);                                \
+            if (mask != 0)                                                          \
+                return current + __builtin_ctz(mask);                               \
+            current += 32;                                                          \
+        }                                                                           \
+        return scalar_##name(current, end);                                           \
+    }
+
+AVX2_KERNEL(skip_whitespace,        avx2_whitespace_mask,        0xFFFFFFFFu)
+AVX2_KERNEL(skip_identifier,        avx2_identifier_mask,        0xFFFFFFFFu)
+AVX2_KERNEL(skip_digits,            avx2_digit_mask,             0xFFFFFFFFu)
+AVX2_KERNEL(find_line_end,          avx2_line_end_mask,          0)
+AVX2_KERNEL(find_quote,             avx2_quote_mask,             0)
+AVX2_KERNEL(find_comment_delimiter, avx2_comment_delimiter_mask, 0)
+#undef AVX2_KERNEL
+
+static const Scanner AVX2_SCANNER = {
+    .name                   = "avx2",
+    .skip_whitespace        = avx2_skip_whitespace,
+    .skip_identifier        = avx2_skip_identifier,
+    .skip_digits            = avx2_skip_digits,
+    .find_line_end          = avx2_find_line_end,
+    .find_quote             = avx2_find_quote,
+    .find_comment_delimiter = avx2_find_comment_delimiter,
+};
+#endif // SCAN_X86
+
+
+/* ---------------------------- DISPATCH -------------------------------- */
+const Scanner* scanner_of_kind(ScannerKind kind) {
+    switch (kind) {
+        case ScannerKind_Scalar:
+            return &SCALAR_SCANNER;
+        case ScannerKind_Sse2:
+#ifdef SCAN_X86
+            if (__builtin_cpu_supports("sse2"))
+                return &SSE2_SCANNER;
+#endif
+            return NULL;
+        case ScannerKind_Avx2:
+#ifdef SCAN_X86
+            if (__builtin_cpu_supports("avx2"))
+                return &AVX2_SCANNER;
+#endif
+            return NULL;
+    }
+    return NULL;
+}
+
+static const Scanner* selected_scanner = NULL;
+static ThreadOnce     selected_scanner_once;
+
+static void scanner_select(void) {
+    const Scanner* scanner = NULL;
+    for (int kind = SCANNER_KIND_LAST; kind >= 0 && scanner == NULL; --kind) {
+        scanner = scanner_of_kind((ScannerKind) kind);
+    }
+    selected_scanner = scanner;
+}
+
+const Scanner* scanner_get(void) {
+    // Lexers may start on several threads at once.
+    thread_once(&selected_scanner_once, scanner_select);
+    return selected_scanner;
+}
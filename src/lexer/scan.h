@@ -0,0 +1,39 @@
+#pragma once
+
+#include "preamble.h"
+
+
+/// Character-class kernels used by the lexer to move over runs of bytes.
+/// All kernels scan the range [current, end) and return a pointer to the
+/// first byte that stops the scan, or `end` if no such byte exists.
+/// The byte at `end` is never read, so `end` may point at the terminating '\0'.
+typedef struct {
+    const char* name;
+
+    /// First byte that is not ' ', '\t', '\r' or '\n'.
+    const char* (*skip_whitespace)(const char* current, const char* end);
+    /// First byte that is not [a-zA-Z0-9_].
+    const char* (*skip_identifier)(const char* current, const char* end);
+    /// First byte that is not [0-9].
+    const char* (*skip_digits)(const char* current, const char* end);
+    /// First '\n' or '\0'.
+    const char* (*find_line_end)(const char* current, const char* end);
+    /// First '"' or '\0'.
+    const char* (*find_quote)(const char* current, const char* end);
+    /// First '*', '/' or '\0'.
+    const char* (*find_comment_delimiter)(const char* current, const char* end);
+} Scanner;
+
+typedef enum {
+    ScannerKind_Scalar,
+    ScannerKind_Sse2,
+    ScannerKind_Avx2,
+    SCANNER_KIND_LAST = ScannerKind_Avx2,
+} ScannerKind;
+
+
+/// The fastest scanner supported by the CPU we are running on.
+const Scanner* scanner_get(void);
+
+/// A specific scanner, or NULL if the CPU (or the build) doesn't support it.
+const Scanner* scanner_of_kind(ScannerKind kind);
@@ -29,7 +29,7 @@ int c_transpile_from_source(Str name, Str source, Logger* logger) {
     }
 
     GrammarTree grammar_tree = parse(array, logger);
-    if (grammar_tree.nodes == NULL) {
+    if (grammar_tree.arena.kinds == NULL) {
         error(logger, "Failed to parse source\n");
         return -1;
     }
@@ -38,7 +38,7 @@ int c_transpile_from_source(Str name, Str source, Logger* logger) {
         ast_print(grammar_tree, stdout);
 
     TypedAst ast = type_check(grammar_tree, logger);
-    if (ast.tree.nodes == NULL) {
+    if (ast.tree.arena.kinds == NULL) {
         error(logger, "Failed to type check source\n");
         return -1;
     }
@@ -57,17 +57,9 @@ int c_transpile_from_source(Str name, Str source, Logger* logger) {
 
 
 
-Bytecode compile_from_source(Str name, Str source, Logger* logger) {
-    debug(logger, "Source %s:\n%s\n", name.data, source.data);
-
-    TokenArray array = lexer_lex(name, source, logger);
-    if (array.tokens == NULL) {
-        error(logger, "Failed to lex source\n");
-        return (Bytecode) { 0, 0 };
-    }
-
+Bytecode compile_from_tokens(TokenArray array, Logger* logger) {
     GrammarTree grammar_tree = parse(array, logger);
-    if (grammar_tree.nodes == NULL) {
+    if (grammar_tree.arena.kinds == NULL) {
         error(logger, "Failed to parse source\n");
         return (Bytecode) { 0, 0 };
     }
@@ -76,7 +68,7 @@ Bytecode compile_from_source(Str name, Str source, Logger* logger) {
         ast_print(grammar_tree, stdout);
 
     TypedAst ast = type_check(grammar_tree, logger);
-    if (ast.tree.nodes == NULL) {
+    if (ast.tree.arena.kinds == NULL) {
         error(logger, "Failed to type check source\n");
         return (Bytecode) { 0, 0 };
     }
@@ -85,9 +77,19 @@ Bytecode compile_from_source(Str name, Str source, Logger* logger) {
     return code;
 }
 
-InterpreterResult run_from_source(Str name, Str source, Logger* logger) {
-    Bytecode code = compile_from_source(name, source, logger);
+Bytecode compile_from_source(Str name, Str source, Logger* logger) {
+    debug(logger, "Source %s:\n%s\n", name.data, source.data);
+
+    TokenArray array = lexer_lex(name, source, logger);
+    if (array.tokens == NULL) {
+        error(logger, "Failed to lex source\n");
+        return (Bytecode) { 0, 0 };
+    }
 
+    return compile_from_tokens(array, logger);
+}
+
+static InterpreterResult run_code(Bytecode code, Logger* logger) {
     if (code.instructions == NULL) {
         error(logger, "Failed to generate code\n");
         return (InterpreterResult) { 0, 1 };
@@ -114,59 +116,80 @@ InterpreterResult run_from_source(Str name, Str source, Logger* logger) {
     return result;
 }
 
+InterpreterResult run_from_source(Str name, Str source, Logger* logger) {
+    return run_code(compile_from_source(name, source, logger), logger);
+}
+
+InterpreterResult run_from_tokens(TokenArray array, Logger* logger) {
+    return run_code(compile_from_tokens(array, logger), logger);
+}
+
 
 Bytecode compile_from_file(Str path, Logger* logger) {
-    Str source = read_file(path.data);
+    File file = read_file(path.data);
 
-    if (str_is_empty(source)) {
+    if (str_is_empty(file.contents)) {
         error(logger, "Failed to read file\n");
         return (Bytecode) { 0, 0 };
     }
 
-    Bytecode result = compile_from_source(path, source, logger);
-    dealloc((char*) source.data);
+    Bytecode result = compile_from_source(path, file.contents, logger);
+    file_close(file);
     return result;
 }
 
 InterpreterResult run_from_file(Str path, Logger* logger) {
-    Str source = read_file(path.data);
+    File file = read_file(path.data);
 
-    if (str_is_invalid(source)) {
+    if (str_is_invalid(file.contents)) {
         error(logger, "Failed to read file\n");
         return (InterpreterResult) { 0, 1 };
     }
 
-    InterpreterResult result = run_from_source(path, source, logger);
-    dealloc((char*) source.data);
+    InterpreterResult result = run_from_source(path, file.contents, logger);
+    file_close(file);
     return result;
 }
 
 
+// Every line is run together with the lines before it, but only the new line is lexed.
 i64 repl(void) {
-    char source[4096] = { 0 };
     char buffer[64] = { 0 };
-    size_t source_length = 0;
 
     Logger logger = logger_make_with_file("REPL", LOG_LEVEL_ERROR, stdout);
+    IncrementalLexer* lexer = lexer_incremental_make(STR("<repl>"));
+    if (lexer == NULL) {
+        error(&logger, "Failed to create the lexer\n");
+        return 1;
+    }
 
     while (1) {
         printf("> ");
         fgets(buffer, sizeof(buffer), stdin);
 
         size_t length = strlen(buffer);
-        memccpy(source + source_length, buffer, '\0', length);
-        source_length += length;
-
+        TokenArray tokens = lexer_incremental_append(lexer, (Str) { length, buffer }, &logger);
         memset(buffer, 0, length);
+        if (tokens.tokens == NULL)
+            continue;
+
+        // The tokens stay the lexer's, so the run gets a copy it may free.
+        TokenArray copy = token_array_copy(tokens);
+        if (copy.tokens == NULL) {
+            error(&logger, "Out of memory\n");
+            lexer_incremental_rollback(lexer);
+            continue;
+        }
 
-        InterpreterResult result = run_from_source(STR("<repl>"), (Str) { source_length, source }, &logger);
+        InterpreterResult result = run_from_tokens(copy, &logger);
         if (result.error) {
-            source_length -= length;
-            source[source_length] = '\0';
+            lexer_incremental_rollback(lexer);
         } else {
+            lexer_incremental_commit(lexer);
             printf("%lld\n", result.result);
         }
     }
 
+    lexer_incremental_free(lexer);
     return 0;
 }
@@ -23,8 +23,10 @@ int c_transpile_from_source(Str name, Str source, Logger* logger);
 
 Bytecode compile_from_file(Str path, Logger* logger);
 Bytecode compile_from_source(Str name, Str source, Logger* logger);
+Bytecode compile_from_tokens(TokenArray tokens, Logger* logger);
 
 InterpreterResult run_from_file(Str path, Logger* logger);
 InterpreterResult run_from_source(Str name, Str source, Logger* logger);
+InterpreterResult run_from_tokens(TokenArray tokens, Logger* logger);
 
 i64 repl(void);
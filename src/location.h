@@ -6,6 +6,13 @@ typedef struct {
     i32 column;
 } Location;
 
+/// Byte offset of the first character of every line, in increasing order.
+/// starts[0] is always 0. An index with count 0 has not been built.
+typedef struct {
+    u32* starts;
+    u32  count;
+} LineIndex;
+
 static inline Location location_of(const char* source, size_t index) {
     Location location = {1, 1 };
     for (size_t i = 0; i < index; ++i) {
@@ -20,3 +27,30 @@ static inline Location location_of(const char* source, size_t index) {
     }
     return location;
 }
+
+/// The 0-based line that contains the byte at index.
+static inline u32 line_index_line_of(LineIndex lines, size_t index) {
+    // Find the last line that starts at or before index.
+    u32 low  = 0;
+    u32 high = lines.count;
+    while (high - low > 1) {
+        u32 middle = low + (high - low) / 2;
+        if (lines.starts[middle] <= index)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/// Same as location_of, but only scans the line that contains index.
+/// Falls back to location_of if the line index has not been built.
+static inline Location location_of_indexed(LineIndex lines, const char* source, size_t index) {
+    if (lines.count == 0)
+        return location_of(source, index);
+
+    u32 line = line_index_line_of(lines, index);
+    Location location = location_of(source + lines.starts[line], index - lines.starts[line]);
+    location.row = (i32) line + 1;
+    return location;
+}
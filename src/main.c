@@ -8,6 +8,7 @@
 #include "interpreter/interpreter.h"
 #include "jit_compiler/jit.h"
 #include "transpiler/c_transpiler.h"
+#include "cache.h"
 
 #include "str.h"
 #include "file.h"
@@ -70,15 +71,19 @@ typedef struct {
 } InterpreterResult;
 
 
-int c_transpile(Str name, Str source, int verbose) {
-    TokenArray array = lexer_lex(name, source);
+int c_transpile(Str name, Str source, int verbose, u32 max_errors) {
+    Logger logger = logger_make_with_file("Lexer", LOG_LEVEL_ERROR, stderr);
+    TokenArray array = lexer_lex(name, source, &logger);
     if (array.tokens == NULL) {
         fprintf(stderr, "Failed to lex source\n");
         return -1;
     }
 
-    GrammarTree grammar_tree = parse(array);
-    if (grammar_tree.nodes == NULL) {
+    GrammarTree grammar_tree = parse_with_max_errors(array, max_errors);
+    if (grammar_tree.arena.kinds == NULL || grammar_tree.error_count != 0) {
+        // A tree that recovered from its errors still holds the tokens.
+        if (grammar_tree.arena.kinds != NULL)
+            grammar_tree_free(grammar_tree);
         fprintf(stderr, "Failed to parse source\n");
         return -1;
     }
@@ -87,7 +92,7 @@ int c_transpile(Str name, Str source, int verbose) {
         ast_print(grammar_tree, stdout);
 
     TypedAst typed_tree = type_check(grammar_tree);
-    if (typed_tree.nodes == NULL) {
+    if (typed_tree.arena.kinds == NULL) {
         fprintf(stderr, "Failed to type check source\n");
         return -1;
     }
@@ -104,28 +109,7 @@ int c_transpile(Str name, Str source, int verbose) {
 }
 
 
-InterpreterResult run(Str name, Str source, int verbose) {
-    TokenArray array = lexer_lex(name, source);
-    if (array.tokens == NULL) {
-        fprintf(stderr, "Failed to lex source\n");
-        return (InterpreterResult) { 0, 1 };
-    }
-
-    GrammarTree grammar_tree = parse(array);
-    if (grammar_tree.nodes == NULL) {
-        fprintf(stderr, "Failed to parse source\n");
-        return (InterpreterResult) { 0, 1 };
-    }
-
-    if (verbose)
-        ast_print(grammar_tree, stdout);
-
-    TypedAst typed_tree = type_check(grammar_tree);
-    if (typed_tree.nodes == NULL) {
-        fprintf(stderr, "Failed to type check source\n");
-        return (InterpreterResult) { 0, 1 };
-    }
-
+static InterpreterResult run_typed(TypedAst typed_tree, int verbose) {
     Bytecode code = generate_code(typed_tree);
     if (code.instructions == NULL) {
         fprintf(stderr, "Failed to generate code\n");
@@ -151,34 +135,100 @@ InterpreterResult run(Str name, Str source, int verbose) {
     return (InterpreterResult) { result, 0 };
 }
 
+// The tokens are handed over to the parser, which frees them if it fails, as
+// does the checker. `cache` is as for run.
+static InterpreterResult run_tokens(TokenArray array, int verbose, u32 max_errors, const char* cache) {
+    GrammarTree grammar_tree = parse_with_max_errors(array, max_errors);
+    if (grammar_tree.arena.kinds == NULL || grammar_tree.error_count != 0) {
+        // A tree that recovered from its errors still holds the tokens.
+        if (grammar_tree.arena.kinds != NULL)
+            grammar_tree_free(grammar_tree);
+        fprintf(stderr, "Failed to parse source\n");
+        return (InterpreterResult) { 0, 1 };
+    }
+
+    if (verbose)
+        ast_print(grammar_tree, stdout);
+
+    TypedAst typed_tree = type_check(grammar_tree);
+    if (typed_tree.arena.kinds == NULL) {
+        fprintf(stderr, "Failed to type check source\n");
+        return (InterpreterResult) { 0, 1 };
+    }
+
+    if (cache != NULL && !cache_write(cache, array.source, array, typed_tree))
+        fprintf(stderr, "[INFO]: Failed to write the cache of %s\n", cache);
+
+    return run_typed(typed_tree, verbose);
+}
+
+// `cache` is the path of the source, to keep its type checked tree next to
+// it, or NULL to always start from the source.
+InterpreterResult run(Str name, Str source, int verbose, u32 max_errors, const char* cache) {
+    CachedAst cached = (cache != NULL) ? cache_read(cache, source) : (CachedAst) { 0 };
+    if (cached.mapping != NULL) {
+        if (verbose)
+            fprintf(stdout, "Loaded %s from its cache\n", cache);
+        InterpreterResult result = run_typed(cached.ast, verbose);
+        cache_close(cached);
+        return result;
+    }
 
+    Logger logger = logger_make_with_file("Lexer", LOG_LEVEL_ERROR, stderr);
+    TokenArray array = lexer_lex(name, source, &logger);
+    if (array.tokens == NULL) {
+        fprintf(stderr, "Failed to lex source\n");
+        return (InterpreterResult) { 0, 1 };
+    }
+
+    return run_tokens(array, verbose, max_errors, cache);
+}
+
+
+// Every line is run together with the lines before it, but only the new line is
+// lexed. A line that fails is dropped from the session.
 i64 repl(void) {
-    char source[4096] = { 0 };
     char buffer[64] = { 0 };
-    size_t source_length = 0;
+
+    Logger logger = logger_make_with_file("REPL", LOG_LEVEL_ERROR, stderr);
+    IncrementalLexer* lexer = lexer_incremental_make(STR("<repl>"));
+    if (lexer == NULL) {
+        fprintf(stderr, "Failed to create the lexer\n");
+        return 1;
+    }
 
     while (1) {
         printf("> ");
-        fgets(buffer, sizeof(buffer), stdin);
+        if (fgets(buffer, sizeof(buffer), stdin) == NULL)
+            break;
 
         if (strcmp(buffer, "\\exit\n") == 0)
             break;
 
         size_t length = strlen(buffer);
-        memccpy(source + source_length, buffer, '\0', length);
-        source_length += length;
-
+        TokenArray tokens = lexer_incremental_append(lexer, (Str) { length, buffer }, &logger);
         memset(buffer, 0, length);
+        if (tokens.tokens == NULL)
+            continue;
+
+        // The tokens stay the lexer's, so the run gets a copy it may free.
+        TokenArray copy = token_array_copy(tokens);
+        if (copy.tokens == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            lexer_incremental_rollback(lexer);
+            continue;
+        }
 
-        InterpreterResult result = run(STR("<repl>"), (Str) { source_length, source }, 0);
+        InterpreterResult result = run_tokens(copy, 0, PARSER_DEFAULT_MAX_ERRORS, NULL);
         if (result.error) {
-            source_length -= length;
-            source[source_length] = '\0';
+            lexer_incremental_rollback(lexer);
         } else {
+            lexer_incremental_commit(lexer);
             printf("%lld\n", result.result);
         }
     }
 
+    lexer_incremental_free(lexer);
     return 0;
 }
 
@@ -210,14 +260,15 @@ int main(int argc, const char* argv[]) {
             repl();
             break;
         } case RUN: {
-            Str source = read_file(commands.input_file);
-            if (str_is_empty(source)) {
+            File file = read_file(commands.input_file);
+            if (str_is_empty(file.contents)) {
                 error(log, "Failed to read file\n");
                 return 1;
             }
             if (commands.verbose)
-                infol(log, "%s\n%s\n", commands.input_file, source.data);
-            InterpreterResult result = run(str_from_c_str(commands.input_file), source, commands.verbose);
+                infol(log, "%s\n%s\n", commands.input_file, file.contents.data);
+            InterpreterResult result = run(str_from_c_str(commands.input_file), file.contents, commands.verbose, commands.max_errors, commands.no_cache ? NULL : commands.input_file);
+            file_close(file);
             if (result.error) {
                 error(log, "Failed to run source\n");
                 return 1;
@@ -229,12 +280,13 @@ int main(int argc, const char* argv[]) {
             panic(log, "Not implemented");
             break;
         } case TRANS: {
-            Str source = read_file(commands.input_file);
-            if (str_is_empty(source)) {
+            File file = read_file(commands.input_file);
+            if (str_is_empty(file.contents)) {
                 error(log, "Failed to read file\n");
                 return 1;
             }
-            c_transpile(str_from_c_str(commands.input_file), source, commands.verbose);
+            c_transpile(str_from_c_str(commands.input_file), file.contents, commands.verbose, commands.max_errors);
+            file_close(file);
         } break;
         case HELP: {
             printf("%s", USAGE);
@@ -3,6 +3,9 @@
 
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <stdio.h>
 #include <string.h>
@@ -30,6 +33,55 @@ void memory_map_free(void* code, size_t size) {
 }
 
 
+// The file's last page is zero-filled past its end, so only a file that ends
+// exactly on a page boundary needs an extra page for the sentinel. A zeroed
+// anonymous region of the full length is reserved first and the file is mapped
+// over its front, so the '\0' is there either way.
+static void* map_file(const char* path, size_t* size, int protection, int flags) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t file_size = (size_t) info.st_size;
+    size_t page      = (size_t) sysconf(_SC_PAGESIZE);
+    size_t length    = (file_size / page + 1) * page;
+
+    char* memory = mmap(NULL, length, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (mmap(memory, file_size, protection, flags|MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(memory, length);
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+    *size = file_size;
+    return memory;
+}
+
+void* memory_map_file(const char* path, size_t* size) {
+    return map_file(path, size, PROT_READ, MAP_SHARED);
+}
+
+void* memory_map_file_copy(const char* path, size_t* size) {
+    return map_file(path, size, PROT_READ|PROT_WRITE, MAP_PRIVATE);
+}
+
+void memory_unmap_file(void* data, size_t size) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    munmap(data, (size / page + 1) * page);
+}
+
+
 static void* (*libc_malloc)(size_t) = NULL;
 static void (*libc_free)(void*) = NULL;
 
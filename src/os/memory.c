@@ -1,3 +1,5 @@
+#include "memory.h"
+
 #if defined(_WIN32)
 #include "win32_memory.c"
 #elif defined(__APPLE__) || defined(__MACH__)
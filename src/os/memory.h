@@ -18,3 +18,11 @@ void memory_dump(void);
 void* memory_map_executable(void* code, size_t size);
 void memory_map_free(void* code, size_t size);
 
+/// Map a file read-only, with its pages shared between every process that maps it.
+/// The mapping is always followed by at least one '\0' byte. Returns NULL on failure
+/// or when the platform can't guarantee the '\0', in which case read the file instead.
+void* memory_map_file(const char* path, size_t* size);
+/// Map a file copy-on-write: the mapping can be written to, but the writes stay
+/// in the process and never reach the file. It isn't followed by a '\0'.
+void* memory_map_file_copy(const char* path, size_t* size);
+void memory_unmap_file(void* data, size_t size);
@@ -0,0 +1,65 @@
+#include "thread.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+typedef struct {
+    pthread_t  thread;
+    ThreadProc proc;
+    void*      arg;
+    int        result;
+} PosixThread;
+
+static void* posix_thread_main(void* arg) {
+    PosixThread* posix = (PosixThread*) arg;
+    posix->result = posix->proc(posix->arg);
+    return NULL;
+}
+
+int thread_start(Thread* thread, ThreadProc proc, void* arg) {
+    PosixThread* posix = malloc(sizeof(PosixThread));
+    if (posix == NULL)
+        return 0;
+
+    posix->proc   = proc;
+    posix->arg    = arg;
+    posix->result = 0;
+    if (pthread_create(&posix->thread, NULL, posix_thread_main, posix) != 0) {
+        free(posix);
+        return 0;
+    }
+
+    thread->handle = posix;
+    return 1;
+}
+
+int thread_join(Thread thread) {
+    PosixThread* posix = (PosixThread*) thread.handle;
+    pthread_join(posix->thread, NULL);
+
+    int result = posix->result;
+    free(posix);
+    return result;
+}
+
+int thread_hardware_count(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+}
+
+// One lock for every ThreadOnce, as it's only taken until each of them is done.
+static pthread_mutex_t once_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void thread_once(ThreadOnce* once, ThreadOnceProc proc) {
+    if (__atomic_load_n(&once->done, __ATOMIC_ACQUIRE))
+        return;
+
+    pthread_mutex_lock(&once_lock);
+    if (!once->done) {
+        proc();
+        __atomic_store_n(&once->done, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&once_lock);
+}
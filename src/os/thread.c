@@ -0,0 +1,7 @@
+#if defined(_WIN32)
+#include "win32_thread.c"
+#elif defined(Unix) || defined(__unix__) || defined(__unix) || defined(__APPLE__) || defined(__MACH__)
+#include "posix_thread.c"
+#else
+#error "Unsupported platform"
+#endif
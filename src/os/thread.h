@@ -0,0 +1,33 @@
+#pragma once
+
+#include "preamble.h"
+
+
+typedef int (*ThreadProc)(void* arg);
+
+typedef struct {
+    void* handle;
+} Thread;
+
+typedef void (*ThreadOnceProc)(void);
+
+/// Guards a proc that thread_once runs only once. Must start out zeroed, as
+/// a static one does.
+typedef struct {
+    long done;
+} ThreadOnce;
+
+
+/// Start a thread running `proc(arg)`. Returns 0 if the thread couldn't be created.
+int  thread_start(Thread* thread, ThreadProc proc, void* arg);
+
+/// Wait for the thread to finish and return the result of its proc.
+int  thread_join(Thread thread);
+
+/// The number of hardware threads, or 1 if it can't be determined.
+int  thread_hardware_count(void);
+
+/// Run `proc` the first time this is called with `once`. Threads that call it
+/// while `proc` runs wait for it, so everything `proc` wrote is visible to
+/// every caller once this returns.
+void thread_once(ThreadOnce* once, ThreadOnceProc proc);
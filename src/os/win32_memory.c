@@ -28,6 +28,67 @@ void memory_map_free(void* code, size_t size) {
 }
 
 
+// A view is zero-filled past the end of the file up to the end of its last page,
+// but nothing can be mapped right after it, so a file that ends exactly on a page
+// boundary has no room for the sentinel and is read instead.
+void* memory_map_file(const char* path, size_t* size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER file_size;
+    SYSTEM_INFO   system_info;
+    GetSystemInfo(&system_info);
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0 || (ULONGLONG) file_size.QuadPart % system_info.dwPageSize == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    void* memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);  // The view keeps the mapping alive.
+    if (memory == NULL)
+        return NULL;
+
+    *size = (size_t) file_size.QuadPart;
+    return memory;
+}
+
+void* memory_map_file_copy(const char* path, size_t* size) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return NULL;
+
+    void* memory = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (memory == NULL)
+        return NULL;
+
+    *size = (size_t) file_size.QuadPart;
+    return memory;
+}
+
+void memory_unmap_file(void* data, size_t size) {
+    (void) size;
+    UnmapViewOfFile(data);
+}
+
+
 void* alloc_(const char* file, int line, size_t size) {
     return malloc(size);
 }
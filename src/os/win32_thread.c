@@ -0,0 +1,67 @@
+#include "thread.h"
+
+#include <windows.h>
+#include <stdlib.h>
+
+
+typedef struct {
+    HANDLE     thread;
+    ThreadProc proc;
+    void*      arg;
+    int        result;
+} Win32Thread;
+
+static DWORD WINAPI win32_thread_main(LPVOID arg) {
+    Win32Thread* win32 = (Win32Thread*) arg;
+    win32->result = win32->proc(win32->arg);
+    return 0;
+}
+
+int thread_start(Thread* thread, ThreadProc proc, void* arg) {
+    Win32Thread* win32 = malloc(sizeof(Win32Thread));
+    if (win32 == NULL)
+        return 0;
+
+    win32->proc   = proc;
+    win32->arg    = arg;
+    win32->result = 0;
+    win32->thread = CreateThread(NULL, 0, win32_thread_main, win32, 0, NULL);
+    if (win32->thread == NULL) {
+        free(win32);
+        return 0;
+    }
+
+    thread->handle = win32;
+    return 1;
+}
+
+int thread_join(Thread thread) {
+    Win32Thread* win32 = (Win32Thread*) thread.handle;
+    WaitForSingleObject(win32->thread, INFINITE);
+    CloseHandle(win32->thread);
+
+    int result = win32->result;
+    free(win32);
+    return result;
+}
+
+int thread_hardware_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+}
+
+// One lock for every ThreadOnce, as it's only taken until each of them is done.
+static SRWLOCK once_lock = SRWLOCK_INIT;
+
+void thread_once(ThreadOnce* once, ThreadOnceProc proc) {
+    if (InterlockedCompareExchange((volatile LONG*) &once->done, 0, 0))
+        return;
+
+    AcquireSRWLockExclusive(&once_lock);
+    if (!once->done) {
+        proc();
+        InterlockedExchange((volatile LONG*) &once->done, 1);
+    }
+    ReleaseSRWLockExclusive(&once_lock);
+}
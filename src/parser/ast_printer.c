@@ -98,14 +98,11 @@ static void visit_call(AstPrinter* printer, const NodeCall* node) {
 
     fprintf(printer->output, "FunCall: id=%d, name='%s' @ %s:%d:%d\n", node_id(printer->ast, (Node *) node), node->name, path, location.row, location.column);
 
-    if (node->args != NULL) {
+    if (node->args.count != 0) {
         printer->indentation += 1;
-        Node* stmt = NULL;
-        int i = 0;
-        while ((stmt = *(node->args + i)) != NULL) {
-            print_indentation(node->args[i+1] == NULL, "arg%d", i);
-            visit((Visitor*) printer, stmt);
-            i += 1;
+        for (u32 i = 0; i < node->args.count; ++i) {
+            print_indentation(i+1 == node->args.count, "arg%d", i);
+            visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->args, i));
         }
         printer->indentation -= 1;
     }
@@ -170,14 +167,9 @@ static void visit_block(AstPrinter* printer, const NodeBlock* node) {
             node_id(printer->ast, (Node *) node), node->parent, node->id, path, location.row, location.column);
 
     printer->indentation += 1;
-    Node* stmt = NULL;
-    int i = 0;
-    if (node->nodes != NULL) {
-        while ((stmt = *(node->nodes + i)) != NULL) {
-            print_indentation(node->nodes[i+1] == NULL, "stmt%d", i);
-            visit((Visitor*) printer, stmt);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        print_indentation(i+1 == node->nodes.count, "stmt%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->nodes, i));
     }
     printer->indentation -= 1;
     printer_rst();
@@ -196,17 +188,12 @@ static void visit_fun_body(AstPrinter* printer, const NodeFunBody* node) {
     const char* path = printer->ast->tokens.name.data;
 
     fprintf(printer->output, "FunBody: id=%d, parent='%d', block_id='%d' decls='%d' @ %s:%d:%d\n",
-            node_id(printer->ast, (Node *) node), node->parent, node->id, node->decls, path, location.row, location.column);
+            node_id(printer->ast, (Node *) node), node->parent, node->id, node->local_count, path, location.row, location.column);
 
     printer->indentation += 1;
-    Node* stmt = NULL;
-    int i = 0;
-    if (node->nodes != NULL) {
-        while ((stmt = *(node->nodes + i)) != NULL) {
-            print_indentation(node->nodes[i+1] == NULL, "stmt%d", i);
-            visit((Visitor*) printer, stmt);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        print_indentation(i+1 == node->nodes.count, "stmt%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->nodes, i));
     }
     printer->indentation -= 1;
     printer_rst();
@@ -221,18 +208,13 @@ static void visit_fun_decl(AstPrinter* printer, const NodeFunDecl* node) {
 
     printer->indentation += 1;
 
-    if (node->params != NULL) {
-        NodeFunParam* param = NULL;
-        int i = 0;
-        while ((param = *(node->params + i)) != NULL) {
-            print_indentation(0, "param%d", i);
-            visit((Visitor*) printer, (Node*)param);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->params.count; ++i) {
+        print_indentation(0, "param%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->params, i));
     }
 
     print_indentation(1, "body");
-    visit_fun_body(printer, node->body);
+    visit((Visitor*) printer, node->body);
     printer->indentation -= 1;
 
     printer_rst();
@@ -262,11 +244,11 @@ static void visit_if_stmt(AstPrinter* printer, const NodeIf* node) {
     printer->indentation += 1;
     print_indentation(0, "cond");
     visit((Visitor*) printer, node->condition);
-    print_indentation(node->else_block == NULL, "then");
-    visit(printer, (Node*) node->then_block);
-    if (node->else_block != NULL) {
+    print_indentation(node->else_block == 0, "then");
+    visit(printer, node->then_block);
+    if (node->else_block != 0) {
         print_indentation(1, "else");
-        visit(printer, (Node*) node->else_block);
+        visit(printer, node->else_block);
     }
     printer->indentation -= 1;
     printer_rst();
@@ -281,11 +263,11 @@ static void visit_while_stmt(AstPrinter* printer, const NodeWhile* node) {
     printer->indentation += 1;
     print_indentation(0, "cond");
     visit((Visitor*) printer, node->condition);
-    print_indentation(node->else_block == NULL, "then");
-    visit_block(printer, node->then_block);
-    if (node->else_block != NULL) {
+    print_indentation(node->else_block == 0, "then");
+    visit(printer, node->then_block);
+    if (node->else_block != 0) {
         print_indentation(1, "else");
-        visit_block(printer, node->else_block);
+        visit(printer, node->else_block);
     }
     printer->indentation -= 1;
     printer_rst();
@@ -308,14 +290,9 @@ static void visit_init(AstPrinter* printer, const NodeInit* node) {
     fprintf(printer->output, "Init: id=%d, name='%s' @ %s:%d:%d\n", node_id(printer->ast, (Node *) node), node->name, path, location.row, location.column);
 
     printer->indentation += 1;
-    NodeInitArg* stmt = NULL;
-    int i = 0;
-    if (node->args != NULL) {
-        while ((stmt = *(node->args + i)) != NULL) {
-            print_indentation(node->args[i+1] == NULL, "arg%d", i);
-            visit((Visitor*) printer, (Node*) stmt);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->args.count; ++i) {
+        print_indentation(i+1 == node->args.count, "arg%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->args, i));
     }
     printer->indentation -= 1;
     printer_rst();
@@ -330,8 +307,8 @@ static void visit_struct_field(AstPrinter* printer, const NodeStructField* node)
             node_id(printer->ast, (Node *) node), repr, node->name, path, location.row, location.column);
     printer->indentation += 1;
     print_indentation(0, "type");
-    visit(printer, (Node*) node->type);
-    if (node->expr != NULL) {
+    visit(printer, node->type);
+    if (node->expr != 0) {
         print_indentation(1, "expr");
         visit((Visitor*) printer, node->expr);
     }
@@ -346,14 +323,9 @@ static void visit_struct_decl(AstPrinter* printer, const NodeStruct* node) {
     fprintf(printer->output, "Struct: id=%d, repr='%s', name='%s' @ %s:%d:%d\n", node_id(printer->ast, (Node *) node), repr, node->name, path, location.row, location.column);
 
     printer->indentation += 1;
-    Node* stmt = NULL;
-    int i = 0;
-    if (node->nodes != NULL) {
-        while ((stmt = *(node->nodes + i)) != NULL) {
-            print_indentation(node->nodes[i+1] == NULL, "field%d", i);
-            visit((Visitor*) printer, stmt);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        print_indentation(i+1 == node->nodes.count, "field%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->nodes, i));
     }
     printer->indentation -= 1;
     printer_rst();
@@ -366,24 +338,14 @@ static void visit_module(AstPrinter* printer, const NodeModule* node) {
     fprintf(printer->output, "Module: id=%d @ %s:%d:%d\n", node_id(printer->ast, (Node *) node), path, location.row, location.column);
 
     printer->indentation += 1;
-    Node* stmt = NULL;
-
-    int i = 0;
-    if (node->decls != NULL) {
-        while ((stmt = *(node->decls + i)) != NULL) {
-            print_indentation(node->decls[i+1] == NULL, "decl%d", i);
-            visit((Visitor*) printer, stmt);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->decls.count; ++i) {
+        print_indentation(i+1 == node->decls.count && node->stmts.count == 0, "decl%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->decls, i));
     }
 
-    i = 0;
-    if (node->stmts != NULL) {
-        while ((stmt = *(node->stmts + i)) != NULL) {
-            print_indentation(node->stmts[i+1] == NULL, "stmt%d", i);
-            visit((Visitor*) printer, stmt);
-            i += 1;
-        }
+    for (u32 i = 0; i < node->stmts.count; ++i) {
+        print_indentation(i+1 == node->stmts.count, "stmt%d", i);
+        visit((Visitor*) printer, node_view_at(&printer->ast->arena, node->stmts, i));
     }
 
     printer->indentation -= 1;
@@ -403,7 +365,7 @@ void ast_print(GrammarTree ast, FILE* output) {
         .output = output,
         .indentation = 0,
     };
+    printer.visitor.arena = &ast.arena;
 
-    Node* node = ast.start;
-    visit((Visitor*) &printer, node);
+    visit((Visitor*) &printer, ast.start);
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "tree.h"
 #include "visitor.h"
 
 #include <stdio.h>
@@ -1,5 +1,11 @@
 #include "node.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "allocator.h"
+
 
 const char* literal_type_name(LiteralType type) {
 #define X(upper, lower, repr, size) case LiteralType_##upper: return #lower;
@@ -133,3 +139,176 @@ int unary_op_is_logical(UnaryOp op) {
     }
 #undef X
 }
+
+
+/* ---------------------------- NODE ARENA -------------------------------- */
+static const u32 NODE_SIZES[NODE_KIND_COUNT] = {
+#define X(upper, lower, flags, body) [NodeKind_##upper] = NODE_POOL_STRIDE(Node##upper),
+    ALL_NODES(X)
+#undef X
+};
+
+NodeArena node_arena_make(size_t token_count) {
+    // Almost every node consumes at least one token, and lists hold at most one
+    // id per node. What is never written to is never touched either, so a large
+    // array costs address space rather than memory. The pools start out empty,
+    // as most kinds only make up a small part of the tree.
+    NodeArena arena = {
+        .kinds = (u8*) alloc(0, token_count + 16),
+        .slots = (u32*) alloc(0, (token_count + 16) * sizeof(u32)),
+        .count = 0,
+        .capacity = (NodeId) (token_count + 16),
+        .views = (NodeId*) alloc(0, (token_count / 2 + 16) * sizeof(NodeId)),
+        .view_count = 0,
+        .view_capacity = (u32) (token_count / 2 + 16),
+    };
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind)
+        arena.pools[kind].stride = NODE_SIZES[kind];
+
+    if (arena.kinds == NULL || arena.slots == NULL || arena.views == NULL) {
+        node_arena_free(&arena);
+        return arena;
+    }
+
+    node_arena_push(&arena, (Node) { .kind = NodeKind_Module });
+    if (arena.count != 1)
+        node_arena_free(&arena);
+    return arena;
+}
+
+void node_arena_free(NodeArena* arena) {
+    if (arena->kinds != NULL)
+        free(arena->kinds);
+    if (arena->slots != NULL)
+        free(arena->slots);
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        if (arena->pools[kind].items != NULL)
+            free(arena->pools[kind].items);
+        if (arena->pools[kind].ids != NULL)
+            free(arena->pools[kind].ids);
+    }
+    if (arena->views != NULL)
+        free(arena->views);
+    *arena = (NodeArena) { 0 };
+}
+
+static int node_pool_grow(NodePool* pool) {
+    size_t capacity = pool->capacity == 0 ? 64 : 2 * (size_t) pool->capacity;
+    u8* items = grow_array(pool->items, pool->count, capacity, pool->stride);
+    if (items == NULL)
+        return 0;
+    pool->items = items;
+
+    NodeId* ids = grow_array(pool->ids, pool->count, capacity, sizeof(NodeId));
+    if (ids == NULL)
+        return 0;
+    pool->ids = ids;
+
+    pool->capacity = (u32) capacity;
+    return 1;
+}
+
+// Returns 0 if out of memory, which is also the module's id. The module is
+// pushed first, by node_arena_make, so that is never ambiguous.
+NodeId node_arena_push(NodeArena* arena, Node node) {
+    if (arena->count == arena->capacity) {
+        size_t capacity = 2 * (size_t) arena->capacity;
+        u8* kinds = grow_array(arena->kinds, arena->count, capacity, sizeof(u8));
+        if (kinds == NULL)
+            return 0;
+        arena->kinds = kinds;
+
+        u32* slots = grow_array(arena->slots, arena->count, capacity, sizeof(u32));
+        if (slots == NULL)
+            return 0;
+        arena->slots = slots;
+
+        arena->capacity = (NodeId) capacity;
+    }
+
+    NodePool* pool = &arena->pools[node.kind];
+    if (pool->count == pool->capacity && !node_pool_grow(pool))
+        return 0;
+
+    NodeId id = arena->count++;
+    u32 slot = pool->count++;
+    arena->kinds[id] = (u8) node.kind;
+    arena->slots[id] = slot;
+    pool->ids[slot] = id;
+    memcpy(node_pool_at(pool, slot), &node, pool->stride);
+    return id;
+}
+
+// The nodes of one kind among [first, end) were pushed one after the other,
+// so they take up consecutive slots in its pool, and are copied in one go.
+NodeId node_arena_append(NodeArena* arena, const NodeArena* other, NodeId first, NodeId end) {
+    u32 count = end - first;
+    if (arena->capacity - arena->count < count) {
+        size_t capacity = 2 * (size_t) arena->capacity;
+        if (capacity < (size_t) arena->count + count)
+            capacity = (size_t) arena->count + count;
+        u8* kinds = grow_array(arena->kinds, arena->count, capacity, sizeof(u8));
+        if (kinds == NULL)
+            return 0;
+        arena->kinds = kinds;
+
+        u32* slots = grow_array(arena->slots, arena->count, capacity, sizeof(u32));
+        if (slots == NULL)
+            return 0;
+        arena->slots = slots;
+
+        arena->capacity = (NodeId) capacity;
+    }
+
+    u32 counts[NODE_KIND_COUNT] = { 0 };
+    u32 firsts[NODE_KIND_COUNT];
+    for (NodeId id = first; id < end; ++id) {
+        u8 kind = other->kinds[id];
+        if (counts[kind]++ == 0)
+            firsts[kind] = other->slots[id];
+    }
+
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind) {
+        NodePool* pool = &arena->pools[kind];
+        if (counts[kind] == 0)
+            continue;
+        while (pool->capacity - pool->count < counts[kind]) {
+            if (!node_pool_grow(pool))
+                return 0;
+        }
+        memcpy(pool->items + (size_t) pool->count * pool->stride, other->pools[kind].items + (size_t) firsts[kind] * pool->stride, (size_t) counts[kind] * pool->stride);
+    }
+
+    NodeId base = arena->count;
+    memcpy(arena->kinds + base, other->kinds + first, count);
+    for (NodeId id = base; id < base + count; ++id) {
+        NodePool* pool = &arena->pools[arena->kinds[id]];
+        u32 slot = pool->count++;
+        arena->slots[id] = slot;
+        pool->ids[slot] = id;
+    }
+    arena->count += count;
+    return base;
+}
+
+void node_arena_set(NodeArena* arena, NodeId id, Node node) {
+    assert(arena->kinds[id] == node.kind && "A node can't change kind");
+    memcpy(node_at(arena, id), &node, arena->pools[node.kind].stride);
+}
+
+int node_arena_push_view(NodeArena* arena, const NodeId* ids, u32 count, NodeView* view) {
+    if (arena->view_capacity - arena->view_count < count) {
+        size_t capacity = 2 * (size_t) arena->view_capacity;
+        if (capacity < (size_t) arena->view_count + count)
+            capacity = (size_t) arena->view_count + count;
+        NodeId* views = grow_array(arena->views, arena->view_count, capacity, sizeof(NodeId));
+        if (views == NULL)
+            return 0;
+        arena->views = views;
+        arena->view_capacity = (u32) capacity;
+    }
+    *view = (NodeView) { arena->view_count, count };
+    memcpy(arena->views + arena->view_count, ids, count * sizeof(NodeId));
+    arena->view_count += count;
+    return 1;
+}
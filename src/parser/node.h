@@ -96,113 +96,111 @@ typedef enum {
 
 #define ALL_NODES(X) \
     X(Literal, literal, NodeFlag_Is_Expression|NodeFlag_Is_Constant,    \
-        LiteralValue value;                                             \
-        LiteralType  type;                                              \
+        LiteralValue  value;                                            \
+        LiteralType   type;                                             \
+        ConstantIndex constant;  /* 0 for booleans. */                  \
     )                                                                   \
     X(Identifier, identifier, NodeFlag_Is_Expression,                   \
         const char* name;                                               \
+        NodeSlot    resolved;                                           \
     )                                                                   \
     X(Unary, unary, NodeFlag_Is_Expression,                             \
-        Node* expr;                                                     \
+        NodeId  expr;                                                   \
         UnaryOp op;                                                     \
     )                                                                   \
     X(Binary, binary, NodeFlag_Is_Expression,                           \
-        Node* left;                                                     \
-        Node* right;                                                    \
+        NodeId   left;                                                  \
+        NodeId   right;                                                 \
         BinaryOp op;                                                    \
     )                                                                   \
     X(Call, call, NodeFlag_Is_Expression,                               \
         const char* name;                                               \
-        i32    count;                                                   \
-        Node** args;                                                    \
+        NodeView    args;                                               \
+        NodeSlot    resolved;                                           \
     )                                                                   \
     X(Access, access, NodeFlag_Is_Expression,                           \
-        Node* left;                                                     \
-        Node* right;                                                    \
+        NodeId left;                                                    \
+        NodeId right;                                                   \
     )                                                                   \
     X(Type, type, NodeFlag_None,                                        \
         const char* name;                                               \
+        TypeId      type_id;                                            \
     )                                                                   \
     X(Assign, assign, NodeFlag_Is_Statement,                            \
         const char* name;                                               \
-        Node* expression;                                               \
+        NodeId   expression;                                            \
+        NodeSlot resolved;                                              \
     )                                                                   \
     X(VarDecl, var_decl, NodeFlag_Is_Statement,                         \
         const char* name;                                               \
-        i32 decl_offset;                                                \
-        Node* expression;                                               \
+        i32    decl_offset;                                             \
+        NodeId expression;                                              \
     )                                                                   \
     X(Block, block, NodeFlag_Is_Statement,                              \
-        i32    id;                                                      \
-        i32    parent;                                                  \
-        i32    count;                                                   \
-        Node** nodes;                                                   \
-        i32    decl_count;                                              \
-        Node** decls;                                                   \
+        i32      id;                                                    \
+        i32      parent;                                                \
+        NodeView nodes;                                                 \
+        u32      declared_count;  /* Locals declared in it directly. */ \
     )                                                                   \
     X(FunBody, fun_body, NodeFlag_None,                                 \
-        i32    id;                                                      \
-        i32    parent;                                                  \
-        i32    count;                                                   \
-        Node** nodes;                                                   \
-        i32    decl_count;                                              \
-        Node** decls;                                                   \
+        i32      id;                                                    \
+        i32      parent;                                                \
+        NodeView nodes;                                                 \
+        u32      declared_count;  /* With the parameters. */            \
+        i32      local_count;                                           \
     )                                                                   \
     X(FunParam, fun_param, NodeFlag_Is_Statement,                       \
         const char* name;                                               \
-        int   offset;                                                   \
-        Node* type;                                                     \
-        Node* expression;                                               \
+        int    offset;                                                  \
+        NodeId type;                                                    \
+        NodeId expression;                                              \
     )                                                                   \
     X(FunDecl, fun_decl, NodeFlag_Is_Statement,                         \
-        const char* name;                                               \
-        NodeFunParam** params;                                          \
-        i32 param_count;                                                \
-        Node* return_type;                                              \
-        NodeFunBody* body;                                              \
+        NodeId   return_type;                                           \
+        const char* name;  /* At the same offset as a VarDecl's. */     \
+        NodeView params;                                                \
+        NodeId   body;                                                  \
+        TypeId   type_id;  /* Of its signature. */                      \
     )                                                                   \
     X(Return, return_stmt, NodeFlag_Is_Statement,                       \
-        Node* expression;                                               \
+        NodeId expression;                                              \
     )                                                                   \
     X(If, if_stmt, NodeFlag_Is_Statement,                               \
-        Node* condition;                                                \
-        NodeBlock* then_block;                                          \
-        NodeBlock* else_block;                                          \
+        NodeId condition;                                               \
+        NodeId then_block;                                              \
+        NodeId else_block;                                              \
     )                                                                   \
     X(While, while_stmt, NodeFlag_Is_Statement,                         \
-        Node* condition;                                                \
-        NodeBlock* then_block;                                          \
-        NodeBlock* else_block;                                          \
+        NodeId condition;                                               \
+        NodeId then_block;                                              \
+        NodeId else_block;                                              \
     )                                                                   \
     X(InitArg, init_arg, NodeFlag_None,                                 \
         const char* name;                                               \
         int    offset;                                                  \
-        Node*  expr;                                                    \
+        NodeId expr;                                                    \
     )                                                                   \
     X(Init, init, NodeFlag_Is_Expression,                               \
         const char* name;                                               \
-        int    count;                                                   \
-        NodeInitArg** args;                                             \
+        NodeView    args;                                               \
     )                                                                   \
     X(StructField, struct_field, NodeFlag_None,                         \
         const char* name;                                               \
-        int   offset;                                                   \
-        Node* type;                                                     \
-        Node* expr;                                                     \
+        int    offset;                                                  \
+        NodeId type;                                                    \
+        NodeId expr;                                                    \
     )                                                                   \
     X(Struct, struct_decl, NodeFlag_None,                               \
-        i32    id;                                                      \
-        i32    parent;                                                  \
-        int    count;                                                   \
-        Node** nodes;                                                   \
+        i32      id;                                                    \
+        i32      parent;                                                \
+        NodeView nodes;                                                 \
         const char* name;                                               \
     )                                                                   \
     X(Module, module, NodeFlag_None,                                    \
-        Node** stmts;                                                   \
-        i64    stmt_count;                                              \
-        Node** decls;                                                   \
-        i64    decl_count;                                              \
-        i64    global_count;                                            \
+        NodeView stmts;                                                 \
+        NodeView decls;                                                 \
+        u32      declared_count;                                        \
+        i64      global_count;                                          \
     )                                                                   \
 
 
@@ -212,8 +210,27 @@ typedef enum {
 #undef X
 } NodeKind;
 
+/// Nodes refer to each other by their index in the tree rather than by pointer,
+/// so the tree can be moved while it grows, and stored as it is. The module is
+/// always node 0 and is never a child, so a NodeId of 0 also means "no node".
 typedef u32 NodeId;
 
+/// A list of children, stored as `count` ids from `offset` in the tree's views.
+typedef struct {
+    u32 offset;
+    u32 count;
+} NodeView;
+
+/// What a name refers to: the local at `slot` in the block with id `block`.
+/// Set by the resolver. The block is -1 if nothing was declared with the name.
+typedef struct {
+    i32 block;
+    u32 slot;
+} NodeSlot;
+
+/// The id of a type in the checker's type table. Set by the checker, 0 until then.
+typedef u32 TypeId;
+
 typedef union Node Node;
 typedef struct {
     NodeKind   kind;
@@ -233,6 +250,9 @@ union Node {
 #undef X
 };
 
+// Fails to compile if a node grows past 40 bytes.
+typedef char node_fits_in_40_bytes[sizeof(Node) <= 40 ? 1 : -1];
+
 #define X(upper, lower, flags, body) \
     static inline NodeBase node_base_##lower(TokenIndex start, TokenIndex end) { return (NodeBase) { NodeKind_##upper, start, end }; }
 ALL_NODES(X)
@@ -245,3 +265,85 @@ ALL_NODES(X)
 
 int node_is_expression(const Node* node);
 int node_is_statement(const Node* node);
+
+
+/* ---------------------------- NODE ARENA -------------------------------- */
+#define X(upper, lower, flags, body) + 1
+enum { NODE_KIND_COUNT = 0 ALL_NODES(X) };
+#undef X
+
+/// All nodes of one kind, packed at their own size rather than the size of
+/// the largest node. `ids` maps a node back to its id.
+typedef struct {
+    u8*     items;
+    NodeId* ids;
+    u32     stride;
+    u32     count;
+    u32     capacity;
+} NodePool;
+
+/// Every node of a tree, stored by kind. A node id indexes `kinds` and `slots`,
+/// and the node itself is `slots[id]` in the pool of its kind. Lists of
+/// children are ids in `views`. Nothing points into the arrays, so they grow
+/// by moving.
+typedef struct {
+    u8*      kinds;
+    u32*     slots;
+    NodeId   count;
+    NodeId   capacity;
+    NodePool pools[NODE_KIND_COUNT];
+    NodeId*  views;
+    u32      view_count;
+    u32      view_capacity;
+} NodeArena;
+
+/// Sizes the arrays from the number of tokens, so that most programs never
+/// need to grow them. Node 0 is reserved for the module. Returns an arena with
+/// kinds == NULL on failure.
+NodeArena node_arena_make(size_t token_count);
+void      node_arena_free(NodeArena* arena);
+
+/// Copies the part of `node` that its kind uses. Returns 0 if out of memory.
+NodeId    node_arena_push(NodeArena* arena, Node node);
+/// Copies the nodes [first, end) of `other` to the end, as they are, so the ids
+/// in them still refer to `other`. Returns the id of the first, or 0 if out of memory.
+NodeId    node_arena_append(NodeArena* arena, const NodeArena* other, NodeId first, NodeId end);
+/// Overwrites a node with one of the same kind.
+void      node_arena_set(NodeArena* arena, NodeId id, Node node);
+/// Copies `count` ids into the views. Returns 0 if out of memory.
+int       node_arena_push_view(NodeArena* arena, const NodeId* ids, u32 count, NodeView* view);
+
+static inline NodeKind node_kind_at(const NodeArena* arena, NodeId id) {
+    return (NodeKind) arena->kinds[id];
+}
+
+/// How far apart the nodes of a kind lie in its pool: the kind's own size,
+/// rounded up to the alignment of Node, as node_at hands out Node pointers.
+#define NODE_POOL_STRIDE(type) ((u32) ((sizeof(type) + _Alignof(Node) - 1) & ~(_Alignof(Node) - 1)))
+
+/// The node in `slot` of the pool.
+static inline void* node_pool_at(const NodePool* pool, u32 slot) {
+    return pool->items + (size_t) slot * pool->stride;
+}
+
+/// Only the members of the node's own kind may be used through the result.
+static inline Node* node_at(const NodeArena* arena, NodeId id) {
+    return (Node*) node_pool_at(&arena->pools[arena->kinds[id]], arena->slots[id]);
+}
+
+#define X(upper, lower, flags, body)                                                       \
+    static inline Node##upper* node_##lower##_at(const NodeArena* arena, NodeId id) {      \
+        return (Node##upper*) node_pool_at(&arena->pools[NodeKind_##upper], arena->slots[id]); \
+    }
+ALL_NODES(X)
+#undef X
+
+static inline NodeId node_view_at(const NodeArena* arena, NodeView view, u32 index) {
+    return arena->views[view.offset + index];
+}
+
+/// Only valid for pointers into the arena's pools, like the ones visitors receive.
+static inline NodeId node_id_of(const NodeArena* arena, const Node* node) {
+    const NodePool* pool = &arena->pools[node->kind];
+    return pool->ids[(size_t) ((const u8*) node - pool->items) / pool->stride];
+}
@@ -1,48 +1,75 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <assert.h>
 
 #include "parser.h"
 #include "error.h"
 #include "allocator.h"
+#include "os/thread.h"
 
 
 
 
 
 /* ---------------------------- PARSER IMPL -------------------------------- */
+typedef struct ExprFrame ExprFrame;
+typedef struct ParsedFun ParsedFun;
+
 typedef struct {
     const TokenArray tokens;
     TokenIndex token_index;
 
-    NodeBlock*  current_block;
+    i32         current_block;  // The id of the innermost block, 0 for the module.
     int         current_decl_count;
 
     NodeId     block_count;
-    Node**     stack;
+    NodeId*    stack;
     NodeId     stack_count;
-
-    Node*      nodes;
-    NodeId     node_count;
-    Node**     views;
-    NodeId     view_count;
+    NodeId     stack_capacity;
+
+    ExprFrame* frames;          // The operators of the expression being parsed, innermost last.
+    u32        frame_count;
+    u32        frame_capacity;
+
+    ParseError* errors;
+    u32         error_count;
+    u32         error_capacity;
+    u32         max_errors;     // 0 if there's no limit.
+
+    NodeArena  arena;
+    int        out_of_memory;
+
+    // Set while parsing ahead on another thread. Nothing is printed then, as
+    // whatever fails is parsed again on the calling thread, which reports it.
+    int        speculative;
+    Logger     logger;          // Points out where the errors are.
+
+    // The top-level functions that were parsed ahead, in the order they
+    // appear, and the first that hasn't been reached yet.
+    ParsedFun* parsed_funs;
+    u32        parsed_fun_count;
+    u32        next_parsed_fun;
 } Parser;
 
 void parser_free(Parser* parser) {
-    free(parser->nodes);
-    free(parser->views);
+    node_arena_free(&parser->arena);
     free(parser->stack);
+    free(parser->frames);
+    free(parser->errors);
     token_array_free(parser->tokens);
 }
 
-GrammarTree parser_to_ast(Parser* parser, Node* start) {
+GrammarTree parser_to_ast(Parser* parser, NodeId start) {
     free(parser->stack);
+    free(parser->frames);
     return (GrammarTree) {
         parser->tokens,
-        parser->nodes,
+        parser->arena,
         start,
-        parser->views,
-        parser->block_count
+        parser->block_count,
+        parser->errors,
+        parser->error_count
     };
 }
 
@@ -65,78 +92,215 @@ static inline const char* repr_of_current(const Parser* parser) {
     return lexer_repr_of(parser->tokens, parser->token_index);
 }
 
-static inline Node* add_node(Parser* parser, Node node) {
-    NodeId id = parser->node_count++;
-    parser->nodes[id] = node;
-    return &parser->nodes[id];
+// Reported once. Parsing stops at the end of the current statement.
+static void out_of_memory(Parser* parser) {
+    if (!parser->out_of_memory && !parser->speculative)
+        fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Out of memory\n", STR_ARG(parser->tokens.name));
+    parser->out_of_memory = 1;
 }
 
-static inline NodeId reserve_node(Parser* parser) {
-    NodeId id = parser->node_count++;
-    return id;
+// Prints the error at the token and adds it to the parser's errors.
+static void parse_error(Parser* parser, TokenIndex token, const char* format, ...) {
+    if (parser->speculative) {
+        parser->error_count += 1;
+        return;
+    }
+
+    if (parser->error_count == parser->error_capacity) {
+        u32 capacity = parser->error_capacity == 0 ? 8 : 2 * parser->error_capacity;
+        ParseError* errors = (ParseError*) alloc(0, capacity * sizeof(ParseError));
+        if (errors == NULL) {
+            out_of_memory(parser);
+            return;
+        }
+        if (parser->error_count != 0)
+            memcpy(errors, parser->errors, parser->error_count * sizeof(ParseError));
+        free(parser->errors);
+        parser->errors = errors;
+        parser->error_capacity = capacity;
+    }
+
+    ParseError* error = &parser->errors[parser->error_count++];
+    error->token = token;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(error->message, sizeof(error->message), format, args);
+    va_end(args);
+
+    fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    %s\n", STR_ARG(parser->tokens.name), error->message);
+    int start = (int) parser->tokens.source_offsets[token];
+    point_to_error_indexed(&parser->logger, parser->tokens.source, parser->tokens.lines, start, start+1);
 }
 
-static inline Node* set_node(Parser* parser, NodeId id, Node node) {
-    parser->nodes[id] = node;
-    return &parser->nodes[id];
+// Nodes may move whenever one is added, so hold on to ids rather than pointers.
+static inline Node* get_node(const Parser* parser, NodeId id) {
+    return node_at(&parser->arena, id);
 }
 
-// Sorts the nodes in the stack by declaration order.
-// This is so we can visit function declarations before they are used.
-static int sort_nodes_by_fun_decl(Node** nodes, int count) {
-    int fun_count = 0;
-    for (int i = 0; i < count; ++i) {
-        if (nodes[i]->kind == NodeKind_FunDecl) {
-            for (int j = i; j > fun_count; --j) {
-                if (nodes[j - 1]->kind == NodeKind_FunDecl) {
-                    Node* temp = nodes[j];
-                    nodes[j] = nodes[j - 1];
-                    nodes[j - 1] = temp;
-                } else {
-                    break;
-                }
-            }
-            fun_count += 1;
-        }
+// Returns 0 if out of memory.
+static inline NodeId add_node(Parser* parser, Node node) {
+    NodeId id = node_arena_push(&parser->arena, node);
+    if (id == 0) {
+        out_of_memory(parser);
     }
-    return fun_count;
+    return id;
+}
+
+// The node must be of the kind it was reserved as.
+static inline NodeId set_node(Parser* parser, NodeId id, Node node) {
+    node_arena_set(&parser->arena, id, node);
+    return id;
 }
 
 static inline NodeId stack_snapshot(Parser* parser) {
     return parser->stack_count;
 }
 
-static inline void stack_push(Parser* parser, Node* node) {
+// Returns 0 if out of memory.
+static int stack_grow(Parser* parser) {
+    NodeId capacity = 2 * parser->stack_capacity;
+    NodeId* stack = (NodeId*) alloc(0, capacity * sizeof(NodeId));
+    if (stack == NULL) {
+        out_of_memory(parser);
+        return 0;
+    }
+    memcpy(stack, parser->stack, parser->stack_count * sizeof(NodeId));
+    free(parser->stack);
+    parser->stack = stack;
+    parser->stack_capacity = capacity;
+    return 1;
+}
+
+static inline void stack_push(Parser* parser, NodeId node) {
+    if (parser->stack_count == parser->stack_capacity && !stack_grow(parser)) {
+        return;
+    }
     parser->stack[parser->stack_count++] = node;
 }
 
-static inline Node** stack_restore(Parser* parser, NodeId snapshot) {
-    if (snapshot == parser->stack_count) {
-        return NULL;
+// Moves the nodes pushed since the snapshot into the views.
+static inline NodeView stack_restore(Parser* parser, NodeId snapshot) {
+    NodeView view = { 0, 0 };
+    u32 count = parser->stack_count - snapshot;
+    if (count != 0 && !node_arena_push_view(&parser->arena, parser->stack + snapshot, count, &view)) {
+        out_of_memory(parser);
     }
+    parser->stack_count = snapshot;
+    return view;
+}
 
-    Node** nodes = parser->views + parser->view_count;
-    for (size_t i = snapshot; i < parser->stack_count; ++i) {
-        parser->views[parser->view_count++] = parser->stack[i];
+// Sorts the nodes in the view by declaration order.
+// This is so we can visit function declarations before they are used.
+// It's a stable partition in a single pass: the declarations are moved to
+// the front as they're found, and the rest wait on the stack until they're
+// copied back after them. Returns the number of declarations.
+static int sort_nodes_by_fun_decl(Parser* parser, NodeView view) {
+    NodeId* nodes = parser->arena.views + view.offset;
+    NodeId snapshot = stack_snapshot(parser);
+    u32 fun_count = 0;
+    for (u32 i = 0; i < view.count; ++i) {
+        if (node_kind_at(&parser->arena, nodes[i]) == NodeKind_FunDecl)
+            nodes[fun_count++] = nodes[i];
+        else
+            stack_push(parser, nodes[i]);
+    }
+    if (parser->out_of_memory) {
+        parser->stack_count = snapshot;
+        return 0;
     }
-    parser->views[parser->view_count++] = NULL;
+    memcpy(nodes + fun_count, parser->stack + snapshot, (view.count - fun_count) * sizeof(NodeId));
     parser->stack_count = snapshot;
-    return nodes;
+    return (int) fun_count;
 }
 
 
-/* ---------------------------- PARSER VISITOR -------------------------------- */
-static Node* number(Parser*);
-static Node* real(Parser*);
-static Node* string(Parser* parser);
-static Node* identifier(Parser*);
-static Node* group(Parser*);
+/* ---------------------------- PARSER RECOVERY -------------------------------- */
+// The state of the parser before a statement, to go back to if it fails.
+typedef struct {
+    TokenIndex token_index;
+    NodeId     stack_count;
+    i32        current_block;
+    int        current_decl_count;
+} StatementStart;
+
+static inline StatementStart statement_start(const Parser* parser) {
+    return (StatementStart) {
+        parser->token_index,
+        parser->stack_count,
+        parser->current_block,
+        parser->current_decl_count,
+    };
+}
+
+// Whether there's a line break between the two tokens.
+static int is_on_new_line(const Parser* parser, TokenIndex previous, TokenIndex token) {
+    const char* source = parser->tokens.source.data;
+    for (SourceIndex i = parser->tokens.source_offsets[previous]; i < parser->tokens.source_offsets[token]; ++i) {
+        if (source[i] == '\n')
+            return 1;
+    }
+    return 0;
+}
+
+// Panic mode: drops the statement that failed and skips ahead to where the
+// next one probably starts, which is a keyword that starts a declaration or
+// statement, the '}' that ends the block, or the first token on a new line.
+// Blocks are skipped as a whole, so that their '}' doesn't end the block
+// around them. Returns 0 if parsing should stop instead, as it's out of
+// memory or has reported as many errors as it may.
+static int recover(Parser* parser, StatementStart start) {
+    if (parser->out_of_memory)
+        return 0;
+    if (parser->max_errors != 0 && parser->error_count >= parser->max_errors)
+        return 0;
+
+    parser->stack_count        = start.stack_count;
+    parser->frame_count        = 0;
+    parser->current_block      = start.current_block;
+    parser->current_decl_count = start.current_decl_count;
+
+    // Always make progress, or the same statement fails again.
+    if (parser->token_index == start.token_index && current(parser) != Token_Eof)
+        advance(parser);
 
-static Node* binary(Parser* parser, Node* left);
-static Node* call(Parser* parser, Node* left);
+    while (current(parser) != Token_Eof) {
+        switch (current(parser)) {
+            case Token_Fun:
+            case Token_Struct:
+            case Token_If:
+            case Token_While:
+            case Token_Return:
+            case Token_Close_Brace:
+                return 1;
+            default:
+                break;
+        }
+        if (is_on_new_line(parser, parser->token_index - 1, parser->token_index))
+            return 1;
+
+        int depth = 0;
+        do {
+            if (current(parser) == Token_Open_Brace)
+                depth += 1;
+            else if (current(parser) == Token_Close_Brace)
+                depth -= 1;
+            advance(parser);
+        } while (depth > 0 && current(parser) != Token_Eof);
+    }
+    return 1;
+}
 
-static Node* statement(Parser* parser);
-static Node* expression(Parser* parser);
+
+/* ---------------------------- PARSER VISITOR -------------------------------- */
+static NodeId number(Parser*);
+static NodeId real(Parser*);
+static NodeId string(Parser* parser);
+static NodeId boolean(Parser*);
+static NodeId identifier(Parser*);
+
+static NodeId statement(Parser* parser);
+static NodeId expression(Parser* parser);
 
 
 typedef enum {
@@ -153,113 +317,190 @@ typedef enum {
     Precedence_Primary
 } Precedence;
 
-typedef Node* (*ParsePrefixFn)(Parser*);
-typedef Node* (*ParseInfixFn)(Parser*, Node*);
+// What a token opens when it's found in front of an operand (prefix) or after
+// one (infix). Each open operator is a frame until its operands are parsed.
+typedef enum {
+    Operator_None,      // Also the frame of the expression itself.
+    Operator_Group,     // ( expression )
+    Operator_Unary,     // op operand
+    Operator_Binary,    // left op right
+    Operator_Call,      // identifier ( expression, ... )
+} Operator;
+
+typedef NodeId (*ParseOperandFn)(Parser*);
 typedef struct {
-    ParsePrefixFn prefix;
-    ParseInfixFn  infix;
+    ParseOperandFn operand;
+    Operator prefix;
+    Operator infix;
     Precedence precedence;
 } ParseRule;
 
-ParseRule rules[30] = {
-        [Token_Number]              = { number,       NULL,         Precedence_None},
-        [Token_Real]                = { real,         NULL,         Precedence_None},
-        [Token_String]              = { string,       NULL,         Precedence_None},
-        [Token_Identifier]          = { identifier,   NULL,         Precedence_None},
-        [Token_Minus]               = { NULL,         binary,       Precedence_Term},
-        [Token_Plus]                = { NULL,         binary,       Precedence_Term},
-        [Token_Asterisk]            = { NULL,         binary,       Precedence_Factor},
-        [Token_Slash]               = { NULL,         binary,       Precedence_Factor},
-        [Token_Percent]             = { NULL,         binary,       Precedence_Factor},
-        [Token_Less]                = { NULL,         binary,       Precedence_Comparison},
-        [Token_Less_Equal]          = { NULL,         binary,       Precedence_Comparison},
-        [Token_Equal_Equal]         = { NULL,         binary,       Precedence_Equality},
-        [Token_Bang_Equal]          = { NULL,         binary,       Precedence_Equality},
-        [Token_Greater_Equal]       = { NULL,         binary,       Precedence_Comparison},
-        [Token_Greater]             = { NULL,         binary,       Precedence_Comparison},
-        [Token_Bang]                = { NULL,         NULL,         Precedence_None},
-        [Token_Equal]               = { NULL,         NULL,         Precedence_None},
-        [Token_Colon]               = { NULL,         NULL,         Precedence_None},
-        [Token_Colon_Equal]         = { NULL,         NULL,         Precedence_None},
-        [Token_If]                  = { NULL,         NULL,         Precedence_None},
-        [Token_Else]                = { NULL,         NULL,         Precedence_None},
-        [Token_While]               = { NULL,         NULL,         Precedence_None},
-        [Token_Fun]                 = { NULL,         NULL,         Precedence_None},
-        [Token_Return]              = { NULL,         NULL,         Precedence_None},
-        [Token_Open_Paren]          = { group,        call,         Precedence_Call},
-        [Token_Close_Paren]         = { NULL,         NULL,         Precedence_None},
-        [Token_Open_Brace]          = { NULL,         NULL,         Precedence_None},
-        [Token_Close_Brace]         = { NULL,         NULL,         Precedence_None},
-        [Token_Comma]               = { NULL,         NULL,         Precedence_None},
-        [Token_Eof]                 = { NULL,         NULL,         Precedence_None},
+ParseRule rules[TOKEN_LAST + 1] = {
+        [Token_Number]              = { number,       Operator_None,    Operator_None,     Precedence_None},
+        [Token_Real]                = { real,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_String]              = { string,       Operator_None,    Operator_None,     Precedence_None},
+        [Token_Identifier]          = { identifier,   Operator_None,    Operator_None,     Precedence_None},
+        [Token_True]                = { boolean,      Operator_None,    Operator_None,     Precedence_None},
+        [Token_False]               = { boolean,      Operator_None,    Operator_None,     Precedence_None},
+        [Token_Not]                 = { NULL,         Operator_Unary,   Operator_None,     Precedence_None},
+        [Token_And]                 = { NULL,         Operator_None,    Operator_Binary,   Precedence_And},
+        [Token_Or]                  = { NULL,         Operator_None,    Operator_Binary,   Precedence_Or},
+        [Token_Minus]               = { NULL,         Operator_None,    Operator_Binary,   Precedence_Term},
+        [Token_Plus]                = { NULL,         Operator_None,    Operator_Binary,   Precedence_Term},
+        [Token_Asterisk]            = { NULL,         Operator_None,    Operator_Binary,   Precedence_Factor},
+        [Token_Slash]               = { NULL,         Operator_None,    Operator_Binary,   Precedence_Factor},
+        [Token_Percent]             = { NULL,         Operator_None,    Operator_Binary,   Precedence_Factor},
+        [Token_Less]                = { NULL,         Operator_None,    Operator_Binary,   Precedence_Comparison},
+        [Token_Less_Equal]          = { NULL,         Operator_None,    Operator_Binary,   Precedence_Comparison},
+        [Token_Equal_Equal]         = { NULL,         Operator_None,    Operator_Binary,   Precedence_Equality},
+        [Token_Bang_Equal]          = { NULL,         Operator_None,    Operator_Binary,   Precedence_Equality},
+        [Token_Greater_Equal]       = { NULL,         Operator_None,    Operator_Binary,   Precedence_Comparison},
+        [Token_Greater]             = { NULL,         Operator_None,    Operator_Binary,   Precedence_Comparison},
+        [Token_Bang]                = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Equal]               = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Colon]               = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Colon_Equal]         = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_If]                  = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Else]                = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_While]               = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Fun]                 = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Return]              = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Open_Paren]          = { NULL,         Operator_Group,   Operator_Call,     Precedence_Call},
+        [Token_Close_Paren]         = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Open_Brace]          = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Close_Brace]         = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Comma]               = { NULL,         Operator_None,    Operator_None,     Precedence_None},
+        [Token_Eof]                 = { NULL,         Operator_None,    Operator_None,     Precedence_None},
 };
 
+static const BinaryOp bin_op_map[TOKEN_LAST + 1] = {
+        [Token_Plus]          = BinaryOp_Add,
+        [Token_Minus]         = BinaryOp_Sub,
+        [Token_Asterisk]      = BinaryOp_Mul,
+        [Token_Slash]         = BinaryOp_Div,
+        [Token_Percent]       = BinaryOp_Mod,
+        [Token_Less]          = BinaryOp_Lt,
+        [Token_Less_Equal]    = BinaryOp_Le,
+        [Token_Equal_Equal]   = BinaryOp_Eq,
+        [Token_Bang_Equal]    = BinaryOp_Ne,
+        [Token_Greater_Equal] = BinaryOp_Ge,
+        [Token_Greater]       = BinaryOp_Gt,
+        [Token_And]           = BinaryOp_And,
+        [Token_Or]            = BinaryOp_Or,
+};
 
-static Node* precedence(Parser* parser, Precedence precedence) {
-    Token token = current(parser);
+static const UnaryOp unary_op_map[TOKEN_LAST + 1] = {
+        [Token_Not]           = UnaryOp_Not,
+};
+
+
+// An operator that is still waiting for an operand. Infix operators binding
+// looser than `precedence` end that operand.
+struct ExprFrame {
+    Operator   kind;
+    Precedence precedence;
+    TokenIndex start;
+    u32        depth;       // The number of groups, calls and unary operators open, this one included.
+    NodeId     left;        // Binary: the left operand. Call: the callee.
+    NodeId     last;        // Call: the last argument, 0 if there's none yet.
+    NodeId     snapshot;    // Call: where the arguments start on the stack.
+};
 
-    ParsePrefixFn prefix = rules[token].prefix;
-    if (prefix == NULL) {
-        fprintf(stderr, "Expect expression\n");
+// Returns 0 if out of memory.
+static int frame_grow(Parser* parser) {
+    u32 capacity = 2 * parser->frame_capacity;
+    ExprFrame* frames = (ExprFrame*) alloc(0, capacity * sizeof(ExprFrame));
+    if (frames == NULL) {
+        out_of_memory(parser);
         return 0;
     }
+    memcpy(frames, parser->frames, parser->frame_count * sizeof(ExprFrame));
+    free(parser->frames);
+    parser->frames = frames;
+    parser->frame_capacity = capacity;
+    return 1;
+}
 
-    Node* left = prefix(parser);
-
-    while (1) {
-        token = current(parser);
-        Precedence next_precedence = rules[token].precedence;
-        if (precedence > next_precedence) {
-            break;
+// Opens an operator at the current token.
+// Returns 0 if the expression is nested too deep or out of memory.
+static inline int frame_push(Parser* parser, Operator kind, Precedence precedence, NodeId left) {
+    u32 depth = parser->frame_count == 0 ? 0 : parser->frames[parser->frame_count - 1].depth;
+    if (kind == Operator_Group || kind == Operator_Call || kind == Operator_Unary) {
+        if (depth == PARSER_MAX_EXPRESSION_DEPTH) {
+            parse_error(parser, parser->token_index, "Expression is nested more than %d levels deep", PARSER_MAX_EXPRESSION_DEPTH);
+            return 0;
         }
-
-        ParseInfixFn infix = rules[token].infix;
-        left = infix(parser, left);
+        depth += 1;
     }
 
-    return left;
+    if (parser->frame_count == parser->frame_capacity && !frame_grow(parser)) {
+        return 0;
+    }
+    parser->frames[parser->frame_count++] = (ExprFrame) {
+        .kind = kind,
+        .precedence = precedence,
+        .start = parser->token_index,
+        .depth = depth,
+        .left = left,
+        .last = 0,
+        .snapshot = stack_snapshot(parser),
+    };
+    return 1;
 }
 
 
-static Node* number(Parser* parser) {
+static NodeId number(Parser* parser) {
     assert(current(parser) == Token_Number && "Expected number token");
     TokenIndex start = parser->token_index;
 
-    const char* repr = repr_of_current(parser);
-    i64 value = strtoll(repr, NULL, 10);
+    ConstantIndex constant = token_array_payload(parser->tokens, start);
+    u64 value = parser->tokens.constants[constant].as.integer;
     advance(parser);
 
-    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_Integer, .value.integer = value };
+    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_Integer, .value.integer = value, .constant = constant };
     return add_node(parser, (Node) { .literal = literal });
 }
 
 
-static Node* real(Parser* parser) {
+static NodeId real(Parser* parser) {
     assert(current(parser) == Token_Real && "Expected real token");
     TokenIndex start = parser->token_index;
 
-    const char* repr = repr_of_current(parser);
-    f64 value = strtod(repr, NULL);
+    ConstantIndex constant = token_array_payload(parser->tokens, start);
+    f64 value = parser->tokens.constants[constant].as.real;
     advance(parser);
 
-    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_Real, .value.real = value };
+    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_Real, .value.real = value, .constant = constant };
     return add_node(parser, (Node) { .literal = literal });
 }
 
 
-static Node* string(Parser* parser) {
+static NodeId string(Parser* parser) {
     assert(current(parser) == Token_String && "Expected string token");
     TokenIndex start = parser->token_index;
 
-    const char* repr = repr_of_current(parser);
+    ConstantIndex constant = token_array_payload(parser->tokens, start);
+    const char* value = (const char*) &parser->tokens.data_pool[parser->tokens.constants[constant].as.string];
+    advance(parser);
+
+    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_String, .value.string = value, .constant = constant };
+    return add_node(parser, (Node) { .literal = literal });
+}
+
+
+static NodeId boolean(Parser* parser) {
+    assert((current(parser) == Token_True || current(parser) == Token_False) && "Expected boolean token");
+    TokenIndex start = parser->token_index;
+
+    u64 value = current(parser) == Token_True;
     advance(parser);
 
-    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_String, .value.string = repr };
+    NodeLiteral literal = { { NodeKind_Literal, start, start }, .type = LiteralType_Boolean, .value.integer = value, .constant = 0 };
     return add_node(parser, (Node) { .literal = literal });
 }
 
 
-static Node* identifier(Parser* parser) {
+static NodeId identifier(Parser* parser) {
     assert(current(parser) == Token_Identifier && "Expected identifier token");
     TokenIndex start = parser->token_index;
 
@@ -274,121 +515,172 @@ static Node* identifier(Parser* parser) {
 }
 
 
-static Node* binary(Parser* parser, Node* left) {
-    Token token = current(parser);
-    assert((
-        token_group(token) == TokenGroup_Binary_Arithmetic_Operator ||
-        token_group(token) == TokenGroup_Binary_Comparison_Operator
-    ) && "Expected binary operator");
-    TokenIndex start = parser->token_index;
+// Closes the call on top of the frames at its ')'.
+static NodeId call_end(Parser* parser) {
+    ExprFrame frame = parser->frames[--parser->frame_count];
+    assert(frame.kind == Operator_Call && "Expected call frame");
 
-    static const BinaryOp bin_op_map[] = {
-        [Token_Plus]        = BinaryOp_Add,
-        [Token_Minus]       = BinaryOp_Sub,
-        [Token_Asterisk]    = BinaryOp_Mul,
-        [Token_Slash]       = BinaryOp_Div,
-        [Token_Percent]     = BinaryOp_Mod,
-        [Token_Less]        = BinaryOp_Lt,
-        [Token_Less_Equal]  = BinaryOp_Le,
-        [Token_Equal_Equal] = BinaryOp_Eq,
-        [Token_Bang_Equal]  = BinaryOp_Ne,
-        [Token_Greater_Equal] = BinaryOp_Ge,
-        [Token_Greater]     = BinaryOp_Gt,
-    };
-    BinaryOp op = bin_op_map[token];
+    if (current(parser) != Token_Close_Paren) {
+        parse_error(parser, parser->token_index, "Expected ')' after argument list, got '%s'", repr_of_current(parser));
+        return 0;
+    }
 
-    NodeId id = reserve_node(parser);
+    // Advance past the ')' token.
     advance(parser);
 
-    ParseRule rule = rules[token];
-    Node* right = precedence(parser, (Precedence)(rule.precedence + 1));
+    NodeView expressions = stack_restore(parser, frame.snapshot);
 
-    NodeBinary binary = {
-        node_base_binary(start, start),
-        .op = op,
-        .left = left,
-        .right = right
+    NodeCall call = {
+        node_base_call(frame.start, frame.last == 0 ? frame.start : get_node(parser, frame.last)->base.end),
+        .name = get_node(parser, frame.left)->identifier.name,
+        .args = expressions
     };
-
-    return set_node(parser, id, node_binary(binary));
+    return add_node(parser, node_call(call));
 }
 
 
-static Node* call(Parser* parser, Node* left) {
-    assert(current(parser) == Token_Open_Paren && "Expected '(' token");
-    assert(left->kind == NodeKind_Identifier && "Expected identifier node");
+// Parses an expression without recursion. Every group, unary operator, binary
+// operator and call that is still waiting for an operand is a frame on the
+// parser's frames, so nesting costs a frame rather than a C stack frame, and
+// groups, calls and unary operators may only nest PARSER_MAX_EXPRESSION_DEPTH deep.
+static NodeId expression(Parser* parser) {
+    u32 base = parser->frame_count;
+    NodeId snapshot = stack_snapshot(parser);
+    if (!frame_push(parser, Operator_None, Precedence_Assignment, 0))
+        return 0;
 
-    TokenIndex start = parser->token_index;
-    advance(parser);
+    // The precedence of the innermost frame.
+    Precedence precedence = Precedence_Assignment;
 
-    NodeId snapshot = stack_snapshot(parser);
-    Node* node = NULL;
-    {
-        while (current(parser) != Token_Close_Paren && current(parser) != Token_Eof) {
-            if ((node = expression(parser)) == NULL)
-                return NULL;
+    while (1) {
+        // Parse an operand, opening any groups and unary operators in front of it.
+        Token token = current(parser);
+        if (rules[token].prefix == Operator_Group) {
+            if (!frame_push(parser, Operator_Group, Precedence_Assignment, 0))
+                goto error;
+            precedence = Precedence_Assignment;
+            advance(parser);
+            continue;
+        }
+        if (rules[token].prefix == Operator_Unary) {
+            if (!frame_push(parser, Operator_Unary, Precedence_Unary, 0))
+                goto error;
+            precedence = Precedence_Unary;
+            advance(parser);
+            continue;
+        }
 
-            stack_push(parser, node);
+        ParseOperandFn operand = rules[token].operand;
+        if (operand == NULL) {
+            parse_error(parser, parser->token_index, "Expected expression, got '%s'", repr_of_current(parser));
+            goto error;
+        }
+
+        NodeId left = operand(parser);
+        if (left == 0)
+            goto error;
+
+        // Open the operators that bind tighter than the innermost frame, and
+        // close that frame with the operand otherwise, until an operator wants
+        // another operand or the expression ends.
+        int needs_operand = 0;
+        while (!needs_operand) {
+            token = current(parser);
+            ParseRule rule = rules[token];
+
+            if (rule.infix != Operator_None && rule.precedence >= precedence) {
+                if (rule.infix == Operator_Binary) {
+                    precedence = (Precedence)(rule.precedence + 1);
+                    if (!frame_push(parser, Operator_Binary, precedence, left))
+                        goto error;
+                    advance(parser);
+                    needs_operand = 1;
+                    continue;
+                }
 
-            // If there is a comma, advance past it and continue parsing arguments.
-            if (current(parser) == Token_Comma) {
+                assert(rule.infix == Operator_Call && "Expected call operator");
+                if (node_kind_at(&parser->arena, left) != NodeKind_Identifier) {
+                    parse_error(parser, parser->token_index, "Only functions can be called");
+                    goto error;
+                }
+                if (!frame_push(parser, Operator_Call, Precedence_Assignment, left))
+                    goto error;
                 advance(parser);
+                if (current(parser) != Token_Close_Paren && current(parser) != Token_Eof) {
+                    precedence = Precedence_Assignment;
+                    needs_operand = 1;
+                    continue;
+                }
+                if ((left = call_end(parser)) == 0)
+                    goto error;
                 continue;
-            } else {
-                break;
             }
-        }
 
-        if (current(parser) != Token_Close_Paren) {
-            fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Expected ')' after argument list, got '%s'\n", STR_ARG(parser->tokens.name), lexer_repr_of(parser->tokens, parser->token_index));
-            int begin = (int) parser->tokens.source_offsets[parser->token_index];
-            point_to_error(parser->tokens.source, begin, (int)start+1);
-            return NULL;
+            ExprFrame* frame = &parser->frames[parser->frame_count - 1];
+            switch (frame->kind) {
+                case Operator_None: {
+                    parser->frame_count -= 1;
+                    return left;
+                }
+                case Operator_Binary: {
+                    TokenIndex start = frame->start;
+                    NodeBinary binary = {
+                        node_base_binary(start, start),
+                        .op = bin_op_map[parser->tokens.tokens[start]],
+                        .left = frame->left,
+                        .right = left
+                    };
+                    parser->frame_count -= 1;
+                    if ((left = add_node(parser, node_binary(binary))) == 0)
+                        goto error;
+                } break;
+                case Operator_Unary: {
+                    TokenIndex start = frame->start;
+                    NodeUnary unary = {
+                        node_base_unary(start, start),
+                        .op = unary_op_map[parser->tokens.tokens[start]],
+                        .expr = left
+                    };
+                    parser->frame_count -= 1;
+                    if ((left = add_node(parser, node_unary(unary))) == 0)
+                        goto error;
+                } break;
+                case Operator_Group: {
+                    if (token != Token_Close_Paren) {
+                        parse_error(parser, parser->token_index, "Expected ')' after expression, got '%s'", repr_of_current(parser));
+                        goto error;
+                    }
+                    advance(parser);
+                    parser->frame_count -= 1;
+                } break;
+                case Operator_Call: {
+                    stack_push(parser, left);
+                    frame->last = left;
+
+                    // If there is a comma, advance past it and continue parsing arguments.
+                    if (token == Token_Comma) {
+                        advance(parser);
+                        if (current(parser) != Token_Close_Paren && current(parser) != Token_Eof) {
+                            needs_operand = 1;
+                            break;
+                        }
+                    }
+                    if ((left = call_end(parser)) == 0)
+                        goto error;
+                } break;
+            }
+            precedence = parser->frames[parser->frame_count - 1].precedence;
         }
-
-        // Advance past the ')' token.
-        advance(parser);
     }
-    size_t count = parser->stack_count - snapshot;
-    Node** expressions = stack_restore(parser, snapshot);
 
-    NodeCall call = {
-        node_base_call(start, node == NULL ? start : node->base.end),
-        .name = left->identifier.name,
-        .count = (i32) count,
-        .args = expressions
-    };
-    return add_node(parser, node_call(call));
-}
-
-
-static Node* expression(Parser* parser) {
-    return precedence(parser, Precedence_Assignment);
+    error:
+    parser->frame_count = base;
+    parser->stack_count = snapshot;
+    return 0;
 }
 
 
-static Node* group(Parser* parser) {
-    Token token = current(parser);
-    assert(token == Token_Open_Paren && "Expected '(' token");
-    advance(parser);
-
-    Node* expr = expression(parser);
-    if (expr == NULL)
-        return NULL;
-
-    token = current(parser);
-    if (token != Token_Close_Paren) {
-        fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Expected ')' after expression, got '%s'\n", STR_ARG(parser->tokens.name), lexer_repr_of(parser->tokens, parser->token_index));
-        int start = (int) parser->tokens.source_offsets[parser->token_index];
-        point_to_error(parser->tokens.source, start, start+1);
-        return NULL;
-    }
-    advance(parser);
-
-    return expr;
-}
-
-static Node* parse_type(Parser* parser) {
+static NodeId parse_type(Parser* parser) {
     assert(current(parser) == Token_Identifier && "Expected identifier token");
     TokenIndex start = parser->token_index;
 
@@ -400,6 +692,8 @@ static Node* parse_type(Parser* parser) {
         literal_type = (const char*)(size_t)(LiteralType_Integer);
     } else if (strcmp(repr, "real") == 0) {
         literal_type = (const char*)(size_t)(LiteralType_Real);
+    } else if (strcmp(repr, "bool") == 0) {
+        literal_type = (const char*)(size_t)(LiteralType_Boolean);
     } else if (strcmp(repr, "str") == 0) {
         literal_type = (const char*)(size_t)(LiteralType_String);
     } else if (strcmp(repr, "void") == 0) {
@@ -416,7 +710,7 @@ static Node* parse_type(Parser* parser) {
 
 }
 
-static Node* assign(Parser* parser) {
+static NodeId assign(Parser* parser) {
     assert(current(parser) == Token_Identifier && "Expected identifier token");
     TokenIndex start = parser->token_index;
 
@@ -424,22 +718,24 @@ static Node* assign(Parser* parser) {
     advance(parser);
 
     if (current(parser) != Token_Equal) {
-        fprintf(stderr, "Expected '=' after identifier\n");
-        return NULL;
+        parse_error(parser, parser->token_index, "Expected '=' after identifier, got '%s'", repr_of_current(parser));
+        return 0;
     }
 
     advance(parser);
-    Node* expr = expression(parser);
+    NodeId expr = expression(parser);
+    if (expr == 0)
+        return 0;
 
     NodeAssign assign = {
-        node_base_assign(start, expr->base.end),
+        node_base_assign(start, get_node(parser, expr)->base.end),
         .name = repr,
         .expression = expr
     };
     return add_node(parser, node_assign(assign));
 }
 
-static Node* var_decl(Parser* parser) {
+static NodeId var_decl(Parser* parser) {
     assert(current(parser) == Token_Identifier && "Expected identifier token");
     TokenIndex start = parser->token_index;
 
@@ -447,17 +743,17 @@ static Node* var_decl(Parser* parser) {
     advance(parser);
 
     if (current(parser) != Token_Colon_Equal) {
-        fprintf(stderr, "Expected ':=' after identifier\n");
-        return NULL;
+        parse_error(parser, parser->token_index, "Expected ':=' after identifier, got '%s'", repr_of_current(parser));
+        return 0;
     }
 
     advance(parser);
-    Node* expr = expression(parser);
-    if (expr == NULL)
-        return NULL;
+    NodeId expr = expression(parser);
+    if (expr == 0)
+        return 0;
 
     NodeVarDecl var_decl = {
-        node_base_var_decl(start, expr->base.end),
+        node_base_var_decl(start, get_node(parser, expr)->base.end),
         .name = repr,
         .decl_offset = parser->current_decl_count++,
         .expression = expr
@@ -466,93 +762,123 @@ static Node* var_decl(Parser* parser) {
     return add_node(parser, node_var_decl(var_decl));
 }
 
-static Node* block(Parser* parser) {
-    assert(current(parser) == Token_Open_Brace && "Expected '{' token");
+// How many of the statements declare a local in the block they're in. The
+// checker sizes the locals of each block by it.
+static u32 declared_count(const Parser* parser, NodeView statements) {
+    u32 count = 0;
+    for (u32 i = 0; i < statements.count; ++i) {
+        NodeKind kind = node_kind_at(&parser->arena, node_view_at(&parser->arena, statements, i));
+        count += (kind == NodeKind_VarDecl || kind == NodeKind_FunDecl);
+    }
+    return count;
+}
+
+static NodeId block(Parser* parser) {
+    if (current(parser) != Token_Open_Brace) {
+        parse_error(parser, parser->token_index, "Expected '{' before block, got '%s'", repr_of_current(parser));
+        return 0;
+    }
 
     TokenIndex start = parser->token_index;
     advance(parser);
 
-    NodeBlock* block = (NodeBlock*) add_node(parser, node_block((NodeBlock) {
+    i32 id = (i32) ++parser->block_count;
+    NodeId block = add_node(parser, node_block((NodeBlock) {
             node_base_block(start, 0),
-            .id = (i32) ++parser->block_count,
-            .parent = parser->current_block == NULL ? 0 : parser->current_block->id,
+            .id = id,
+            .parent = parser->current_block,
     }));
-    NodeBlock* previous_block = parser->current_block;
-    parser->current_block = block;
+    if (block == 0)
+        return 0;
+    i32 previous_block = parser->current_block;
+    parser->current_block = id;
 
     size_t snapshot = stack_snapshot(parser);
-    Node* node = NULL;
+    NodeId node = 0;
     {
         while (current(parser) != Token_Close_Brace && current(parser) != Token_Eof) {
-            if ((node = statement(parser)) == NULL)
-                return NULL;
+            StatementStart before = statement_start(parser);
+            if ((node = statement(parser)) == 0) {
+                if (!recover(parser, before))
+                    return 0;
+                continue;
+            }
             stack_push(parser, node);
         }
         if (current(parser) != Token_Close_Brace) {
-            fprintf(stderr, "Expected '}' after block\n");
-            return NULL;
+            parse_error(parser, parser->token_index, "Expected '}' after block, got '%s'", repr_of_current(parser));
+            return 0;
         }
         advance(parser);
     }
-    size_t count = parser->stack_count - snapshot;
-    Node** statements = stack_restore(parser, snapshot);
+    NodeView statements = stack_restore(parser, snapshot);
 
     TokenIndex stop = parser->token_index;
-    parser->current_block->base = node_base_block(start, stop);
-    parser->current_block->nodes = statements;
-    parser->current_block->count = (i32) count;
+    NodeBlock* node_block = node_block_at(&parser->arena, block);
+    node_block->base = node_base_block(start, stop);
+    node_block->nodes = statements;
+    node_block->declared_count = declared_count(parser, statements);
 
     parser->current_block = previous_block;
-    return (Node*) block;
+    return block;
 }
 
-static Node* fun_body(Parser* parser) {
-    assert(current(parser) == Token_Open_Brace && "Expected '{' token");
+static NodeId fun_body(Parser* parser) {
+    if (current(parser) != Token_Open_Brace) {
+        parse_error(parser, parser->token_index, "Expected '{' before function body, got '%s'", repr_of_current(parser));
+        return 0;
+    }
 
     TokenIndex start = parser->token_index;
     advance(parser);
 
-    NodeFunBody* body = (NodeFunBody*) add_node(parser, node_fun_body((NodeFunBody) {
+    i32 id = (i32) ++parser->block_count;
+    NodeId body = add_node(parser, node_fun_body((NodeFunBody) {
             node_base_fun_body(start, 0),
-            .id = (i32) ++parser->block_count,
-            .parent = parser->current_block == NULL ? 0 : parser->current_block->id,
+            .id = id,
+            .parent = parser->current_block,
     }));
+    if (body == 0)
+        return 0;
 
-    NodeBlock* previous_block = parser->current_block;
+    i32 previous_block = parser->current_block;
     int previous_decl_count = parser->current_decl_count;
 
-    parser->current_block = (NodeBlock*) body;
+    parser->current_block = id;
 
     size_t snapshot = stack_snapshot(parser);
-    Node* node = NULL;
+    NodeId node = 0;
     {
         while (current(parser) != Token_Close_Brace && current(parser) != Token_Eof) {
-            if ((node = statement(parser)) == NULL)
-                return NULL;
+            StatementStart before = statement_start(parser);
+            if ((node = statement(parser)) == 0) {
+                if (!recover(parser, before))
+                    return 0;
+                continue;
+            }
             stack_push(parser, node);
         }
         if (current(parser) != Token_Close_Brace) {
-            fprintf(stderr, "Expected '}' after block\n");
-            return NULL;
+            parse_error(parser, parser->token_index, "Expected '}' after block, got '%s'", repr_of_current(parser));
+            return 0;
         }
         advance(parser);
     }
-    size_t count = parser->stack_count - snapshot;
-    Node** statements = stack_restore(parser, snapshot);
-
-    body->decls = parser->current_decl_count - previous_decl_count;
+    NodeView statements = stack_restore(parser, snapshot);
 
     TokenIndex stop = parser->token_index;
-    parser->current_block->base = node_base_fun_body(start, stop);
-    parser->current_block->nodes = statements;
-    parser->current_block->count = (i32) count;
+    NodeFunBody* node_body = node_fun_body_at(&parser->arena, body);
+    node_body->base = node_base_fun_body(start, stop);
+    node_body->nodes = statements;
+    node_body->declared_count = declared_count(parser, statements);
+    node_body->local_count = parser->current_decl_count - previous_decl_count;
 
     parser->current_block = previous_block;
     parser->current_decl_count = previous_decl_count;
-    return (Node*) body;
+    return body;
 }
 
-static NodeFunParam* fun_param(Parser* parser, int offset) {
+static NodeId fun_param(Parser* parser, int offset) {
     assert(current(parser) == Token_Identifier && "Expected identifier token");
     TokenIndex start = parser->token_index;
 
@@ -560,16 +886,16 @@ static NodeFunParam* fun_param(Parser* parser, int offset) {
     advance(parser);
 
     if (current(parser) != Token_Colon) {
-        fprintf(stderr, "Expected ':' after identifier\n");
-        return NULL;
+        parse_error(parser, parser->token_index, "Expected ':' after identifier, got '%s'", repr_of_current(parser));
+        return 0;
     }
     advance(parser);
 
     if (current(parser) != Token_Identifier) {
-        fprintf(stderr, "Expected type after ':'\n");
-        return NULL;
+        parse_error(parser, parser->token_index, "Expected type after ':', got '%s'", repr_of_current(parser));
+        return 0;
     }
-    Node* type = parse_type(parser);
+    NodeId type = parse_type(parser);
 
     NodeFunParam fun_param = {
         node_base_fun_param(start, start),
@@ -577,85 +903,87 @@ static NodeFunParam* fun_param(Parser* parser, int offset) {
         .name = repr,
         .type = type,
     };
-    return (NodeFunParam*) add_node(parser, node_fun_param(fun_param));
+    return add_node(parser, node_fun_param(fun_param));
 }
 
-static NodeFunParam** fun_params(Parser* parser, size_t* count) {
+// Returns 0 on failure, else 1 with the parameters in `params`.
+static int fun_params(Parser* parser, NodeView* params) {
     size_t snapshot = stack_snapshot(parser);
-    NodeFunParam* param = NULL;
+    NodeId param = 0;
     {
         int offset = 0;
         while (current(parser) != Token_Close_Paren && current(parser) != Token_Eof) {
-            if ((param = fun_param(parser, offset++)) == NULL)
-                return NULL;
-            stack_push(parser, (Node*) param);
+            if ((param = fun_param(parser, offset++)) == 0)
+                return 0;
+            stack_push(parser, param);
             if (current(parser) == Token_Comma)
                 advance(parser);
             else
                 break;
         }
         if (current(parser) != Token_Close_Paren) {
-            fprintf(stderr, "Expected ')' after argument list\n");
-            return NULL;
+            parse_error(parser, parser->token_index, "Expected ')' after argument list, got '%s'", repr_of_current(parser));
+            return 0;
         }
         advance(parser);
     }
-    *count = parser->stack_count - snapshot;
-    return (NodeFunParam**) stack_restore(parser, snapshot);
+    *params = stack_restore(parser, snapshot);
+    return 1;
 }
 
-static NodeFunDecl* fun_decl(Parser* parser) {
+static NodeId fun_decl(Parser* parser) {
     assert(current(parser) == Token_Fun && "Expected 'fun' token");
     TokenIndex start = parser->token_index;
     advance(parser);
 
     if (current(parser) != Token_Identifier) {
-        fprintf(stderr, "Expected identifier after 'fun'\n");
-        return NULL;
+        parse_error(parser, parser->token_index, "Expected identifier after 'fun', got '%s'", repr_of_current(parser));
+        return 0;
     }
     const char* repr = repr_of_current(parser);
     advance(parser);
 
     if (current(parser) != Token_Open_Paren) {
-        fprintf(stderr, "Expected '(' after identifier\n");
-        return NULL;
+        parse_error(parser, parser->token_index, "Expected '(' after identifier, got '%s'", repr_of_current(parser));
+        return 0;
     }
     advance(parser);
 
-    size_t count;
-    NodeFunParam** params = fun_params(parser, &count);
+    NodeView params;
+    if (!fun_params(parser, &params))
+        return 0;
 
-    parser->current_decl_count = (int) count;
+    parser->current_decl_count = (int) params.count;
 
-    Node* type = NULL;
-    if (current(parser) != Token_Open_Brace) {
+    NodeId type = 0;
+    if (current(parser) == Token_Identifier) {
         type = parse_type(parser);
     }
 
-    Node* body = fun_body(parser);
-    if (body == NULL)
-        return NULL;
+    NodeId body = fun_body(parser);
+    if (body == 0)
+        return 0;
+    node_fun_body_at(&parser->arena, body)->declared_count += params.count;
 
     NodeFunDecl fun_decl = {
-        .base = node_base_fun_decl(start, body->base.end),
+        .base = node_base_fun_decl(start, get_node(parser, body)->base.end),
         .name = repr,
         .params = params,
         .return_type = type,
-        .param_count = (i32) count,
-        .body = (NodeFunBody *) body,
+        .body = body,
     };
-    return (NodeFunDecl*) add_node(parser, node_fun_decl(fun_decl));
+    return add_node(parser, node_fun_decl(fun_decl));
 }
 
-static Node* return_stmt(Parser* parser) {
+static NodeId return_stmt(Parser* parser) {
     assert(current(parser) == Token_Return && "Expected 'return' token");
     TokenIndex start = parser->token_index;
     advance(parser);
 
     // TODO(ted): Make a void/unit expression to disambiguate (is it needed?)
-    Node* expr = expression(parser);
-    if (expr == NULL)
-        return NULL;
+    NodeId expr = expression(parser);
+    if (expr == 0)
+        return 0;
 
     NodeReturn return_stmt = {
         node_base_return_stmt(start, strlen("return")),
@@ -664,69 +992,71 @@ static Node* return_stmt(Parser* parser) {
     return add_node(parser, node_return_stmt(return_stmt));
 }
 
-static Node* if_stmt(Parser* parser) {
+static NodeId if_stmt(Parser* parser) {
     assert(current(parser) == Token_If && "Expected 'if' token");
     TokenIndex start = parser->token_index;
     advance(parser);
 
-    Node* condition = expression(parser);
-    if (condition == NULL) {
-        return NULL;
+    NodeId condition = expression(parser);
+    if (condition == 0) {
+        return 0;
     }
 
-    Node* then_block = block(parser);
-    if (then_block == NULL) {
-        return NULL;
+    NodeId then_block = block(parser);
+    if (then_block == 0) {
+        return 0;
     }
 
-    Node* else_block = NULL;
+    NodeId else_block = 0;
     if (current(parser) == Token_Else) {
         advance(parser);
-        else_block = block(parser);
+        if ((else_block = block(parser)) == 0)
+            return 0;
     }
 
     NodeIf if_stmt = {
-        node_base_if_stmt(start, then_block->base.end),
+        node_base_if_stmt(start, get_node(parser, then_block)->base.end),
         .condition = condition,
-        .then_block = (NodeBlock*) then_block,
-        .else_block = (NodeBlock*) else_block
+        .then_block = then_block,
+        .else_block = else_block
     };
     return add_node(parser, node_if_stmt(if_stmt));
 }
 
 
-static Node* while_stmt(Parser* parser) {
+static NodeId while_stmt(Parser* parser) {
     assert(current(parser) == Token_While && "Expected 'while' token");
     TokenIndex start = parser->token_index;
     advance(parser);
 
-    Node* condition = expression(parser);
-    if (condition == NULL) {
-        return NULL;
+    NodeId condition = expression(parser);
+    if (condition == 0) {
+        return 0;
     }
 
-    Node* then_block = block(parser);
-    if (then_block == NULL) {
-        return NULL;
+    NodeId then_block = block(parser);
+    if (then_block == 0) {
+        return 0;
     }
 
-    Node* else_block = NULL;
+    NodeId else_block = 0;
     if (current(parser) == Token_Else) {
         advance(parser);
-        else_block = block(parser);
+        if ((else_block = block(parser)) == 0)
+            return 0;
     }
 
     NodeWhile while_stmt = {
-        node_base_while_stmt(start, then_block->base.end),
+        node_base_while_stmt(start, get_node(parser, then_block)->base.end),
         .condition = condition,
-        .then_block = (NodeBlock*) then_block,
-        .else_block = (NodeBlock*) else_block
+        .then_block = then_block,
+        .else_block = else_block
     };
     return add_node(parser, node_while_stmt(while_stmt));
 }
 
 
-static Node* statement(Parser* parser) {
+static NodeId statement(Parser* parser) {
     Token token = current(parser);
 
     switch (token) {
@@ -748,11 +1078,10 @@ static Node* statement(Parser* parser) {
         case Token_Close_Brace:
         case Token_Colon:
         case Token_Comma:
-        case Token_Else: {
-            fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Invalid token: '%s'\n", STR_ARG(parser->tokens.name), lexer_repr_of(parser->tokens, parser->token_index));
-            int start = (int) parser->tokens.source_offsets[parser->token_index];
-            point_to_error(parser->tokens.source, start, start+1);
-            return NULL;
+        case Token_Else:
+        default: {
+            parse_error(parser, parser->token_index, "Invalid token: '%s'", repr_of_current(parser));
+            return 0;
         } break;
         case Token_Identifier: {
             if (peek(parser) == Token_Colon_Equal) {
@@ -779,78 +1108,392 @@ static Node* statement(Parser* parser) {
             return while_stmt(parser);
         } break;
         case Token_Fun: {
-            return (Node*) fun_decl(parser);
+            return fun_decl(parser);
         } break;
         case Token_Return: {
-            return (Node*) return_stmt(parser);
+            return return_stmt(parser);
         }
         case Token_Eof: {
-            return NULL;
+            return 0;
         }
     }
 }
 
 
-GrammarTree parse(TokenArray tokens) {
+/* ---------------------------- PARSER MODULE -------------------------------- */
+static NodeId splice_parsed_fun(Parser* parser);
+
+static Parser parser_make(TokenArray tokens, u32 max_errors, size_t token_count, int speculative) {
     Parser parser = {
         .tokens = tokens,
         .token_index = 0,
-        .stack = (Node**) alloc(0, 1024 * sizeof(Node*)),
+        .stack = (NodeId*) alloc(0, 256 * sizeof(NodeId)),
         .stack_count = 0,
-        .current_block = NULL,
+        .stack_capacity = 256,
+        .frames = (ExprFrame*) alloc(0, 32 * sizeof(ExprFrame)),
+        .frame_count = 0,
+        .frame_capacity = 32,
+        .current_block = 0,
         .current_decl_count = 0,
         .block_count = 0,
-        .nodes = (Node*) alloc(0, 1024 * sizeof(Node)),
-        .node_count = 0,
-        .views = (Node**) alloc(0, 1024 * sizeof(Node*)),
-        .view_count = 0,
+        .errors = NULL,
+        .error_count = 0,
+        .error_capacity = 0,
+        .max_errors = max_errors,
+        .arena = node_arena_make(token_count),
+        .out_of_memory = 0,
+        .speculative = speculative,
+        .logger = logger_make_with_file("Parser", LOG_LEVEL_ERROR, stderr),
+        .parsed_funs = NULL,
+        .parsed_fun_count = 0,
+        .next_parsed_fun = 0,
     };
+    if (parser.stack == NULL || parser.frames == NULL || parser.arena.kinds == NULL) {
+        out_of_memory(&parser);
+    }
+    return parser;
+}
 
-    // Reserve one slot so that any references to 0 are invalid,
-    // as no nodes should be able to reference a start node.
-    TokenIndex first = parser.token_index;
-    NodeId module_id = reserve_node(&parser);
+// Parses the statements of the module, and hands the arena over to the tree.
+// Frees everything, the tokens too, if it fails.
+static GrammarTree parse_module(Parser* parser) {
+    TokenArray tokens = parser->tokens;
+    if (parser->out_of_memory) {
+        goto error;
+    }
 
-    size_t snapshot = stack_snapshot(&parser);
-    while (parser.token_index < tokens.size) {
-        Token token = current(&parser);
+    // The arena reserves node 0 for the module, so that any references to 0
+    // are invalid, as no nodes should be able to reference a start node.
+    TokenIndex first = parser->token_index;
+    NodeId module_id = 0;
 
-        if (token != Token_Eof) {
-            Node* node = statement(&parser);
-            if (node == NULL) {
-                goto error;
-            }
-            stack_push(&parser, node);
-        } else {
-            int count = (int) (parser.stack_count - snapshot);
-            Node** statements = stack_restore(&parser, snapshot);
-
-            int fun_count = sort_nodes_by_fun_decl(statements, count);
-            int stmt_count = count - fun_count;
-
-            TokenIndex stop = parser.token_index;
-            NodeModule module = {
-                node_base_module(first, stop),
-                .stmts = statements + fun_count,
-                .stmt_count = (i32) stmt_count,
-                .decls = statements,
-                .decl_count = fun_count,
-                .global_count = parser.current_decl_count,
-            };
-            return parser_to_ast(&parser, (Node*) set_node(&parser, module_id, node_module(module)));
+    // Statements with errors are left out, and parsing goes on after them,
+    // so that every error in the file is reported at once.
+    size_t snapshot = stack_snapshot(parser);
+    while (parser->token_index < tokens.size && current(parser) != Token_Eof) {
+        StatementStart before = statement_start(parser);
+        NodeId node = splice_parsed_fun(parser);
+        if (node == 0 && !parser->out_of_memory) {
+            node = statement(parser);
+        }
+        if (parser->out_of_memory) {
+            goto error;
+        }
+        if (node != 0) {
+            stack_push(parser, node);
+        } else if (!recover(parser, before)) {
+            fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Stopped after %u errors\n", STR_ARG(tokens.name), parser->error_count);
+            break;
         }
     }
 
-    fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Unexpected end of file\n", STR_ARG(tokens.name));
-    
+    if (parser->token_index >= tokens.size) {
+        fprintf(stderr, "[Error] (Parser) " STR_FMT "\n    Unexpected end of file\n", STR_ARG(tokens.name));
+        goto error;
+    }
+
+    NodeView statements = stack_restore(parser, snapshot);
+    if (parser->out_of_memory) {
+        goto error;
+    }
+
+    u32 fun_count = (u32) sort_nodes_by_fun_decl(parser, statements);
+    if (parser->out_of_memory) {
+        goto error;
+    }
+
+    TokenIndex stop = parser->token_index;
+    NodeModule module = {
+        node_base_module(first, stop),
+        .stmts = { statements.offset + fun_count, statements.count - fun_count },
+        .decls = { statements.offset, fun_count },
+        .global_count = parser->current_decl_count,
+        .declared_count = declared_count(parser, statements),
+    };
+    return parser_to_ast(parser, set_node(parser, module_id, node_module(module)));
+
     error:;
-    parser_free(&parser);
-    return (GrammarTree) {tokens, NULL, NULL, NULL, 0 };
+    parser_free(parser);
+    return (GrammarTree) {tokens, { 0 }, 0, 0, NULL, 0 };
+}
+
+GrammarTree parse(TokenArray tokens) {
+    return parse_with_max_errors(tokens, PARSER_DEFAULT_MAX_ERRORS);
+}
+
+GrammarTree parse_with_max_errors(TokenArray tokens, u32 max_errors) {
+    Parser parser = parser_make(tokens, max_errors, tokens.size, 0);
+    return parse_module(&parser);
+}
+
+
+/* ---------------------------- PARALLEL PARSER -------------------------------- */
+// A top-level function ends at the '}' that closes its body, which matching
+// braces finds without parsing it. Every thread parses a run of functions, in
+// a parser of its own, each as if it was at the top of the module. One
+// function's nodes, views and blocks come out contiguous, and in the order
+// the calling thread would have made them, so when the calling thread reaches
+// the function it only appends them and moves their ids. The tree is then
+// exactly what parse_with_max_errors makes. A function with errors is left to
+// the calling thread, which reports them where they belong.
+#define PARSER_MAX_THREADS         64
+#define PARSER_MIN_PARALLEL_TOKENS (64 * 1024)
+
+struct ParsedFun {
+    TokenIndex start;       // The 'fun' token.
+    TokenIndex end;         // The token after its '}'.
+
+    // Filled in by the thread that parsed it. `decl` is 0 if it failed.
+    const NodeArena* arena;
+    NodeId decl;
+    NodeId first_node;
+    NodeId end_node;
+    u32    first_view;
+    u32    end_view;
+    NodeId first_block;     // The parser's block count before and after it.
+    NodeId end_block;
+    int    decl_count;      // What fun_decl left current_decl_count at.
+};
+
+typedef struct {
+    TokenArray tokens;
+    ParsedFun* funs;
+    u32        count;
+    size_t     token_count;  // Of all its functions, to size the arena.
+    NodeArena  arena;
+} ParseJob;
+
+// Moves the ids in a node that was parsed ahead to where it's spliced in.
+static void move_node(Node* node, NodeId nodes, u32 views, i32 blocks) {
+#define MOVE_ID(id)     if ((id) != 0) (id) += nodes
+#define MOVE_VIEW(view) if ((view).count != 0) (view).offset += views
+#define MOVE_BLOCK(block)                   \
+    (block).id += blocks;                   \
+    if ((block).parent != 0) (block).parent += blocks
+
+    switch (node->kind) {
+        case NodeKind_Literal:
+        case NodeKind_Identifier:
+        case NodeKind_Type:
+        case NodeKind_Module:
+            break;
+        case NodeKind_Unary:       MOVE_ID(node->unary.expr); break;
+        case NodeKind_Binary:      MOVE_ID(node->binary.left); MOVE_ID(node->binary.right); break;
+        case NodeKind_Call:        MOVE_VIEW(node->call.args); break;
+        case NodeKind_Access:      MOVE_ID(node->access.left); MOVE_ID(node->access.right); break;
+        case NodeKind_Assign:      MOVE_ID(node->assign.expression); break;
+        case NodeKind_VarDecl:     MOVE_ID(node->var_decl.expression); break;
+        case NodeKind_Block:       MOVE_BLOCK(node->block); MOVE_VIEW(node->block.nodes); break;
+        case NodeKind_FunBody:     MOVE_BLOCK(node->fun_body); MOVE_VIEW(node->fun_body.nodes); break;
+        case NodeKind_FunParam:    MOVE_ID(node->fun_param.type); MOVE_ID(node->fun_param.expression); break;
+        case NodeKind_FunDecl:     MOVE_VIEW(node->fun_decl.params); MOVE_ID(node->fun_decl.return_type); MOVE_ID(node->fun_decl.body); break;
+        case NodeKind_Return:      MOVE_ID(node->return_stmt.expression); break;
+        case NodeKind_If:          MOVE_ID(node->if_stmt.condition); MOVE_ID(node->if_stmt.then_block); MOVE_ID(node->if_stmt.else_block); break;
+        case NodeKind_While:       MOVE_ID(node->while_stmt.condition); MOVE_ID(node->while_stmt.then_block); MOVE_ID(node->while_stmt.else_block); break;
+        case NodeKind_InitArg:     MOVE_ID(node->init_arg.expr); break;
+        case NodeKind_Init:        MOVE_VIEW(node->init.args); break;
+        case NodeKind_StructField: MOVE_ID(node->struct_field.type); MOVE_ID(node->struct_field.expr); break;
+        case NodeKind_Struct:      MOVE_BLOCK(node->struct_decl); MOVE_VIEW(node->struct_decl.nodes); break;
+    }
+
+#undef MOVE_BLOCK
+#undef MOVE_VIEW
+#undef MOVE_ID
+}
+
+// If a function that was parsed ahead starts at the current token, appends its
+// nodes, views and blocks, and returns its id. Returns 0 otherwise, and if out
+// of memory.
+static NodeId splice_parsed_fun(Parser* parser) {
+    while (parser->next_parsed_fun < parser->parsed_fun_count && parser->parsed_funs[parser->next_parsed_fun].start < parser->token_index)
+        parser->next_parsed_fun += 1;
+    if (parser->next_parsed_fun == parser->parsed_fun_count)
+        return 0;
+
+    const ParsedFun* fun = &parser->parsed_funs[parser->next_parsed_fun];
+    if (fun->start != parser->token_index || fun->decl == 0)
+        return 0;
+    parser->next_parsed_fun += 1;
+
+    NodeArena* arena = &parser->arena;
+    NodeId nodes  = arena->count - fun->first_node;
+    u32    views  = arena->view_count - fun->first_view;
+    i32    blocks = (i32) parser->block_count - (i32) fun->first_block;
+
+    u32 view_count = fun->end_view - fun->first_view;
+    if (view_count != 0) {
+        NodeView view;
+        if (!node_arena_push_view(arena, fun->arena->views + fun->first_view, view_count, &view)) {
+            out_of_memory(parser);
+            return 0;
+        }
+        for (u32 i = view.offset; i < view.offset + view_count; ++i)
+            arena->views[i] += nodes;
+    }
+
+    NodeId first = node_arena_append(arena, fun->arena, fun->first_node, fun->end_node);
+    if (first == 0) {
+        out_of_memory(parser);
+        return 0;
+    }
+    for (NodeId id = first; id < arena->count; ++id)
+        move_node(node_at(arena, id), nodes, views, blocks);
+
+    parser->token_index        = fun->end;
+    parser->block_count       += fun->end_block - fun->first_block;
+    parser->current_decl_count = fun->decl_count;
+    return fun->decl + nodes;
+}
+
+// Finds the functions outside of any braces. Returns how many there are.
+static u32 find_top_level_funs(TokenArray tokens, ParsedFun** funs) {
+    u32 count    = 0;
+    u32 capacity = 64;
+    *funs = (ParsedFun*) alloc(0, capacity * sizeof(ParsedFun));
+    if (*funs == NULL)
+        return 0;
+
+    u32 depth  = 0;
+    int in_fun = 0;
+    TokenIndex start = 0;
+    for (TokenIndex i = 0; i < tokens.size; ++i) {
+        Token token = (Token) tokens.tokens[i];
+        if (token == Token_Open_Brace) {
+            depth += 1;
+        } else if (token == Token_Close_Brace && depth > 0) {
+            depth -= 1;
+            if (depth != 0 || !in_fun)
+                continue;
+
+            if (count == capacity) {
+                ParsedFun* grown = (ParsedFun*) alloc(0, 2 * capacity * sizeof(ParsedFun));
+                if (grown == NULL)
+                    return count;
+                memcpy(grown, *funs, count * sizeof(ParsedFun));
+                free(*funs);
+                *funs = grown;
+                capacity *= 2;
+            }
+            (*funs)[count++] = (ParsedFun) { .start = start, .end = i + 1 };
+            in_fun = 0;
+        } else if (token == Token_Fun && depth == 0) {
+            start  = i;
+            in_fun = 1;
+        }
+    }
+    return count;
+}
+
+static int parse_job_run(void* arg) {
+    ParseJob* job = (ParseJob*) arg;
+
+    // One error is enough to leave the function to the calling thread.
+    Parser parser = parser_make(job->tokens, 1, job->token_count, 1);
+    for (u32 i = 0; i < job->count && !parser.out_of_memory; ++i) {
+        ParsedFun* fun = &job->funs[i];
+        parser.token_index        = fun->start;
+        parser.current_block      = 0;
+        parser.current_decl_count = 0;
+        parser.stack_count        = 0;
+        parser.frame_count        = 0;
+        parser.error_count        = 0;
+
+        fun->first_node  = parser.arena.count;
+        fun->first_view  = parser.arena.view_count;
+        fun->first_block = parser.block_count;
+        NodeId decl = fun_decl(&parser);
+        if (decl == 0 || parser.error_count != 0 || parser.out_of_memory || parser.token_index != fun->end)
+            continue;
+
+        fun->decl       = decl;
+        fun->end_node   = parser.arena.count;
+        fun->end_view   = parser.arena.view_count;
+        fun->end_block  = parser.block_count;
+        fun->decl_count = parser.current_decl_count;
+    }
+
+    free(parser.stack);
+    free(parser.frames);
+    job->arena = parser.arena;
+    return 1;
+}
+
+// Runs every job, the first one on the calling thread.
+// If a thread can't be started, its job also runs on the calling thread.
+static void parse_jobs_run(ParseJob* jobs, int count) {
+    Thread threads[PARSER_MAX_THREADS];
+    int    started[PARSER_MAX_THREADS];
+    for (int i = 1; i < count; ++i)
+        started[i] = thread_start(&threads[i], parse_job_run, &jobs[i]);
+
+    parse_job_run(&jobs[0]);
+    for (int i = 1; i < count; ++i) {
+        if (started[i])
+            thread_join(threads[i]);
+        else
+            parse_job_run(&jobs[i]);
+    }
+}
+
+GrammarTree parse_parallel(TokenArray tokens, u32 max_errors, int thread_count) {
+    if (thread_count <= 0)
+        thread_count = thread_hardware_count();
+    if (thread_count > PARSER_MAX_THREADS)
+        thread_count = PARSER_MAX_THREADS;
+    if ((size_t) thread_count > tokens.size / PARSER_MIN_PARALLEL_TOKENS)
+        thread_count = (int) (tokens.size / PARSER_MIN_PARALLEL_TOKENS);
+    if (thread_count <= 1)
+        return parse_with_max_errors(tokens, max_errors);
+
+    ParsedFun* funs = NULL;
+    u32 fun_count = find_top_level_funs(tokens, &funs);
+    if (fun_count < (u32) thread_count) {
+        free(funs);
+        return parse_with_max_errors(tokens, max_errors);
+    }
+
+    // Every job gets a run of functions with about as many tokens as the others.
+    size_t total = 0;
+    for (u32 i = 0; i < fun_count; ++i)
+        total += funs[i].end - funs[i].start;
+
+    ParseJob jobs[PARSER_MAX_THREADS];
+    int    job_count = 0;
+    u32    first     = 0;
+    size_t taken     = 0;
+    for (int i = 0; i < thread_count && first < fun_count; ++i) {
+        size_t target = (i == thread_count-1) ? total : total / (size_t) thread_count * (size_t) (i+1);
+        u32    end    = first;
+        size_t size   = 0;
+        while (end < fun_count && taken < target) {
+            size  += funs[end].end - funs[end].start;
+            taken += funs[end].end - funs[end].start;
+            end   += 1;
+        }
+        jobs[job_count++] = (ParseJob) { tokens, funs + first, end - first, size, { 0 } };
+        first = end;
+    }
+    parse_jobs_run(jobs, job_count);
+
+    for (int i = 0; i < job_count; ++i) {
+        for (u32 j = 0; j < jobs[i].count; ++j)
+            jobs[i].funs[j].arena = &jobs[i].arena;
+    }
+
+    Parser parser = parser_make(tokens, max_errors, tokens.size, 0);
+    parser.parsed_funs      = funs;
+    parser.parsed_fun_count = fun_count;
+    GrammarTree tree = parse_module(&parser);
+
+    for (int i = 0; i < job_count; ++i)
+        node_arena_free(&jobs[i].arena);
+    free(funs);
+    return tree;
 }
 
 
 void grammar_tree_free(GrammarTree ast) {
-    free(ast.nodes);
-    free(ast.views);
+    node_arena_free(&ast.arena);
+    free(ast.errors);
     token_array_free(ast.tokens);
 }
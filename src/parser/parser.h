@@ -5,16 +5,45 @@
 #include "lexer/lexer.h"
 
 
+/// How deeply groups, calls and unary operators may nest inside one expression before
+/// parsing stops with an error. Define it at build time to change it.
+#ifndef PARSER_MAX_EXPRESSION_DEPTH
+#define PARSER_MAX_EXPRESSION_DEPTH 1024
+#endif
+
+/// How many syntax errors `parse` reports before it gives up on the rest of the file.
+#define PARSER_DEFAULT_MAX_ERRORS 20
+
+typedef struct {
+    TokenIndex token;       /// Where the error was found.
+    char       message[124];
+} ParseError;
+
+/// If there are errors, the statements they were found in are left out of the
+/// tree, and it must not be type checked. It must still be freed.
 typedef struct {
     const TokenArray tokens;
 
-    Node*  nodes;
-    Node*  start;
-    Node** views;
+    NodeArena arena;
+    NodeId    start;
 
     size_t block_count;
+
+    ParseError* errors;
+    u32         error_count;
 } GrammarTree;
 
+/// Parse the tokens, reporting at most PARSER_DEFAULT_MAX_ERRORS syntax errors.
+/// The arena is empty only if out of memory.
 GrammarTree parse(TokenArray tokens);
 
+/// Same as `parse`, but stops after `max_errors` syntax errors, or never if it's 0.
+/// After an error, parsing goes on from the start of the next statement.
+GrammarTree parse_with_max_errors(TokenArray tokens, u32 max_errors);
+
+/// Same as `parse_with_max_errors`, but the top-level functions are parsed on up to
+/// `thread_count` threads, or one per hardware thread if it's 0. The tree is identical.
+/// Small token arrays, and those with few functions, are parsed on the calling thread.
+GrammarTree parse_parallel(TokenArray tokens, u32 max_errors, int thread_count);
+
 void grammar_tree_free(GrammarTree ast);
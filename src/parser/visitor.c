@@ -3,57 +3,58 @@
 #include "visitor.h"
 
 
-void* visit(void* visitor, Node* node) {
+void* visit(void* visitor, NodeId id) {
     Visitor* impl = (Visitor*) visitor;
-    switch (node->kind) {
+    switch (node_kind_at(impl->arena, id)) {
         case NodeKind_Literal:
-            return impl->visit_literal(impl, (NodeLiteral*) node);
+            return impl->visit_literal(impl, node_literal_at(impl->arena, id));
         case NodeKind_Identifier:
-            return impl->visit_identifier(impl, (NodeIdentifier*) node);
+            return impl->visit_identifier(impl, node_identifier_at(impl->arena, id));
         case NodeKind_Unary:
-            return impl->visit_unary(impl, (NodeUnary*) node);
+            return impl->visit_unary(impl, node_unary_at(impl->arena, id));
         case NodeKind_Binary:
-            return impl->visit_binary(impl, (NodeBinary*) node);
+            return impl->visit_binary(impl, node_binary_at(impl->arena, id));
         case NodeKind_Call:
-            return impl->visit_call(impl, (NodeCall*) node);
+            return impl->visit_call(impl, node_call_at(impl->arena, id));
         case NodeKind_Access:
-            return impl->visit_access(impl, (NodeAccess*) node);
+            return impl->visit_access(impl, node_access_at(impl->arena, id));
         case NodeKind_Type:
-            return impl->visit_type(impl, (NodeType*) node);
+            return impl->visit_type(impl, node_type_at(impl->arena, id));
         case NodeKind_Assign:
-            return impl->visit_assign(impl, (NodeAssign*) node);
+            return impl->visit_assign(impl, node_assign_at(impl->arena, id));
         case NodeKind_VarDecl:
-            return impl->visit_var_decl(impl, (NodeVarDecl*) node);
+            return impl->visit_var_decl(impl, node_var_decl_at(impl->arena, id));
         case NodeKind_Block:
-            return impl->visit_block(impl, (NodeBlock*) node);
+            return impl->visit_block(impl, node_block_at(impl->arena, id));
         case NodeKind_FunParam:
-            return impl->visit_fun_param(impl, (NodeFunParam*) node);
+            return impl->visit_fun_param(impl, node_fun_param_at(impl->arena, id));
         case NodeKind_FunBody:
-            return impl->visit_fun_body(impl, (NodeFunBody*) node);
+            return impl->visit_fun_body(impl, node_fun_body_at(impl->arena, id));
         case NodeKind_FunDecl:
-            return impl->visit_fun_decl(impl, (NodeFunDecl*) node);
+            return impl->visit_fun_decl(impl, node_fun_decl_at(impl->arena, id));
         case NodeKind_Return:
-            return impl->visit_return_stmt(impl, (NodeReturn*) node);
+            return impl->visit_return_stmt(impl, node_return_stmt_at(impl->arena, id));
         case NodeKind_If:
-            return impl->visit_if_stmt(impl, (NodeIf*) node);
+            return impl->visit_if_stmt(impl, node_if_stmt_at(impl->arena, id));
         case NodeKind_While:
-            return impl->visit_while_stmt(impl, (NodeWhile*) node);
+            return impl->visit_while_stmt(impl, node_while_stmt_at(impl->arena, id));
         case NodeKind_Module:
-            return impl->visit_module(impl, (NodeModule*) node);
+            return impl->visit_module(impl, node_module_at(impl->arena, id));
         case NodeKind_InitArg:
-            return impl->visit_init_arg(impl, (NodeInitArg*) node);
+            return impl->visit_init_arg(impl, node_init_arg_at(impl->arena, id));
         case NodeKind_Init:
-            return impl->visit_init(impl, (NodeInit*) node);
+            return impl->visit_init(impl, node_init_at(impl->arena, id));
         case NodeKind_StructField:
-            return impl->visit_struct_field(impl, (NodeStructField*) node);
+            return impl->visit_struct_field(impl, node_struct_field_at(impl->arena, id));
         case NodeKind_Struct:
-            return impl->visit_struct_decl(impl, (NodeStruct*) node);
+            return impl->visit_struct_decl(impl, node_struct_decl_at(impl->arena, id));
     }
 }
 
 
-void* walk(Visitor* visitor, Node* node) {
-    switch (node->kind) {
+void* walk(Visitor* visitor, NodeId id) {
+    Node* node = node_at(visitor->arena, id);
+    switch (node_kind_at(visitor->arena, id)) {
         case NodeKind_Literal:
             return NULL;
         case NodeKind_Identifier:
@@ -66,7 +67,7 @@ void* walk(Visitor* visitor, Node* node) {
             visit(visitor, node->binary.right);
             return NULL;
         case NodeKind_Call:
-            walk_view(visitor, (Node**)node->call.args);
+            walk_view(visitor, node->call.args);
             return NULL;
         case NodeKind_Access:
             visit(visitor, node->access.left);
@@ -84,29 +85,30 @@ void* walk(Visitor* visitor, Node* node) {
             walk_view(visitor, node->block.nodes);
             return NULL;
         case NodeKind_FunParam:    
-            visit(visitor, node->fun_param.expression);
+            if (node->fun_param.expression)
+                visit(visitor, node->fun_param.expression);
             return NULL;
         case NodeKind_FunBody:
-            walk_view(visitor, node->block.nodes);
+            walk_view(visitor, node->fun_body.nodes);
             return NULL;
         case NodeKind_FunDecl:
-            walk_view(visitor, (Node**)node->fun_decl.params);
-            visit(visitor, (Node*) node->fun_decl.body);
+            walk_view(visitor, node->fun_decl.params);
+            visit(visitor, node->fun_decl.body);
             return NULL;
         case NodeKind_Return:
             visit(visitor, node->return_stmt.expression);
             return NULL;
         case NodeKind_If:
             visit(visitor, node->if_stmt.condition);
-            visit(visitor, (Node*)node->if_stmt.then_block);
+            visit(visitor, node->if_stmt.then_block);
             if (node->if_stmt.else_block)
-                visit(visitor, (Node*)node->if_stmt.else_block);
+                visit(visitor, node->if_stmt.else_block);
             return NULL;
         case NodeKind_While:
             visit(visitor, node->while_stmt.condition);
-            visit(visitor, (Node*)node->while_stmt.then_block);
+            visit(visitor, node->while_stmt.then_block);
             if (node->while_stmt.else_block)
-                visit(visitor, (Node*)node->while_stmt.else_block);
+                visit(visitor, node->while_stmt.else_block);
             return NULL;
         case NodeKind_Module:
             walk_view(visitor, node->module.decls);
@@ -116,7 +118,7 @@ void* walk(Visitor* visitor, Node* node) {
             visit(visitor, node->init_arg.expr);
             return NULL;
         case NodeKind_Init:
-            walk_view(visitor, (Node**)node->init.args);
+            walk_view(visitor, node->init.args);
             return NULL;
         case NodeKind_StructField:
             if (node->struct_field.expr)
@@ -128,14 +130,9 @@ void* walk(Visitor* visitor, Node* node) {
     }
 }
 
-void* walk_view(Visitor* visitor, Node** nodes) {
-    if (nodes == NULL)
-        return NULL;
-
-    Node* node = *nodes;
-    while (node != NULL) {
-        visit(visitor, node);
-        node++;
+void* walk_view(Visitor* visitor, NodeView nodes) {
+    for (u32 i = 0; i < nodes.count; ++i) {
+        visit(visitor, node_view_at(visitor->arena, nodes, i));
     }
     return NULL;
 }
@@ -164,7 +161,7 @@ void* walk_binary(Visitor* visitor, NodeBinary* node) {
 }
 
 void* walk_call(Visitor* visitor, NodeCall* node) {
-    walk_view(visitor, (Node**)node->args);
+    walk_view(visitor, node->args);
     return NULL;
 }
 
@@ -191,44 +188,45 @@ void* walk_var_decl(Visitor* visitor, NodeVarDecl* node) {
 }
 
 void* walk_block(Visitor* visitor, NodeBlock* node) {
-    walk_view(visitor, (Node**)node->nodes);
+    walk_view(visitor, node->nodes);
     return NULL;
 }
 
 void* walk_fun_param(Visitor* visitor, NodeFunParam* node) {
-    visit(visitor, node->expression);
+    if (node->expression)
+        visit(visitor, node->expression);
     return NULL;
 }
 
 void* walk_fun_body(Visitor* visitor, NodeFunBody* node) {
-    walk_view(visitor, (Node**)node->nodes);
+    walk_view(visitor, node->nodes);
     return NULL;
 }
 
 void* walk_fun_decl(Visitor* visitor, NodeFunDecl* node) {
-    walk_view(visitor, (Node**)node->params);
-    visit(visitor, (Node*)node->body);
+    walk_view(visitor, node->params);
+    visit(visitor, node->body);
     return NULL;
 }
 
 void* walk_return_stmt(Visitor* visitor, NodeReturn* node) {
-    visit(visitor, (Node*)node->expression);
+    visit(visitor, node->expression);
     return NULL;
 }
 
 void* walk_if_stmt(Visitor* visitor, NodeIf* node) {
     visit(visitor, node->condition);
-    visit(visitor, (Node*)node->then_block);
+    visit(visitor, node->then_block);
     if (node->else_block)
-        visit(visitor, (Node*)node->else_block);
+        visit(visitor, node->else_block);
     return NULL;
 }
 
 void* walk_while_stmt(Visitor* visitor, NodeWhile* node) {
     visit(visitor, node->condition);
-    visit(visitor, (Node*)node->then_block);
+    visit(visitor, node->then_block);
     if (node->else_block)
-        visit(visitor, (Node*)node->else_block);
+        visit(visitor, node->else_block);
     return NULL;
 }
 
@@ -238,7 +236,7 @@ void* walk_init_arg(Visitor* visitor, NodeInitArg * node) {
 }
 
 void* walk_init(Visitor* visitor, NodeInit* node) {
-    walk_view(visitor, (Node**) node->args);
+    walk_view(visitor, node->args);
     return NULL;
 }
 
@@ -1,6 +1,6 @@
 
 
-#include "tree.h"
+#include "node.h"
 
 
 struct Visitor;
@@ -12,12 +12,14 @@ typedef struct Visitor {
 #define X(upper, lower, flags, body) void* (*visit_##lower)(struct Visitor* visitor, Node##upper* node);
     ALL_NODES(X)
 #undef X
+    /// The nodes that the ids being visited refer to.
+    const NodeArena* arena;
 } Visitor;
 
-void* visit(void* visitor, Node* node);
+void* visit(void* visitor, NodeId node);
 
-void* walk(Visitor* visitor, Node* node);
-void* walk_view(Visitor* visitor, Node** nodes);
+void* walk(Visitor* visitor, NodeId node);
+void* walk_view(Visitor* visitor, NodeView nodes);
 void* walk_literal(Visitor* visitor, NodeLiteral* node);
 void* walk_identifier(Visitor* visitor, NodeIdentifier* node);
 void* walk_unary(Visitor* visitor, NodeUnary* node);
@@ -39,3 +41,126 @@ void* walk_init(Visitor* visitor, NodeInit* node);
 void* walk_struct_field(Visitor* visitor, NodeStructField* node);
 void* walk_struct_decl(Visitor* visitor, NodeStruct* node);
 
+
+
+/* ---------------------------- STATIC VISITOR -------------------------------- */
+/// visit() switches on the kind and then calls through the Visitor's table, so
+/// no handler can be inlined into the traversal. A pass can instead generate a
+/// visitor of its own from ALL_NODES, which calls its handlers directly:
+///
+///     #define STATIC_VISITOR_CONTEXT Counter   // Has a `const NodeArena* arena`.
+///     #define STATIC_VISITOR_PREFIX  count     // Handlers are count_literal, count_binary, ...
+///     DECLARE_STATIC_VISITOR()
+///
+///     static void* count_binary(Counter* counter, NodeBinary* node) {
+///         counter->count += 1;
+///         return count_walk(counter, NodeKind_Binary, (Node*) node);
+///     }
+///     ...one handler for every kind...
+///
+///     DEFINE_STATIC_VISITOR()
+///
+/// This gives `count_visit(context, id)` in place of visit(), and
+/// `count_walk(context, kind, node)` in place of the walk_* functions. The last
+/// child of a node is visited in tail position, so walking down a chain of
+/// nodes doesn't grow the stack at every step. Children that are 0 are skipped.
+#define STATIC_VISITOR_CONCAT_(a, b) a##b
+#define STATIC_VISITOR_CONCAT(a, b)  STATIC_VISITOR_CONCAT_(a, b)
+#define STATIC_VISITOR_NAME(name)    STATIC_VISITOR_CONCAT(STATIC_VISITOR_PREFIX, _##name)
+
+#define STATIC_VISITOR_DECLARE_HANDLER(upper, lower, flags, body) \
+    static void* STATIC_VISITOR_NAME(lower)(STATIC_VISITOR_CONTEXT* context, Node##upper* node);
+
+#define STATIC_VISITOR_CASE(upper, lower, flags, body)  \
+    case NodeKind_##upper: return STATIC_VISITOR_NAME(lower)(context, node_##lower##_at(context->arena, id));
+
+#define DECLARE_STATIC_VISITOR()                                                                        \
+    ALL_NODES(STATIC_VISITOR_DECLARE_HANDLER)                                                           \
+    static inline void* STATIC_VISITOR_NAME(visit)(STATIC_VISITOR_CONTEXT* context, NodeId id);        \
+    static inline void* STATIC_VISITOR_NAME(walk)(STATIC_VISITOR_CONTEXT* context, NodeKind kind, Node* node);
+
+#define DEFINE_STATIC_VISITOR()                                                                         \
+    static inline void* STATIC_VISITOR_NAME(visit)(STATIC_VISITOR_CONTEXT* context, NodeId id) {       \
+        switch (node_kind_at(context->arena, id)) {                                                     \
+            ALL_NODES(STATIC_VISITOR_CASE)                                                              \
+        }                                                                                               \
+        return NULL;                                                                                    \
+    }                                                                                                   \
+                                                                                                        \
+    static inline void* STATIC_VISITOR_NAME(walk_view)(STATIC_VISITOR_CONTEXT* context, NodeView nodes) { \
+        if (nodes.count == 0)                                                                           \
+            return NULL;                                                                                \
+        for (u32 i = 0; i + 1 < nodes.count; ++i)                                                       \
+            STATIC_VISITOR_NAME(visit)(context, node_view_at(context->arena, nodes, i));                \
+        return STATIC_VISITOR_NAME(visit)(context, node_view_at(context->arena, nodes, nodes.count - 1)); \
+    }                                                                                                   \
+                                                                                                        \
+    /* `kind` is usually a constant, which folds the switch away once inlined into a handler. */       \
+    static inline void* STATIC_VISITOR_NAME(walk)(STATIC_VISITOR_CONTEXT* context, NodeKind kind, Node* node) { \
+        NodeId last = 0;                                                                                \
+        switch (kind) {                                                                                 \
+            case NodeKind_Literal:                                                                      \
+            case NodeKind_Identifier:                                                                   \
+            case NodeKind_Type:                                                                         \
+                return NULL;                                                                            \
+            case NodeKind_Unary:                                                                        \
+                last = node->unary.expr;                                                                \
+                break;                                                                                  \
+            case NodeKind_Binary:                                                                       \
+                STATIC_VISITOR_NAME(visit)(context, node->binary.left);                                 \
+                last = node->binary.right;                                                              \
+                break;                                                                                  \
+            case NodeKind_Call:                                                                         \
+                return STATIC_VISITOR_NAME(walk_view)(context, node->call.args);                        \
+            case NodeKind_Access:                                                                       \
+                STATIC_VISITOR_NAME(visit)(context, node->access.left);                                 \
+                last = node->access.right;                                                              \
+                break;                                                                                  \
+            case NodeKind_Assign:                                                                       \
+                last = node->assign.expression;                                                         \
+                break;                                                                                  \
+            case NodeKind_VarDecl:                                                                      \
+                last = node->var_decl.expression;                                                       \
+                break;                                                                                  \
+            case NodeKind_Block:                                                                        \
+                return STATIC_VISITOR_NAME(walk_view)(context, node->block.nodes);                      \
+            case NodeKind_FunParam:                                                                     \
+                last = node->fun_param.expression;                                                      \
+                break;                                                                                  \
+            case NodeKind_FunBody:                                                                      \
+                return STATIC_VISITOR_NAME(walk_view)(context, node->fun_body.nodes);                   \
+            case NodeKind_FunDecl:                                                                      \
+                STATIC_VISITOR_NAME(walk_view)(context, node->fun_decl.params);                         \
+                last = node->fun_decl.body;                                                             \
+                break;                                                                                  \
+            case NodeKind_Return:                                                                       \
+                last = node->return_stmt.expression;                                                    \
+                break;                                                                                  \
+            case NodeKind_If:                                                                           \
+                STATIC_VISITOR_NAME(visit)(context, node->if_stmt.condition);                           \
+                STATIC_VISITOR_NAME(visit)(context, node->if_stmt.then_block);                          \
+                last = node->if_stmt.else_block;                                                        \
+                break;                                                                                  \
+            case NodeKind_While:                                                                        \
+                STATIC_VISITOR_NAME(visit)(context, node->while_stmt.condition);                        \
+                STATIC_VISITOR_NAME(visit)(context, node->while_stmt.then_block);                       \
+                last = node->while_stmt.else_block;                                                     \
+                break;                                                                                  \
+            case NodeKind_Module:                                                                       \
+                STATIC_VISITOR_NAME(walk_view)(context, node->module.decls);                            \
+                return STATIC_VISITOR_NAME(walk_view)(context, node->module.stmts);                     \
+            case NodeKind_InitArg:                                                                      \
+                last = node->init_arg.expr;                                                             \
+                break;                                                                                  \
+            case NodeKind_Init:                                                                         \
+                return STATIC_VISITOR_NAME(walk_view)(context, node->init.args);                        \
+            case NodeKind_StructField:                                                                  \
+                last = node->struct_field.expr;                                                         \
+                break;                                                                                  \
+            case NodeKind_Struct:                                                                       \
+                return STATIC_VISITOR_NAME(walk_view)(context, node->struct_decl.nodes);                \
+        }                                                                                               \
+        if (last == 0)                                                                                  \
+            return NULL;                                                                                \
+        return STATIC_VISITOR_NAME(visit)(context, last);                                               \
+    }
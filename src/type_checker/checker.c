@@ -4,57 +4,126 @@
 
 #include "allocator.h"
 #include "checker.h"
+#include "resolver.h"
 #include "error.h"
 #include "../parser/visitor.h"
+#include "os/thread.h"
 
 void typed_ast_free(TypedAst ast) {
-    free(ast.nodes);
-    Block* block = ast.block;
-    while (block != NULL) {
-        free(block->locals);
-        block++;
-    }
+    node_arena_free(&ast.arena);
+    free(ast.locals);
+    free(ast.tables);
     free(ast.block);
+    type_table_free(&ast.types);
+}
+
+
+/* ---------------------------- SCOPE TABLE -------------------------------- */
+static inline const char* local_name(const Local* local) {
+    assert((local->decl->kind == NodeKind_VarDecl || local->decl->kind == NodeKind_FunDecl || local->decl->kind == NodeKind_FunParam) && "Invalid node kind");
+    return local->decl->var_decl.name;
+}
+
+// Hashes where the name is in the data pool rather than where the pool is, so
+// the table stays valid when a cached tree is loaded somewhere else. The high
+// bits of the product depend on all the bits of the offset.
+static inline u32 name_hash(const Block* block, const char* name) {
+    u64 offset = (u64) ((uintptr_t) name - (uintptr_t) block->names);
+    return (u32) ((offset * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// The first of `table` that either holds the local named `name`, or is empty.
+static u32 table_probe(const Block* block, const u32* table, u32 capacity, const char* name) {
+    u32 mask = capacity - 1;
+    u32 i = name_hash(block, name) & mask;
+    while (table[i] != 0 && local_name(block->locals + table[i] - 1) != name)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// Keeps the first local of each name, as a scan through the locals would find.
+static void table_insert(const Block* block, u32* table, u32 capacity, u32 index) {
+    u32 i = table_probe(block, table, capacity, local_name(block->locals + index));
+    if (table[i] == 0)
+        table[i] = index + 1;
+}
+
+Local* block_find_local(const Block* block, const char* name) {
+    if (block->table_capacity == 0)
+        return NULL;
+    u32 i = table_probe(block, block->table, block->table_capacity, name);
+    return block->table[i] == 0 ? NULL : block->locals + block->table[i] - 1;
+}
+
+int block_add_local(Block* block, Local local) {
+    if (block->count == block->capacity)
+        return 0;
+
+    u32 index = (u32) block->count++;
+    block->locals[index] = local;
+    table_insert(block, block->table, block->table_capacity, index);
+    return 1;
 }
 
 
 /* ---------------------------- CHECKER IMPL -------------------------------- */
+// What the visitor's handlers return: the TypeId of the node, 0 on error, or -1
+// for a statement. As wide as the pointer visit() passes it through, since a
+// TypeId is narrower.
+typedef size_t CheckResult;
+
 typedef struct {
     Visitor visitor;
     GrammarTree ast;
 
     Block* blocks;
     size_t block_count;
+    Local* locals;
+    u32*   tables;
+
+    // Filled before checking, and only read while checking.
+    TypeTable types;
 
     Block* current;
     NodeFunDecl* current_function;
+
+    // Set while checking ahead on another thread. Nothing is printed then, as
+    // whatever fails is checked again on the calling thread, which reports it.
+    int speculative;
+    Logger logger;  // Points out where the errors are.
+
+    // Whether each top-level function was checked ahead, by its index in the
+    // module's declarations. NULL if none were.
+    const u8* checked_funs;
 } Checker;
 
 static void checker_free(Checker* checker) {
-    for (size_t i = 0; i < checker->block_count; ++i) {
-        free(checker->blocks[i].locals);
-    }
+    free(checker->locals);
+    free(checker->tables);
     free(checker->blocks);
+    type_table_free(&checker->types);
     grammar_tree_free(checker->ast);
 }
 
 static TypedAst checker_to_ast(Checker* checker) {
     return (TypedAst) {
-        checker->ast.nodes,
-        checker->ast.views,
+        checker->ast.arena,
         checker->ast.start,
         checker->blocks,
+        checker->block_count,
+        checker->locals,
+        checker->tables,
+        checker->types,
     };
 }
 
+static inline Node* get_node(const Checker* checker, NodeId id) {
+    return node_at(&checker->ast.arena, id);
+}
+
 static Block* push_block(Checker* checker, const NodeBlock* block) {
     Block* current = checker->current;
     Block* x = checker->blocks + block->id;
-    if (x->locals == NULL) {
-        x->locals = (Local *) alloc(0, 1024 * sizeof(Local));
-        x->count = 0;
-        x->parent = block->parent;
-    }
     x->parent_count = (current == NULL) ? 0 : (i32)(current->count + current->parent_count);
     checker->current = x;
     return current;
@@ -64,57 +133,98 @@ static void restore_block(Checker* checker, Block* block) {
     checker->current = block;
 }
 
-static Local* find_local(Checker* checker, const char* name) {
-    Block* current = checker->current;
-    while (current != NULL) {
-        for (int i = 0; i < current->count; ++i) {
-            Local* local = current->locals + i;
-            assert((local->decl->kind == NodeKind_VarDecl || local->decl->kind == NodeKind_FunDecl || local->decl->kind == NodeKind_FunParam) && "Invalid node kind");
-            if (local->decl->var_decl.name == name) {
-                return local;
-            }
-        }
-        current = current->parent == -1 ? NULL : checker->blocks + current->parent;
-    }
-    return NULL;
+// The local that the resolver found for a name, or NULL if there is none.
+static Local* resolved_local(Checker* checker, NodeSlot slot) {
+    if (slot.block == -1)
+        return NULL;
+    Block* block = checker->blocks + slot.block;
+    assert(slot.slot < block->count && "Resolved to a local that isn't declared yet");
+    return block->locals + slot.slot;
+}
+
+// The resolver put the locals of each block in the order they are declared
+// here, and left out the declarations of names that were already in scope. So
+// a declaration is new only if it's the next local of the current block.
+static int is_redeclared(const Checker* checker, const Node* decl) {
+    const Block* current = checker->current;
+    return current->count == current->capacity || current->locals[current->count].decl != decl;
+}
+
+static void declare_local(Checker* checker, const Node* decl, TypeId type) {
+    assert(!is_redeclared(checker, decl) && "Declared in another order than the resolver");
+    checker->current->locals[checker->current->count++].type = type;
 }
 
 static void report_undeclared_identifier(Checker* checker, const char* name, const Node* node) {
+    if (checker->speculative)
+        return;
+
     fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Undeclared identifier: '%s'\n", STR_ARG(checker->ast.tokens.name), name);
     int start = (int) checker->ast.tokens.source_offsets[node->base.start];
     int end   = (int) checker->ast.tokens.source_offsets[node->base.end];
     const char* repr = lexer_repr_of(checker->ast.tokens, node->base.end);
 
-    point_to_error(checker->ast.tokens.source, start, end + (int)strlen(repr));
+    point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
 }
 
 static void report_binary_op_mismatch(Checker* checker, const NodeBinary* binary, TypeId left, TypeId right) {
-    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Operator '%s' is not supported between '%s' and '%s'\n", STR_ARG(checker->ast.tokens.name), binary_op_repr(binary->op), literal_type_repr(left), literal_type_repr(right));
+    if (checker->speculative)
+        return;
+
+    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Operator '%s' is not supported between '%s' and '%s'\n", STR_ARG(checker->ast.tokens.name), binary_op_repr(binary->op), type_repr(&checker->types, left), type_repr(&checker->types, right));
     int start = (int) checker->ast.tokens.source_offsets[binary->base.start];
     int end   = (int) checker->ast.tokens.source_offsets[binary->base.end];
     const char* repr = lexer_repr_of(checker->ast.tokens, binary->base.end);
 
-    point_to_error(checker->ast.tokens.source, start, end + (int)strlen(repr));
+    point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
+}
+
+static void report_unary_op_mismatch(Checker* checker, const NodeUnary* unary, TypeId operand) {
+    if (checker->speculative)
+        return;
+
+    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Operator '%s' is not supported for '%s'\n", STR_ARG(checker->ast.tokens.name), unary_op_repr(unary->op), type_repr(&checker->types, operand));
+    int start = (int) checker->ast.tokens.source_offsets[unary->base.start];
+    int end   = (int) checker->ast.tokens.source_offsets[unary->base.end];
+    const char* repr = lexer_repr_of(checker->ast.tokens, unary->base.end);
+
+    point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
+}
+
+// For the nodes that the parser produces, but that can't be checked yet.
+static void report_unsupported(Checker* checker, const char* what, const Node* node) {
+    if (checker->speculative)
+        return;
+
+    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    %s are not supported yet\n", STR_ARG(checker->ast.tokens.name), what);
+    int start = (int) checker->ast.tokens.source_offsets[node->base.start];
+    int end   = (int) checker->ast.tokens.source_offsets[node->base.end];
+    const char* repr = lexer_repr_of(checker->ast.tokens, node->base.end);
+
+    point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
 }
 
 static void report_type_expectation(Checker* checker, const char* prefix, const Node* node, TypeId expected, TypeId got) {
-    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    %s. Expected '%s', got '%s'\n", STR_ARG(checker->ast.tokens.name), prefix, literal_type_repr(expected), literal_type_repr(got));
+    if (checker->speculative)
+        return;
+
+    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    %s. Expected '%s', got '%s'\n", STR_ARG(checker->ast.tokens.name), prefix, type_repr(&checker->types, expected), type_repr(&checker->types, got));
     int start = (int) checker->ast.tokens.source_offsets[node->base.start];
     int end   = (int) checker->ast.tokens.source_offsets[node->base.end];
     const char* repr = lexer_repr_of(checker->ast.tokens, node->base.end);
 
-    point_to_error(checker->ast.tokens.source, start, end + (int)strlen(repr));
+    point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
 }
 
 
 /* ---------------------------- CHECKER VISITOR -------------------------------- */
-static TypeId type_check_literal(Checker* checker, const NodeLiteral* literal) {
+static CheckResult type_check_literal(Checker* checker, const NodeLiteral* literal) {
     (void)checker;
-    return literal->type;
+    return type_of_literal(literal->type);
 }
 
-static TypeId type_check_identifier(Checker* checker, const NodeIdentifier* identifier) {
-    Local* local = find_local(checker, identifier->name);
+static CheckResult type_check_identifier(Checker* checker, const NodeIdentifier* identifier) {
+    Local* local = resolved_local(checker, identifier->resolved);
     if (local)
         return local->type;
 
@@ -122,111 +232,135 @@ static TypeId type_check_identifier(Checker* checker, const NodeIdentifier* iden
     return 0;
 }
 
-static TypeId type_check_binary(Checker* checker, const NodeBinary* binary) {
-    TypeId left = (TypeId) visit(checker, binary->left);
+static CheckResult type_check_unary(Checker* checker, const NodeUnary* unary) {
+    TypeId operand = (TypeId) (size_t) visit(checker, unary->expr);
+    if (operand == 0)
+        return 0;
+
+    int supported = unary_op_is_arithmetic(unary->op)
+        ? operand == TypeId_Integer || operand == TypeId_Real
+        : operand == TypeId_Boolean;
+    if (!supported) {
+        report_unary_op_mismatch(checker, unary, operand);
+        return 0;
+    }
+
+    return operand;
+}
+
+static CheckResult type_check_binary(Checker* checker, const NodeBinary* binary) {
+    TypeId left = (TypeId) (size_t) visit(checker, binary->left);
     if (left == 0)
         return 0;
 
-    TypeId right = (TypeId) visit(checker, binary->right);
+    TypeId right = (TypeId) (size_t) visit(checker, binary->right);
     if (right == 0)
         return 0;
 
-    if (left != right) {
+    if (left != right || (binary_op_is_logical(binary->op) && left != TypeId_Boolean)) {
         report_binary_op_mismatch(checker, binary, left, right);
         return 0;
     }
 
     if (binary_op_is_relational(binary->op))
-        return LiteralType_Boolean;
+        return TypeId_Boolean;
     else
         return left;
 }
 
-static TypeId type_check_call(Checker* checker, const NodeCall* call) {
+static CheckResult type_check_call(Checker* checker, const NodeCall* call) {
     if (strcmp(call->name, "print") == 0)
         return -1;
 
-    Local* local = find_local(checker, call->name);
+    Local* local = resolved_local(checker, call->resolved);
     if (local == NULL) {
         report_undeclared_identifier(checker, call->name, (Node*) call);
         return 0;
     }
 
-    if (local->decl->kind != NodeKind_FunDecl) {
+    TypeId fun = local->type;
+    if (type_kind(&checker->types, fun) != TypeKind_Fun) {
+        if (checker->speculative)
+            return 0;
         fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    '%s' is not a function\n", STR_ARG(checker->ast.tokens.name), call->name);
         int start = (int) checker->ast.tokens.source_offsets[call->base.start];
         int end   = (int) checker->ast.tokens.source_offsets[call->base.end];
         const char* repr = lexer_repr_of(checker->ast.tokens, call->base.end);
 
-        point_to_error(checker->ast.tokens.source, start, end + (int)strlen(repr));
+        point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
         return 0;
     }
 
-    NodeFunDecl* fun_decl = &local->decl->fun_decl;
-    if (fun_decl->param_count != call->count) {
-        fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Function '%s' requires %d arguments, got %d\n", STR_ARG(checker->ast.tokens.name), call->name, fun_decl->param_count, call->count);
+    u32 param_count = type_fun_param_count(&checker->types, fun);
+    if (param_count != call->args.count) {
+        if (checker->speculative)
+            return 0;
+        fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Function '%s' requires %u arguments, got %u\n", STR_ARG(checker->ast.tokens.name), call->name, param_count, call->args.count);
         int start = (int) checker->ast.tokens.source_offsets[call->base.start];
         int end   = (int) checker->ast.tokens.source_offsets[call->base.end];
         const char* repr = lexer_repr_of(checker->ast.tokens, call->base.end);
 
-        point_to_error(checker->ast.tokens.source, start, end + (int)strlen(repr));
+        point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
         return 0;
     }
 
-    for (i32 i = 0; i < fun_decl->param_count; ++i) {
-        Node* arg = call->args[i];
-        TypeId type = (TypeId) visit(checker, arg);
+    for (u32 i = 0; i < param_count; ++i) {
+        NodeId arg = node_view_at(&checker->ast.arena, call->args, i);
+        TypeId type = (TypeId) (size_t) visit(checker, arg);
         if (type == 0)
             return 0;
 
-        if (type != (TypeId) fun_decl->params[i]->type->type.name) {
-            report_type_expectation(checker, "Argument type mismatch", arg, (TypeId) fun_decl->params[i]->type, type);
+        TypeId expected = type_fun_param(&checker->types, fun, i);
+        if (type != expected) {
+            report_type_expectation(checker, "Argument type mismatch", get_node(checker, arg), expected, type);
             return 0;
         }
     }
 
-    if (fun_decl->return_type == NULL)
+    TypeId result = type_fun_result(&checker->types, fun);
+    if (result == TypeId_Void)
         return -1;
     else
-        return (TypeId) fun_decl->return_type->type.name;
+        return result;
 }
 
-static TypeId type_check_var_decl(Checker* checker, const NodeVarDecl* var_decl) {
-    Local* local = find_local(checker, var_decl->name);
-    if (local) {
+static CheckResult type_check_access(Checker* checker, const NodeAccess* access) {
+    report_unsupported(checker, "Member accesses", (Node*) access);
+    return 0;
+}
+
+static CheckResult type_check_var_decl(Checker* checker, const NodeVarDecl* var_decl) {
+    if (is_redeclared(checker, (Node*) var_decl)) {
+        if (checker->speculative)
+            return 0;
         fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Variable '%s' already declared\n", STR_ARG(checker->ast.tokens.name), var_decl->name);
         int start = (int) checker->ast.tokens.source_offsets[var_decl->base.start];
         int end   = (int) checker->ast.tokens.source_offsets[var_decl->base.end];
         const char* repr = lexer_repr_of(checker->ast.tokens, var_decl->base.end);
 
-        point_to_error(checker->ast.tokens.source, start, end + (int)strlen(repr));
+        point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end + (int)strlen(repr));
         return 0;
     }
 
-    TypeId expr = (TypeId) visit(checker, var_decl->expression);
+    TypeId expr = (TypeId) (size_t) visit(checker, var_decl->expression);
     if (expr == 0)
         return 0;
 
-    Block* current = checker->current;
-    current->locals[current->count++] = (Local) {
-        .type = expr,
-        .decl = (Node*) var_decl
-    };
+    declare_local(checker, (Node*) var_decl, expr);
     return -1;
 }
 
-static TypeId type_check_type(Checker* checker, const NodeType* node) {
+static CheckResult type_check_type(Checker* checker, const NodeType* node) {
     (void)checker;
-    // TODO: Add to symbol table.
-    return (TypeId) node->name;
+    return node->type_id;
 }
 
-static TypeId type_check_assign(Checker* checker, const NodeAssign* assign) {
-    TypeId expr = (TypeId) visit(checker, assign->expression);
+static CheckResult type_check_assign(Checker* checker, const NodeAssign* assign) {
+    TypeId expr = (TypeId) (size_t) visit(checker, assign->expression);
     if (expr == 0)
         return 0;
 
-    Local* local = find_local(checker, assign->name);
+    Local* local = resolved_local(checker, assign->resolved);
     if (local)
         return local->type;
 
@@ -234,11 +368,14 @@ static TypeId type_check_assign(Checker* checker, const NodeAssign* assign) {
     return 0;
 }
 
-static TypeId type_check_block(Checker* checker, const NodeBlock* node) {
+static CheckResult type_check_block(Checker* checker, const NodeBlock* node) {
     Block* parent = push_block(checker, node);
-    for (i32 i = 0; i < node->count; ++i) {
-        Node* stmt = node->nodes[i];
-        if (visit(checker, stmt) == 0)
+    // Its locals are counted from the start, also when a function that failed
+    // to check on another thread is checked again.
+    checker->current->count = 0;
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        NodeId stmt = node_view_at(&checker->ast.arena, node->nodes, i);
+        if ((TypeId) (size_t) visit(checker, stmt) == 0)
             return 0;
     }
     restore_block(checker, parent);
@@ -246,43 +383,32 @@ static TypeId type_check_block(Checker* checker, const NodeBlock* node) {
     return -1;
 }
 
-static TypeId type_check_fun_param(Checker* checker, const NodeFunParam* fun_param) {
-    assert(fun_param->expression == NULL && "Function parameters cannot have default values for now");
+static CheckResult type_check_fun_param(Checker* checker, const NodeFunParam* fun_param) {
+    assert(fun_param->expression == 0 && "Function parameters cannot have default values for now");
 
-    Block* current = checker->current;
-    current->locals[current->count++] = (Local) {
-        .type = (TypeId) visit(checker, fun_param->type),
-        .decl = (Node*) fun_param
-    };
+    declare_local(checker, (Node*) fun_param, (TypeId) (size_t) visit(checker, fun_param->type));
     return -1;
 }
 
-static TypeId type_check_fun_body(Checker* checker, const NodeFunBody* node) {
+static CheckResult type_check_fun_body(Checker* checker, const NodeFunBody* node) {
     Block* parent = push_block(checker, (const NodeBlock *) node);
-    for (i32 i = 0; i < node->count; ++i) {
-        Node* stmt = node->nodes[i];
-        if (visit(checker, stmt) == 0)
+    for (u32 i = 0; i < node->nodes.count; ++i) {
+        NodeId stmt = node_view_at(&checker->ast.arena, node->nodes, i);
+        if ((TypeId) (size_t) visit(checker, stmt) == 0)
             return 0;
     }
     restore_block(checker, parent);
     return -1;
 }
 
-static TypeId type_check_fun_decl(Checker* checker, const NodeFunDecl* fun_decl) {
-    Local* local = find_local(checker, fun_decl->name);
-    if (local != NULL) {
-        fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Function '%s' already declared\n", STR_ARG(checker->ast.tokens.name), fun_decl->name);
-        int start = (int) checker->ast.tokens.source_offsets[fun_decl->base.start];
-        int end   = (int) checker->ast.tokens.source_offsets[fun_decl->body->base.start];
-
-        point_to_error(checker->ast.tokens.source, start, end);
-        return 0;
-    }
-
+// Checks the parameters and the body of a function, but doesn't declare it.
+static CheckResult type_check_fun(Checker* checker, const NodeFunDecl* fun_decl) {
     // Add parameters to the symbol table at the beginning of the function.
-    Block* block = push_block(checker, (const NodeBlock*) fun_decl->body);
-    for (i32 i = 0; i < fun_decl->param_count; ++i) {
-        NodeFunParam* param = fun_decl->params[i];
+    NodeFunBody* body = node_fun_body_at(&checker->ast.arena, fun_decl->body);
+    Block* block = push_block(checker, (const NodeBlock*) body);
+    checker->current->count = 0;
+    for (u32 i = 0; i < fun_decl->params.count; ++i) {
+        NodeFunParam* param = node_fun_param_at(&checker->ast.arena, node_view_at(&checker->ast.arena, fun_decl->params, i));
         if (type_check_fun_param(checker, param) == 0)
             return 0;
     }
@@ -290,93 +416,145 @@ static TypeId type_check_fun_decl(Checker* checker, const NodeFunDecl* fun_decl)
 
     NodeFunDecl* current_function = checker->current_function;
     checker->current_function = (NodeFunDecl*) fun_decl;
-    if (type_check_fun_body(checker, fun_decl->body) == 0)
+    if (type_check_fun_body(checker, body) == 0)
         return 0;
     checker->current_function = current_function;
+    return -1;
+}
 
-    Block* current = checker->current;
-    current->locals[current->count++] = (Local) {
-            .type = (TypeId) fun_decl->return_type,
-            .decl = (Node*) fun_decl
-    };
+static CheckResult type_check_fun_decl(Checker* checker, const NodeFunDecl* fun_decl) {
+    if (is_redeclared(checker, (Node*) fun_decl)) {
+        if (checker->speculative)
+            return 0;
+        fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Function '%s' already declared\n", STR_ARG(checker->ast.tokens.name), fun_decl->name);
+        int start = (int) checker->ast.tokens.source_offsets[fun_decl->base.start];
+        int end   = (int) checker->ast.tokens.source_offsets[get_node(checker, fun_decl->body)->base.start];
+
+        point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end);
+        return 0;
+    }
+
+    if (type_check_fun(checker, fun_decl) == 0)
+        return 0;
+
+    declare_local(checker, (Node*) fun_decl, fun_decl->type_id);
 
     return -1;
 }
 
-static TypeId type_check_return_stmt(Checker* checker, const NodeReturn* return_stmt) {
+static CheckResult type_check_return_stmt(Checker* checker, const NodeReturn* return_stmt) {
     if (checker->current_function == NULL) {
+        if (checker->speculative)
+            return 0;
         fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Return statement outside of function\n", STR_ARG(checker->ast.tokens.name));
         int start = (int) checker->ast.tokens.source_offsets[return_stmt->base.start];
         int end   = (int) checker->ast.tokens.source_offsets[return_stmt->base.end];
 
-        point_to_error(checker->ast.tokens.source, start, end);
+        point_to_error_indexed(&checker->logger, checker->ast.tokens.source, checker->ast.tokens.lines, start, end);
         return 0;
     }
 
-    TypeId expr = (TypeId) visit(checker, return_stmt->expression);
+    TypeId expr = (TypeId) (size_t) visit(checker, return_stmt->expression);
     if (expr == 0)
         return 0;
 
-    if (expr != (TypeId) checker->current_function->return_type->type.name) {
-        report_type_expectation(checker, "Return type mismatch", return_stmt->expression, (TypeId) checker->current_function->return_type->type.name, expr);
+    TypeId expected = type_fun_result(&checker->types, checker->current_function->type_id);
+    if (expr != expected) {
+        report_type_expectation(checker, "Return type mismatch", get_node(checker, return_stmt->expression), expected, expr);
         return 0;
     }
 
     return -1;
 }
 
-static TypeId type_check_if_stmt(Checker* checker, const NodeIf* if_stmt) {
-    TypeId condition = (TypeId) visit(checker, if_stmt->condition);
+static CheckResult type_check_if_stmt(Checker* checker, const NodeIf* if_stmt) {
+    TypeId condition = (TypeId) (size_t) visit(checker, if_stmt->condition);
     if (condition == 0)
         return 0;
 
-    if (condition != LiteralType_Boolean) {
-        report_type_expectation(checker, "Condition of 'if' statement must be a boolean", (Node*) if_stmt->condition, LiteralType_Boolean, condition);
+    if (condition != TypeId_Boolean) {
+        report_type_expectation(checker, "Condition of 'if' statement must be a boolean", get_node(checker, if_stmt->condition), TypeId_Boolean, condition);
         return 0;
     }
 
-    if (type_check_block(checker, if_stmt->then_block) == 0)
+    if (type_check_block(checker, &get_node(checker, if_stmt->then_block)->block) == 0)
         return 0;
 
-    if (if_stmt->else_block != NULL && type_check_block(checker, if_stmt->then_block) == 0)
+    if (if_stmt->else_block != 0 && type_check_block(checker, &get_node(checker, if_stmt->else_block)->block) == 0)
         return 0;
 
     return -1;
 }
 
-static TypeId type_check_while_stmt(Checker* checker, const NodeWhile* while_stmt) {
-    TypeId condition = (TypeId) visit(checker, while_stmt->condition);
+static CheckResult type_check_while_stmt(Checker* checker, const NodeWhile* while_stmt) {
+    TypeId condition = (TypeId) (size_t) visit(checker, while_stmt->condition);
     if (condition == 0)
         return 0;
 
-    if (condition != LiteralType_Boolean) {
-        report_type_expectation(checker, "Condition of 'while' statement must be a boolean", (Node*) while_stmt->condition, LiteralType_Boolean, condition);
+    if (condition != TypeId_Boolean) {
+        report_type_expectation(checker, "Condition of 'while' statement must be a boolean", get_node(checker, while_stmt->condition), TypeId_Boolean, condition);
         return 0;
     }
 
-    if (type_check_block(checker, while_stmt->then_block) == 0)
+    if (type_check_block(checker, &get_node(checker, while_stmt->then_block)->block) == 0)
         return 0;
 
-    if (while_stmt->else_block != NULL && type_check_block(checker, while_stmt->then_block) == 0)
+    if (while_stmt->else_block != 0 && type_check_block(checker, &get_node(checker, while_stmt->else_block)->block) == 0)
         return 0;
 
     return -1;
 }
 
+static CheckResult type_check_init_arg(Checker* checker, const NodeInitArg* init_arg) {
+    return (CheckResult) visit(checker, init_arg->expr);
+}
+
+// The struct's fields aren't interned yet, so there is nothing to check the
+// arguments against.
+static CheckResult type_check_init(Checker* checker, const NodeInit* init) {
+    report_unsupported(checker, "Struct initializers", (Node*) init);
+    return 0;
+}
+
+static CheckResult type_check_struct_field(Checker* checker, const NodeStructField* struct_field) {
+    TypeId type = (TypeId) (size_t) visit(checker, struct_field->type);
+    if (type == 0 || struct_field->expr == 0)
+        return type;
+
+    TypeId expr = (TypeId) (size_t) visit(checker, struct_field->expr);
+    if (expr == 0)
+        return 0;
+
+    if (expr != type) {
+        report_type_expectation(checker, "Default value type mismatch", get_node(checker, struct_field->expr), type, expr);
+        return 0;
+    }
+
+    return type;
+}
+
+static CheckResult type_check_struct_decl(Checker* checker, const NodeStruct* struct_decl) {
+    report_unsupported(checker, "Struct declarations", (Node*) struct_decl);
+    return 0;
+}
 
 
-static TypeId type_check_module(Checker* checker, const NodeModule* node) {
+static CheckResult type_check_module(Checker* checker, const NodeModule* node) {
     NodeBlock block = { .id = 0, .parent=-1 };
     Block* parent = push_block(checker, &block);
-    for (i32 i = 0; i < node->decl_count; ++i) {
-        Node* node_ = node->decls[i];
-        if (visit(checker, node_) == 0)
+    for (u32 i = 0; i < node->decls.count; ++i) {
+        NodeId node_ = node_view_at(&checker->ast.arena, node->decls, i);
+        if (checker->checked_funs != NULL && checker->checked_funs[i]) {
+            const NodeFunDecl* fun_decl = node_fun_decl_at(&checker->ast.arena, node_);
+            declare_local(checker, (Node*) fun_decl, fun_decl->type_id);
+        } else if ((TypeId) (size_t) visit(checker, node_) == 0) {
             return 0;
+        }
     }
 
-    for (i32 i = 0; i < node->stmt_count; ++i) {
-        Node* node_ = node->stmts[i];
-        if (visit(checker, node_) == 0)
+    for (u32 i = 0; i < node->stmts.count; ++i) {
+        NodeId node_ = node_view_at(&checker->ast.arena, node->stmts, i);
+        if ((TypeId) (size_t) visit(checker, node_) == 0)
             return 0;
     }
     restore_block(checker, parent);
@@ -385,33 +563,247 @@ static TypeId type_check_module(Checker* checker, const NodeModule* node) {
 }
 
 
-TypedAst type_check(GrammarTree ast) {
-    Node* node = ast.start;
+// Interns the type of every Type node and the signature of every function up
+// front, so that checking only reads the table, also on several threads. A name
+// that isn't a literal type is a struct, which for now is only its name, as
+// the fields of struct declarations aren't checked yet. Returns 0 if out of memory.
+static int intern_types(TypeTable* types, NodeArena* arena) {
+    NodePool* type_pool = &arena->pools[NodeKind_Type];
+    for (u32 i = 0; i < type_pool->count; ++i) {
+        NodeType* type = (NodeType*) node_pool_at(type_pool, i);
+        if ((uintptr_t) type->name <= LITERAL_TYPE_LAST)
+            type->type_id = type_of_literal((LiteralType) (uintptr_t) type->name);
+        else
+            type->type_id = type_table_struct(types, type->name, NULL, 0);
+        if (type->type_id == TypeId_Invalid)
+            return 0;
+    }
 
+    NodePool* fun_pool = &arena->pools[NodeKind_FunDecl];
+    u32 max_param_count = 0;
+    for (u32 i = 0; i < fun_pool->count; ++i) {
+        NodeFunDecl* fun_decl = (NodeFunDecl*) node_pool_at(fun_pool, i);
+        if (fun_decl->params.count > max_param_count)
+            max_param_count = fun_decl->params.count;
+    }
+
+    TypeId* params = (TypeId*) alloc(0, (max_param_count + 1) * sizeof(TypeId));
+    if (params == NULL)
+        return 0;
+
+    for (u32 i = 0; i < fun_pool->count; ++i) {
+        NodeFunDecl* fun_decl = (NodeFunDecl*) node_pool_at(fun_pool, i);
+        for (u32 j = 0; j < fun_decl->params.count; ++j) {
+            NodeFunParam* param = node_fun_param_at(arena, node_view_at(arena, fun_decl->params, j));
+            params[j] = node_type_at(arena, param->type)->type_id;
+        }
+
+        TypeId result = (fun_decl->return_type == 0) ? (TypeId) TypeId_Void : node_type_at(arena, fun_decl->return_type)->type_id;
+        fun_decl->type_id = type_table_fun(types, result, params, fun_decl->params.count);
+        if (fun_decl->type_id == TypeId_Invalid) {
+            free(params);
+            return 0;
+        }
+    }
+
+    free(params);
+    return 1;
+}
+
+static Checker checker_make(GrammarTree ast, Scopes scopes, TypeTable types) {
     Visitor visitor = {
 #define X(upper, lower, flags, body) .visit_##lower = (Visit##upper##Fn) type_check_##lower,
         ALL_NODES(X)
 #undef X
     };
 
-    Checker checker = {
+    return (Checker) {
         .visitor = visitor,
         .ast = ast,
-        .blocks = (Block*) alloc(0, (ast.block_count + 1) * sizeof(Block)),
-        .block_count = 0,
+        .blocks = scopes.blocks,
+        .block_count = scopes.block_count,
+        .locals = scopes.locals,
+        .tables = scopes.tables,
+        .types = types,
         .current = NULL,
         .current_function = NULL,
+        .speculative = 0,
+        .logger = logger_make_with_file("Checker", LOG_LEVEL_ERROR, stderr),
+        .checked_funs = NULL,
     };
-    memset(checker.blocks, 0, (ast.block_count + 1) * sizeof(Block));
+}
 
-    TypeId type = (TypeId) visit(&checker.visitor, node);
+// Checks the module, and frees everything if it fails.
+static TypedAst checker_run(Checker* checker) {
+    checker->visitor.arena = &checker->ast.arena;
+    TypeId type = (TypeId) (size_t) visit(&checker->visitor, checker->ast.start);
 
     if (type == 0) {
-        checker_free(&checker);
-        return (TypedAst) { NULL, NULL, NULL, NULL };
+        checker_free(checker);
+        return (TypedAst) { 0 };
+    }
+
+    return checker_to_ast(checker);
+}
+
+static TypedAst out_of_memory(GrammarTree ast) {
+    fprintf(stderr, "[Error] (Checker) " STR_FMT "\n    Out of memory\n", STR_ARG(ast.tokens.name));
+    grammar_tree_free(ast);
+    return (TypedAst) { 0 };
+}
+
+// The table with the types of the tree. Returns one with kinds == NULL if out of memory.
+static TypeTable make_types(NodeArena* arena, const char* data_pool) {
+    TypeTable types = type_table_make(data_pool);
+    if (types.kinds != NULL && !intern_types(&types, arena)) {
+        type_table_free(&types);
+        return (TypeTable) { 0 };
+    }
+    return types;
+}
+
+TypedAst type_check(GrammarTree ast) {
+    TypeTable types = make_types(&ast.arena, (const char*) ast.tokens.data_pool);
+    if (types.kinds == NULL)
+        return out_of_memory(ast);
+
+    Scopes scopes = resolve(&ast);
+    if (scopes.blocks == NULL) {
+        type_table_free(&types);
+        return out_of_memory(ast);
     }
 
-    return checker_to_ast(&checker);
+    Checker checker = checker_make(ast, scopes, types);
+    return checker_run(&checker);
 }
 
 
+/* ---------------------------- PARALLEL CHECKER -------------------------------- */
+// The top-level functions share nothing but the module's block, in which they
+// only read the functions declared before them. So every thread resolves and
+// checks a run of functions, in a checker of its own, with a copy of the
+// module's block as it is when the calling thread gets to each of them. The
+// calling thread then goes through the module as type_check does, but only
+// declares the functions that were checked ahead. A function with errors is
+// left to it, which reports them where they belong, so the errors are exactly
+// those of type_check.
+#define CHECKER_MAX_THREADS        64
+#define CHECKER_MIN_PARALLEL_NODES (64 * 1024)
+
+typedef struct {
+    const Checker* checker;
+    const NodeId*  funs;
+    u8*            checked;     // Set for each function that checked.
+    u32            count;
+    size_t         token_count; // Of all its functions, to split them evenly.
+} CheckJob;
+
+static int check_job_run(void* arg) {
+    CheckJob* job = (CheckJob*) arg;
+    Checker checker = *job->checker;
+    checker.visitor.arena = &checker.ast.arena;
+    checker.speculative = 1;
+
+    Scopes scopes = { checker.blocks, checker.block_count, checker.locals, checker.tables };
+    for (u32 i = 0; i < job->count; ++i) {
+        i64 slot = resolve_fun(&scopes, &checker.ast.arena, job->funs[i]);
+        if (slot == -1)
+            continue;
+
+        Block module = checker.blocks[0];
+        module.count = slot;
+        checker.current = &module;
+        checker.current_function = NULL;
+        job->checked[i] = type_check_fun(&checker, node_fun_decl_at(&checker.ast.arena, job->funs[i])) != 0;
+    }
+    return 1;
+}
+
+// Runs every job, the first one on the calling thread.
+// If a thread can't be started, its job also runs on the calling thread.
+static void check_jobs_run(CheckJob* jobs, int count) {
+    Thread threads[CHECKER_MAX_THREADS];
+    int    started[CHECKER_MAX_THREADS];
+    for (int i = 1; i < count; ++i)
+        started[i] = thread_start(&threads[i], check_job_run, &jobs[i]);
+
+    check_job_run(&jobs[0]);
+    for (int i = 1; i < count; ++i) {
+        if (started[i])
+            thread_join(threads[i]);
+        else
+            check_job_run(&jobs[i]);
+    }
+}
+
+TypedAst type_check_parallel(GrammarTree ast, int thread_count) {
+    if (thread_count <= 0)
+        thread_count = thread_hardware_count();
+    if (thread_count > CHECKER_MAX_THREADS)
+        thread_count = CHECKER_MAX_THREADS;
+    if ((size_t) thread_count > ast.arena.count / CHECKER_MIN_PARALLEL_NODES)
+        thread_count = (int) (ast.arena.count / CHECKER_MIN_PARALLEL_NODES);
+
+    const NodeModule* module = node_module_at(&ast.arena, ast.start);
+    u32 fun_count = module->decls.count;
+    if (thread_count <= 1 || fun_count < (u32) thread_count)
+        return type_check(ast);
+
+    TypeTable types = make_types(&ast.arena, (const char*) ast.tokens.data_pool);
+    if (types.kinds == NULL)
+        return out_of_memory(ast);
+    Scopes scopes = resolve_globals(&ast);
+    if (scopes.blocks == NULL) {
+        type_table_free(&types);
+        return out_of_memory(ast);
+    }
+    u8* checked = (u8*) alloc(0, fun_count);
+    if (checked == NULL) {
+        scopes_free(scopes);
+        type_table_free(&types);
+        return out_of_memory(ast);
+    }
+    memset(checked, 0, fun_count);
+
+    // The functions are declared with their signatures until the threads
+    // are done, as every function sees those before it.
+    Checker checker = checker_make(ast, scopes, types);
+    const NodeId* funs = checker.ast.arena.views + module->decls.offset;
+    Block* globals = checker.blocks;
+    size_t total = 0;
+    for (u32 i = 0; i < fun_count; ++i) {
+        const NodeFunDecl* fun_decl = node_fun_decl_at(&checker.ast.arena, funs[i]);
+        Local* local = block_find_local(globals, fun_decl->name);
+        if (local->decl == (Node*) fun_decl) {
+            local->type = fun_decl->type_id;
+            globals->count = (local - globals->locals) + 1;
+        }
+        total += fun_decl->base.end - fun_decl->base.start;
+    }
+
+    // Every job gets a run of functions with about as many tokens as the others.
+    CheckJob jobs[CHECKER_MAX_THREADS];
+    int    job_count = 0;
+    u32    first     = 0;
+    size_t taken     = 0;
+    for (int i = 0; i < thread_count && first < fun_count; ++i) {
+        size_t target = (i == thread_count-1) ? total : total / (size_t) thread_count * (size_t) (i+1);
+        u32    end    = first;
+        size_t size   = 0;
+        while (end < fun_count && taken < target) {
+            const NodeFunDecl* fun_decl = node_fun_decl_at(&checker.ast.arena, funs[end]);
+            size  += fun_decl->base.end - fun_decl->base.start;
+            taken += fun_decl->base.end - fun_decl->base.start;
+            end   += 1;
+        }
+        jobs[job_count++] = (CheckJob) { &checker, funs + first, checked + first, end - first, size };
+        first = end;
+    }
+    check_jobs_run(jobs, job_count);
+
+    globals->count = 0;
+    checker.checked_funs = checked;
+    TypedAst typed = checker_run(&checker);
+    free(checked);
+    return typed;
+}
@@ -2,9 +2,9 @@
 
 #include "preamble.h"
 #include "parser/parser.h"
+#include "type_checker/type_table.h"
 
 
-typedef u64 TypeId;
 typedef struct {
     TypeId type;
     Node*  decl;
@@ -15,18 +15,47 @@ typedef struct {
     i32     parent_count;
     Local*  locals;
     i64     count;
+    i64     capacity;   /// As many as the parser counted declarations in the block.
+
+    /// Open addressing table from the name of each local to its index + 1, or
+    /// 0 for an empty slot. Names are interned, so they're compared by pointer,
+    /// and hashed by their offset into `names`, which keeps the table valid when
+    /// the names and the pool move together. The capacity is a power of two.
+    u32*        table;
+    u32         table_capacity;
+    const char* names;  /// The data pool the names are interned in.
 } Block;
 
 typedef struct {
     // Extracted from the untyped ast.
-    Node*  nodes;
-    Node** views;
-    Node*  start;
+    NodeArena arena;
+    NodeId    start;
 
     // Type checked info.
     Block*  block;
+    size_t  block_count;
+
+    // What the locals and the tables of all the blocks are carved out of.
+    Local*  locals;
+    u32*    tables;
+
+    // Every type in the tree, by the ids in the nodes and the locals.
+    TypeTable types;
 } TypedAst;
 
 TypedAst type_check(GrammarTree ast);
 
+/// Same as `type_check`, but the top-level functions are checked on up to
+/// `thread_count` threads, or one per hardware thread if it's 0. The result and
+/// the errors are identical. Small trees, and those with few functions, are
+/// checked on the calling thread.
+TypedAst type_check_parallel(GrammarTree ast, int thread_count);
+
+/// The local declared with `name` in the block itself, not in its parents.
+/// The first one, if there are several. NULL if there is none.
+Local* block_find_local(const Block* block, const char* name);
+
+/// Returns 0 if the block is already full.
+int block_add_local(Block* block, Local local);
+
 void typed_ast_free(TypedAst ast);
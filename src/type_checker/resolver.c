@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "resolver.h"
+#include "../parser/visitor.h"
+
+
+/* ---------------------------- SCOPES -------------------------------- */
+// The smallest power of two that is at most three quarters full with `count`
+// locals, so that probes stay short.
+static u32 table_capacity_for(i64 count) {
+    if (count == 0)
+        return 0;
+    u32 capacity = 8;
+    while (4 * (u64) count > 3 * (u64) capacity)
+        capacity *= 2;
+    return capacity;
+}
+
+static void size_block(Scopes* scopes, i32 id, i32 parent, u32 declared_count) {
+    Block* block = scopes->blocks + id;
+    block->parent = parent;
+    block->capacity = declared_count;
+    block->table_capacity = table_capacity_for(declared_count);
+}
+
+// Gives every block room for exactly the locals the parser counted in it. They
+// are all carved out of one array, and their tables out of another, so none of
+// them grow or move once the tree is resolved. Returns 0 if out of memory.
+static int carve_blocks(Scopes* scopes, const GrammarTree* ast) {
+    const NodeArena* arena = &ast->arena;
+    size_t block_count = scopes->block_count;
+    scopes->blocks = (Block*) alloc(0, block_count * sizeof(Block));
+    if (scopes->blocks == NULL)
+        return 0;
+    memset(scopes->blocks, 0, block_count * sizeof(Block));
+
+    const NodeModule* module = node_module_at(arena, ast->start);
+    size_block(scopes, 0, -1, module->declared_count);
+    const NodePool* blocks = &arena->pools[NodeKind_Block];
+    for (u32 i = 0; i < blocks->count; ++i) {
+        const NodeBlock* block = (const NodeBlock*) node_pool_at(blocks, i);
+        size_block(scopes, block->id, block->parent, block->declared_count);
+    }
+    const NodePool* bodies = &arena->pools[NodeKind_FunBody];
+    for (u32 i = 0; i < bodies->count; ++i) {
+        const NodeFunBody* body = (const NodeFunBody*) node_pool_at(bodies, i);
+        size_block(scopes, body->id, body->parent, body->declared_count);
+    }
+
+    size_t local_count = 0;
+    size_t table_count = 0;
+    for (size_t i = 0; i < block_count; ++i) {
+        local_count += (size_t) scopes->blocks[i].capacity;
+        table_count += scopes->blocks[i].table_capacity;
+    }
+    scopes->locals = (Local*) alloc(0, local_count * sizeof(Local));
+    scopes->tables = (u32*) alloc(0, table_count * sizeof(u32));
+    if ((local_count != 0 && scopes->locals == NULL) || (table_count != 0 && scopes->tables == NULL))
+        return 0;
+    memset(scopes->tables, 0, table_count * sizeof(u32));
+
+    Local* locals = scopes->locals;
+    u32*   tables = scopes->tables;
+    for (size_t i = 0; i < block_count; ++i) {
+        Block* block = scopes->blocks + i;
+        block->locals = locals;
+        block->table  = tables;
+        block->names  = (const char*) ast->tokens.data_pool;
+        locals += block->capacity;
+        tables += block->table_capacity;
+    }
+    return 1;
+}
+
+void scopes_free(Scopes scopes) {
+    free(scopes.locals);
+    free(scopes.tables);
+    free(scopes.blocks);
+}
+
+
+/* ---------------------------- RESOLVER IMPL -------------------------------- */
+typedef struct {
+    const NodeArena* arena;
+    Scopes scopes;
+    Block* current;
+
+    // How many of the module's locals are in scope. A top-level function only
+    // sees the functions declared before it, even once the others are.
+    u32 visible;
+} Resolver;
+
+static const NodeSlot UNRESOLVED = { -1, 0 };
+
+// Searches the current block and then each block around it.
+static NodeSlot lookup(const Resolver* resolver, const char* name) {
+    const Block* current = resolver->current;
+    while (current != NULL) {
+        const Local* local = block_find_local(current, name);
+        if (local != NULL) {
+            u32 slot = (u32) (local - current->locals);
+            if (current != resolver->scopes.blocks || slot < resolver->visible)
+                return (NodeSlot) { (i32) (current - resolver->scopes.blocks), slot };
+        }
+        current = current->parent == -1 ? NULL : resolver->scopes.blocks + current->parent;
+    }
+    return UNRESOLVED;
+}
+
+static void declare(Resolver* resolver, Node* decl) {
+    int added = block_add_local(resolver->current, (Local) { 0, decl });
+    assert(added && "The parser counted fewer declarations in the block");
+    (void) added;
+}
+
+static Block* enter_block(Resolver* resolver, i32 id) {
+    Block* current = resolver->current;
+    resolver->current = resolver->scopes.blocks + id;
+    return current;
+}
+
+// Nothing looks names up in a block once it's left, as only the table is used
+// to find them. So its count goes back to 0, for the checker to count again.
+static void leave_block(Resolver* resolver, Block* parent) {
+    resolver->current->count = 0;
+    resolver->current = parent;
+}
+
+
+/* ---------------------------- RESOLVER VISITOR -------------------------------- */
+// Goes through the tree in the same order as the checker, so each name sees
+// exactly the declarations the checker has seen when it gets there.
+#define STATIC_VISITOR_CONTEXT Resolver
+#define STATIC_VISITOR_PREFIX  resolve
+DECLARE_STATIC_VISITOR()
+
+static void* resolve_literal(Resolver* resolver, NodeLiteral* node) {
+    (void) resolver;
+    (void) node;
+    return NULL;
+}
+
+static void* resolve_identifier(Resolver* resolver, NodeIdentifier* node) {
+    node->resolved = lookup(resolver, node->name);
+    return NULL;
+}
+
+static void* resolve_unary(Resolver* resolver, NodeUnary* node) {
+    return resolve_walk(resolver, NodeKind_Unary, (Node*) node);
+}
+
+static void* resolve_binary(Resolver* resolver, NodeBinary* node) {
+    return resolve_walk(resolver, NodeKind_Binary, (Node*) node);
+}
+
+static void* resolve_call(Resolver* resolver, NodeCall* node) {
+    node->resolved = lookup(resolver, node->name);
+    return resolve_walk(resolver, NodeKind_Call, (Node*) node);
+}
+
+static void* resolve_access(Resolver* resolver, NodeAccess* node) {
+    return resolve_walk(resolver, NodeKind_Access, (Node*) node);
+}
+
+static void* resolve_type(Resolver* resolver, NodeType* node) {
+    (void) resolver;
+    (void) node;
+    return NULL;
+}
+
+static void* resolve_assign(Resolver* resolver, NodeAssign* node) {
+    node->resolved = lookup(resolver, node->name);
+    return resolve_walk(resolver, NodeKind_Assign, (Node*) node);
+}
+
+// The variable isn't in scope in its own initializer.
+static void* resolve_var_decl(Resolver* resolver, NodeVarDecl* node) {
+    int redeclared = lookup(resolver, node->name).block != -1;
+    resolve_visit(resolver, node->expression);
+    if (!redeclared)
+        declare(resolver, (Node*) node);
+    return NULL;
+}
+
+static void* resolve_block(Resolver* resolver, NodeBlock* node) {
+    Block* parent = enter_block(resolver, node->id);
+    resolve_walk(resolver, NodeKind_Block, (Node*) node);
+    leave_block(resolver, parent);
+    return NULL;
+}
+
+static void* resolve_fun_body(Resolver* resolver, NodeFunBody* node) {
+    Block* parent = enter_block(resolver, node->id);
+    resolve_walk(resolver, NodeKind_FunBody, (Node*) node);
+    leave_block(resolver, parent);
+    return NULL;
+}
+
+// Visited from its function, with the body as the current block.
+static void* resolve_fun_param(Resolver* resolver, NodeFunParam* node) {
+    declare(resolver, (Node*) node);
+    return NULL;
+}
+
+// The parameters go first in the body's block.
+static void resolve_params_and_body(Resolver* resolver, const NodeFunDecl* node) {
+    NodeFunBody* body = node_fun_body_at(resolver->arena, node->body);
+    Block* parent = enter_block(resolver, body->id);
+    for (u32 i = 0; i < node->params.count; ++i)
+        resolve_visit(resolver, node_view_at(resolver->arena, node->params, i));
+    resolver->current = parent;
+
+    resolve_visit(resolver, node->body);
+}
+
+// The function itself is only in scope after its body, so it can't call itself.
+static void* resolve_fun_decl(Resolver* resolver, NodeFunDecl* node) {
+    int redeclared = lookup(resolver, node->name).block != -1;
+    resolve_params_and_body(resolver, node);
+    if (!redeclared)
+        declare(resolver, (Node*) node);
+    return NULL;
+}
+
+static void* resolve_return_stmt(Resolver* resolver, NodeReturn* node) {
+    return resolve_walk(resolver, NodeKind_Return, (Node*) node);
+}
+
+static void* resolve_if_stmt(Resolver* resolver, NodeIf* node) {
+    return resolve_walk(resolver, NodeKind_If, (Node*) node);
+}
+
+static void* resolve_while_stmt(Resolver* resolver, NodeWhile* node) {
+    return resolve_walk(resolver, NodeKind_While, (Node*) node);
+}
+
+static void* resolve_init_arg(Resolver* resolver, NodeInitArg* node) {
+    return resolve_walk(resolver, NodeKind_InitArg, (Node*) node);
+}
+
+static void* resolve_init(Resolver* resolver, NodeInit* node) {
+    return resolve_walk(resolver, NodeKind_Init, (Node*) node);
+}
+
+static void* resolve_struct_field(Resolver* resolver, NodeStructField* node) {
+    return resolve_walk(resolver, NodeKind_StructField, (Node*) node);
+}
+
+static void* resolve_struct_decl(Resolver* resolver, NodeStruct* node) {
+    return resolve_walk(resolver, NodeKind_Struct, (Node*) node);
+}
+
+// Only declares the top-level functions, which resolve_fun goes into, as they
+// don't depend on each other.
+static void* resolve_module(Resolver* resolver, NodeModule* node) {
+    Block* parent = enter_block(resolver, 0);
+    for (u32 i = 0; i < node->decls.count; ++i) {
+        NodeFunDecl* fun = node_fun_decl_at(resolver->arena, node_view_at(resolver->arena, node->decls, i));
+        if (lookup(resolver, fun->name).block == -1)
+            declare(resolver, (Node*) fun);
+    }
+    for (u32 i = 0; i < node->stmts.count; ++i)
+        resolve_visit(resolver, node_view_at(resolver->arena, node->stmts, i));
+    leave_block(resolver, parent);
+    return NULL;
+}
+
+DEFINE_STATIC_VISITOR()
+#undef STATIC_VISITOR_PREFIX
+#undef STATIC_VISITOR_CONTEXT
+
+
+Scopes resolve_globals(GrammarTree* ast) {
+    Resolver resolver = {
+        .arena = &ast->arena,
+        .scopes = { NULL, ast->block_count + 1, NULL, NULL },
+        .current = NULL,
+        .visible = UINT32_MAX,
+    };
+    if (!carve_blocks(&resolver.scopes, ast)) {
+        scopes_free(resolver.scopes);
+        return (Scopes) { NULL, 0, NULL, NULL };
+    }
+
+    resolve_visit(&resolver, ast->start);
+    return resolver.scopes;
+}
+
+i64 resolve_fun(const Scopes* scopes, const NodeArena* arena, NodeId fun) {
+    const NodeFunDecl* node = node_fun_decl_at(arena, fun);
+    const Local* local = block_find_local(scopes->blocks, node->name);
+    if (local == NULL || local->decl != (const Node*) node)
+        return -1;
+
+    u32 slot = (u32) (local - scopes->blocks->locals);
+    Resolver resolver = {
+        .arena = arena,
+        .scopes = *scopes,
+        .current = scopes->blocks,
+        .visible = slot,
+    };
+    resolve_params_and_body(&resolver, node);
+    return slot;
+}
+
+Scopes resolve(GrammarTree* ast) {
+    Scopes scopes = resolve_globals(ast);
+    if (scopes.blocks == NULL)
+        return scopes;
+
+    const NodeModule* module = node_module_at(&ast->arena, ast->start);
+    for (u32 i = 0; i < module->decls.count; ++i)
+        resolve_fun(&scopes, &ast->arena, node_view_at(&ast->arena, module->decls, i));
+    return scopes;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "preamble.h"
+#include "checker.h"
+
+
+/// The blocks of a tree, with room for exactly the locals declared in each.
+typedef struct {
+    Block*  blocks;
+    size_t  block_count;
+
+    // What the locals and the tables of all the blocks are carved out of.
+    Local*  locals;
+    u32*    tables;
+} Scopes;
+
+/// Declares the locals of every block in the order the checker goes through
+/// them, and points each identifier, assignment and call at the local it names,
+/// so no later pass has to look a name up. A declaration of a name that is
+/// already in scope is left out, which is how the checker tells it apart.
+///
+/// The counts of the blocks are left at 0, for the checker to count the locals
+/// again as it gets to them. Returns scopes without blocks if out of memory.
+Scopes resolve(GrammarTree* ast);
+
+/// Same as `resolve`, but leaves out the parameters and the bodies of the
+/// top-level functions, for `resolve_fun` to go into.
+Scopes resolve_globals(GrammarTree* ast);
+
+/// Resolves the parameters and the body of a top-level function, which sees
+/// only the functions declared before it in the module. The functions only
+/// read the module's block and write to none of the same ones, so they can be
+/// resolved on different threads.
+/// Returns the slot of the function in the module's block, or -1 if it's
+/// already declared, which leaves it unresolved.
+i64 resolve_fun(const Scopes* scopes, const NodeArena* arena, NodeId fun);
+
+void scopes_free(Scopes scopes);
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "type_table.h"
+
+
+#define TYPE_TABLE_INITIAL_CAPACITY 64
+
+// The members of a type that isn't in the table yet. A function's result comes
+// before its parameters, which are passed on their own.
+typedef struct {
+    TypeKind      kind;
+    const char*   name;
+    TypeId        result;
+    const TypeId* members;
+    u32           count;
+} TypeKey;
+
+static inline u32 key_member_count(const TypeKey* key) {
+    return key->count + (key->kind == TypeKind_Fun);
+}
+
+static inline u64 mix(u64 hash, u64 value) {
+    return (hash ^ value) * 0x9E3779B97F4A7C15ull;
+}
+
+// Where the name is in the data pool rather than where the pool is, so the
+// table stays valid when a cached tree is loaded somewhere else. 0 without one.
+static inline u64 name_offset(const TypeTable* types, const char* name) {
+    return name == NULL ? 0 : (u64) ((uintptr_t) name - (uintptr_t) types->data_pool) + 1;
+}
+
+// The high bits of the products depend on everything that was mixed in.
+static u32 key_hash(const TypeTable* types, const TypeKey* key) {
+    u64 hash = mix((u64) key->kind, name_offset(types, key->name));
+    if (key->kind == TypeKind_Fun)
+        hash = mix(hash, key->result);
+    for (u32 i = 0; i < key->count; ++i)
+        hash = mix(hash, key->members[i]);
+    return (u32) (hash >> 32);
+}
+
+static int key_equals(const TypeTable* types, TypeId type, const TypeKey* key) {
+    if (types->kinds[type] != key->kind || types->names[type] != key->name || types->member_counts[type] != key_member_count(key))
+        return 0;
+
+    const TypeId* members = types->members + types->firsts[type];
+    if (key->kind == TypeKind_Fun && *members++ != key->result)
+        return 0;
+    return key->count == 0 || memcmp(members, key->members, key->count * sizeof(TypeId)) == 0;
+}
+
+static TypeKey key_of(const TypeTable* types, TypeId type) {
+    TypeKey key = { (TypeKind) types->kinds[type], types->names[type], 0, types->members + types->firsts[type], types->member_counts[type] };
+    if (key.kind == TypeKind_Fun) {
+        key.result   = *key.members++;
+        key.count   -= 1;
+    }
+    return key;
+}
+
+// The first of `table` that either holds the type, or is empty.
+static u32 type_probe(const TypeTable* types, const u32* table, u32 capacity, const TypeKey* key) {
+    u32 mask = capacity - 1;
+    u32 i = key_hash(types, key) & mask;
+    while (table[i] != 0 && !key_equals(types, table[i], key))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int grow_table(TypeTable* types, u32 capacity) {
+    u32* table = (u32*) alloc(0, capacity * sizeof(u32));
+    if (table == NULL)
+        return 0;
+    memset(table, 0, capacity * sizeof(u32));
+
+    for (TypeId type = TYPE_ID_BUILTIN_COUNT; type < types->count; ++type) {
+        TypeKey key = key_of(types, type);
+        table[type_probe(types, table, capacity, &key)] = type;
+    }
+    free(types->table);
+    types->table = table;
+    types->table_capacity = capacity;
+    return 1;
+}
+
+static int grow_types(TypeTable* types, u32 capacity) {
+    u8*          kinds         = (u8*)          alloc(0, capacity * sizeof(u8));
+    const char** names         = (const char**) alloc(0, capacity * sizeof(const char*));
+    u32*         firsts        = (u32*)         alloc(0, capacity * sizeof(u32));
+    u32*         member_counts = (u32*)         alloc(0, capacity * sizeof(u32));
+    if (kinds == NULL || names == NULL || firsts == NULL || member_counts == NULL) {
+        free(kinds);
+        free((void*) names);
+        free(firsts);
+        free(member_counts);
+        return 0;
+    }
+
+    if (types->count != 0) {
+        memcpy(kinds,         types->kinds,         types->count * sizeof(u8));
+        memcpy(names,         types->names,         types->count * sizeof(const char*));
+        memcpy(firsts,        types->firsts,        types->count * sizeof(u32));
+        memcpy(member_counts, types->member_counts, types->count * sizeof(u32));
+    }
+    free(types->kinds);
+    free((void*) types->names);
+    free(types->firsts);
+    free(types->member_counts);
+    types->kinds         = kinds;
+    types->names         = names;
+    types->firsts        = firsts;
+    types->member_counts = member_counts;
+    types->capacity      = capacity;
+    return 1;
+}
+
+static int grow_members(TypeTable* types, u32 capacity) {
+    TypeId* members = (TypeId*) alloc(0, capacity * sizeof(TypeId));
+    if (members == NULL)
+        return 0;
+    if (types->member_count != 0)
+        memcpy(members, types->members, types->member_count * sizeof(TypeId));
+    free(types->members);
+    types->members = members;
+    types->member_capacity = capacity;
+    return 1;
+}
+
+// Appends the type without looking for it. Returns TypeId_Invalid if out of memory.
+static TypeId push_type(TypeTable* types, const TypeKey* key) {
+    u32 member_count = key_member_count(key);
+    if (types->count == types->capacity && !grow_types(types, 2 * types->capacity))
+        return TypeId_Invalid;
+    if (types->member_count + member_count > types->member_capacity) {
+        u32 capacity = 2 * types->member_capacity;
+        while (types->member_count + member_count > capacity)
+            capacity *= 2;
+        if (!grow_members(types, capacity))
+            return TypeId_Invalid;
+    }
+
+    TypeId type = types->count++;
+    types->kinds[type]         = (u8) key->kind;
+    types->names[type]         = key->name;
+    types->firsts[type]        = types->member_count;
+    types->member_counts[type] = member_count;
+    if (key->kind == TypeKind_Fun)
+        types->members[types->member_count++] = key->result;
+    if (key->count != 0)
+        memcpy(types->members + types->member_count, key->members, key->count * sizeof(TypeId));
+    types->member_count += key->count;
+    return type;
+}
+
+static TypeId intern(TypeTable* types, const TypeKey* key) {
+    // At most three quarters full, so that probes stay short.
+    if (4 * (u64) (types->count + 1) > 3 * (u64) types->table_capacity && !grow_table(types, 2 * types->table_capacity))
+        return TypeId_Invalid;
+
+    u32 i = type_probe(types, types->table, types->table_capacity, key);
+    if (types->table[i] != 0)
+        return types->table[i];
+
+    TypeId type = push_type(types, key);
+    if (type != TypeId_Invalid)
+        types->table[i] = type;
+    return type;
+}
+
+
+/* ---------------------------- TYPE TABLE -------------------------------- */
+TypeTable type_table_make(const char* data_pool) {
+    TypeTable types = { 0 };
+    types.data_pool = data_pool;
+    if (!grow_types(&types, TYPE_TABLE_INITIAL_CAPACITY) || !grow_members(&types, TYPE_TABLE_INITIAL_CAPACITY) || !grow_table(&types, 2 * TYPE_TABLE_INITIAL_CAPACITY)) {
+        type_table_free(&types);
+        return (TypeTable) { 0 };
+    }
+
+    push_type(&types, &(TypeKey) { TypeKind_Invalid, NULL, 0, NULL, 0 });
+#define X(upper, lower, repr, size) push_type(&types, &(TypeKey) { TypeKind_Literal, NULL, 0, NULL, 0 });
+    ALL_LITERAL_TYPES(X)
+#undef X
+    return types;
+}
+
+void type_table_free(TypeTable* types) {
+    free(types->kinds);
+    free((void*) types->names);
+    free(types->firsts);
+    free(types->member_counts);
+    free(types->members);
+    free(types->table);
+}
+
+TypeId type_table_fun(TypeTable* types, TypeId result, const TypeId* params, u32 param_count) {
+    TypeKey key = { TypeKind_Fun, NULL, result, params, param_count };
+    return intern(types, &key);
+}
+
+TypeId type_table_struct(TypeTable* types, const char* name, const TypeId* fields, u32 field_count) {
+    TypeKey key = { TypeKind_Struct, name, 0, fields, field_count };
+    return intern(types, &key);
+}
+
+const char* type_repr(const TypeTable* types, TypeId type) {
+    if (type >= types->count)
+        return "nothing";
+
+    switch (type_kind(types, type)) {
+        case TypeKind_Invalid: return "invalid";
+        case TypeKind_Literal: return literal_type_repr((LiteralType) (type - 1));
+        case TypeKind_Struct:  return types->names[type];
+        case TypeKind_Fun:     return "fun";
+    }
+    return "invalid";
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <assert.h>
+
+#include "preamble.h"
+#include "parser/node.h"
+
+
+#define ALL_TYPE_KINDS(X) \
+    X(Invalid)  \
+    X(Literal)  \
+    X(Struct)   \
+    X(Fun)      \
+
+#define X(upper) TypeKind_##upper,
+typedef enum {
+    ALL_TYPE_KINDS(X)
+} TypeKind;
+#undef X
+
+/// The types every table starts with: no type at 0, then the literal types in
+/// the order they're declared in.
+#define X(upper, lower, repr, size) TypeId_##upper,
+enum {
+    TypeId_Invalid,
+    ALL_LITERAL_TYPES(X)
+    TYPE_ID_BUILTIN_COUNT,
+};
+#undef X
+
+static inline TypeId type_of_literal(LiteralType type) {
+    return (TypeId) type + 1;
+}
+
+/// Every type of a program, by id. A type is only added once, so two types
+/// are the same exactly when their ids are, and comparing them never looks
+/// into the table.
+typedef struct {
+    // One of each per type.
+    u8*          kinds;
+    const char** names;         // Of a struct, NULL for the others.
+    u32*         firsts;        // Where its members start in `members`.
+    u32*         member_counts;
+    u32          count;
+    u32          capacity;
+
+    /// The fields of a struct, and the result and then the parameters of a function.
+    TypeId*      members;
+    u32          member_count;
+    u32          member_capacity;
+
+    /// Open addressing table from the kind, name and members of every type
+    /// past the builtin ones to its id, or 0 for an empty slot. Names are
+    /// interned, so they're compared by pointer, and hashed by their offset
+    /// into `data_pool`, which keeps the table valid when the names and the
+    /// pool move together. The capacity is a power of two.
+    u32*         table;
+    u32          table_capacity;
+    const char*  data_pool;     /// What the names of structs are interned in.
+} TypeTable;
+
+/// A table of only the builtin types, for the structs named in `data_pool`.
+/// Returns one with kinds == NULL if out of memory.
+TypeTable type_table_make(const char* data_pool);
+void      type_table_free(TypeTable* types);
+
+/// The function type with the result and parameters, added if it's new.
+/// Returns TypeId_Invalid if out of memory.
+TypeId type_table_fun(TypeTable* types, TypeId result, const TypeId* params, u32 param_count);
+
+/// The struct type with the name and field types, added if it's new.
+/// Returns TypeId_Invalid if out of memory.
+TypeId type_table_struct(TypeTable* types, const char* name, const TypeId* fields, u32 field_count);
+
+/// How the type is written, for errors.
+const char* type_repr(const TypeTable* types, TypeId type);
+
+static inline TypeKind type_kind(const TypeTable* types, TypeId type) {
+    return (TypeKind) types->kinds[type];
+}
+
+static inline TypeId type_fun_result(const TypeTable* types, TypeId fun) {
+    assert(type_kind(types, fun) == TypeKind_Fun && "Not a function type");
+    return types->members[types->firsts[fun]];
+}
+
+static inline u32 type_fun_param_count(const TypeTable* types, TypeId fun) {
+    assert(type_kind(types, fun) == TypeKind_Fun && "Not a function type");
+    return types->member_counts[fun] - 1;
+}
+
+static inline TypeId type_fun_param(const TypeTable* types, TypeId fun, u32 index) {
+    assert(index < type_fun_param_count(types, fun) && "Parameter out of range");
+    return types->members[types->firsts[fun] + 1 + index];
+}
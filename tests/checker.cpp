@@ -4,205 +4,472 @@
 
 extern "C" {
 #include "type_checker/checker.h"
+#include "cache.h"
 }
 
-TEST(ParserTest, Simple) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main() {}");
+#include "logger.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+// A type checked program, with the tokens it was checked from, which the
+// tree doesn't own once it's checked.
+struct Checked {
+    TokenArray tokens;
+    TypedAst   ast;
+};
+
+static Checked check_source(const char* source) {
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray tokens = lexer_lex(STR("test"), str_from_c_str(source), &logger);
+    GrammarTree tree = parse(tokens);
+    EXPECT_NE(tree.arena.kinds, nullptr);
+    EXPECT_EQ(tree.error_count, 0u);
+    return { tokens, type_check(tree) };
+}
+
+static void checked_free(Checked checked) {
+    typed_ast_free(checked.ast);
+    token_array_free(checked.tokens);
+}
+
+
+TEST(CacheTest, RoundTrip) {
+    const char* source =
+        "fun add(a: int, b: int) int { return a + b }\n"
+        "fun main() int {\n"
+        "    x := add(1, 2)\n"
+        "    if x < 10 { y := \"small\" }\n"
+        "    return x\n"
+        "}\n";
+    std::string path = ::testing::TempDir() + "nox_cache_round_trip.nox";
+    Str contents = str_from_c_str(source);
+
+    Checked checked = check_source(source);
+    ASSERT_NE(checked.ast.arena.kinds, nullptr);
+    ASSERT_TRUE(cache_write(path.c_str(), contents, checked.tokens, checked.ast));
+
+    CachedAst cached = cache_read(path.c_str(), contents);
+    ASSERT_NE(cached.mapping, nullptr);
+
+    ASSERT_EQ(cached.tokens.size, checked.tokens.size);
+    ASSERT_EQ(memcmp(cached.tokens.tokens, checked.tokens.tokens, checked.tokens.size), 0);
+    ASSERT_EQ(memcmp(cached.tokens.source_offsets, checked.tokens.source_offsets, checked.tokens.size * sizeof(SourceIndex)), 0);
+    ASSERT_EQ(cached.tokens.constant_count, checked.tokens.constant_count);
+
+    const TypedAst& ast = cached.ast;
+    ASSERT_EQ(ast.arena.count, checked.ast.arena.count);
+    ASSERT_EQ(ast.start, checked.ast.start);
+    ASSERT_EQ(ast.block_count, checked.ast.block_count);
+    ASSERT_EQ(ast.types.count, checked.ast.types.count);
+    for (NodeId id = 0; id < ast.arena.count; ++id) {
+        ASSERT_EQ(node_kind_at(&ast.arena, id), node_kind_at(&checked.ast.arena, id));
+        ASSERT_EQ(node_at(&ast.arena, id)->base.start, node_at(&checked.ast.arena, id)->base.start);
+    }
+
+    // The names are interned in the cache's own copy of the data pool.
+    NodeModule* module = node_module_at(&ast.arena, ast.start);
+    NodeFunDecl* fun = node_fun_decl_at(&ast.arena, node_view_at(&ast.arena, module->decls, 1));
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->type_id, node_fun_decl_at(&checked.ast.arena, node_view_at(&checked.ast.arena, module->decls, 1))->type_id);
+    for (size_t i = 0; i < ast.block_count; ++i)
+        ASSERT_EQ(ast.block[i].count, checked.ast.block[i].count);
+    ASSERT_NE(block_find_local(&ast.block[0], fun->name), nullptr);
+
+    cache_close(cached);
+    checked_free(checked);
+    std::remove((path + CACHE_EXTENSION).c_str());
+}
+
+TEST(CacheTest, RejectsAnotherSource) {
+    const char* source  = "fun main() int { return 1 }\n";
+    const char* changed = "fun main() int { return 2 }\n";
+    std::string path = ::testing::TempDir() + "nox_cache_stale.nox";
 
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+    Checked checked = check_source(source);
+    ASSERT_NE(checked.ast.arena.kinds, nullptr);
+    ASSERT_TRUE(cache_write(path.c_str(), str_from_c_str(source), checked.tokens, checked.ast));
+    ASSERT_NE(cache_hash(str_from_c_str(source)), cache_hash(str_from_c_str(changed)));
 
-    Node_Module module = *(Node_Module*) ast.nodes;
+    CachedAst cached = cache_read(path.c_str(), str_from_c_str(changed));
+    ASSERT_EQ(cached.mapping, nullptr);
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmt_count, 1);
+    cached = cache_read((path + ".missing").c_str(), str_from_c_str(source));
+    ASSERT_EQ(cached.mapping, nullptr);
 
-    Node_Stmt* stmt = module.stmts[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
+    checked_free(checked);
+    std::remove((path + CACHE_EXTENSION).c_str());
 }
 
-TEST(ParserTest, SimpleWithArgs) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main(arg1: int, arg2: int) {}");
 
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+// Declarations of locals named `names`, for a block made by hand.
+// The names one after the other, as the lexer interns them into the data pool.
+static std::string data_pool_of(const std::vector<std::string>& names, std::vector<size_t>& offsets) {
+    std::string pool;
+    for (const std::string& name : names) {
+        offsets.push_back(pool.size());
+        pool.append(name.c_str(), name.size() + 1);
+    }
+    return pool;
+}
+
+static std::vector<Node> var_decls(const char* pool, const std::vector<size_t>& offsets) {
+    std::vector<Node> decls(offsets.size());
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        decls[i].var_decl.base = node_base_var_decl(0, 0);
+        decls[i].var_decl.name = pool + offsets[i];
+    }
+    return decls;
+}
 
-    Node_Module module = *(Node_Module*) ast.nodes;
+TEST(CheckerTest, BlockFindLocal) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 1000; ++i)
+        names.push_back("local" + std::to_string(i));
+    names.push_back("unused");
+    std::vector<size_t> offsets;
+    std::string pool = data_pool_of(names, offsets);
+    std::vector<Node> decls = var_decls(pool.c_str(), offsets);
+
+    // The first of the name is the one found, so add "local0" again at the end.
+    std::vector<Local> locals(1001);
+    std::vector<u32>   table(2048, 0);
+    Block block = {};
+    block.locals = locals.data();
+    block.capacity = (i64) locals.size();
+    block.table = table.data();
+    block.table_capacity = (u32) table.size();
+    block.names = pool.c_str();
+    ASSERT_EQ(block_find_local(&block, pool.c_str() + offsets[0]), nullptr);
+
+    for (int i = 0; i < 1000; ++i)
+        ASSERT_TRUE(block_add_local(&block, { (TypeId) i, &decls[i] }));
+    ASSERT_TRUE(block_add_local(&block, { TypeId_String, &decls[0] }));
+    ASSERT_FALSE(block_add_local(&block, { TypeId_String, &decls[1] }));
+
+    for (int i = 0; i < 1000; ++i) {
+        Local* local = block_find_local(&block, pool.c_str() + offsets[i]);
+        ASSERT_NE(local, nullptr);
+        ASSERT_EQ(local, &locals[i]);
+        ASSERT_EQ(local->type, (TypeId) i);
+    }
+    ASSERT_EQ(block_find_local(&block, pool.c_str() + offsets[1000]), nullptr);
+
+    // Moved along with the data pool, as when the block is loaded from the
+    // cache, the table still finds every local.
+    std::string moved = pool;
+    std::vector<Node> moved_decls = var_decls(moved.c_str(), offsets);
+    for (i64 i = 0; i < block.count; ++i)
+        locals[i].decl = &moved_decls[locals[i].decl - decls.data()];
+    block.names = moved.c_str();
+    ASSERT_EQ(block_find_local(&block, moved.c_str() + offsets[500]), &locals[500]);
+    ASSERT_EQ(block_find_local(&block, moved.c_str() + offsets[0]), &locals[0]);
+    ASSERT_EQ(block_find_local(&block, moved.c_str() + offsets[1000]), nullptr);
+
+    // Blocks without locals have no table.
+    Block empty = {};
+    ASSERT_EQ(block_find_local(&empty, pool.c_str() + offsets[0]), nullptr);
+}
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmt_count, 1);
+// The checker frees the tokens if it fails.
+static bool checks(const char* source) {
+    Checked checked = check_source(source);
+    if (checked.ast.arena.kinds == NULL)
+        return false;
+    checked_free(checked);
+    return true;
+}
 
-    Node_Stmt* stmt = module.stmts[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 2);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "arg1") == 0);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[1].name, "arg2") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type, (const char*) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[1].type, (const char*) (size_t) (LiteralType_Integer));
-}
-
-
-
-TEST(ParserTest, SimpleWithArgsAndReturnAndBody) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main(arg1: int, arg2: int) int { return arg1 + arg2 }");
-
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+TEST(CheckerTest, LocalsGoOutOfScopeWithTheirBlock) {
+    ASSERT_TRUE(checks(
+        "fun main(a: int) int {\n"
+        "    b := a\n"
+        "    if a < 1 { c := b > 0 d := not c }\n"
+        "    while b > 1 { c := b - 1 b = c }\n"
+        "    return a + b\n"
+        "}\n"));
+
+    ASSERT_FALSE(checks(
+        "fun main() int {\n"
+        "    if true { c := 1 }\n"
+        "    return c\n"
+        "}\n"));
+}
 
-    Node_Module module = *(Node_Module*) ast.nodes;
+static NodeFunDecl* checked_fun_at(const TypedAst& ast, u32 index) {
+    NodeModule* module = node_module_at(&ast.arena, ast.start);
+    return node_fun_decl_at(&ast.arena, node_view_at(&ast.arena, module->decls, index));
+}
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmt_count, 1);
+TEST(CheckerTest, BlocksHaveRoomForExactlyTheirLocals) {
+    Checked checked = check_source(
+        "fun f(a: int, b: int) int {\n"
+        "    c := a + b\n"
+        "    if c > 0 { d := c e := d } else { g := 1 }\n"
+        "    while c > 0 { c = c - 1 }\n"
+        "    return c\n"
+        "}\n"
+        "x := f(1, 2)\n");
+    const TypedAst& ast = checked.ast;
+    ASSERT_NE(ast.arena.kinds, nullptr);
+
+    NodeFunDecl* fun = checked_fun_at(ast, 0);
+    NodeFunBody* body = node_fun_body_at(&ast.arena, fun->body);
+    NodeIf* if_stmt = node_if_stmt_at(&ast.arena, node_view_at(&ast.arena, body->nodes, 1));
+    NodeWhile* while_stmt = node_while_stmt_at(&ast.arena, node_view_at(&ast.arena, body->nodes, 2));
+
+    // The module has f and x, and the body the parameters and c.
+    ASSERT_EQ(ast.block_count, 5u);
+    ASSERT_EQ(ast.block[0].capacity, 2);
+    ASSERT_EQ(ast.block[body->id].capacity, 3);
+    ASSERT_EQ(ast.block[node_block_at(&ast.arena, if_stmt->then_block)->id].capacity, 2);
+    ASSERT_EQ(ast.block[node_block_at(&ast.arena, if_stmt->else_block)->id].capacity, 1);
+    ASSERT_EQ(ast.block[node_block_at(&ast.arena, while_stmt->then_block)->id].capacity, 0);
+
+    // Carved one after the other out of the same array, and all filled.
+    Local* next = ast.locals;
+    for (size_t i = 0; i < ast.block_count; ++i) {
+        const Block& block = ast.block[i];
+        ASSERT_EQ(block.locals, next);
+        ASSERT_EQ(block.count, block.capacity);
+        next += block.capacity;
+
+        // A power of two at most three quarters full, or none for no locals.
+        if (block.capacity == 0) {
+            ASSERT_EQ(block.table_capacity, 0u);
+        } else {
+            ASSERT_EQ(block.table_capacity & (block.table_capacity - 1), 0u);
+            ASSERT_LE(4 * block.capacity, 3 * (i64) block.table_capacity);
+        }
+    }
+    checked_free(checked);
+}
 
-    Node_Stmt* stmt = module.stmts[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 2);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "arg1") == 0);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[1].name, "arg2") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type, (const char*) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[1].type, (const char*) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.return_type, (const char*) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.body.count, 1);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.return_stmt.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.return_stmt.expr->as.binary.op, BinaryOp_Add);
+TEST(CheckerTest, ManyBlocks) {
+    std::string source = "fun main() int {\n    a := 0\n";
+    for (int i = 0; i < 5000; ++i)
+        source += "    if a < " + std::to_string(i) + " { b := a c := b a = c + 1 }\n";
+    Checked checked = check_source((source + "    return a\n}\n").c_str());
+    const TypedAst& ast = checked.ast;
+    ASSERT_NE(ast.arena.kinds, nullptr);
+
+    // The module, the body and the blocks of the ifs.
+    ASSERT_EQ(ast.block_count, 5002u);
+    i64 total = 0;
+    for (size_t i = 0; i < ast.block_count; ++i)
+        total += ast.block[i].capacity;
+    ASSERT_EQ(total, 1 + 1 + 5000 * 2);
+    checked_free(checked);
 }
 
-TEST(ParserTest, SimpleWithArgsAndReturnAndBodyAndVarDecl) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main(arg1: int, arg2: int) int { a := arg1 + arg2 return a }");
-
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+TEST(CheckerTest, ResolvesNamesToBlockAndSlot) {
+    Checked checked = check_source(
+        "fun f(a: int, b: int) int {\n"
+        "    c := a + b\n"
+        "    if c > 0 { d := c c = d }\n"
+        "    return c\n"
+        "}\n"
+        "fun g() int { return f(1, 2) }\n");
+    const TypedAst& ast = checked.ast;
+    ASSERT_NE(ast.arena.kinds, nullptr);
+
+    NodeFunDecl* f = checked_fun_at(ast, 0);
+    NodeFunBody* body = node_fun_body_at(&ast.arena, f->body);
+    i32 then_id = node_block_at(&ast.arena, node_if_stmt_at(&ast.arena, node_view_at(&ast.arena, body->nodes, 1))->then_block)->id;
+
+    // a and b are the body's first slots, before c.
+    NodeBinary* sum = node_binary_at(&ast.arena, node_var_decl_at(&ast.arena, node_view_at(&ast.arena, body->nodes, 0))->expression);
+    NodeSlot a = node_identifier_at(&ast.arena, sum->left)->resolved;
+    NodeSlot b = node_identifier_at(&ast.arena, sum->right)->resolved;
+    ASSERT_EQ(a.block, body->id);
+    ASSERT_EQ(a.slot, 0u);
+    ASSERT_EQ(b.block, body->id);
+    ASSERT_EQ(b.slot, 1u);
+
+    // Inside the if, d is its own, and c the body's.
+    NodeBlock* then_block = node_block_at(&ast.arena, node_if_stmt_at(&ast.arena, node_view_at(&ast.arena, body->nodes, 1))->then_block);
+    NodeVarDecl* d = node_var_decl_at(&ast.arena, node_view_at(&ast.arena, then_block->nodes, 0));
+    NodeSlot c = node_identifier_at(&ast.arena, d->expression)->resolved;
+    ASSERT_EQ(c.block, body->id);
+    ASSERT_EQ(c.slot, 2u);
+    NodeAssign* assign = node_assign_at(&ast.arena, node_view_at(&ast.arena, then_block->nodes, 1));
+    ASSERT_EQ(assign->resolved.block, body->id);
+    ASSERT_EQ(assign->resolved.slot, 2u);
+    NodeSlot d_slot = node_identifier_at(&ast.arena, assign->expression)->resolved;
+    ASSERT_EQ(d_slot.block, then_id);
+    ASSERT_EQ(d_slot.slot, 0u);
+
+    // f is the module's first local.
+    NodeFunDecl* g = checked_fun_at(ast, 1);
+    NodeFunBody* g_body = node_fun_body_at(&ast.arena, g->body);
+    NodeCall* call = node_call_at(&ast.arena, node_return_stmt_at(&ast.arena, node_view_at(&ast.arena, g_body->nodes, 0))->expression);
+    ASSERT_EQ(call->resolved.block, 0);
+    ASSERT_EQ(call->resolved.slot, 0u);
+    checked_free(checked);
+}
 
-    Node_Module module = *(Node_Module *) ast.nodes;
-
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmt_count, 1);
-
-    Node_Stmt* stmt = module.stmts[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 2);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "arg1") == 0);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[1].name, "arg2") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type, (const char *) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[1].type, (const char *) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.return_type, (const char *) (size_t) (LiteralType_Integer));
-    ASSERT_EQ(stmt->as.fun_decl.body.count, 2);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->kind, NodeKind_VarDecl);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.base.kind, NodeKind_VarDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.body.nodes[0]->as.var_decl.name, "a") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.type, (const char*)0);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.expr->as.binary.op, BinaryOp_Add);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[1]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[1]->as.return_stmt.expr->kind, NodeKind_Identifier);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.body.nodes[1]->as.return_stmt.expr->as.identifier.name, "a") == 0);
+TEST(CheckerTest, RejectsRedeclarations) {
+    ASSERT_FALSE(checks("fun main() { a := 1 a := 2 }\n"));
+    ASSERT_FALSE(checks("fun main(a: int) { a := 2 }\n"));
+    ASSERT_FALSE(checks("fun main() { a := 1 if true { a := 2 } }\n"));
+    ASSERT_FALSE(checks("fun f() {}\nfun f() {}\n"));
+    ASSERT_FALSE(checks("a := 1\na := 2\n"));
+
+    // A name isn't in scope in its own initializer, nor a function in its
+    // body, nor before it's declared.
+    ASSERT_FALSE(checks("fun main() { a := a }\n"));
+    ASSERT_FALSE(checks("fun f() int { return f() }\n"));
+    ASSERT_FALSE(checks("fun f() int { return g() }\nfun g() int { return 1 }\n"));
+    ASSERT_TRUE(checks("fun g() int { return 1 }\nfun f() int { return g() }\n"));
 }
 
-
-TEST(ParserTest, MultipleFunctionDeclarations) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main() int { return 1 * 2 + 3 } fun test(t: int) int { a := 1 + 2 * 3 return a / t }");
-
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
-
-    Node_Module module = *(Node_Module *) ast.nodes;
-
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmt_count, 2);
-
-    Node_Stmt* stmt = module.stmts[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 0);
-    ASSERT_EQ(stmt->as.fun_decl.return_type, (const char*)LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.body.count, 1);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.return_stmt.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.return_stmt.expr->as.binary.op, BinaryOp_Add);
-
-    stmt = module.stmts[1];
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "test") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 1);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "t") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type, (const char*)LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.return_type, (const char*)LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.body.count, 2);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->kind, NodeKind_VarDecl);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.base.kind, NodeKind_VarDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.body.nodes[0]->as.var_decl.name, "a") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.type, (const char*)0);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[0]->as.var_decl.expr->as.binary.op, BinaryOp_Add);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[1]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[1]->as.return_stmt.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body.nodes[1]->as.return_stmt.expr->as.binary.op, BinaryOp_Div);
-}
-
-
-TEST(ParserTest, IfStmt) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main() int { if 1 == 2 { return 1 } else { return 2 } }");
-
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
-
-    Node_Module module = *(Node_Module *) ast.nodes;
-
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmt_count, 1);
-
-    Node_Stmt* stmt = module.stmts[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-
-    Node_FunDecl fun_decl = stmt->as.fun_decl;
-    ASSERT_EQ(fun_decl.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(fun_decl.name, "main") == 0);
-    ASSERT_EQ(fun_decl.params.count, 0);
-    ASSERT_EQ(fun_decl.return_type, (const char*)LiteralType_Integer);
-
-    ASSERT_EQ(fun_decl.body.count, 1);
-    ASSERT_EQ(fun_decl.body.nodes[0]->kind, NodeKind_If);
-    Node_If if_stmt = fun_decl.body.nodes[0]->as.if_stmt;
-    ASSERT_EQ(if_stmt.condition->kind, NodeKind_Binary);
-    Node_Cond* condition = if_stmt.condition;
-    ASSERT_EQ(condition->as.binary.op, BinaryOp_Eq);
-
-    Node_Stmt* then_stmt = if_stmt.then_stmt;
-    ASSERT_EQ(then_stmt->kind, NodeKind_Block);
-    Node_Block then_block = then_stmt->as.block;
-    ASSERT_EQ(then_block.count, 1);
-    ASSERT_EQ(then_block.nodes[0]->kind, NodeKind_Return);
-    Node_Return return_stmt = then_block.nodes[0]->as.return_stmt;
-    ASSERT_EQ(return_stmt.expr->kind, NodeKind_Literal);
-    ASSERT_EQ(return_stmt.expr->as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(return_stmt.expr->as.literal.value.integer, 1);
-
-    Node_Stmt* else_stmt = if_stmt.else_stmt;
-    ASSERT_EQ(else_stmt->kind, NodeKind_Block);
-    Node_Block else_block = else_stmt->as.block;
-    ASSERT_EQ(else_block.count, 1);
-    ASSERT_EQ(else_block.nodes[0]->kind, NodeKind_Return);
-    return_stmt = else_block.nodes[0]->as.return_stmt;
-    ASSERT_EQ(return_stmt.expr->kind, NodeKind_Literal);
-    ASSERT_EQ(return_stmt.expr->as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(return_stmt.expr->as.literal.value.integer, 2);
+// Enough nodes that type_check_parallel checks them on several threads.
+static std::string many_functions(int count, int broken) {
+    std::string source;
+    for (int i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        std::string prev = (i == 0) ? "1" : "f" + std::to_string(i - 1) + "(1)";
+        source += "fun f" + n + "(a: int) int {\n"
+                  "    b := a * " + n + " + " + prev + "\n"
+                  "    if b < 10 { c := b > 1 if not c { b = 1 } } else { while b > 0 { b = b - 1 } }\n"
+                  "    return " + (i == broken ? "b > 0" : "b") + "\n"
+                  "}\n";
+    }
+    return source;
 }
 
+static Checked check_with(const std::string& source, int threads, std::string* errors) {
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray tokens = lexer_lex(STR("test"), str_from_c_str(source.c_str()), &logger);
+    GrammarTree tree = parse(tokens);
+    EXPECT_EQ(tree.error_count, 0u);
 
+    ::testing::internal::CaptureStderr();
+    TypedAst ast = threads == 1 ? type_check(tree) : type_check_parallel(tree, threads);
+    *errors = ::testing::internal::GetCapturedStderr();
+    return { tokens, ast };
+}
 
+TEST(CheckerTest, ParallelMatchesSerial) {
+    std::string valid = many_functions(10000, -1);
+    std::string errors;
+    Checked serial_checked = check_with(valid, 1, &errors);
+    const TypedAst& serial = serial_checked.ast;
+    ASSERT_NE(serial.arena.kinds, nullptr);
+    ASSERT_EQ(errors, "");
+
+    for (int threads : { 2, 4, 7 }) {
+        Checked parallel_checked = check_with(valid, threads, &errors);
+        const TypedAst& parallel = parallel_checked.ast;
+        ASSERT_NE(parallel.arena.kinds, nullptr);
+        ASSERT_EQ(errors, "");
+
+        ASSERT_EQ(parallel.block_count, serial.block_count);
+        ASSERT_EQ(parallel.types.count, serial.types.count);
+        for (size_t i = 0; i < serial.block_count; ++i) {
+            const Block& x = serial.block[i];
+            const Block& y = parallel.block[i];
+            ASSERT_EQ(x.count, y.count);
+            for (i64 j = 0; j < x.count; ++j) {
+                ASSERT_EQ(x.locals[j].type, y.locals[j].type);
+                ASSERT_EQ(node_id_of(&serial.arena, x.locals[j].decl), node_id_of(&parallel.arena, y.locals[j].decl));
+            }
+        }
+        checked_free(parallel_checked);
+    }
+    checked_free(serial_checked);
+
+    // An error in a function that another thread checked is reported once, as
+    // the serial checker reports it. The checker frees the tokens when it fails.
+    std::string broken = many_functions(10000, 7777);
+    std::string expected;
+    ASSERT_EQ(check_with(broken, 1, &expected).ast.arena.kinds, nullptr);
+    ASSERT_THAT(expected, ::testing::HasSubstr("Return type mismatch"));
+    for (int threads : { 2, 4, 7 }) {
+        ASSERT_EQ(check_with(broken, threads, &errors).ast.arena.kinds, nullptr);
+        ASSERT_EQ(errors, expected);
+    }
+}
 
+TEST(TypeTableTest, InternsEachTypeOnce) {
+    // Struct names are interned, so only the same pointer is the same name.
+    std::vector<size_t> offsets;
+    std::string pool = data_pool_of({ "Point", "Point" }, offsets);
+    TypeTable types = type_table_make(pool.c_str());
+    ASSERT_NE(types.kinds, nullptr);
+    ASSERT_EQ(types.count, (u32) TYPE_ID_BUILTIN_COUNT);
+    ASSERT_EQ(type_of_literal(LiteralType_Integer), (TypeId) TypeId_Integer);
+    ASSERT_EQ(type_kind(&types, TypeId_Integer), TypeKind_Literal);
+    ASSERT_STREQ(type_repr(&types, TypeId_Integer), "int");
+
+    TypeId int_int[] = { TypeId_Integer, TypeId_Integer };
+    TypeId int_real[] = { TypeId_Integer, TypeId_Real };
+    TypeId real_int[] = { TypeId_Real, TypeId_Integer };
+    TypeId add = type_table_fun(&types, TypeId_Integer, int_int, 2);
+    ASSERT_NE(add, (TypeId) TypeId_Invalid);
+    ASSERT_EQ(type_table_fun(&types, TypeId_Integer, int_int, 2), add);
+    ASSERT_NE(type_table_fun(&types, TypeId_Real, int_int, 2), add);
+    ASSERT_NE(type_table_fun(&types, TypeId_Integer, int_real, 2), type_table_fun(&types, TypeId_Integer, real_int, 2));
+    ASSERT_NE(type_table_fun(&types, TypeId_Integer, int_int, 1), add);
+
+    ASSERT_EQ(type_kind(&types, add), TypeKind_Fun);
+    ASSERT_EQ(type_fun_result(&types, add), (TypeId) TypeId_Integer);
+    ASSERT_EQ(type_fun_param_count(&types, add), 2u);
+    ASSERT_EQ(type_fun_param(&types, add, 1), (TypeId) TypeId_Integer);
+
+    const char* point = pool.c_str() + offsets[0];
+    const char* other_point = pool.c_str() + offsets[1];
+    TypeId fields[] = { TypeId_Real, TypeId_Real };
+    TypeId a = type_table_struct(&types, point, fields, 2);
+    ASSERT_EQ(type_table_struct(&types, point, fields, 2), a);
+    ASSERT_NE(type_table_struct(&types, other_point, fields, 2), a);
+    ASSERT_NE(type_table_struct(&types, point, fields, 1), a);
+    ASSERT_EQ(type_kind(&types, a), TypeKind_Struct);
+    ASSERT_STREQ(type_repr(&types, a), "Point");
+
+    // Functions of functions, so that the table grows many times.
+    std::vector<TypeId> ids;
+    TypeId previous = add;
+    for (int i = 0; i < 10000; ++i) {
+        TypeId params[] = { previous, (TypeId) (TypeId_Boolean + i % 3) };
+        previous = type_table_fun(&types, TypeId_Void, params, 2);
+        ASSERT_NE(previous, (TypeId) TypeId_Invalid);
+        ids.push_back(previous);
+    }
+    u32 count = types.count;
+
+    // Moved along with the data pool, as when the table is loaded from the
+    // cache, it still finds every type.
+    std::string moved = pool;
+    for (TypeId type = TYPE_ID_BUILTIN_COUNT; type < types.count; ++type) {
+        if (types.names[type] != NULL)
+            types.names[type] = moved.c_str() + (types.names[type] - pool.c_str());
+    }
+    types.data_pool = moved.c_str();
+    ASSERT_EQ(type_table_struct(&types, moved.c_str() + offsets[0], fields, 2), a);
+    previous = add;
+    for (int i = 0; i < 10000; ++i) {
+        TypeId params[] = { previous, (TypeId) (TypeId_Boolean + i % 3) };
+        previous = type_table_fun(&types, TypeId_Void, params, 2);
+        ASSERT_EQ(previous, ids[i]);
+    }
+    ASSERT_EQ(types.count, count);
+    type_table_free(&types);
+}
 
+TEST(TypeTableTest, FunctionsWithTheSameSignatureShareATypeId) {
+    Checked checked = check_source(
+        "fun f(a: int, b: real) bool { return true }\n"
+        "fun g(x: int, y: real) bool { return false }\n"
+        "fun h(x: real, y: int) bool { return false }\n");
+    ASSERT_NE(checked.ast.arena.kinds, nullptr);
+    TypeId f = checked_fun_at(checked.ast, 0)->type_id;
+    ASSERT_EQ(checked_fun_at(checked.ast, 1)->type_id, f);
+    ASSERT_NE(checked_fun_at(checked.ast, 2)->type_id, f);
+    ASSERT_EQ(type_fun_param(&checked.ast.types, f, 1), (TypeId) TypeId_Real);
+    checked_free(checked);
+}
@@ -9,6 +9,8 @@ using testing::ElementsAre;
 
 extern "C" {
 #include "lexer/lexer.h"
+#include "lexer/scan.h"
+#include "os/thread.h"
 }
 
 
@@ -22,9 +24,8 @@ void test_tokenization(Str source, std::vector<Token> expected_tokens, std::vect
     EXPECT_EQ(token_array.size, expected_tokens.size());
     size_t size = std::min((size_t)token_array.size, expected_tokens.size());
 
-    std::vector<Token> tokens(token_array.tokens, token_array.tokens+token_array.size);
     for (size_t i = 0; i < size; ++i) {
-        EXPECT_EQ(token_array.tokens[i], expected_tokens[i]);
+        EXPECT_EQ((Token) token_array.tokens[i], expected_tokens[i]);
     }
 
     std::vector<std::string> reprs;
@@ -79,6 +80,33 @@ TEST(LexerTest, Keywords) {
     test_tokenization(STR("if"), { Token_If }, { "if" });
     test_tokenization(STR("else"), { Token_Else }, { "else" });
     test_tokenization(STR("while"), { Token_While }, { "while" });
+    test_tokenization(STR("then"), { Token_Then }, { "then" });
+    test_tokenization(STR("fun"), { Token_Fun }, { "fun" });
+    test_tokenization(STR("return"), { Token_Return }, { "return" });
+    test_tokenization(STR("struct"), { Token_Struct }, { "struct" });
+    test_tokenization(STR("true"), { Token_True }, { "true" });
+    test_tokenization(STR("false"), { Token_False }, { "false" });
+    test_tokenization(STR("not"), { Token_Not }, { "not" });
+    test_tokenization(STR("and"), { Token_And }, { "and" });
+    test_tokenization(STR("or"), { Token_Or }, { "or" });
+}
+
+TEST(LexerTest, AllKeywords) {
+    // Every keyword in ALL_TOKENS is recognized, and near misses stay identifiers.
+    for (int token = 0; token <= TOKEN_LAST; ++token) {
+        if (!(token_group((Token) token) & TokenGroup_Keyword))
+            continue;
+
+        std::string keyword = token_repr((Token) token);
+        test_tokenization(Str { keyword.size(), keyword.c_str() }, { (Token) token }, { keyword });
+
+        std::string longer = keyword + "_";
+        test_tokenization(Str { longer.size(), longer.c_str() }, { Token_Identifier }, { longer });
+        std::string shorter = keyword.substr(0, keyword.size() - 1);
+        if (!shorter.empty())
+            test_tokenization(Str { shorter.size(), shorter.c_str() }, { Token_Identifier }, { shorter });
+    }
+    test_tokenization(STR("iff efse tree"), { Token_Identifier, Token_Identifier, Token_Identifier }, { "iff", "efse", "tree" });
 }
 
 TEST(LexerTest, BinaryOperators) {
@@ -134,6 +162,338 @@ TEST(LexerTest, Comments) {
     test_tokenization(STR("/* hello\n /* hello*/ \n*/"), {}, {});
 }
 
+TEST(LexerTest, ManyTokens) {
+    // Well past any fixed-size token buffer.
+    std::string source;
+    std::vector<Token> expected_tokens;
+    std::vector<std::string> expected_reprs;
+    for (int i = 0; i < 100000; ++i) {
+        source += "a + 1 ";
+        expected_tokens.insert(expected_tokens.end(), { Token_Identifier, Token_Plus, Token_Number });
+        expected_reprs.insert(expected_reprs.end(), { "a", "+", "1" });
+    }
+
+    test_tokenization(Str { source.size(), source.c_str() }, expected_tokens, expected_reprs);
+}
+
+TEST(LexerTest, InternPrefixes) {
+    // A string that is a prefix of an interned one must not be matched with it.
+    test_tokenization(STR("abc ab a abc"), { Token_Identifier, Token_Identifier, Token_Identifier, Token_Identifier }, { "abc", "ab", "a", "abc" });
+    test_tokenization(STR("\"abc\" \"ab\" \"\""), { Token_String, Token_String, Token_String }, { "abc", "ab", "" });
+}
+
+TEST(LexerTest, ManyDistinctIdentifiers) {
+    // Forces the intern table and its data pool to grow several times.
+    std::string source;
+    std::vector<Token> expected_tokens;
+    std::vector<std::string> expected_reprs;
+    for (int i = 0; i < 200000; ++i) {
+        std::string identifier = "name_" + std::to_string(i);
+        source += identifier + " ";
+        expected_tokens.push_back(Token_Identifier);
+        expected_reprs.push_back(identifier);
+    }
+    source += "name_0 name_199999";
+    expected_tokens.insert(expected_tokens.end(), { Token_Identifier, Token_Identifier });
+    expected_reprs.insert(expected_reprs.end(), { "name_0", "name_199999" });
+
+    Str str = { source.size(), source.c_str() };
+    test_tokenization(str, expected_tokens, expected_reprs);
+
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray token_array = lexer_lex(STR("<test>"), str, &logger);
+    ASSERT_EQ(token_array.size, 200003u);
+    EXPECT_EQ(token_array_payload(token_array, 0), token_array_payload(token_array, 200000));
+    EXPECT_EQ(token_array_payload(token_array, 199999), token_array_payload(token_array, 200001));
+    token_array_free(token_array);
+}
+
+TEST(LexerTest, LongRuns) {
+    // Runs longer than a vector block, so the kernels take their block loop and scalar tail.
+    std::string identifier(100, 'a');
+    identifier += "_Z9";
+    std::string digits(70, '7');
+    std::string zeros(70, '0');
+    std::string spaces(75, ' ');
+    std::string text(90, 'x');
+
+    std::string source = identifier + spaces + digits + "." + digits + "\t\n" + spaces
+                       + "\"" + text + "\\\"" + text + "\""
+                       + "//" + text + "\n"
+                       + "/*" + text + "/*" + text + "*/" + text + "*/"
+                       + zeros + "7";  // Integers past INT64_MAX don't lex, leading zeros do.
+
+    test_tokenization(
+        Str { source.size(), source.c_str() },
+        { Token_Identifier, Token_Real, Token_String, Token_Number },
+        { identifier, digits + "." + digits, text + "\\\"" + text, zeros + "7" }
+    );
+}
+
+TEST(LexerTest, SparsePayloads) {
+    // Only identifiers and literals have a payload, and the rank index finds
+    // them across word boundaries.
+    std::string source;
+    for (int i = 0; i < 300; ++i)
+        source += (i % 3 == 0) ? "name_" + std::to_string(i) + " " : "+ ";
+
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray token_array = lexer_lex(STR("<test>"), Str { source.size(), source.c_str() }, &logger);
+    ASSERT_EQ(token_array.size, 301u);
+    EXPECT_EQ(token_array.payload_count, 100u);
+
+    for (TokenIndex i = 0; i < token_array.size; ++i) {
+        if (i % 3 == 0 && i < 300) {
+            ASSERT_NE(token_array_payload(token_array, i), 0u);
+            EXPECT_EQ(lexer_repr_of(token_array, i), "name_" + std::to_string(i));
+        } else {
+            EXPECT_EQ(token_array_payload(token_array, i), 0u);
+        }
+    }
+    token_array_free(token_array);
+}
+
+TEST(LexerTest, Constants) {
+    // Literals are decoded once, and equal literals written the same way share a constant.
+    Str source = STR("7 3.25 0.1 \"a\\tb\\\"\" 9223372036854775807 7 007 \"a\\tb\\\"\" 12345678901234567.5");
+
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray token_array = lexer_lex(STR("<test>"), source, &logger);
+    ASSERT_EQ(token_array.size, 10u);
+
+    EXPECT_EQ(token_array_constant(token_array, 0).kind, ConstantKind_Integer);
+    EXPECT_EQ(token_array_constant(token_array, 0).as.integer, 7u);
+    EXPECT_EQ(token_array_constant(token_array, 1).kind, ConstantKind_Real);
+    EXPECT_EQ(token_array_constant(token_array, 1).as.real, 3.25);
+    EXPECT_EQ(token_array_constant(token_array, 2).as.real, 0.1);
+    EXPECT_EQ(token_array_constant(token_array, 3).kind, ConstantKind_String);
+    EXPECT_STREQ((const char*) token_array.data_pool + token_array_constant(token_array, 3).as.string, "a\tb\"");
+    EXPECT_STREQ(lexer_repr_of(token_array, 3), "a\\tb\\\"");
+    EXPECT_EQ(token_array_constant(token_array, 4).as.integer, 9223372036854775807u);
+    EXPECT_EQ(token_array_constant(token_array, 8).as.real, 12345678901234567.5);
+
+    EXPECT_EQ(token_array_payload(token_array, 0), token_array_payload(token_array, 5));
+    EXPECT_EQ(token_array_payload(token_array, 3), token_array_payload(token_array, 7));
+    EXPECT_EQ(token_array_constant(token_array, 6).as.integer, 7u);
+    EXPECT_STREQ(lexer_repr_of(token_array, 0), "7");
+    EXPECT_STREQ(lexer_repr_of(token_array, 6), "007");
+    EXPECT_EQ(token_array.constant_count, 8u);
+    token_array_free(token_array);
+
+    TokenArray too_large = lexer_lex(STR("<test>"), STR("9223372036854775808"), &logger);
+    EXPECT_EQ(too_large.tokens, nullptr);
+    TokenArray bad_escape = lexer_lex(STR("<test>"), STR("\"a\\qb\""), &logger);
+    EXPECT_EQ(bad_escape.tokens, nullptr);
+}
+
+TEST(LexerTest, StringsEndingInBackslash) {
+    // An escaped backslash doesn't escape the quote after it.
+    Str source = STR("\"\\\\\" \"a\\\\\" \"\\\\\\\"\"");
+
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray token_array = lexer_lex(STR("<test>"), source, &logger);
+    ASSERT_EQ(token_array.size, 4u);
+
+    EXPECT_EQ(token_array.tokens[0], Token_String);
+    EXPECT_STREQ((const char*) token_array.data_pool + token_array_constant(token_array, 0).as.string, "\\");
+    EXPECT_STREQ((const char*) token_array.data_pool + token_array_constant(token_array, 1).as.string, "a\\");
+    EXPECT_STREQ((const char*) token_array.data_pool + token_array_constant(token_array, 2).as.string, "\\\"");
+    EXPECT_STREQ(lexer_repr_of(token_array, 1), "a\\\\");
+    EXPECT_EQ(token_array.tokens[3], Token_Eof);
+    token_array_free(token_array);
+}
+
+static void expect_same_token_arrays(TokenArray a, TokenArray b) {
+    ASSERT_EQ(a.size, b.size);
+    ASSERT_EQ(a.data_pool_size, b.data_pool_size);
+    ASSERT_EQ(a.payload_count, b.payload_count);
+    EXPECT_EQ(memcmp(a.tokens, b.tokens, a.size * sizeof(u8)), 0);
+    EXPECT_EQ(memcmp(a.source_offsets, b.source_offsets, a.size * sizeof(SourceIndex)), 0);
+    EXPECT_EQ(memcmp(a.payloads, b.payloads, a.payload_count * sizeof(DataPoolIndex)), 0);
+    EXPECT_EQ(memcmp(a.payload_bits, b.payload_bits, (a.size / 64 + 1) * sizeof(u64)), 0);
+    ASSERT_EQ(a.constant_count, b.constant_count);
+    for (ConstantIndex i = 0; i < a.constant_count; ++i) {
+        EXPECT_EQ(a.constants[i].kind, b.constants[i].kind);
+        EXPECT_EQ(a.constants[i].repr, b.constants[i].repr);
+        if (a.constants[i].kind == ConstantKind_String)
+            EXPECT_EQ(a.constants[i].as.string, b.constants[i].as.string);
+        else if (a.constants[i].kind == ConstantKind_Real)
+            EXPECT_EQ(a.constants[i].as.real, b.constants[i].as.real);
+        else
+            EXPECT_EQ(a.constants[i].as.integer, b.constants[i].as.integer);
+    }
+    EXPECT_EQ(memcmp(a.data_pool + sizeof(DataPoolIndex), b.data_pool + sizeof(DataPoolIndex), a.data_pool_size - sizeof(DataPoolIndex)), 0);
+    ASSERT_EQ(a.lines.count, b.lines.count);
+    EXPECT_EQ(memcmp(a.lines.starts, b.lines.starts, a.lines.count * sizeof(u32)), 0);
+}
+
+TEST(LexerTest, ParallelMatchesSerial) {
+    // Strings and block comments spanning lines land on chunk boundaries now and then.
+    const char* lines[] = {
+        "fun f%d(a: int) int { return a * %d }\n",
+        "value_%d := \"text %d\"\n",
+        "/* comment %d\n spanning\n lines %d */\n",
+        "multi := \"line %d\n string %d\"\n",
+        "// line comment %d %d\n",
+        "x = 1.5 + %d - y%d\n",
+    };
+    std::string source;
+    char line[128];
+    for (int i = 0; source.size() < 4 * 1024 * 1024; ++i) {
+        snprintf(line, sizeof(line), lines[(i * 7) % 6], i % 5000, i);
+        source += line;
+    }
+
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    Str str = { source.size(), source.c_str() };
+    TokenArray serial = lexer_lex(STR("<test>"), str, &logger);
+    ASSERT_NE(serial.tokens, nullptr);
+
+    for (int threads = 1; threads <= 8; ++threads) {
+        TokenArray parallel = lexer_lex_parallel(STR("<test>"), str, &logger, threads);
+        ASSERT_NE(parallel.tokens, nullptr);
+        expect_same_token_arrays(serial, parallel);
+        token_array_free(parallel);
+    }
+    token_array_free(serial);
+
+    // An unterminated string fails the same way.
+    source += "\"unterminated";
+    str = { source.size(), source.c_str() };
+    TokenArray parallel = lexer_lex_parallel(STR("<test>"), str, &logger, 4);
+    EXPECT_EQ(parallel.tokens, nullptr);
+}
+
+static void expect_same_tokens(TokenArray a, TokenArray b) {
+    ASSERT_EQ(a.size, b.size);
+    ASSERT_EQ(a.payload_count, b.payload_count);
+    for (TokenIndex i = 0; i < a.size; ++i) {
+        EXPECT_EQ(a.tokens[i], b.tokens[i]);
+        EXPECT_EQ(a.source_offsets[i], b.source_offsets[i]);
+        EXPECT_STREQ(lexer_repr_of(a, i), lexer_repr_of(b, i));
+    }
+    ASSERT_EQ(a.lines.count, b.lines.count);
+    EXPECT_EQ(memcmp(a.lines.starts, b.lines.starts, a.lines.count * sizeof(u32)), 0);
+}
+
+TEST(LexerTest, IncrementalMatchesWhole) {
+    // Appends that continue the last token or a comment after it.
+    const char* lines[] = {
+        "fun add(a: int, b: int) int {\n",
+        "    return a + b\n",
+        "}\nx := 1",
+        ".5 // trailing",
+        " comment\nname",
+        "_suffix = \"text\" == fu",
+        "n\n",
+    };
+
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    IncrementalLexer* incremental = lexer_incremental_make(STR("<test>"));
+    ASSERT_NE(incremental, nullptr);
+
+    std::string source;
+    for (const char* line : lines) {
+        source += line;
+        TokenArray appended = lexer_incremental_append(incremental, str_from_c_str(line), &logger);
+        ASSERT_NE(appended.tokens, nullptr);
+        lexer_incremental_commit(incremental);
+
+        TokenArray whole = lexer_lex(STR("<test>"), Str { source.size(), source.c_str() }, &logger);
+        expect_same_tokens(appended, whole);
+        token_array_free(whole);
+    }
+
+    // A line that doesn't lex is dropped, and a rolled back line is forgotten.
+    EXPECT_EQ(lexer_incremental_append(incremental, STR("\"unterminated"), &logger).tokens, nullptr);
+    ASSERT_NE(lexer_incremental_append(incremental, STR("y := 2\n"), &logger).tokens, nullptr);
+    lexer_incremental_rollback(incremental);
+
+    source += "z := 3\n";
+    TokenArray appended = lexer_incremental_append(incremental, STR("z := 3\n"), &logger);
+    TokenArray whole = lexer_lex(STR("<test>"), Str { source.size(), source.c_str() }, &logger);
+    expect_same_tokens(appended, whole);
+    token_array_free(whole);
+
+    // The REPL runs a copy of the tokens, as running them may free them.
+    TokenArray copy = token_array_copy(appended);
+    ASSERT_NE(copy.tokens, nullptr);
+    EXPECT_NE(copy.tokens, appended.tokens);
+    expect_same_token_arrays(copy, appended);
+    token_array_free(copy);
+    lexer_incremental_free(incremental);
+}
+
+TEST(LexerTest, LineIndex) {
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    Str source = STR("a\nbc\n\n\tfun x\r\n  y");
+    TokenArray token_array = lexer_lex(STR("<test>"), source, &logger);
+
+    std::vector<u32> starts(token_array.lines.starts, token_array.lines.starts + token_array.lines.count);
+    EXPECT_THAT(starts, ElementsAre(0, 2, 5, 6, 14));
+
+    for (size_t i = 0; i <= source.size; ++i) {
+        Location expected = location_of(source.data, i);
+        Location actual   = location_of_indexed(token_array.lines, source.data, i);
+        EXPECT_EQ(actual.row, expected.row) << "at " << i;
+        EXPECT_EQ(actual.column, expected.column) << "at " << i;
+    }
+    token_array_free(token_array);
+}
+
+TEST(ScannerTest, KernelsAgreeWithScalar) {
+    const Scanner* scalar = scanner_of_kind(ScannerKind_Scalar);
+    ASSERT_NE(scalar, nullptr);
+    ASSERT_NE(scanner_get(), nullptr);
+
+    const char alphabet[] = " \t\r\naz_AZ09*/\"\x80\xff.{";
+    std::string buffer;
+    u64 state = 0x2545F4914F6CDD1Dull;
+    auto next = [&state]() { state ^= state << 13; state ^= state >> 7; state ^= state << 17; return state; };
+
+    for (int kind = 0; kind <= SCANNER_KIND_LAST; ++kind) {
+        const Scanner* scanner = scanner_of_kind((ScannerKind) kind);
+        if (scanner == nullptr)
+            continue;
+
+        for (int i = 0; i < 5000; ++i) {
+            // Mostly one character so runs get long, with the occasional other byte.
+            size_t size = next() % 100;
+            char   run  = alphabet[next() % (sizeof(alphabet) - 1)];
+            buffer.clear();
+            for (size_t j = 0; j < size; ++j)
+                buffer += (next() % 8) ? run : alphabet[next() % (sizeof(alphabet) - 1)];
+
+            const char* begin = buffer.c_str();
+            const char* end   = begin + buffer.size();
+            EXPECT_EQ(scanner->skip_whitespace(begin, end),        scalar->skip_whitespace(begin, end))        << scanner->name;
+            EXPECT_EQ(scanner->skip_identifier(begin, end),        scalar->skip_identifier(begin, end))        << scanner->name;
+            EXPECT_EQ(scanner->skip_digits(begin, end),            scalar->skip_digits(begin, end))            << scanner->name;
+            EXPECT_EQ(scanner->find_line_end(begin, end),          scalar->find_line_end(begin, end))          << scanner->name;
+            EXPECT_EQ(scanner->find_quote(begin, end),             scalar->find_quote(begin, end))             << scanner->name;
+            EXPECT_EQ(scanner->find_comment_delimiter(begin, end), scalar->find_comment_delimiter(begin, end)) << scanner->name;
+        }
+    }
+}
+
+static int get_scanner(void* result) {
+    *(const Scanner**) result = scanner_get();
+    return 1;
+}
+
+TEST(ScannerTest, SelectedOnceAcrossThreads) {
+    // Run under ThreadSanitizer, this also checks that selecting it doesn't race.
+    Thread threads[8];
+    const Scanner* scanners[8] = {};
+    for (int i = 0; i < 8; ++i)
+        ASSERT_TRUE(thread_start(&threads[i], get_scanner, &scanners[i]));
+    for (int i = 0; i < 8; ++i)
+        thread_join(threads[i]);
+
+    for (int i = 0; i < 8; ++i)
+        EXPECT_EQ(scanners[i], scanner_get());
+}
+
 //TEST(LexerTest, AllTokens) {
 //    test_tokenization(
 //            STR("0 123 0.0 1.02 0.01 123.123 \"\" \"a\" \"abc\" \"a b c\" \"a\nb c\" \"a\\nb\\tc\" \"a\\\"b c\" a abc a_b_c a0 a0b a0_b1_c2 if else while + - * / % < <= == != >= > = := : . true false not and or ( ) { } ,"),
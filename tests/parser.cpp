@@ -4,208 +4,556 @@
 
 extern "C" {
 #include "parser/parser.h"
+#include "parser/visitor.h"
 }
 
 #include "logger.h"
 
+#include <string>
+#include <vector>
 
-TEST(ParserTest, Simple) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main() {}");
 
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+static GrammarTree parse_source(const char* source) {
+    Logger logger = logger_make_with_file("test", LOG_LEVEL_ERROR, stderr);
+    TokenArray tokens = lexer_lex(STR("test"), str_from_c_str(source), &logger);
+    return parse(tokens);
+}
 
-    Node_Module module = *(Node_Module*) ast.nodes;
+// The literal type that a type node names, as the parser stores it in the name.
+static LiteralType literal_type_of(const GrammarTree& ast, NodeId type) {
+    return (LiteralType) (size_t) node_type_at(&ast.arena, type)->name;
+}
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmts.count, 1);
+static NodeFunDecl* fun_decl_at(const GrammarTree& ast, u32 index) {
+    NodeModule* module = node_module_at(&ast.arena, ast.start);
+    NodeId fun = node_view_at(&ast.arena, module->decls, index);
+    EXPECT_EQ(node_kind_at(&ast.arena, fun), NodeKind_FunDecl);
+    return node_fun_decl_at(&ast.arena, fun);
+}
 
-    Node_Stmt* stmt = module.stmts.nodes[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
+static NodeFunParam* param_at(const GrammarTree& ast, const NodeFunDecl* fun, u32 index) {
+    return node_fun_param_at(&ast.arena, node_view_at(&ast.arena, fun->params, index));
 }
 
-TEST(ParserTest, SimpleWithArgs) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main(arg1: int, arg2: int) {}");
+// The id of the statement at `index` in the function's body.
+static NodeId body_at(const GrammarTree& ast, const NodeFunDecl* fun, u32 index) {
+    return node_view_at(&ast.arena, node_fun_body_at(&ast.arena, fun->body)->nodes, index);
+}
 
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+static u32 body_count(const GrammarTree& ast, const NodeFunDecl* fun) {
+    return node_fun_body_at(&ast.arena, fun->body)->nodes.count;
+}
 
-    Node_Module module = *(Node_Module*) ast.nodes;
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmts.count, 1);
+TEST(ParserTest, Simple) {
+    GrammarTree ast = parse_source("fun main() {}");
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    NodeModule* module = node_module_at(&ast.arena, ast.start);
+    ASSERT_EQ(node_kind_at(&ast.arena, ast.start), NodeKind_Module);
+    ASSERT_EQ(module->stmts.count, 0u);
+    ASSERT_EQ(module->decls.count, 1u);
+
+    NodeFunDecl* fun = fun_decl_at(ast, 0);
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->params.count, 0u);
+    ASSERT_EQ(body_count(ast, fun), 0u);
+    grammar_tree_free(ast);
+}
 
-    Node_Stmt* stmt = module.stmts.nodes[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 2);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "arg1") == 0);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[1].name, "arg2") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[1].type.as.literal.type, LiteralType_Integer);
+TEST(ParserTest, SimpleWithArgs) {
+    GrammarTree ast = parse_source("fun main(arg1: int, arg2: int) {}");
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    NodeFunDecl* fun = fun_decl_at(ast, 0);
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->params.count, 2u);
+    ASSERT_STREQ(param_at(ast, fun, 0)->name, "arg1");
+    ASSERT_STREQ(param_at(ast, fun, 1)->name, "arg2");
+    ASSERT_EQ(literal_type_of(ast, param_at(ast, fun, 0)->type), LiteralType_Integer);
+    ASSERT_EQ(literal_type_of(ast, param_at(ast, fun, 1)->type), LiteralType_Integer);
+    grammar_tree_free(ast);
 }
 
 
 
 TEST(ParserTest, SimpleWithArgsAndReturnAndBody) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main(arg1: int, arg2: int) int { return arg1 + arg2 }");
+    GrammarTree ast = parse_source("fun main(arg1: int, arg2: int) int { return arg1 + arg2 }");
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    NodeFunDecl* fun = fun_decl_at(ast, 0);
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->params.count, 2u);
+    ASSERT_STREQ(param_at(ast, fun, 0)->name, "arg1");
+    ASSERT_STREQ(param_at(ast, fun, 1)->name, "arg2");
+    ASSERT_EQ(literal_type_of(ast, fun->return_type), LiteralType_Integer);
+
+    ASSERT_EQ(body_count(ast, fun), 1u);
+    NodeId stmt = body_at(ast, fun, 0);
+    ASSERT_EQ(node_kind_at(&ast.arena, stmt), NodeKind_Return);
+    NodeId expr = node_return_stmt_at(&ast.arena, stmt)->expression;
+    ASSERT_EQ(node_kind_at(&ast.arena, expr), NodeKind_Binary);
+    ASSERT_EQ(node_binary_at(&ast.arena, expr)->op, BinaryOp_Add);
+    grammar_tree_free(ast);
+}
 
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+TEST(ParserTest, SimpleWithArgsAndReturnAndBodyAndVarDecl) {
+    GrammarTree ast = parse_source("fun main(arg1: int, arg2: int) int { a := arg1 + arg2 return a }");
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    NodeFunDecl* fun = fun_decl_at(ast, 0);
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->params.count, 2u);
+    ASSERT_EQ(literal_type_of(ast, fun->return_type), LiteralType_Integer);
+
+    ASSERT_EQ(body_count(ast, fun), 2u);
+    NodeId decl = body_at(ast, fun, 0);
+    ASSERT_EQ(node_kind_at(&ast.arena, decl), NodeKind_VarDecl);
+    ASSERT_STREQ(node_var_decl_at(&ast.arena, decl)->name, "a");
+    NodeId expr = node_var_decl_at(&ast.arena, decl)->expression;
+    ASSERT_EQ(node_kind_at(&ast.arena, expr), NodeKind_Binary);
+    ASSERT_EQ(node_binary_at(&ast.arena, expr)->op, BinaryOp_Add);
+
+    NodeId stmt = body_at(ast, fun, 1);
+    ASSERT_EQ(node_kind_at(&ast.arena, stmt), NodeKind_Return);
+    expr = node_return_stmt_at(&ast.arena, stmt)->expression;
+    ASSERT_EQ(node_kind_at(&ast.arena, expr), NodeKind_Identifier);
+    ASSERT_STREQ(node_identifier_at(&ast.arena, expr)->name, "a");
+    grammar_tree_free(ast);
+}
 
-    Node_Module module = *(Node_Module*) ast.nodes;
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmts.count, 1);
+TEST(ParserTest, MultipleFunctionDeclarations) {
+    GrammarTree ast = parse_source("fun main() int { return 1 * 2 + 3 } fun test(t: int) int { a := 1 + 2 * 3 return a / t }");
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+    ASSERT_EQ(node_module_at(&ast.arena, ast.start)->decls.count, 2u);
+
+    NodeFunDecl* fun = fun_decl_at(ast, 0);
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->params.count, 0u);
+    ASSERT_EQ(literal_type_of(ast, fun->return_type), LiteralType_Integer);
+    ASSERT_EQ(body_count(ast, fun), 1u);
+    NodeId stmt = body_at(ast, fun, 0);
+    ASSERT_EQ(node_kind_at(&ast.arena, stmt), NodeKind_Return);
+    NodeId expr = node_return_stmt_at(&ast.arena, stmt)->expression;
+    ASSERT_EQ(node_kind_at(&ast.arena, expr), NodeKind_Binary);
+    ASSERT_EQ(node_binary_at(&ast.arena, expr)->op, BinaryOp_Add);
+
+    fun = fun_decl_at(ast, 1);
+    ASSERT_STREQ(fun->name, "test");
+    ASSERT_EQ(fun->params.count, 1u);
+    ASSERT_STREQ(param_at(ast, fun, 0)->name, "t");
+    ASSERT_EQ(literal_type_of(ast, param_at(ast, fun, 0)->type), LiteralType_Integer);
+    ASSERT_EQ(literal_type_of(ast, fun->return_type), LiteralType_Integer);
+    ASSERT_EQ(body_count(ast, fun), 2u);
+    NodeId decl = body_at(ast, fun, 0);
+    ASSERT_EQ(node_kind_at(&ast.arena, decl), NodeKind_VarDecl);
+    ASSERT_STREQ(node_var_decl_at(&ast.arena, decl)->name, "a");
+    expr = node_var_decl_at(&ast.arena, decl)->expression;
+    ASSERT_EQ(node_binary_at(&ast.arena, expr)->op, BinaryOp_Add);
+    stmt = body_at(ast, fun, 1);
+    ASSERT_EQ(node_kind_at(&ast.arena, stmt), NodeKind_Return);
+    expr = node_return_stmt_at(&ast.arena, stmt)->expression;
+    ASSERT_EQ(node_kind_at(&ast.arena, expr), NodeKind_Binary);
+    ASSERT_EQ(node_binary_at(&ast.arena, expr)->op, BinaryOp_Div);
+    grammar_tree_free(ast);
+}
+
 
-    Node_Stmt* stmt = module.stmts.nodes[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 2);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "arg1") == 0);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[1].name, "arg2") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[1].type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.return_type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.body->count, 1);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.return_stmt.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.return_stmt.expr->as.binary.op, BinaryOp_Add);
+TEST(ParserTest, IfStmt) {
+    GrammarTree ast = parse_source("fun main() int { if 1 == 2 { return 1 } else { return 2 } }");
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    NodeFunDecl* fun = fun_decl_at(ast, 0);
+    ASSERT_STREQ(fun->name, "main");
+    ASSERT_EQ(fun->params.count, 0u);
+    ASSERT_EQ(literal_type_of(ast, fun->return_type), LiteralType_Integer);
+
+    ASSERT_EQ(body_count(ast, fun), 1u);
+    NodeId stmt = body_at(ast, fun, 0);
+    ASSERT_EQ(node_kind_at(&ast.arena, stmt), NodeKind_If);
+    NodeIf* if_stmt = node_if_stmt_at(&ast.arena, stmt);
+    ASSERT_EQ(node_kind_at(&ast.arena, if_stmt->condition), NodeKind_Binary);
+    ASSERT_EQ(node_binary_at(&ast.arena, if_stmt->condition)->op, BinaryOp_Eq);
+
+    NodeId blocks[] = { if_stmt->then_block, if_stmt->else_block };
+    for (u32 i = 0; i < 2; ++i) {
+        ASSERT_EQ(node_kind_at(&ast.arena, blocks[i]), NodeKind_Block);
+        NodeBlock* block = node_block_at(&ast.arena, blocks[i]);
+        ASSERT_EQ(block->nodes.count, 1u);
+        NodeId ret = node_view_at(&ast.arena, block->nodes, 0);
+        ASSERT_EQ(node_kind_at(&ast.arena, ret), NodeKind_Return);
+        NodeId expr = node_return_stmt_at(&ast.arena, ret)->expression;
+        ASSERT_EQ(node_kind_at(&ast.arena, expr), NodeKind_Literal);
+        ASSERT_EQ(node_literal_at(&ast.arena, expr)->type, LiteralType_Integer);
+        ASSERT_EQ(node_literal_at(&ast.arena, expr)->value.integer, i + 1u);
+    }
+    grammar_tree_free(ast);
 }
 
-TEST(ParserTest, SimpleWithArgsAndReturnAndBodyAndVarDecl) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main(arg1: int, arg2: int) int { a := arg1 + arg2 return a }");
-
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
-
-    Node_Module module = *(Node_Module *) ast.nodes;
-
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmts.count, 1);
-
-    Node_Stmt* stmt = module.stmts.nodes[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 2);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "arg1") == 0);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[1].name, "arg2") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[1].type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.return_type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.body->count, 2);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->kind, NodeKind_VarDecl);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.base.kind, NodeKind_VarDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.body->nodes[0]->as.var_decl.name, "a") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.type.as.literal.type, LiteralType_Inferred);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.expr->as.binary.op, BinaryOp_Add);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[1]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[1]->as.return_stmt.expr->kind, NodeKind_Identifier);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.body->nodes[1]->as.return_stmt.expr->as.identifier.name, "a") == 0);
+
+TEST(ParserTest, NodeArenaKeepsHandlesWhileGrowing) {
+    // Sized for a handful of tokens, so it has to grow many times.
+    NodeArena arena = node_arena_make(4);
+    ASSERT_NE(arena.kinds, nullptr);
+    ASSERT_EQ(arena.count, 1u);
+    ASSERT_EQ(node_at(&arena, 0)->kind, NodeKind_Module);
+
+    const NodeId count = 1000000;
+    for (NodeId i = 1; i < count; ++i) {
+        Node node = {};
+        node.base.kind = NodeKind_Identifier;
+        node.base.start = i;
+        ASSERT_EQ(node_arena_push(&arena, node), i);
+    }
+    ASSERT_EQ(arena.count, count);
+
+    for (NodeId i = 1; i < count; i += 997) {
+        ASSERT_EQ(node_at(&arena, i)->base.start, i);
+        ASSERT_EQ(node_id_of(&arena, node_at(&arena, i)), i);
+    }
+
+    std::vector<NodeView> views;
+    for (NodeId i = 1; i < 10000; ++i) {
+        NodeId ids[7];
+        u32 size = i % 7 + 1;
+        for (u32 j = 0; j < size; ++j)
+            ids[j] = i + j;
+
+        NodeView view;
+        ASSERT_TRUE(node_arena_push_view(&arena, ids, size, &view));
+        ASSERT_EQ(view.count, size);
+        views.push_back(view);
+    }
+    for (size_t i = 0; i < views.size(); ++i) {
+        for (u32 j = 0; j < views[i].count; ++j)
+            ASSERT_EQ(node_view_at(&arena, views[i], j), (NodeId) (i + 1 + j));
+    }
+
+    node_arena_free(&arena);
+    ASSERT_EQ(arena.kinds, nullptr);
 }
 
+TEST(ParserTest, NodeArenaPacksEachKindAtItsOwnSize) {
+    NodeArena arena = node_arena_make(16);
+    ASSERT_NE(arena.kinds, nullptr);
+
+    for (u32 i = 0; i < 3000; ++i) {
+        Node node = {};
+        if (i % 3 == 0) {
+            node.literal.base = node_base_literal(i, i);
+            node.literal.value.integer = i;
+        } else if (i % 3 == 1) {
+            node.identifier.base = node_base_identifier(i, i);
+        } else {
+            node.binary.base = node_base_binary(i, i);
+            node.binary.left = i - 2;
+            node.binary.right = i - 1;
+        }
+        ASSERT_EQ(node_arena_push(&arena, node), i + 1);
+    }
+
+    ASSERT_EQ(arena.pools[NodeKind_Literal].count, 1000u);
+    ASSERT_EQ(arena.pools[NodeKind_Identifier].count, 1000u);
+    ASSERT_EQ(arena.pools[NodeKind_Binary].count, 1000u);
+    ASSERT_LT(arena.pools[NodeKind_Identifier].stride, sizeof(Node));
+    ASSERT_GE(arena.pools[NodeKind_Identifier].stride, sizeof(NodeIdentifier));
+    ASSERT_GE(arena.pools[NodeKind_Binary].stride, sizeof(NodeBinary));
+    for (int kind = 0; kind < NODE_KIND_COUNT; ++kind)
+        ASSERT_EQ(arena.pools[kind].stride % alignof(Node), 0u);
+
+    for (u32 i = 0; i < 3000; ++i) {
+        NodeId id = i + 1;
+        ASSERT_EQ(node_at(&arena, id)->base.start, i);
+        ASSERT_EQ(node_id_of(&arena, node_at(&arena, id)), id);
+        if (i % 3 == 0) {
+            ASSERT_EQ(node_kind_at(&arena, id), NodeKind_Literal);
+            ASSERT_EQ(node_literal_at(&arena, id)->value.integer, i);
+        } else if (i % 3 == 2) {
+            ASSERT_EQ(node_kind_at(&arena, id), NodeKind_Binary);
+            ASSERT_EQ(node_binary_at(&arena, id)->right, i - 1);
+        }
+    }
+
+    Node binary = {};
+    binary.binary.base = node_base_binary(7, 8);
+    binary.binary.op = BinaryOp_Mul;
+    node_arena_set(&arena, 3, binary);
+    ASSERT_EQ(node_binary_at(&arena, 3)->op, BinaryOp_Mul);
+    ASSERT_EQ(node_at(&arena, 4)->base.start, 3u);
+
+    node_arena_free(&arena);
+}
 
-TEST(ParserTest, MultipleFunctionDeclarations) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main() int { return 1 * 2 + 3 } fun test(t: int) int { a := 1 + 2 * 3 return a / t }");
-
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
-
-    Node_Module module = *(Node_Module *) ast.nodes;
-
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmts.count, 2);
-
-    Node_Stmt* stmt = module.stmts.nodes[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
-    ASSERT_EQ(stmt->as.fun_decl.base.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "main") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 0);
-    ASSERT_EQ(stmt->as.fun_decl.return_type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.body->count, 1);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.return_stmt.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.return_stmt.expr->as.binary.op, BinaryOp_Add);
-
-    stmt = module.stmts.nodes[1];
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.name, "test") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.count, 1);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.params.nodes[0].name, "t") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.params.nodes[0].type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.return_type.as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(stmt->as.fun_decl.body->count, 2);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->kind, NodeKind_VarDecl);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.base.kind, NodeKind_VarDecl);
-    ASSERT_TRUE(strcmp(stmt->as.fun_decl.body->nodes[0]->as.var_decl.name, "a") == 0);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.type.as.literal.type, LiteralType_Inferred);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[0]->as.var_decl.expr->as.binary.op, BinaryOp_Add);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[1]->kind, NodeKind_Return);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[1]->as.return_stmt.expr->kind, NodeKind_Binary);
-    ASSERT_EQ(stmt->as.fun_decl.body->nodes[1]->as.return_stmt.expr->as.binary.op, BinaryOp_Div);
+TEST(ParserTest, HoistsFunctionsInSourceOrder) {
+    // Interleaved, so that a partition that isn't stable would reorder them.
+    std::string source;
+    for (int i = 0; i < 1000; ++i)
+        source += "a" + std::to_string(i) + " := " + std::to_string(i) + "\nfun f" + std::to_string(i) + "() {}\n";
+
+    GrammarTree ast = parse_source(source.c_str());
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    NodeModule* module = node_module_at(&ast.arena, ast.start);
+    ASSERT_EQ(module->decls.count, 1000u);
+    ASSERT_EQ(module->stmts.count, 1000u);
+    for (u32 i = 0; i < 1000; ++i) {
+        ASSERT_EQ(fun_decl_at(ast, i)->name, "f" + std::to_string(i));
+
+        NodeId stmt = node_view_at(&ast.arena, module->stmts, i);
+        ASSERT_EQ(node_kind_at(&ast.arena, stmt), NodeKind_VarDecl);
+        ASSERT_EQ(node_var_decl_at(&ast.arena, stmt)->name, "a" + std::to_string(i));
+    }
+    grammar_tree_free(ast);
 }
 
+static std::string nested_return(int depth, const char* open, const char* close) {
+    std::string source = "fun main() int { return ";
+    for (int i = 0; i < depth; ++i)
+        source += open;
+    source += "1";
+    for (int i = 0; i < depth; ++i)
+        source += close;
+    return source + " }";
+}
 
-TEST(ParserTest, IfStmt) {
-    Logger logger = logger_make_with_file("test", LOG_LEVEL_DEBUG, stderr);
-    Str source = STR("fun main() int { if 1 == 2 { return 1 } else { return 2 } }");
+TEST(ParserTest, ExpressionsNestUpToTheDepthLimit) {
+    GrammarTree ast = parse_source(nested_return(PARSER_MAX_EXPRESSION_DEPTH - 1, "(", ")").c_str());
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+    grammar_tree_free(ast);
+
+    // Long chains of binary operators don't nest, however long they are.
+    std::string source = "fun main() int { return 1";
+    for (int i = 0; i < 100000; ++i)
+        source += " + 1";
+    GrammarTree chain = parse_source((source + " }").c_str());
+    ASSERT_NE(chain.arena.kinds, nullptr);
+    ASSERT_EQ(chain.error_count, 0u);
+    grammar_tree_free(chain);
+}
 
-    TokenArray tokens = lexer_lex(STR("test"), source, &logger);
-    GrammarTree ast = parse(tokens, &logger);
+TEST(ParserTest, ExpressionsNestedTooDeepAreAnError) {
+    const char* nestings[][2] = { { "(", ")" }, { "not ", "" }, { "f(", ")" } };
+    for (auto& nesting : nestings) {
+        // Far past the limit, which would overflow the stack if it recursed.
+        GrammarTree ast = parse_source(nested_return(100000, nesting[0], nesting[1]).c_str());
+        ASSERT_NE(ast.arena.kinds, nullptr);
+        ASSERT_EQ(ast.error_count, 1u);
+        ASSERT_THAT(ast.errors[0].message, ::testing::HasSubstr("nested more than"));
+        grammar_tree_free(ast);
+    }
+}
 
-    Node_Module module = *(Node_Module *) ast.nodes;
+TEST(ParserTest, ReportsEverySyntaxError) {
+    const char* source =
+        "fun a() int { return 1 + }\n"
+        "fun b() int { return 2 }\n"
+        "fun c() { x := * 3 }\n"
+        "y := )\n"
+        "z := 4\n";
+    GrammarTree ast = parse_source(source);
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 3u);
+    for (u32 i = 1; i < ast.error_count; ++i)
+        ASSERT_LT(ast.errors[i-1].token, ast.errors[i].token);
+
+    // What's between the errors is still parsed.
+    NodeModule* module = node_module_at(&ast.arena, ast.start);
+    bool found_b = false;
+    for (u32 i = 0; i < module->decls.count; ++i)
+        found_b |= std::string(fun_decl_at(ast, i)->name) == "b";
+    ASSERT_TRUE(found_b);
+    ASSERT_EQ(module->stmts.count, 1u);
+    ASSERT_STREQ(node_var_decl_at(&ast.arena, node_view_at(&ast.arena, module->stmts, 0))->name, "z");
+    grammar_tree_free(ast);
+}
 
-    ASSERT_EQ(module.base.kind, NodeKind_Module);
-    ASSERT_EQ(module.stmts.count, 1);
+TEST(ParserTest, StopsAfterMaxErrors) {
+    std::string source;
+    for (int i = 0; i < 50; ++i)
+        source += "x := )\n";
+
+    // 0 is no limit.
+    u32 limits[][2] = { { 2, 2 }, { PARSER_DEFAULT_MAX_ERRORS, PARSER_DEFAULT_MAX_ERRORS }, { 0, 50 } };
+    for (auto& limit : limits) {
+        Logger logger = logger_make_with_file("test", LOG_LEVEL_NONE, stderr);
+        TokenArray tokens = lexer_lex(STR("test"), str_from_c_str(source.c_str()), &logger);
+        GrammarTree ast = parse_with_max_errors(tokens, limit[0]);
+        ASSERT_NE(ast.arena.kinds, nullptr);
+        ASSERT_EQ(ast.error_count, limit[1]);
+        grammar_tree_free(ast);
+    }
+}
 
-    Node_Stmt* stmt = module.stmts.nodes[0];
-    ASSERT_EQ(stmt->kind, NodeKind_FunDecl);
+// Enough tokens that parse_parallel doesn't leave it to the calling thread.
+static std::string many_functions(int count) {
+    std::string source;
+    for (int i = 0; i < count; ++i) {
+        std::string n = std::to_string(i);
+        source += "fun f" + n + "(a: int) int {\n"
+                  "    b := a * " + n + " + 1\n"
+                  "    if b < 10 { c := b return c } else { while b > 0 { b = b - 1 } }\n"
+                  "    return b\n"
+                  "}\n";
+        if (i % 100 == 0)
+            source += "g" + n + " := f" + n + "(" + n + ")\n";
+    }
+    return source;
+}
 
-    Node_FunDecl fun_decl = stmt->as.fun_decl;
-    ASSERT_EQ(fun_decl.kind, NodeKind_FunDecl);
-    ASSERT_TRUE(strcmp(fun_decl.name, "main") == 0);
-    ASSERT_EQ(fun_decl.params.count, 0);
-    ASSERT_EQ(fun_decl.return_type.as.literal.type, LiteralType_Integer);
+// Names are interned in each tree's own tokens, and type names are either a
+// literal type or a name.
+static bool same_name(const char* a, const char* b) {
+    if ((uintptr_t) a <= LITERAL_TYPE_LAST || (uintptr_t) b <= LITERAL_TYPE_LAST)
+        return a == b;
+    return strcmp(a, b) == 0;
+}
 
-    ASSERT_EQ(fun_decl.body->count, 1);
-    ASSERT_EQ(fun_decl.body->nodes[0]->kind, NodeKind_If);
-    Node_If if_stmt = fun_decl.body->nodes[0]->as.if_stmt;
-    ASSERT_EQ(if_stmt.condition->kind, NodeKind_Binary);
-    Node_Cond* condition = if_stmt.condition;
-    ASSERT_EQ(condition->as.binary.op, BinaryOp_Eq);
+static bool same_view(NodeView a, NodeView b) {
+    return a.offset == b.offset && a.count == b.count;
+}
 
-    Node_Stmt* then_stmt = if_stmt.then_stmt;
-    ASSERT_EQ(then_stmt->kind, NodeKind_Block);
-    Node_Block then_block = then_stmt->as.block;
-    ASSERT_EQ(then_block.count, 1);
-    ASSERT_EQ(then_block.nodes[0]->kind, NodeKind_Return);
-    Node_Return return_stmt = then_block.nodes[0]->as.return_stmt;
-    ASSERT_EQ(return_stmt.expr->kind, NodeKind_Literal);
-    ASSERT_EQ(return_stmt.expr->as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(return_stmt.expr->as.literal.value.integer, 1);
+// Field by field, as the padding between them may differ.
+static bool same_node(const Node* a, const Node* b) {
+    if (a->base.kind != b->base.kind || a->base.start != b->base.start || a->base.end != b->base.end)
+        return false;
+
+    switch (a->base.kind) {
+        case NodeKind_Literal:     return a->literal.value.integer == b->literal.value.integer && a->literal.type == b->literal.type && a->literal.constant == b->literal.constant;
+        case NodeKind_Identifier:  return same_name(a->identifier.name, b->identifier.name);
+        case NodeKind_Unary:       return a->unary.expr == b->unary.expr && a->unary.op == b->unary.op;
+        case NodeKind_Binary:      return a->binary.left == b->binary.left && a->binary.right == b->binary.right && a->binary.op == b->binary.op;
+        case NodeKind_Call:        return same_name(a->call.name, b->call.name) && same_view(a->call.args, b->call.args);
+        case NodeKind_Access:      return a->access.left == b->access.left && a->access.right == b->access.right;
+        case NodeKind_Type:        return same_name(a->type.name, b->type.name);
+        case NodeKind_Assign:      return same_name(a->assign.name, b->assign.name) && a->assign.expression == b->assign.expression;
+        case NodeKind_VarDecl:     return same_name(a->var_decl.name, b->var_decl.name) && a->var_decl.decl_offset == b->var_decl.decl_offset && a->var_decl.expression == b->var_decl.expression;
+        case NodeKind_Block:       return a->block.id == b->block.id && a->block.parent == b->block.parent && same_view(a->block.nodes, b->block.nodes) && a->block.declared_count == b->block.declared_count;
+        case NodeKind_FunBody:     return a->fun_body.id == b->fun_body.id && a->fun_body.parent == b->fun_body.parent && same_view(a->fun_body.nodes, b->fun_body.nodes) && a->fun_body.declared_count == b->fun_body.declared_count;
+        case NodeKind_FunParam:    return same_name(a->fun_param.name, b->fun_param.name) && a->fun_param.offset == b->fun_param.offset && a->fun_param.type == b->fun_param.type && a->fun_param.expression == b->fun_param.expression;
+        case NodeKind_FunDecl:     return same_name(a->fun_decl.name, b->fun_decl.name) && a->fun_decl.return_type == b->fun_decl.return_type && same_view(a->fun_decl.params, b->fun_decl.params) && a->fun_decl.body == b->fun_decl.body;
+        case NodeKind_Return:      return a->return_stmt.expression == b->return_stmt.expression;
+        case NodeKind_If:          return a->if_stmt.condition == b->if_stmt.condition && a->if_stmt.then_block == b->if_stmt.then_block && a->if_stmt.else_block == b->if_stmt.else_block;
+        case NodeKind_While:       return a->while_stmt.condition == b->while_stmt.condition && a->while_stmt.then_block == b->while_stmt.then_block && a->while_stmt.else_block == b->while_stmt.else_block;
+        case NodeKind_Module:      return same_view(a->module.stmts, b->module.stmts) && same_view(a->module.decls, b->module.decls) && a->module.declared_count == b->module.declared_count && a->module.global_count == b->module.global_count;
+        default:                   return true;  // Structs aren't parsed in these tests.
+    }
+}
 
-    Node_Stmt* else_stmt = if_stmt.else_stmt;
-    ASSERT_EQ(else_stmt->kind, NodeKind_Block);
-    Node_Block else_block = else_stmt->as.block;
-    ASSERT_EQ(else_block.count, 1);
-    ASSERT_EQ(else_block.nodes[0]->kind, NodeKind_Return);
-    return_stmt = else_block.nodes[0]->as.return_stmt;
-    ASSERT_EQ(return_stmt.expr->kind, NodeKind_Literal);
-    ASSERT_EQ(return_stmt.expr->as.literal.type, LiteralType_Integer);
-    ASSERT_EQ(return_stmt.expr->as.literal.value.integer, 2);
+static void expect_same_tree(const GrammarTree& a, const GrammarTree& b) {
+    ASSERT_EQ(a.start, b.start);
+    ASSERT_EQ(a.block_count, b.block_count);
+    ASSERT_EQ(a.arena.count, b.arena.count);
+    ASSERT_EQ(memcmp(a.arena.kinds, b.arena.kinds, a.arena.count), 0);
+    ASSERT_EQ(memcmp(a.arena.slots, b.arena.slots, a.arena.count * sizeof(u32)), 0);
+    ASSERT_EQ(a.arena.view_count, b.arena.view_count);
+    ASSERT_EQ(memcmp(a.arena.views, b.arena.views, a.arena.view_count * sizeof(NodeId)), 0);
+    for (NodeId id = 0; id < a.arena.count; ++id)
+        ASSERT_TRUE(same_node(node_at(&a.arena, id), node_at(&b.arena, id))) << "node " << id;
+
+    ASSERT_EQ(a.error_count, b.error_count);
+    for (u32 i = 0; i < a.error_count; ++i) {
+        ASSERT_EQ(a.errors[i].token, b.errors[i].token);
+        ASSERT_STREQ(a.errors[i].message, b.errors[i].message);
+    }
 }
 
+TEST(ParserTest, ParallelMatchesSerial) {
+    std::string valid = many_functions(3000);
+    // An error in a function that a thread parses is left to the calling thread.
+    std::string broken = valid + "fun h() int { return 1 + }\n" + many_functions(10) + "fun k() { x := ) }\n";
+
+    for (const std::string* source : { &valid, &broken }) {
+        GrammarTree serial = parse_source(source->c_str());
+        ASSERT_NE(serial.arena.kinds, nullptr);
+
+        for (int threads : { 2, 4, 7 }) {
+            Logger logger = logger_make_with_file("test", LOG_LEVEL_NONE, stderr);
+            TokenArray tokens = lexer_lex(STR("test"), str_from_c_str(source->c_str()), &logger);
+            GrammarTree parallel = parse_parallel(tokens, PARSER_DEFAULT_MAX_ERRORS, threads);
+            ASSERT_NE(parallel.arena.kinds, nullptr);
+            expect_same_tree(serial, parallel);
+            grammar_tree_free(parallel);
+        }
+        grammar_tree_free(serial);
+    }
+}
 
 
+// Records the nodes in the order each visitor reaches them.
+struct Recorder {
+    const NodeArena*     arena;
+    std::vector<NodeId>* ids;
+};
+
+#define STATIC_VISITOR_CONTEXT Recorder
+#define STATIC_VISITOR_PREFIX  record
+DECLARE_STATIC_VISITOR()
+
+#define X(upper, lower, flags, body)                                    \
+    static void* record_##lower(Recorder* recorder, Node##upper* node) { \
+        recorder->ids->push_back(node_id_of(recorder->arena, (Node*) node)); \
+        return record_walk(recorder, NodeKind_##upper, (Node*) node);   \
+    }
+ALL_NODES(X)
+#undef X
+
+DEFINE_STATIC_VISITOR()
+#undef STATIC_VISITOR_PREFIX
+#undef STATIC_VISITOR_CONTEXT
+
+struct DynamicRecorder {
+    Visitor              visitor;
+    std::vector<NodeId>* ids;
+};
+
+// visitor.c leaves the module to each pass, which does it as the static visitor does.
+static void* walk_module(Visitor* visitor, NodeModule* node) {
+    walk_view(visitor, node->decls);
+    return walk_view(visitor, node->stmts);
+}
 
+static std::vector<NodeId> record_dynamic(const GrammarTree& ast) {
+    std::vector<NodeId> ids;
+    DynamicRecorder recorder = {};
+    recorder.ids = &ids;
+    recorder.visitor.arena = &ast.arena;
+#define X(upper, lower, flags, body)                                                        \
+    recorder.visitor.visit_##lower = [](Visitor* visitor, Node##upper* node) -> void* {    \
+        ((DynamicRecorder*) visitor)->ids->push_back(node_id_of(visitor->arena, (Node*) node)); \
+        return walk_##lower(visitor, node);                                                 \
+    };
+    ALL_NODES(X)
+#undef X
+    visit(&recorder.visitor, ast.start);
+    return ids;
+}
 
+TEST(ParserTest, StaticVisitorMatchesVisit) {
+    GrammarTree ast = parse_source(many_functions(200).c_str());
+    ASSERT_NE(ast.arena.kinds, nullptr);
+    ASSERT_EQ(ast.error_count, 0u);
+
+    std::vector<NodeId> ids;
+    Recorder recorder = { &ast.arena, &ids };
+    record_visit(&recorder, ast.start);
+    ASSERT_EQ(ids, record_dynamic(ast));
+
+    // No node is reached twice, and types aren't reached at all. Some nodes
+    // are left out of the tree, like the identifier an assignment starts as.
+    std::vector<int> seen(ast.arena.count, 0);
+    for (NodeId id : ids) {
+        ASSERT_NE(node_kind_at(&ast.arena, id), NodeKind_Type);
+        ASSERT_EQ(seen[id]++, 0) << "node " << id;
+    }
+    ASSERT_GT(ids.size(), ast.arena.count / 2);
+    grammar_tree_free(ast);
+}